@@ -6,15 +6,31 @@
 #include "alp.h"
 #include "file_parser.h"
 #include "mqtt_interface.h"
+#include "event_stream.h"
+#include "device_registry.h"
+#include "pipeline_stats.h"
+#include "gateway_health.h"
+#include "logger.h"
+#include "frame_capture.h"
+#include "uplink_dedup.h"
+#include "publish_scheduler.h"
+#include "aggregator.h"
+#include "rule_engine.h"
+#include "file_cache.h"
+#include "compact_output.h"
+#include "raw_passthrough.h"
+#include "serial_bridge.h"
+#include "event_loop.h"
+#include "boot_timeline.h"
+#include "history_store.h"
+#include "downlink_mailbox.h"
 #include <esp_task_wdt.h>
 
 #define LOG_LOCAL_LEVEL ESP_LOG_INFO
 
-#define ESP_BUSY_PIN 13
+// two config slots and the network cache
+#define FILESYSTEM_SIZE 1232
 
-#define FILESYSTEM_SIZE 612
-
-#define MAX_CREDENTIAL_SIZE 100
 #define MAX_SERIAL_BUFFER_SIZE 256
 #define MAX_CUSTOM_FILES 2
 #define MAX_PUBLISH_OBJECTS 12
@@ -24,6 +40,10 @@
 // 60 seconds timeout WDT
 #define WDT_TIMEOUT 60
 
+// queued publishes wait for tokens of the scheduler, a bridge client for its bytes to be forwarded
+#define PUBLISH_WAIT_MS 5
+#define BRIDGE_WAIT_MS 1
+
 const char* ssid = "Dash7-gateway";
 
 static char mac_id_string[20];
@@ -44,10 +64,16 @@ static char mqtt_password_string[MAX_CREDENTIAL_SIZE];
 int mqtt_password_length;
 
 static char mqtt_client_string[30];
+static char latency_topic[40];
 
 static uint32_t mqtt_port;
 
+static uint8_t output_mode;
+static char compact_topic_prefix_string[MAX_CREDENTIAL_SIZE];
+int compact_topic_prefix_length;
+
 static unsigned long previous_trigger = 60000;
+static bool webserver_started = false;
 
 static uint8_t serial_output_buffer[MAX_SERIAL_BUFFER_SIZE];
 static custom_file_contents_t custom_files[MAX_CUSTOM_FILES];
@@ -60,20 +86,20 @@ static persisted_data_t linked_data = (persisted_data_t){
   .mqtt_user = { .length = &mqtt_user_length, .content = mqtt_user_string },
   .mqtt_password = { .length = &mqtt_password_length, .content = mqtt_password_string },
   .mqtt_port = &mqtt_port,
+  .output_mode = &output_mode,
+  .compact_topic_prefix = { .length = &compact_topic_prefix_length, .content = compact_topic_prefix_string },
 };
 
-static gateway_status_file_t status_file;
-
 static void connection_details_changed() {
   mqtt_interface_config_changed(linked_data);
+  compact_output_configure(output_mode, compact_topic_prefix_string);
 
   filesystem_write(linked_data);
 }
 
-static void modem_rebooted(uint8_t reason) {
-  DPRINT("Modem rebooted with reason ");
-  DPRINTLN(reason);
-  status_file.dash7_modem_reboot_counter++;
+static void modem_rebooted(uint8_t modem, uint8_t reason) {
+  LOG_WARNING("Modem %u rebooted with reason %u", modem, reason);
+  gateway_health_modem_rebooted();
 }
 
 void setup() 
@@ -83,74 +109,163 @@ void setup()
   esp_task_wdt_init(WDT_TIMEOUT, true); // set timeout and indicate hardware reset on timeout
   esp_task_wdt_add(NULL); // add current thread to WDT watch
 
+  logger_init();
+
   uint64_t MAC = ESP.getEfuseMac();
   uint8_t* MAC_ptr = (uint8_t*) &MAC;
   sprintf(mac_id_string, "%02x%02x%02x%02x%02x%02x", MAC_ptr[5], MAC_ptr[4], MAC_ptr[3], MAC_ptr[2], MAC_ptr[1], MAC_ptr[0]);
   sprintf(mqtt_client_string, "Dash7-gateway-%s", mac_id_string);
+  sprintf(latency_topic, "d7/latency/%s", mac_id_string);
 
+  // the modems are read first, frames arriving during the rest of setup wait in the UART buffers
   serial_interface_init(&modem_rebooted, serial_output_buffer);
-  alp_init(custom_files, MAX_CUSTOM_FILES);
-  file_parser_init(MAX_PUBLISH_OBJECTS);
+  boot_timeline_init(mac_id_string);
+  boot_timeline_mark(BOOT_SERIAL);
 
   filesystem_init(FILESYSTEM_SIZE);
   filesystem_read(linked_data);
+  boot_timeline_mark(BOOT_CONFIG);
 
-  WiFi_init(ssid);
-  webserver_init(ssid, &connection_details_changed, linked_data);
-
-  status_file.heartbeat_counter = 0;
-  status_file.processed_messages = 0;
-  status_file.dash7_modem_reboot_counter = 0;
-  status_file.status_interval = GATEWAY_STATUS_INTERVAL;
-  status_file.rebooted = true;
+  alp_init(custom_files, MAX_CUSTOM_FILES);
+  alp_set_callbacks(downlink_mailbox_uplink, downlink_mailbox_response);
+  file_parser_init(MAX_PUBLISH_OBJECTS);
+  event_stream_init();
+  frame_capture_init();
+  device_registry_init();
+  uplink_dedup_init();
+  file_cache_init();
+  publish_scheduler_init();
+  aggregator_init();
+  rule_engine_init();
+  history_store_init();
+  downlink_mailbox_init();
+  gateway_health_init(mac_id_string, GATEWAY_STATUS_INTERVAL);
+  compact_output_init(mac_id_string);
+  raw_passthrough_init(mac_id_string);
+  compact_output_configure(output_mode, compact_topic_prefix_string);
+  boot_timeline_mark(BOOT_MODULES);
+
+  // the webserver follows in the loop once there is a network to serve it on
+  WiFi_init(ssid, ssid_length > 0);
+  boot_timeline_mark(BOOT_NETWORK_START);
+  serial_bridge_init();
+  event_loop_init();
 
   esp_task_wdt_reset();
 
+  boot_timeline_mark(BOOT_SETUP_DONE);
   DPRINTLN("setup complete");
 }
 
+static void start_webserver() {
+  if(webserver_started)
+    return;
+  if(WiFi_access_point_active())
+    boot_timeline_mark(BOOT_ACCESS_POINT);
+  else if(!WiFi_interface_is_connected())
+    return;
+  webserver_init(ssid, &connection_details_changed, linked_data);
+  webserver_started = true;
+  boot_timeline_mark(BOOT_WEBSERVER);
+}
+
+// the loop waits until a modem sends or the sockets are polled, unless it has work left
+static uint32_t loop_timeout(uint8_t serial_payload_length) {
+  if(serial_payload_length) // more frames may be waiting in the rings
+    return 0;
+  if(serial_bridge_get_statistics()->connected)
+    return BRIDGE_WAIT_MS;
+  if(!publish_scheduler_idle())
+    return PUBLISH_WAIT_MS;
+  return EVENT_LOOP_NO_TIMEOUT;
+}
+
 static void parse_and_publish(custom_file_contents_t* custom_file_content) {
+  STATS_START(parse_start);
   uint8_t number_of_publish_results = parse_custom_files(custom_file_content, results);
-  mqtt_interface_publish(results, number_of_publish_results);
+  STATS_STOP(STAGE_FILE_PARSER, parse_start);
+  uint32_t received = millis();
+  for(uint8_t index = 0; index < number_of_publish_results; index++) {
+    results[index].rssi = custom_file_content->rssi;
+    results[index].received = received ? received : 1;
+  }
+  rule_engine_evaluate(custom_file_content, results, number_of_publish_results);
+  history_store_record(custom_file_content, results, number_of_publish_results);
+  event_stream_push(custom_file_content, results, number_of_publish_results);
+  compact_output_publish(custom_file_content, results, number_of_publish_results);
+  if(!compact_output_home_assistant())
+    return;
+  number_of_publish_results = aggregator_filter(results, number_of_publish_results);
+  publish_scheduler_enqueue(custom_file_content->file_id, results, number_of_publish_results, serial_frame_arrival());
 }
 
 static void gateway_status_triggered() {
-  custom_files[0] = (custom_file_contents_t){
-    .file_id = GATEWAY_STATUS_FILE_ID,
-    .length = 5,
-    .offset = 0,
-    .chip_id = ESP.getEfuseMac()
-  };
-  memcpy(custom_files[0].buffer, status_file.bytes, 5);
-
-  parse_and_publish(&custom_files[0]);
-
-  status_file.rebooted = false;
-  status_file.processed_messages = 0;
-  status_file.heartbeat_counter = (status_file.heartbeat_counter == 0xFF ? 1 : status_file.heartbeat_counter + 1);
+  gateway_health_publish();
+
+#ifdef PIPELINE_STATS
+  static char latency_json[1400];
+  if(pipeline_stats_json(latency_json, sizeof(latency_json)))
+    mqtt_interface_publish_raw(latency_topic, latency_json, false);
+#endif
 }
 
 void loop()
 {
+  unsigned long loop_start = micros();
+  // uplinks are handled without a broker too, so local rules keep working. Publishes wait in the scheduler.
+  serial_handle();
+  uint8_t serial_payload_length = serial_parse();
+  if(serial_payload_length) {
+    STATS_START(alp_start);
+    uint8_t number_of_custom_files_parsed = raw_passthrough_decode() ? alp_parse(serial_output_buffer, serial_payload_length) : 0;
+    STATS_STOP(STAGE_ALP, alp_start);
+    raw_passthrough_push(serial_output_buffer, serial_payload_length, serial_frame_modem(), custom_files, number_of_custom_files_parsed);
+    if(number_of_custom_files_parsed) {
+        boot_timeline_mark(BOOT_FIRST_UPLINK);
+        gateway_health_processed(number_of_custom_files_parsed);
+        for(uint8_t index_custom_file = 0; index_custom_file < number_of_custom_files_parsed; index_custom_file++) {
+            custom_files[index_custom_file].modem = serial_frame_modem();
+            // the same uplink heard by several modems is handled once, the strongest reception is kept
+            uplink_dedup_result_t dedup_result = uplink_dedup_check(&custom_files[index_custom_file]);
+            if(dedup_result == UPLINK_STRONGER_COPY)
+                device_registry_merge_reception(&custom_files[index_custom_file]);
+            if(dedup_result != UPLINK_NEW)
+                continue;
+            // partial writes are completed from the cached image of the file
+            if(!file_cache_merge(&custom_files[index_custom_file]))
+                continue;
+            device_registry_update(&custom_files[index_custom_file]);
+            parse_and_publish(&custom_files[index_custom_file]);
+        }
+        STATS_STOP(STAGE_TOTAL, serial_frame_arrival());
+    }
+  }
+  downlink_mailbox_handle();
+  // before the broker connection, the mqtt interface resolves the broker over the mDNS the webserver starts
+  start_webserver();
   if(WiFi_connect(client_ssid_string, ssid_length, client_password_string, password_length)) {
+    boot_timeline_mark(BOOT_NETWORK_UP);
     if(mqtt_interface_connect(mqtt_client_string, linked_data)) {
-      serial_handle();
-      uint8_t serial_payload_length = serial_parse();
-      if(serial_payload_length) {
-        uint8_t number_of_custom_files_parsed = alp_parse(serial_output_buffer, serial_payload_length);
-        if(number_of_custom_files_parsed) {
-            status_file.processed_messages += number_of_custom_files_parsed;
-            for(uint8_t index_custom_file = 0; index_custom_file < number_of_custom_files_parsed; index_custom_file++)
-                parse_and_publish(&custom_files[index_custom_file]);
-        }
-      }
       if(millis() - previous_trigger > (GATEWAY_STATUS_INTERVAL * 1000)) {
         previous_trigger = millis();
         gateway_status_triggered();        
       }
+      aggregator_handle();
+      raw_passthrough_handle();
+      publish_scheduler_handle();
+      boot_timeline_handle();
       mqtt_interface_handle();
+      // publishes are coalesced into full segments, whatever is left goes out once there is nothing more to add
+      if(!serial_payload_length && publish_scheduler_idle())
+        mqtt_interface_flush();
     }
   }
-  webserver_handle();
+  if(webserver_started)
+    webserver_handle();
+  serial_bridge_handle();
+  event_stream_handle();
+  frame_capture_handle();
   esp_task_wdt_reset();
+  gateway_health_loop_time(micros() - loop_start);
+  event_loop_wait(loop_timeout(serial_payload_length));
 }
@@ -2,11 +2,21 @@
 #include <ETH.h>
 #include <Dns.h>
 #include "structures.h"
+#include "filesystem.h"
 
 #define WIFI_TIMEOUT 20000
 #define WIFI_DELAY_RETRY 500
 
+// with stored credentials the access point only comes up when the station is not connected by then
+#define ACCESS_POINT_FALLBACK 30000
+
 static bool advertising;
+static const char* access_point_name;
+static unsigned long access_point_fallback = 0;
+
+static bool scanning = false;
+static bool cached_attempt_done = false;
+static bool was_connected = false;
 
 const IPAddress public_dns_ip(8, 8, 8, 8);
 DNSClient dns_client;
@@ -45,12 +55,23 @@ void WiFiEvent(WiFiEvent_t event)
   }
 }
 
-void WiFi_init(const char* access_point_ssid) {
+static void start_access_point() {
   WiFi.mode(WIFI_MODE_APSTA);
   advertising = true;
-  WiFi.disconnect();
-  
-  WiFi.softAP(access_point_ssid);
+  WiFi.softAP(access_point_name);
+}
+
+void WiFi_init(const char* access_point_ssid, bool has_credentials) {
+  access_point_name = access_point_ssid;
+  if(has_credentials) {
+    WiFi.mode(WIFI_STA);
+    advertising = false;
+    access_point_fallback = millis() + ACCESS_POINT_FALLBACK;
+    WiFi.disconnect();
+  } else {
+    WiFi.disconnect();
+    start_access_point();
+  }
 
   ETH.setHostname("Dash7-gateway");
   WiFi.setHostname("Dash7-gateway");
@@ -62,42 +83,101 @@ void WiFi_init(const char* access_point_ssid) {
 #endif
 }
 
+// the access point of the last connection, a boot tries it before scanning
+static void remember_access_point() {
+  if(was_connected)
+    return;
+  was_connected = true;
+  if(WiFi.status() != WL_CONNECTED)
+    return;
+
+  network_cache_t cache;
+  filesystem_read_network_cache(&cache);
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = WiFi.channel();
+  filesystem_write_network_cache(&cache);
+}
+
+static bool connect_cached(char* ssid, char* password) {
+  network_cache_t cache;
+  if(cached_attempt_done || !filesystem_read_network_cache(&cache) || !cache.channel)
+    return false;
+  cached_attempt_done = true;
+  WiFi.begin(ssid, password, cache.channel, cache.bssid);
+  return true;
+}
+
+// the scan runs in the background, the loop keeps serving the modems meanwhile
+static void finish_scan(char* ssid, char* password) {
+  int n = WiFi.scanComplete();
+  if(n == WIFI_SCAN_RUNNING)
+    return;
+  scanning = false;
+  if(n < 1) {
+    WiFi.scanDelete();
+    return;
+  }
+  for(int i = 0; i < n; i++) {
+    String found_ssid = WiFi.SSID(i);
+    int len = found_ssid.length();
+    char found_ssid_char[len];
+    found_ssid.toCharArray(found_ssid_char, len + 1);
+    if(!memcmp(found_ssid_char, ssid, len)) {
+      WiFi.begin(found_ssid_char, password);
+      break;
+    }
+  }
+  WiFi.scanDelete();
+  next_try_timestamp = millis() + WIFI_TIMEOUT;
+}
+
 bool WiFi_connect(char* ssid, int ssid_length, char* password, int password_length) {
   if(!WiFi_interface_is_connected()) {
     if(first_try_connect) {
       DPRINTLN("Wi-Fi disconnected, trying to reconnect");
       first_try_connect = false;
     }
+    if(was_connected) {
+      was_connected = false;
+      cached_attempt_done = false;
+      scanning = false;
+      WiFi.scanDelete();
+    }
+    if(!advertising && access_point_fallback && (long)(millis() - access_point_fallback) > 0) {
+      DPRINTLN("no connection yet, starting access point");
+      start_access_point();
+    }
     if(ssid_length == 0)
       return false;
 
+    if(scanning) {
+      finish_scan(ssid, password);
+      return false;
+    }
+
     if(millis() < next_try_timestamp) // let it try before 
       return false;
 
-    int n = WiFi.scanNetworks();
-    if(n < 1)
+    if(!connect_cached(ssid, password)) {
+      WiFi.scanNetworks(true);
+      scanning = true;
       return false;
-    bool found = false;
-    for(int i = 0; i < n; i++) {
-      String found_ssid = WiFi.SSID(i);
-      int len = found_ssid.length();
-      char found_ssid_char[len];
-      found_ssid.toCharArray(found_ssid_char, len + 1);
-      if(!memcmp(found_ssid_char, ssid, len)) {
-        WiFi.begin(found_ssid_char, password);
-        found = true;
-        break;
-      }
     }
     next_try_timestamp = millis() + WIFI_TIMEOUT;
 
     return false;
   } else {
+    remember_access_point();
+    access_point_fallback = 0;
     WiFi_advertising_disable();
     return true;  
   }
 }
 
+bool WiFi_access_point_active() {
+  return advertising;
+}
+
 bool WiFi_interface_is_connected() {
   return (WiFi.status() == WL_CONNECTED) || eth_connected;
 }
@@ -106,9 +186,12 @@ void WiFi_advertising_disable() {
   if(advertising) {
     DPRINTLN("Interface connected, disabling access point");
     WiFi.mode(WIFI_STA);
+    advertising = false;
+  }
+  // a boot with credentials never advertised, the first pass after a connection sets up dns for both
+  if(!first_try_connect) {
     dns_client.begin(public_dns_ip);
     first_try_connect = true;
-    advertising = false;
   }
 }
 
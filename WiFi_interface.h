@@ -1,14 +1,17 @@
 #ifndef WIFI_INTERFACE_H
 #define WIFI_INTERFACE_H
 
-#include <Arduino.h>
+#include "structures.h"
 
-void WiFi_init(const char* access_point_ssid);
+// without credentials the access point starts right away, otherwise only when the station does not connect
+void WiFi_init(const char* access_point_ssid, bool has_credentials);
 
 bool WiFi_connect(char* ssid, int ssid_length, char* password, int password_length);
 
 bool WiFi_interface_is_connected();
 
+bool WiFi_access_point_active();
+
 void WiFi_advertising_disable();
 
 bool WiFi_get_ip_by_name(char* host, IPAddress* resulting_ip);
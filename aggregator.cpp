@@ -0,0 +1,202 @@
+#include "aggregator.h"
+#include "publish_scheduler.h"
+#include "mqtt_interface.h"
+#include "logger.h"
+
+// numeric entities tracked at once, the least recently updated one is flushed and replaced when full
+#define AGGREGATOR_CAPACITY 64
+#define AGGREGATION_DEFAULT_WINDOW 0
+#define CLOSE_CHECK_INTERVAL 1000
+
+#define FNV_OFFSET_BASIS 0x811c9dc5
+#define FNV_PRIME 0x01000193
+
+typedef struct {
+  uint32_t hash;
+  char object_id[50];
+  char component[20];
+  uint32_t window_start;
+  uint32_t last_update;
+  float minimum;
+  float maximum;
+  float sum;
+  float latest;
+  uint16_t count;
+  uint8_t decimals;
+  bool used;
+} aggregate_t;
+
+static aggregate_t aggregates[AGGREGATOR_CAPACITY];
+static aggregator_statistics_t statistics;
+static unsigned long last_close_check = 0;
+
+void aggregator_init() {
+  memset(aggregates, 0, sizeof(aggregates));
+  memset(&statistics, 0, sizeof(statistics));
+  statistics.window = AGGREGATION_DEFAULT_WINDOW;
+  statistics.mode = AGGREGATION_SUMMARY;
+}
+
+const aggregator_statistics_t* aggregator_get_statistics() {
+  return &statistics;
+}
+
+static uint32_t hash_of(const char* object_id) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for(; *object_id; object_id++) {
+    hash ^= (uint8_t) *object_id;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static void close_window(aggregate_t* aggregate) {
+  static publish_object_t object;
+  static char attributes_topic[100];
+  static char attributes_json[160];
+
+  float mean = aggregate->sum / aggregate->count;
+  memset(&object, 0, sizeof(publish_object_t));
+  sprintf(object.object_id, "%s", aggregate->object_id);
+  sprintf(object.component, "%s", aggregate->component);
+  snprintf(object.state, sizeof(object.state), "%.*f", aggregate->decimals, statistics.mode == AGGREGATION_SUMMARY ? mean : aggregate->latest);
+  publish_scheduler_enqueue_state(PUBLISH_CLASS_MEASUREMENT, &object, 0);
+
+  // attributes are one small publish per entity per window, they skip the scheduler
+  if(statistics.mode == AGGREGATION_SUMMARY) {
+    snprintf(attributes_topic, sizeof(attributes_topic), "homeassistant/%s/%s/attributes", aggregate->component, aggregate->object_id);
+    snprintf(attributes_json, sizeof(attributes_json), "{\"min\":%.*f,\"max\":%.*f,\"mean\":%.*f,\"count\":%u,\"window\":%u}",
+      aggregate->decimals, aggregate->minimum, aggregate->decimals, aggregate->maximum, aggregate->decimals + 1, mean, aggregate->count, statistics.window);
+    mqtt_interface_publish_raw(attributes_topic, attributes_json, true);
+  }
+
+  aggregate->count = 0;
+  statistics.windows++;
+}
+
+void aggregator_configure(uint16_t window, aggregation_mode_t mode) {
+  // pending windows are published with the old settings, entities are announced again with the new ones
+  for(uint8_t i = 0; i < AGGREGATOR_CAPACITY; i++) {
+    if(aggregates[i].used && aggregates[i].count)
+      close_window(&aggregates[i]);
+  }
+  memset(aggregates, 0, sizeof(aggregates));
+  statistics.entities = 0;
+  statistics.window = window;
+  statistics.mode = mode;
+}
+
+static bool numeric_measurement(publish_object_t* object, float* value, uint8_t* decimals) {
+  if(strcmp(object->state_class, "measurement") || object->category[0] != 0 || object->state[0] == 0)
+    return false;
+
+  char* end;
+  *value = strtof(object->state, &end);
+  if(*end != 0)
+    return false;
+
+  const char* point = strchr(object->state, '.');
+  *decimals = point ? strlen(point + 1) : 0;
+  return true;
+}
+
+static aggregate_t* find(const char* object_id, uint32_t hash) {
+  for(uint8_t i = 0; i < AGGREGATOR_CAPACITY; i++) {
+    if(aggregates[i].used && aggregates[i].hash == hash && !strcmp(aggregates[i].object_id, object_id))
+      return &aggregates[i];
+  }
+  return NULL;
+}
+
+static aggregate_t* insert(publish_object_t* object, uint32_t hash) {
+  aggregate_t* slot = NULL;
+  uint32_t now = millis();
+  for(uint8_t i = 0; i < AGGREGATOR_CAPACITY; i++) {
+    if(!aggregates[i].used) {
+      slot = &aggregates[i];
+      break;
+    }
+    if(!slot || (now - aggregates[i].last_update) > (now - slot->last_update))
+      slot = &aggregates[i];
+  }
+
+  if(slot->used) {
+    if(slot->count)
+      close_window(slot);
+    statistics.evictions++;
+  } else {
+    statistics.entities++;
+  }
+
+  memset(slot, 0, sizeof(aggregate_t));
+  slot->used = true;
+  slot->hash = hash;
+  slot->last_update = now;
+  sprintf(slot->object_id, "%s", object->object_id);
+  sprintf(slot->component, "%s", object->component);
+  return slot;
+}
+
+/**
+ * @brief absorb numeric measurements into their window, everything else is passed on
+ * @param objects the parsed entities, the ones to publish now are compacted to the front
+ * @return the amount of entities to publish now
+ */
+uint8_t aggregator_filter(publish_object_t* objects, uint8_t amount) {
+  if(!statistics.window)
+    return amount;
+
+  uint8_t kept = 0;
+  for(uint8_t index = 0; index < amount; index++) {
+    publish_object_t* object = &objects[index];
+    float value;
+    uint8_t decimals;
+    bool pass = true;
+
+    if(numeric_measurement(object, &value, &decimals)) {
+      uint32_t hash = hash_of(object->object_id);
+      aggregate_t* aggregate = find(object->object_id, hash);
+      if(!aggregate) {
+        // the first sample of an entity is published right away, so it is announced with its attributes topic
+        insert(object, hash);
+        object->attributes = (statistics.mode == AGGREGATION_SUMMARY);
+      } else {
+        uint32_t now = millis();
+        if(!aggregate->count) {
+          aggregate->window_start = now;
+          aggregate->minimum = value;
+          aggregate->maximum = value;
+          aggregate->sum = 0;
+        }
+        aggregate->minimum = min(aggregate->minimum, value);
+        aggregate->maximum = max(aggregate->maximum, value);
+        aggregate->sum += value;
+        aggregate->latest = value;
+        aggregate->decimals = decimals;
+        aggregate->count++;
+        aggregate->last_update = now;
+        statistics.samples++;
+        pass = false;
+      }
+    }
+
+    if(pass) {
+      if(kept != index)
+        objects[kept] = *object;
+      kept++;
+    }
+  }
+  return kept;
+}
+
+void aggregator_handle() {
+  if(!statistics.window || millis() - last_close_check < CLOSE_CHECK_INTERVAL)
+    return;
+  last_close_check = millis();
+
+  uint32_t window_ms = (uint32_t) statistics.window * 1000;
+  for(uint8_t i = 0; i < AGGREGATOR_CAPACITY; i++) {
+    if(aggregates[i].used && aggregates[i].count && last_close_check - aggregates[i].window_start >= window_ms)
+      close_window(&aggregates[i]);
+  }
+}
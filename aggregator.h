@@ -0,0 +1,29 @@
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+#include "structures.h"
+
+typedef enum {
+  AGGREGATION_SUMMARY, // mean as state, min, max, mean and count as attributes
+  AGGREGATION_LATEST,  // the last value of the window as state
+} aggregation_mode_t;
+
+typedef struct {
+  uint16_t window;     // seconds, 0 when aggregation is off
+  aggregation_mode_t mode;
+  uint16_t entities;
+  uint32_t samples;    // samples absorbed into a window instead of being published
+  uint32_t windows;    // windows closed and published
+  uint32_t evictions;
+} aggregator_statistics_t;
+
+void aggregator_init();
+
+void aggregator_configure(uint16_t window, aggregation_mode_t mode);
+
+uint8_t aggregator_filter(publish_object_t* objects, uint8_t amount);
+
+void aggregator_handle();
+
+const aggregator_statistics_t* aggregator_get_statistics();
+
+#endif
@@ -1,13 +1,25 @@
 #include "alp.h"
+#include "logger.h"
 
 #define CUSTOM_FILE_EMPTY -1
 
+#define ALP_OP_WRITE_FILE_DATA 0x04
 #define ALP_OP_RETURN_FILE_DATA 0x20
 #define ALP_OP_STATUS 0x22
 #define ALP_OP_RESPONSE_TAG 0x23
+#define ALP_OP_FORWARD 0x32
 #define ALP_OP_INDIRECT_FORWARD 0x33
 #define ALP_OP_REQUEST_TAG 0x34
 
+#define ALP_RESPONSE_TAG_EOP 0x80
+#define ALP_RESPONSE_TAG_ERR 0x40
+
+#define D7_INTERFACE_ID 0xD7
+#define D7_QOS_RESP_MODE_ANY 0x02
+#define D7_DORMANT_TIMEOUT_NONE 0x00
+#define D7_ADDRESSEE_ID_TYPE_UID (2 << 4)
+#define D7_DEFAULT_ACCESS_CLASS 0x01
+
 static uint8_t number_of_parsed_files = 0;
 
 static uint8_t current_uid[8] = {0, 0, 0, 0, 0, 0, 0, 0};
@@ -18,11 +30,19 @@ static void print_uid();
 static custom_file_contents_t* custom_files;
 static uint8_t max_size;
 
+static alp_uplink_callback uplink_callback = NULL;
+static alp_response_callback response_callback = NULL;
+
 void alp_init(custom_file_contents_t* custom_file_contents_buffer, uint8_t max_buffer_size) {
   custom_files = custom_file_contents_buffer;
   max_size = max_buffer_size;
 }
 
+void alp_set_callbacks(alp_uplink_callback uplink, alp_response_callback response) {
+  uplink_callback = uplink;
+  response_callback = response;
+}
+
 static void reset_custom_files() {
   for(uint8_t i = 0; i < max_size; i++) {
     custom_files[i].file_id = CUSTOM_FILE_EMPTY;
@@ -36,12 +56,12 @@ static void save_custom_file(uint8_t* buffer, uint8_t file_id, uint8_t offset, u
       custom_files[i].file_id = file_id;
       custom_files[i].length  = length;
       custom_files[i].offset  = offset;
-      memcpy(custom_files[i].buffer, buffer, length - offset);
+      memcpy(custom_files[i].buffer, buffer, length);
       number_of_parsed_files += 1;
       return;
     }
   }
-  DPRINT("ERROR - could not put custom file in buffer");
+  LOG_ERROR("could not put custom file %u in buffer", file_id);
 }
 
 /**
@@ -80,6 +100,7 @@ uint8_t alp_parse(uint8_t* buffer, uint8_t payload_length) {
   uint8_t length;
   uint8_t index = 0;
   uint8_t rssi = 0;
+  uint8_t link_budget = 0;
 
   //cleanup previous files
   reset_custom_files();
@@ -105,7 +126,7 @@ uint8_t alp_parse(uint8_t* buffer, uint8_t payload_length) {
           length = buffer[index++];
           index += 3;
           rssi = buffer[index++];
-          uint8_t linkbudget = buffer[index++];
+          link_budget = buffer[index++];
           // uid is at index 12
           index += 7;
           memcpy(current_uid, &buffer[index], 8);
@@ -117,12 +138,16 @@ uint8_t alp_parse(uint8_t* buffer, uint8_t payload_length) {
         }
       case ALP_OP_RESPONSE_TAG:
         {
+          uint8_t flags = buffer[index - 1];
           uint8_t tag_id = buffer[index++];
+          if(response_callback)
+            response_callback(tag_id, flags & ALP_RESPONSE_TAG_EOP, flags & ALP_RESPONSE_TAG_ERR);
+          payload_length -= 2;
           break;
         }
       default: //not implemented alp
         {
-        DPRINTLN("unknown alp command, skipping message");
+        LOG_WARNING("unknown alp command %02x, skipping message", buffer[index - 1]);
         index += payload_length - 1;
         payload_length = 0;
         }
@@ -130,11 +155,18 @@ uint8_t alp_parse(uint8_t* buffer, uint8_t payload_length) {
     }
   }
 
+  if(memcmp(current_uid, empty_uid, 8) && uplink_callback) {
+    uint64_t uid;
+    memcpy(&uid, current_uid, sizeof(uid));
+    uplink_callback(uid);
+  }
+
   // after parsing, add uid and rssi to the files
   if(memcmp(current_uid, empty_uid, 8) && number_of_parsed_files) {
     for(uint8_t i = 0; i < number_of_parsed_files; i++) {
       memcpy(custom_files[i].uid, current_uid, 8);
       custom_files[i].rssi = rssi;
+      custom_files[i].link_budget = link_budget;
     }
   }
 
@@ -181,6 +213,39 @@ uint8_t alp_append_return_file_data(uint8_t* alp_command, uint8_t file_id, uint3
   return index;
 }
 
+uint8_t alp_append_write_file_data(uint8_t* alp_command, uint8_t file_id, uint32_t offset, uint32_t length, uint8_t* data) {
+  uint8_t index = 0;
+
+  alp_command[index++] = ALP_OP_WRITE_FILE_DATA;
+  alp_command[index++] = file_id;
+  index += alp_append_length_operand(&alp_command[index], offset);
+  index += alp_append_length_operand(&alp_command[index], length);
+  memcpy(&alp_command[index], data, length);
+  index += length;
+
+  return index;
+}
+
+/**
+ * @brief append a forward over the D7 interface, unicast to one node
+ * @param uid the uid of the addressee, in the order it is received in
+ * @return the amount of bytes added
+ */
+uint8_t alp_append_forward_uid(uint8_t* alp_command, const uint8_t* uid) {
+  uint8_t index = 0;
+
+  alp_command[index++] = ALP_OP_FORWARD;
+  alp_command[index++] = D7_INTERFACE_ID;
+  alp_command[index++] = D7_QOS_RESP_MODE_ANY;
+  alp_command[index++] = D7_DORMANT_TIMEOUT_NONE;
+  alp_command[index++] = D7_ADDRESSEE_ID_TYPE_UID;
+  alp_command[index++] = D7_DEFAULT_ACCESS_CLASS;
+  memcpy(&alp_command[index], uid, 8);
+  index += 8;
+
+  return index;
+}
+
 // overload of indirect forward not yet supported
 uint8_t alp_append_indirect_forward(uint8_t* alp_command, uint8_t file_id) {
   uint8_t index = 0;
@@ -201,13 +266,6 @@ uint8_t alp_append_tag_request(uint8_t* alp_command, uint8_t tag_id, bool always
 }
 
 static void print_uid() {
-  DPRINT("current id ");
-  DPRINT(current_uid[0], HEX);
-  DPRINT(current_uid[1], HEX);
-  DPRINT(current_uid[2], HEX);
-  DPRINT(current_uid[3], HEX);
-  DPRINT(current_uid[4], HEX);
-  DPRINT(current_uid[5], HEX);
-  DPRINT(current_uid[6], HEX);
-  DPRINTLN(current_uid[7], HEX);
+  LOG_DEBUG("current id %02X%02X%02X%02X", current_uid[0], current_uid[1], current_uid[2], current_uid[3]);
+  LOG_DEBUG("           %02X%02X%02X%02X", current_uid[4], current_uid[5], current_uid[6], current_uid[7]);
 }
@@ -2,8 +2,27 @@
 #define ALP_H
 #include "structures.h"
 
+// called once per parsed command that carries the interface status of a node, before its files are handled
+typedef void (*alp_uplink_callback) (uint64_t uid);
+// called for every response tag, the end of packet flag marks the completion of the tagged request
+typedef void (*alp_response_callback) (uint8_t tag_id, bool end_of_packet, bool error);
+
 void alp_init(custom_file_contents_t* custom_file_contents_buffer, uint8_t max_buffer_size);
 
+void alp_set_callbacks(alp_uplink_callback uplink, alp_response_callback response);
+
 uint8_t alp_parse(uint8_t* buffer, uint8_t payload_length);
 
+uint8_t alp_append_length_operand(uint8_t* alp_command, uint32_t length);
+
+uint8_t alp_append_return_file_data(uint8_t* alp_command, uint8_t file_id, uint32_t offset, uint32_t length, uint8_t* data);
+
+uint8_t alp_append_write_file_data(uint8_t* alp_command, uint8_t file_id, uint32_t offset, uint32_t length, uint8_t* data);
+
+uint8_t alp_append_indirect_forward(uint8_t* alp_command, uint8_t file_id);
+
+uint8_t alp_append_forward_uid(uint8_t* alp_command, const uint8_t* uid);
+
+uint8_t alp_append_tag_request(uint8_t* alp_command, uint8_t tag_id, bool always_answer);
+
 #endif
@@ -0,0 +1,45 @@
+#include "boot_timeline.h"
+#include "mqtt_interface.h"
+#include "logger.h"
+#include <esp_timer.h>
+
+static const char* phase_names[BOOT_PHASE_COUNT] = { "serial", "config", "modules", "network_start", "setup_done",
+  "first_uplink", "network_up", "webserver", "access_point", "mqtt_connected", "first_publish" };
+
+static uint32_t stamps[BOOT_PHASE_COUNT];
+static char boot_topic[40];
+static bool published = false;
+
+void boot_timeline_init(const char* gateway_id) {
+  snprintf(boot_topic, sizeof(boot_topic), "d7/boot/%s", gateway_id);
+}
+
+void boot_timeline_mark(boot_phase_t phase) {
+  if(stamps[phase])
+    return;
+  // esp_timer counts from the start of the application, ms 0 is reserved for phases not reached
+  uint32_t now = esp_timer_get_time() / 1000;
+  stamps[phase] = now ? now : 1;
+  LOG_INFO("boot phase %u at %u ms", phase, stamps[phase]);
+}
+
+uint32_t boot_timeline_ms(boot_phase_t phase) {
+  return stamps[phase];
+}
+
+void boot_timeline_json(char* json, uint16_t size) {
+  uint16_t length = snprintf(json, size, "{\"time_to_first_publish\":%u", stamps[BOOT_FIRST_PUBLISH]);
+  for(uint8_t phase = 0; phase < BOOT_PHASE_COUNT && length < size; phase++)
+    length += snprintf(&json[length], size - length, ",\"%s\":%u", phase_names[phase], stamps[phase]);
+  if(length < size)
+    snprintf(&json[length], size - length, "}");
+}
+
+void boot_timeline_handle() {
+  if(published || !stamps[BOOT_FIRST_PUBLISH])
+    return;
+
+  static char json[BOOT_TIMELINE_JSON_SIZE];
+  boot_timeline_json(json, sizeof(json));
+  published = mqtt_interface_publish_raw(boot_topic, json, true);
+}
@@ -0,0 +1,36 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+#include "structures.h"
+
+#define BOOT_TIMELINE_JSON_SIZE 300
+
+// in the order they normally happen, each is stamped the first time it is reached
+typedef enum {
+  BOOT_SERIAL,          // modem UARTs ingesting
+  BOOT_CONFIG,          // configuration and network cache loaded
+  BOOT_MODULES,         // pipeline modules initialised
+  BOOT_NETWORK_START,   // WiFi/ethernet started, the access point only without credentials
+  BOOT_SETUP_DONE,
+  BOOT_FIRST_UPLINK,    // first frame decoded
+  BOOT_NETWORK_UP,      // station or ethernet connected
+  BOOT_WEBSERVER,
+  BOOT_ACCESS_POINT,    // access point serving the configuration page
+  BOOT_MQTT_CONNECTED,
+  BOOT_FIRST_PUBLISH,   // first uplink handed to the broker
+  BOOT_PHASE_COUNT
+} boot_phase_t;
+
+void boot_timeline_init(const char* gateway_id);
+
+void boot_timeline_mark(boot_phase_t phase);
+
+// ms since the chip booted, 0 when the phase was not reached
+uint32_t boot_timeline_ms(boot_phase_t phase);
+
+// ms per phase, with time_to_first_publish up front
+void boot_timeline_json(char* json, uint16_t size);
+
+// publishes the timeline to d7/boot/<gateway id> once the first uplink went out
+void boot_timeline_handle();
+
+#endif
@@ -0,0 +1,105 @@
+#include "cbor.h"
+
+#define CBOR_MAJOR_UNSIGNED 0
+#define CBOR_MAJOR_NEGATIVE 1
+#define CBOR_MAJOR_BYTES    2
+#define CBOR_MAJOR_TEXT     3
+#define CBOR_MAJOR_MAP      5
+#define CBOR_MAJOR_SIMPLE   7
+
+#define CBOR_FALSE            20
+#define CBOR_TRUE             21
+#define CBOR_INDEFINITE       31
+#define CBOR_ADDITIONAL_UINT8 24
+
+void cbor_init(cbor_writer_t* writer, uint8_t* buffer, uint16_t size) {
+  writer->buffer = buffer;
+  writer->size = size;
+  writer->length = 0;
+  writer->overflow = false;
+}
+
+static bool reserve(cbor_writer_t* writer, uint16_t length) {
+  if(writer->overflow || writer->length + length > writer->size) {
+    writer->overflow = true;
+    return false;
+  }
+  return true;
+}
+
+static void write_byte(cbor_writer_t* writer, uint8_t value) {
+  if(reserve(writer, 1))
+    writer->buffer[writer->length++] = value;
+}
+
+// the initial byte and the argument in network order, 0 to 8 bytes depending on the value
+static void write_head(cbor_writer_t* writer, uint8_t major, uint64_t value) {
+  uint8_t argument_length;
+  uint8_t additional;
+  if(value < CBOR_ADDITIONAL_UINT8) {
+    write_byte(writer, (major << 5) | value);
+    return;
+  } else if(value <= 0xFF) {
+    argument_length = 1;
+    additional = 24;
+  } else if(value <= 0xFFFF) {
+    argument_length = 2;
+    additional = 25;
+  } else if(value <= 0xFFFFFFFF) {
+    argument_length = 4;
+    additional = 26;
+  } else {
+    argument_length = 8;
+    additional = 27;
+  }
+
+  if(!reserve(writer, 1 + argument_length))
+    return;
+  writer->buffer[writer->length++] = (major << 5) | additional;
+  for(int8_t shift = (argument_length - 1) * 8; shift >= 0; shift -= 8)
+    writer->buffer[writer->length++] = value >> shift;
+}
+
+void cbor_uint(cbor_writer_t* writer, uint64_t value) {
+  write_head(writer, CBOR_MAJOR_UNSIGNED, value);
+}
+
+void cbor_int(cbor_writer_t* writer, int64_t value) {
+  if(value >= 0)
+    write_head(writer, CBOR_MAJOR_UNSIGNED, value);
+  else
+    write_head(writer, CBOR_MAJOR_NEGATIVE, -1 - value);
+}
+
+void cbor_bool(cbor_writer_t* writer, bool value) {
+  write_byte(writer, (CBOR_MAJOR_SIMPLE << 5) | (value ? CBOR_TRUE : CBOR_FALSE));
+}
+
+void cbor_bytes(cbor_writer_t* writer, const uint8_t* data, uint16_t length) {
+  write_head(writer, CBOR_MAJOR_BYTES, length);
+  if(reserve(writer, length)) {
+    memcpy(&writer->buffer[writer->length], data, length);
+    writer->length += length;
+  }
+}
+
+void cbor_text(cbor_writer_t* writer, const char* text) {
+  uint16_t length = strlen(text);
+  write_head(writer, CBOR_MAJOR_TEXT, length);
+  if(reserve(writer, length)) {
+    memcpy(&writer->buffer[writer->length], text, length);
+    writer->length += length;
+  }
+}
+
+void cbor_map(cbor_writer_t* writer, uint16_t pairs) {
+  write_head(writer, CBOR_MAJOR_MAP, pairs);
+}
+
+void cbor_map_begin(cbor_writer_t* writer) {
+  write_byte(writer, (CBOR_MAJOR_MAP << 5) | CBOR_INDEFINITE);
+}
+
+void cbor_break(cbor_writer_t* writer) {
+  write_byte(writer, 0xFF);
+}
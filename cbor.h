@@ -0,0 +1,26 @@
+#ifndef CBOR_H
+#define CBOR_H
+#include "structures.h"
+
+// writes CBOR (RFC 8949) straight into a caller buffer, every item in its shortest form
+typedef struct {
+  uint8_t* buffer;
+  uint16_t size;
+  uint16_t length;
+  bool overflow; // set when an item did not fit, the document is then incomplete
+} cbor_writer_t;
+
+void cbor_init(cbor_writer_t* writer, uint8_t* buffer, uint16_t size);
+
+void cbor_uint(cbor_writer_t* writer, uint64_t value);
+void cbor_int(cbor_writer_t* writer, int64_t value);
+void cbor_bool(cbor_writer_t* writer, bool value);
+void cbor_bytes(cbor_writer_t* writer, const uint8_t* data, uint16_t length);
+void cbor_text(cbor_writer_t* writer, const char* text);
+
+void cbor_map(cbor_writer_t* writer, uint16_t pairs);
+// a map of unknown size, closed by cbor_break
+void cbor_map_begin(cbor_writer_t* writer);
+void cbor_break(cbor_writer_t* writer);
+
+#endif
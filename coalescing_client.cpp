@@ -0,0 +1,144 @@
+#include "coalescing_client.h"
+#include "logger.h"
+
+CoalescingClient::CoalescingClient(Client* client) : client(client), pending_length(0), pending_packets(0), pending_since(0) {
+  memset(&statistics, 0, sizeof(statistics));
+  statistics.enabled = true;
+}
+
+void CoalescingClient::set_client(Client* new_client) {
+  client = new_client;
+  discard_pending();
+}
+
+void CoalescingClient::set_enabled(bool enabled) {
+  if(!enabled)
+    send_pending();
+  statistics.enabled = enabled;
+}
+
+const coalescing_statistics_t* CoalescingClient::get_statistics() {
+  return &statistics;
+}
+
+// the MQTT client was told these packets were written, they are gone without reaching the socket
+void CoalescingClient::discard_pending() {
+  statistics.lost += pending_packets;
+  pending_length = 0;
+  pending_packets = 0;
+}
+
+// a failed write leaves a partial MQTT packet on the stream, so the connection is dropped and set up again
+bool CoalescingClient::send_pending() {
+  if(!pending_length)
+    return true;
+  uint16_t length = pending_length;
+  statistics.segments++;
+  if(client->write(pending, length) == length) {
+    pending_length = 0;
+    pending_packets = 0;
+    return true;
+  }
+  LOG_ERROR("coalesced write of %u bytes with %u packets failed", length, pending_packets);
+  statistics.failures++;
+  discard_pending();
+  client->stop();
+  return false;
+}
+
+void CoalescingClient::poll() {
+  if(pending_length && micros() - pending_since >= COALESCING_CLIENT_DEADLINE_US) {
+    statistics.flush_deadline++;
+    send_pending();
+  }
+}
+
+bool CoalescingClient::flush_idle() {
+  if(!pending_length)
+    return true;
+  statistics.flush_idle++;
+  return send_pending();
+}
+
+size_t CoalescingClient::write(uint8_t byte) {
+  return write(&byte, 1);
+}
+
+size_t CoalescingClient::write(const uint8_t* buffer, size_t size) {
+  statistics.packets++;
+  statistics.bytes += size;
+  if(!statistics.enabled) {
+    statistics.segments++;
+    return client->write(buffer, size);
+  }
+
+  if(pending_length + size > COALESCING_CLIENT_SIZE) {
+    statistics.flush_full++;
+    if(!send_pending())
+      return 0;
+  }
+  if(size >= COALESCING_CLIENT_SIZE) {
+    statistics.segments++;
+    return client->write(buffer, size);
+  }
+
+  if(!pending_length)
+    pending_since = micros();
+  memcpy(&pending[pending_length], buffer, size);
+  pending_length += size;
+  pending_packets++;
+  if(pending_length == COALESCING_CLIENT_SIZE) {
+    statistics.flush_full++;
+    send_pending();
+  }
+  return size;
+}
+
+int CoalescingClient::connect(IPAddress ip, uint16_t port) {
+  discard_pending();
+  return client->connect(ip, port);
+}
+
+int CoalescingClient::connect(const char* host, uint16_t port) {
+  discard_pending();
+  return client->connect(host, port);
+}
+
+// reads only check the deadline: PubSubClient polls available() every loop, and only blocks on it while connecting
+int CoalescingClient::available() {
+  poll();
+  return client->available();
+}
+
+int CoalescingClient::read() {
+  poll();
+  return client->read();
+}
+
+int CoalescingClient::read(uint8_t* buffer, size_t size) {
+  poll();
+  return client->read(buffer, size);
+}
+
+int CoalescingClient::peek() {
+  poll();
+  return client->peek();
+}
+
+void CoalescingClient::flush() {
+  send_pending();
+  client->flush();
+}
+
+void CoalescingClient::stop() {
+  send_pending();
+  client->stop();
+}
+
+uint8_t CoalescingClient::connected() {
+  return client->connected();
+}
+
+CoalescingClient::operator bool() {
+  return (bool)*client;
+}
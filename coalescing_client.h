@@ -0,0 +1,61 @@
+#ifndef COALESCING_CLIENT_H
+#define COALESCING_CLIENT_H
+#include <Client.h>
+
+// the TCP_MSS of lwIP on the ESP32, one full segment per socket write
+#define COALESCING_CLIENT_SIZE 1436
+
+// the oldest buffered byte waits at most this long for more packets to join it
+#define COALESCING_CLIENT_DEADLINE_US 2000
+
+typedef struct {
+  bool enabled;
+  uint32_t packets;        // writes handed in by the MQTT client
+  uint32_t bytes;
+  uint32_t segments;       // writes handed to the socket
+  uint32_t flush_full;
+  uint32_t flush_deadline;
+  uint32_t flush_idle;
+  uint32_t failures;
+  uint32_t lost;           // writes reported as done that were still buffered when the socket write failed
+} coalescing_statistics_t;
+
+/**
+ * @brief a Client that gathers consecutive small writes into segment sized writes to the client it wraps
+ */
+class CoalescingClient : public Client {
+  public:
+    CoalescingClient(Client* client);
+
+    void set_client(Client* client);
+    void set_enabled(bool enabled);
+    void poll();
+    bool flush_idle();
+    const coalescing_statistics_t* get_statistics();
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    size_t write(uint8_t byte);
+    size_t write(const uint8_t* buffer, size_t size);
+    int available();
+    int read();
+    int read(uint8_t* buffer, size_t size);
+    int peek();
+    void flush();
+    void stop();
+    uint8_t connected();
+    operator bool();
+
+  private:
+    bool send_pending();
+    void discard_pending();
+
+    Client* client;
+    uint8_t pending[COALESCING_CLIENT_SIZE];
+    uint16_t pending_length;
+    uint16_t pending_packets;
+    unsigned long pending_since;
+    coalescing_statistics_t statistics;
+};
+
+#endif
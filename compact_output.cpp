@@ -0,0 +1,97 @@
+#include "compact_output.h"
+#include "cbor.h"
+#include "file_parser.h"
+#include "mqtt_interface.h"
+#include "logger.h"
+#include "boot_timeline.h"
+#include <esp_timer.h>
+
+#define MAX_COMPACT_DOCUMENT_SIZE 256
+#define MAX_COMPACT_TOPIC_SIZE (MAX_CREDENTIAL_SIZE + 20)
+
+// fixed header, remaining length and topic length of a publish without packet id
+#define MQTT_PUBLISH_OVERHEAD 4
+
+static char gateway_id[20];
+static char compact_topic[MAX_COMPACT_TOPIC_SIZE];
+static uint8_t compact_document[MAX_COMPACT_DOCUMENT_SIZE];
+static compact_output_statistics_t statistics;
+
+void compact_output_init(const char* id) {
+  memset(&statistics, 0, sizeof(statistics));
+  snprintf(gateway_id, sizeof(gateway_id), "%s", id);
+  compact_output_configure(OUTPUT_MODE_HOME_ASSISTANT, DEFAULT_COMPACT_TOPIC_PREFIX);
+}
+
+/**
+ * @brief select what is published per uplink, documents go to <topic prefix>/<gateway id>
+ * @param mode OUTPUT_MODE_* flags, Home Assistant only when none is set
+ */
+void compact_output_configure(uint8_t mode, const char* topic_prefix) {
+  statistics.mode = (mode & (OUTPUT_MODE_HOME_ASSISTANT | OUTPUT_MODE_COMPACT)) ? mode : OUTPUT_MODE_HOME_ASSISTANT;
+  if(!topic_prefix || !topic_prefix[0])
+    topic_prefix = DEFAULT_COMPACT_TOPIC_PREFIX;
+  snprintf(compact_topic, sizeof(compact_topic), "%s/%s", topic_prefix, gateway_id);
+}
+
+bool compact_output_home_assistant() {
+  return statistics.mode & OUTPUT_MODE_HOME_ASSISTANT;
+}
+
+const compact_output_statistics_t* compact_output_get_statistics() {
+  return &statistics;
+}
+
+// bytes the Home Assistant states of this uplink take on the wire, discovery configs are retained and left out
+static uint32_t json_bytes(publish_object_t* objects, uint8_t amount) {
+  uint32_t bytes = 0;
+  for(uint8_t index = 0; index < amount; index++) {
+    if(objects[index].state_topic)
+      continue;
+    // homeassistant/<component>/<object id>/state
+    bytes += MQTT_PUBLISH_OVERHEAD + 21 + strlen(objects[index].component) + strlen(objects[index].object_id) + strlen(objects[index].state);
+  }
+  return bytes;
+}
+
+/**
+ * @brief publish one CBOR document for the uplink, encoded in a single pass from the file image
+ * @param objects the entities parsed from the uplink, only used to compare the size with the Home Assistant output
+ */
+void compact_output_publish(custom_file_contents_t* custom_file_content, publish_object_t* objects, uint8_t amount) {
+  if(!(statistics.mode & OUTPUT_MODE_COMPACT))
+    return;
+
+  cbor_writer_t writer;
+  cbor_init(&writer, compact_document, sizeof(compact_document));
+  cbor_map(&writer, 7);
+  cbor_uint(&writer, COMPACT_KEY_UID);
+  cbor_bytes(&writer, custom_file_content->uid, sizeof(custom_file_content->uid));
+  cbor_uint(&writer, COMPACT_KEY_FILE_ID);
+  cbor_uint(&writer, custom_file_content->file_id);
+  cbor_uint(&writer, COMPACT_KEY_RSSI);
+  cbor_uint(&writer, custom_file_content->rssi);
+  cbor_uint(&writer, COMPACT_KEY_LINK_BUDGET);
+  cbor_uint(&writer, custom_file_content->link_budget);
+  cbor_uint(&writer, COMPACT_KEY_TIMESTAMP);
+  cbor_uint(&writer, esp_timer_get_time() / 1000);
+  cbor_uint(&writer, COMPACT_KEY_MODEM);
+  cbor_uint(&writer, custom_file_content->modem);
+  cbor_uint(&writer, COMPACT_KEY_FIELDS);
+  file_parser_encode_cbor(custom_file_content, &writer);
+
+  if(writer.overflow) {
+    LOG_ERROR("compact document of file %d does not fit", custom_file_content->file_id);
+    statistics.failures++;
+    return;
+  }
+  if(!mqtt_interface_connected() || !mqtt_interface_publish_binary(compact_topic, compact_document, writer.length, false)) {
+    statistics.failures++;
+    return;
+  }
+
+  statistics.documents++;
+  boot_timeline_mark(BOOT_FIRST_PUBLISH);
+  statistics.compact_bytes += MQTT_PUBLISH_OVERHEAD + strlen(compact_topic) + writer.length;
+  statistics.json_bytes += json_bytes(objects, amount);
+}
@@ -0,0 +1,32 @@
+#ifndef COMPACT_OUTPUT_H
+#define COMPACT_OUTPUT_H
+#include "structures.h"
+
+// integer keys of the CBOR document published per uplink
+#define COMPACT_KEY_UID         0
+#define COMPACT_KEY_FILE_ID     1
+#define COMPACT_KEY_RSSI        2
+#define COMPACT_KEY_LINK_BUDGET 3
+#define COMPACT_KEY_TIMESTAMP   4 // milliseconds since the gateway booted
+#define COMPACT_KEY_MODEM       5
+#define COMPACT_KEY_FIELDS      6
+
+typedef struct {
+  uint8_t mode;
+  uint32_t documents;
+  uint32_t failures;
+  uint32_t compact_bytes; // topic and payload of the CBOR documents
+  uint32_t json_bytes;    // topic and payload of the Home Assistant states of the same uplinks
+} compact_output_statistics_t;
+
+void compact_output_init(const char* gateway_id);
+
+void compact_output_configure(uint8_t mode, const char* topic_prefix);
+
+bool compact_output_home_assistant();
+
+void compact_output_publish(custom_file_contents_t* custom_file_content, publish_object_t* objects, uint8_t amount);
+
+const compact_output_statistics_t* compact_output_get_statistics();
+
+#endif
@@ -2,6 +2,27 @@
 
 #include <WebServer.h>
 #include <ESPmDNS.h>
+#include "web_assets.h"
+#include "event_stream.h"
+#include "device_registry.h"
+#include "file_cache.h"
+#include "pipeline_stats.h"
+#include "logger.h"
+#include "frame_capture.h"
+#include "aggregator.h"
+#include "rule_engine.h"
+#include "compact_output.h"
+#include "raw_passthrough.h"
+#include "serial_bridge.h"
+#include "mqtt5_client.h"
+#include "mqtt_interface.h"
+#include "event_loop.h"
+#include "boot_timeline.h"
+#include "history_store.h"
+#include "downlink_mailbox.h"
+#include "uplink_dedup.h"
+
+#define STREAM_CHUNK_SIZE 256
 
 WebServer server(80);
 
@@ -10,18 +31,93 @@ static webserver_update_callback update_callback = NULL;
 
 static persisted_data_t cached_data;
 
+typedef struct {
+  char buffer[STREAM_CHUNK_SIZE];
+  uint16_t used;
+} chunk_writer_t;
+
+typedef void (*token_writer_t) (chunk_writer_t* writer, const char* token, uint8_t token_length);
+
 void handleRoot();
+void handleStaticAsset();
 void handlePost();
+void handleEvents();
+void handleDevicesPage();
+void handleApiDevices();
+void handleApiLatency();
+void handleApiLogs();
+void handleApiCapture();
+void handleCaptureDownload();
+void handleApiAggregation();
+void handleApiAggregationPost();
+void handleApiRules();
+void handleApiOutput();
+void handleApiPassthrough();
+void handleApiPassthroughPost();
+void handleApiBridge();
+void handleApiBridgePost();
+void handleApiMqtt5();
+void handleApiMqtt5Post();
+void handleApiMqtt();
+void handleApiMqttPost();
+void handleApiPower();
+void handleApiPowerPost();
+void handleApiLogsPost();
+void handleApiCapturePost();
+void handleApiBoot();
+void handleApiHistory();
+void handleApiMailbox();
+void handleApiMailboxPost();
+void handleApiRulesPost();
+void handleApiDedup();
+void handleApiDedupPost();
 
 void webserver_init(const char* mdns_hostname, webserver_update_callback callback, persisted_data_t data) {
   update_callback = callback;
   cached_data = data;
+
+  const char* collected_headers[] = { "If-None-Match" };
+  server.collectHeaders(collected_headers, 1);
   
   server.begin();
   MDNS.begin(mdns_hostname);
   
   server.on("/", HTTP_GET, handleRoot);
   server.on("/change", HTTP_POST, handlePost);
+  server.on("/events", HTTP_GET, handleEvents);
+  server.on("/devices", HTTP_GET, handleDevicesPage);
+  server.on("/api/devices", HTTP_GET, handleApiDevices);
+  server.on("/api/latency", HTTP_GET, handleApiLatency);
+  server.on("/api/logs", HTTP_GET, handleApiLogs);
+  server.on("/api/capture", HTTP_GET, handleApiCapture);
+  server.on("/api/aggregation", HTTP_GET, handleApiAggregation);
+  server.on("/api/rules", HTTP_GET, handleApiRules);
+  server.on("/api/output", HTTP_GET, handleApiOutput);
+  server.on("/api/passthrough", HTTP_GET, handleApiPassthrough);
+  server.on("/api/bridge", HTTP_GET, handleApiBridge);
+  server.on("/api/mqtt5", HTTP_GET, handleApiMqtt5);
+  server.on("/api/mqtt", HTTP_GET, handleApiMqtt);
+  server.on("/api/power", HTTP_GET, handleApiPower);
+  server.on("/api/boot", HTTP_GET, handleApiBoot);
+  server.on("/api/history", HTTP_GET, handleApiHistory);
+  server.on("/api/mailbox", HTTP_GET, handleApiMailbox);
+  server.on("/api/dedup", HTTP_GET, handleApiDedup);
+  server.on("/api/mailbox", HTTP_POST, handleApiMailboxPost);
+  server.on("/api/dedup", HTTP_POST, handleApiDedupPost);
+  server.on("/api/rules", HTTP_POST, handleApiRulesPost);
+  server.on("/api/aggregation", HTTP_POST, handleApiAggregationPost);
+  server.on("/api/passthrough", HTTP_POST, handleApiPassthroughPost);
+  server.on("/api/bridge", HTTP_POST, handleApiBridgePost);
+  server.on("/api/mqtt5", HTTP_POST, handleApiMqtt5Post);
+  server.on("/api/mqtt", HTTP_POST, handleApiMqttPost);
+  server.on("/api/power", HTTP_POST, handleApiPowerPost);
+  server.on("/api/logs", HTTP_POST, handleApiLogsPost);
+  server.on("/api/capture", HTTP_POST, handleApiCapturePost);
+  server.on("/capture.pcap", HTTP_GET, handleCaptureDownload);
+  server.on("/capture.bin", HTTP_GET, handleCaptureDownload);
+  server.on("/capture-spill.bin", HTTP_GET, handleCaptureDownload);
+  for(uint8_t i = 0; i < WEB_STATIC_ASSET_COUNT; i++)
+    server.on(web_static_assets[i].path, HTTP_GET, handleStaticAsset);
   server.onNotFound(handleRoot);
 }
 
@@ -29,129 +125,687 @@ void webserver_handle() {
   server.handleClient();
 }
 
-const String first = "<head>" \
-    "<style type=\"text/css\">" \
-      "#container {" \
-        "margin: 0;" \
-        "position: absolute;" \
-        "top: 25%;" \
-        "left: 50%;" \
-        "transform: translate(-50%, -25%);" \
-        "width:400px;" \
-        "height:600px;" \
-      "}" \
-      "h1{" \
-        "text-align: center;" \
-        "padding:10px;" \
-      "}" \
-      "label, input{" \
-        "display:block;" \
-        "width:100%;" \
-      "}" \
-      "input {" \
-        "margin-bottom: 2em;" \
-      "}" \
-    "</style>" \
-  "</head>" \
-  "<body>" \
-    "<div id=\"container\">" \
-    "<h1>IoWay</h1>" \
-    "<form action=\"change\" method=\"POST\">";
-const String postedString = "<p style=\"color: red;\">Command sent to server!</p>";
-const String WiFiCredentialsString = "<div>" \
-        "<label for=\"SSID\">Wi-Fi SSID</label>" \
-        "<input type=\"text\" name=\"SSID\" />" \
-      "</div>" \
-      "<div>" \
-        "<label for=\"password\">Password</label>" \
-        "<input type=\"password\" name=\"password\" />" \
-      "</div>";
-const String mqttBrokerString = "<div>" \
-        "<label for=\"broker\">MQTT Broker</label>" \
-        "<input type=\"text\" name=\"broker\" value=\"";
-const String mqttUserString = "\" />" \
-      "</div>" \
-      "<div>" \
-        "<label for=\"user\">MQTT User</label>" \
-        "<input type=\"text\" name=\"user\" value=\"";
-const String mqttPasswordString = "\"/>" \
-      "</div>" \
-      "<div>" \
-        "<label for=\"mqttPassword\">MQTT Password</label>" \
-        "<input type=\"password\" name=\"mqttPassword\" value=\"";
-const String mqttPortString = "\"/>" \
-      "</div>" \
-      "<div>" \
-        "<label for=\"mqttPort\">MQTT Port</label>" \
-        "<input type=\"number\" name=\"mqttPort\" value=\"";
-const String mqttSubmitString = "\" />" \
-      "</div>" \
-      "<div>" \
-        "<input type=\"submit\" value=\"submit\" />" \
-      "</div>" \
-    "</form></div>" \
-  "</body>";
+static void chunk_flush(chunk_writer_t* writer) {
+  if(writer->used) {
+    server.sendContent(writer->buffer, writer->used);
+    writer->used = 0;
+  }
+}
+
+static void chunk_append(chunk_writer_t* writer, const char* data, size_t length) {
+  while(length) {
+    size_t space = STREAM_CHUNK_SIZE - writer->used;
+    size_t part = length < space ? length : space;
+    memcpy(&writer->buffer[writer->used], data, part);
+    writer->used += part;
+    data += part;
+    length -= part;
+    if(writer->used == STREAM_CHUNK_SIZE)
+      chunk_flush(writer);
+  }
+}
 
-void handleRoot() {
-  String htmlPage = first; 
-  if(posted)
-    htmlPage += postedString;
-  htmlPage += WiFiCredentialsString;
-  htmlPage += mqttBrokerString;
-  htmlPage += cached_data.mqtt_broker.content;
-  htmlPage += mqttUserString;
+static void chunk_append_escaped(chunk_writer_t* writer, const char* value) {
+  for(; *value; value++) {
+    switch(*value) {
+      case '"': chunk_append(writer, "&quot;", 6); break;
+      case '&': chunk_append(writer, "&amp;", 5); break;
+      case '<': chunk_append(writer, "&lt;", 4); break;
+      case '>': chunk_append(writer, "&gt;", 4); break;
+      default: chunk_append(writer, value, 1); break;
+    }
+  }
+}
+
+static void chunk_printf(chunk_writer_t* writer, const char* format, ...) {
+  char formatted[128];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(formatted, sizeof(formatted), format, args);
+  va_end(args);
+  if(length > 0)
+    chunk_append(writer, formatted, min(length, (int)sizeof(formatted) - 1));
+}
+
+static void chunked_begin(chunk_writer_t* writer, const char* content_type) {
+  writer->used = 0;
+  server.sendHeader("Cache-Control", "no-store");
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, content_type, "");
+}
+
+static void chunked_end(chunk_writer_t* writer) {
+  chunk_flush(writer);
+  server.sendContent("");
+}
+
+/**
+ * @brief stream a PROGMEM template as chunked response, replacing %TOKEN% placeholders on the fly
+ * @param content_type the content type of the response
+ * @param template_pointer the null terminated template in PROGMEM
+ * @param write_token called for every placeholder with the name between the percent signs
+ */
+static void stream_template(const char* content_type, PGM_P template_pointer, token_writer_t write_token) {
+  chunk_writer_t writer;
+  chunked_begin(&writer, content_type);
+
+  char token[16];
+  uint8_t token_length = 0;
+  bool in_token = false;
+  for(PGM_P p = template_pointer; pgm_read_byte(p) != 0; p++) {
+    char c = pgm_read_byte(p);
+    if(c == '%') {
+      if(in_token)
+        write_token(&writer, token, token_length);
+      in_token = !in_token;
+      token_length = 0;
+    } else if(!in_token) {
+      chunk_append(&writer, &c, 1);
+    } else if(token_length < sizeof(token)) {
+      token[token_length++] = c;
+    }
+  }
+  chunked_end(&writer);
+}
+
+static bool token_equals(const char* token, uint8_t token_length, const char* name) {
+  return (strlen(name) == token_length) && !memcmp(token, name, token_length);
+}
+
+static void write_root_token(chunk_writer_t* writer, const char* token, uint8_t token_length) {
+  if(token_equals(token, token_length, "POSTED")) {
+    if(posted)
+      chunk_append(writer, "<p class=\"posted\">Command sent to server!</p>", 45);
+  } else if(token_equals(token, token_length, "BROKER")) {
+    chunk_append_escaped(writer, cached_data.mqtt_broker.content);
+  } else if(token_equals(token, token_length, "PORT")) {
+    char port[12];
+    chunk_append(writer, port, sprintf(port, "%u", *cached_data.mqtt_port));
+  } else if(token_length == 7 && !memcmp(token, "OUTPUT", 6)) {
+    if(*cached_data.output_mode == token[6] - '0')
+      chunk_append(writer, " selected", 9);
+  } else if(token_equals(token, token_length, "PREFIX")) {
+    chunk_append_escaped(writer, cached_data.compact_topic_prefix.content);
+  }
   // we could fill in user and password up front so users can make easy changes. This will, however, send them in plaintext and thus expose them to the network
-  //htmlPage += mqtt_user_string;
-  htmlPage += mqttPasswordString;
-  //htmlPage += mqtt_password_string;
-  htmlPage += mqttPortString;
-  htmlPage += *cached_data.mqtt_port;
-  htmlPage += mqttSubmitString;
+}
+
+static void write_no_token(chunk_writer_t* writer, const char* token, uint8_t token_length) {
+}
 
-  server.send(200, "text/html", htmlPage);
+void handleRoot() {
+  uint32_t heap_before = ESP.getFreeHeap();
+  unsigned long start = micros();
 
+  stream_template("text/html", index_html, write_root_token);
   posted = false;
+
+  LOG_DEBUG("root served in %u us, heap delta %d", micros() - start, heap_before - ESP.getFreeHeap());
+}
+
+void handleStaticAsset() {
+  for(uint8_t i = 0; i < WEB_STATIC_ASSET_COUNT; i++) {
+    const web_asset_t* asset = &web_static_assets[i];
+    if(!server.uri().equals(asset->path))
+      continue;
+
+    server.sendHeader("ETag", asset->etag);
+    server.sendHeader("Cache-Control", "max-age=86400");
+    if(server.hasHeader("If-None-Match") && server.header("If-None-Match").equals(asset->etag)) {
+      server.send(304);
+      return;
+    }
+    server.sendHeader("Content-Encoding", "gzip");
+    server.send_P(200, asset->content_type, (PGM_P)asset->data, asset->length);
+    return;
+  }
+  handleRoot();
+}
+
+void handleDevicesPage() {
+  stream_template("text/html", devices_html, write_no_token);
+}
+
+void handleApiDevices() {
+  chunk_writer_t writer;
+  chunked_begin(&writer, "application/json");
+
+  uint32_t now = millis();
+  const file_cache_statistics_t* file_cache = file_cache_get_statistics();
+  chunk_printf(&writer, "{\"count\":%u,\"evictions\":%u,", device_registry_count(), device_registry_evictions());
+  chunk_printf(&writer, "\"file_cache\":{\"entries\":%u,\"capacity\":%u,\"psram\":%s,", file_cache->entries, file_cache->capacity,
+    file_cache->psram ? "true" : "false");
+  chunk_printf(&writer, "\"merges\":%u,\"incomplete\":%u,\"evictions\":%u},\"devices\":[", file_cache->merges, file_cache->incomplete,
+    file_cache->evictions);
+  bool first = true;
+  for(uint16_t slot = 0; slot < DEVICE_REGISTRY_CAPACITY; slot++) {
+    device_record_t* device = device_registry_get(slot);
+    if(!device)
+      continue;
+    uint8_t* uid = (uint8_t*) &device->uid;
+    chunk_printf(&writer, "%s{\"uid\":\"%02X%02X%02X%02X%02X%02X%02X%02X\",\"last_seen\":%u,\"uplinks\":%u,",
+      first ? "" : ",", uid[0], uid[1], uid[2], uid[3], uid[4], uid[5], uid[6], uid[7], (now - device->last_seen) / 1000, device->uplinks);
+    chunk_printf(&writer, "\"rssi\":{\"avg\":%.1f,\"min\":%u,\"max\":%u},\"link_budget\":{\"avg\":%.1f,\"min\":%u,\"max\":%u},",
+      (float) device->rssi_ewma / (1 << DEVICE_REGISTRY_EWMA_SHIFT), device->rssi_min, device->rssi_max,
+      (float) device->link_budget_ewma / (1 << DEVICE_REGISTRY_EWMA_SHIFT), device->link_budget_min, device->link_budget_max);
+    chunk_printf(&writer, "\"modem\":%u,\"modems\":%u,", device->modem, device->modems);
+    chunk_printf(&writer, "\"battery\":%u,\"hw\":%u,\"sw\":%u,\"files\":{", device->battery_voltage, device->hw_version, device->sw_version);
+    bool first_file = true;
+    for(uint8_t file_slot = 0; file_slot < DEVICE_REGISTRY_FILE_SLOTS; file_slot++) {
+      if(!device->file_uplinks[file_slot])
+        continue;
+      uint8_t file_id = device_registry_file_id(file_slot);
+      if(file_id)
+        chunk_printf(&writer, "%s\"%u\":%u", first_file ? "" : ",", file_id, device->file_uplinks[file_slot]);
+      else
+        chunk_printf(&writer, "%s\"other\":%u", first_file ? "" : ",", device->file_uplinks[file_slot]);
+      first_file = false;
+    }
+    chunk_append(&writer, "}}", 2);
+    first = false;
+  }
+  chunk_append(&writer, "]}", 2);
+  chunked_end(&writer);
+}
+
+void handleApiLatency() {
+#ifdef PIPELINE_STATS
+  static char latency_json[1400];
+  if(pipeline_stats_json(latency_json, sizeof(latency_json))) {
+    server.send(200, "application/json", latency_json);
+    return;
+  }
+#endif
+  server.send(404, "text/plain", "latency instrumentation not compiled in");
+}
+
+void handleApiLogs() {
+  chunk_writer_t writer;
+  chunked_begin(&writer, "text/plain");
+  char line[160];
+  uint32_t end = logger_next_sequence();
+  for(uint32_t sequence = logger_oldest_sequence(); sequence != end; sequence++) {
+    uint16_t length = logger_format(sequence, line, sizeof(line));
+    if(!length)
+      continue;
+    chunk_append(&writer, line, length);
+    chunk_append(&writer, "\n", 1);
+  }
+  chunked_end(&writer);
+}
+
+void handleApiLogsPost() {
+  static const char* level_arguments[] = { "error", "warning", "info", "debug" };
+  if(server.hasArg("level")) {
+    for(uint8_t level = LOG_LEVEL_ERROR; level <= LOG_LEVEL_DEBUG; level++) {
+      if(server.arg("level").equals(level_arguments[level]))
+        logger_set_level((log_level_t) level);
+    }
+  }
+  handleApiLogs();
+}
+
+void handleApiCapture() {
+  const frame_capture_statistics_t* capture = frame_capture_get_statistics();
+  char json[200];
+  snprintf(json, sizeof(json), "{\"enabled\":%s,\"spilling\":%s,\"frames\":%u,\"buffered\":%u,\"overwritten\":%u,\"spilled\":%u,\"spill_dropped\":%u}",
+    capture->enabled ? "true" : "false", capture->spilling ? "true" : "false", capture->frames, capture->buffered,
+    capture->overwritten, capture->spilled, capture->spill_dropped);
+  server.send(200, "application/json", json);
+}
+
+void handleApiCapturePost() {
+  bool ok = true;
+  if(server.hasArg("enable"))
+    ok &= frame_capture_enable(server.arg("enable").equals("1"));
+  if(server.hasArg("spill"))
+    ok &= frame_capture_spill(server.arg("spill").equals("1"));
+  if(!ok) {
+    server.send(500, "text/plain", "no memory for the capture buffers or no filesystem to spill to");
+    return;
+  }
+  handleApiCapture();
+}
+
+void handleCaptureDownload() {
+  capture_format_t format = CAPTURE_FORMAT_RAW;
+  if(server.uri().equals("/capture.pcap"))
+    format = CAPTURE_FORMAT_PCAP;
+  else if(server.uri().equals("/capture-spill.bin"))
+    format = CAPTURE_FORMAT_SPILL;
+
+  if(!frame_capture_download(server.client(), format))
+    server.send(503, "text/plain", "capture download busy or unavailable");
+}
+
+void handleApiAggregation() {
+  const aggregator_statistics_t* aggregation = aggregator_get_statistics();
+  char json[160];
+  snprintf(json, sizeof(json), "{\"window\":%u,\"mode\":\"%s\",\"entities\":%u,\"samples\":%u,\"windows\":%u,\"evictions\":%u}",
+    aggregation->window, aggregation->mode == AGGREGATION_LATEST ? "latest" : "summary", aggregation->entities,
+    aggregation->samples, aggregation->windows, aggregation->evictions);
+  server.send(200, "application/json", json);
+}
+
+void handleApiAggregationPost() {
+  const aggregator_statistics_t* aggregation = aggregator_get_statistics();
+  if(server.hasArg("window") || server.hasArg("mode")) {
+    uint16_t window = server.hasArg("window") ? strtoul(server.arg("window").c_str(), NULL, 10) : aggregation->window;
+    aggregation_mode_t mode = aggregation->mode;
+    if(server.hasArg("mode"))
+      mode = server.arg("mode").equals("latest") ? AGGREGATION_LATEST : AGGREGATION_SUMMARY;
+    aggregator_configure(window, mode);
+  }
+  handleApiAggregation();
+}
+
+void handleApiRules() {
+  static char rules_json[3072];
+  if(!rule_engine_json(rules_json, sizeof(rules_json))) {
+    server.send(500, "text/plain", "rules do not fit in the response");
+    return;
+  }
+  server.send(200, "application/json", rules_json);
+}
+
+// the body replaces the rules file, the response lists the rules that compiled
+void handleApiRulesPost() {
+  if(!server.hasArg("plain") || !rule_engine_store(server.arg("plain").c_str())) {
+    server.send(400, "text/plain", "rules missing, too large or not stored");
+    return;
+  }
+  handleApiRules();
+}
+
+// bytes on the wire of the CBOR documents against the Home Assistant states of the same uplinks
+void handleApiOutput() {
+  const compact_output_statistics_t* output = compact_output_get_statistics();
+  float savings = output->json_bytes ? 100.0f * (1.0f - (float) output->compact_bytes / output->json_bytes) : 0;
+  char json[200];
+  snprintf(json, sizeof(json), "{\"home_assistant\":%s,\"compact\":%s,\"documents\":%u,\"failures\":%u,\"compact_bytes\":%u,\"json_bytes\":%u,\"savings\":%.1f}",
+    (output->mode & OUTPUT_MODE_HOME_ASSISTANT) ? "true" : "false", (output->mode & OUTPUT_MODE_COMPACT) ? "true" : "false",
+    output->documents, output->failures, output->compact_bytes, output->json_bytes, savings);
+  server.send(200, "application/json", json);
+}
+
+static const char* passthrough_modes[] = { "off", "unknown", "all", "only" };
+
+void handleApiPassthrough() {
+  const raw_passthrough_statistics_t* passthrough = raw_passthrough_get_statistics();
+  char json[160];
+  snprintf(json, sizeof(json), "{\"mode\":\"%s\",\"frames\":%u,\"batches\":%u,\"bytes\":%u,\"dropped_frames\":%u}",
+    passthrough_modes[passthrough->mode], passthrough->frames, passthrough->batches, passthrough->bytes, passthrough->dropped_frames);
+  server.send(200, "application/json", json);
+}
+
+void handleApiPassthroughPost() {
+  if(server.hasArg("mode")) {
+    for(uint8_t mode = PASSTHROUGH_OFF; mode <= PASSTHROUGH_ONLY; mode++) {
+      if(server.arg("mode").equals(passthrough_modes[mode]))
+        raw_passthrough_set_mode((passthrough_mode_t) mode);
+    }
+  }
+  handleApiPassthrough();
+}
+
+void handleApiBridge() {
+  const serial_bridge_statistics_t* bridge = serial_bridge_get_statistics();
+  char json[400];
+  snprintf(json, sizeof(json), "{\"enabled\":%s,\"exclusive\":%s,\"connected\":%s,\"modem\":%u,\"port\":%u,\"connects\":%u,"
+    "\"to_client\":{\"bytes\":%u,\"rate\":%u,\"short_writes\":%u,\"write_us_max\":%u},"
+    "\"from_client\":{\"bytes\":%u,\"rate\":%u,\"frames\":%u,\"skipped\":%u,\"latency_us_avg\":%u,\"latency_us_max\":%u}}",
+    bridge->enabled ? "true" : "false", bridge->exclusive ? "true" : "false", bridge->connected ? "true" : "false", bridge->modem,
+    SERIAL_BRIDGE_PORT, bridge->connects, bridge->bytes_to_client, bridge->rate_to_client, bridge->short_writes, bridge->write_us_max,
+    bridge->bytes_from_client, bridge->rate_from_client, bridge->frames_from_client, bridge->skipped_bytes,
+    bridge->frame_latency_us_avg, bridge->frame_latency_us_max);
+  server.send(200, "application/json", json);
+}
+
+void handleApiBridgePost() {
+#ifdef SERIAL_BRIDGE
+  const serial_bridge_statistics_t* bridge = serial_bridge_get_statistics();
+  bool enable = server.hasArg("enable") ? server.arg("enable").equals("1") : bridge->enabled;
+  uint8_t modem = server.hasArg("modem") ? strtoul(server.arg("modem").c_str(), NULL, 10) : bridge->modem;
+  bool exclusive = server.hasArg("exclusive") ? server.arg("exclusive").equals("1") : bridge->exclusive;
+  serial_bridge_configure(enable, modem, exclusive);
+  handleApiBridge();
+#else
+  server.send(403, "text/plain", "serial bridge not compiled in");
+#endif
+}
+
+// states over MQTT 5 with topic aliases, compared with what they would take over MQTT 3.1.1
+void handleApiMqtt5() {
+  const mqtt5_statistics_t* mqtt5 = mqtt5_client_get_statistics();
+  float savings = mqtt5->v311_bytes ? 100.0f * (1.0f - (float) mqtt5->bytes / mqtt5->v311_bytes) : 0;
+  char json[300];
+  snprintf(json, sizeof(json), "{\"enabled\":%s,\"connected\":%s,\"connects\":%u,\"topic_aliases\":%u,\"publishes\":%u,\"failures\":%u,"
+    "\"alias_hits\":%u,\"alias_misses\":%u,\"folded\":%u,\"bytes\":%u,\"v311_bytes\":%u,\"savings\":%.1f}",
+    mqtt5->enabled ? "true" : "false", mqtt5_client_connected() ? "true" : "false", mqtt5->connects, mqtt5->topic_alias_maximum,
+    mqtt5->publishes, mqtt5->publish_failures, mqtt5->alias_hits, mqtt5->alias_misses, mqtt5->folded, mqtt5->bytes, mqtt5->v311_bytes, savings);
+  server.send(200, "application/json", json);
+}
+
+void handleApiMqtt5Post() {
+  if(server.hasArg("enable"))
+    mqtt5_client_enable(server.arg("enable").equals("1"));
+  handleApiMqtt5();
+}
+
+// packets per socket write on the 3.1.1 connection, coalesce=0 sends every packet on its own for comparison
+void handleApiMqtt() {
+  const mqtt_statistics_t* mqtt = mqtt_interface_get_statistics();
+  const coalescing_statistics_t* socket = mqtt_interface_get_coalescing_statistics();
+  uint32_t average_segment = socket->segments ? socket->bytes / socket->segments : 0;
+  char json[380];
+  snprintf(json, sizeof(json), "{\"connected\":%s,\"connects\":%u,\"publishes\":%u,\"failures\":%u,\"coalesce\":%s,\"packets\":%u,"
+    "\"bytes\":%u,\"segments\":%u,\"average_segment\":%u,\"segment_fill\":%.1f,\"flush_full\":%u,\"flush_deadline\":%u,"
+    "\"flush_idle\":%u,\"write_failures\":%u,\"lost\":%u}",
+    mqtt_interface_connected() ? "true" : "false", mqtt->connects, mqtt->publishes, mqtt->publish_failures, socket->enabled ? "true" : "false",
+    socket->packets, socket->bytes, socket->segments, average_segment, 100.0f * average_segment / COALESCING_CLIENT_SIZE,
+    socket->flush_full, socket->flush_deadline, socket->flush_idle, socket->failures, socket->lost);
+  server.send(200, "application/json", json);
+}
+
+void handleApiMqttPost() {
+  if(server.hasArg("coalesce"))
+    mqtt_interface_coalesce(server.arg("coalesce").equals("1"));
+  handleApiMqtt();
+}
+
+static const char* power_modes[POWER_MODE_COUNT] = { "active", "idle", "light_sleep" };
+
+// how much of the time the loop runs, and what waiting for events instead saves
+void handleApiPower() {
+  const event_loop_statistics_t* loop = event_loop_get_statistics();
+  char json[360];
+  snprintf(json, sizeof(json), "{\"mode\":\"%s\",\"power_management\":%s,\"light_sleep_refused\":%s,\"poll_interval_ms\":%u,\"waits\":%u,"
+    "\"wakes_event\":%u,\"wakes_timeout\":%u,\"duty_cycle\":%.1f,\"wakes_per_second\":%u,\"wake_latency_us_avg\":%u,\"wake_latency_us_max\":%u,\"estimated_ma\":%.1f}",
+    power_modes[loop->mode], loop->pm_configured ? "true" : "false", loop->light_sleep_refused ? "true" : "false", loop->poll_interval_ms,
+    loop->waits, loop->wakes_event, loop->wakes_timeout, loop->duty_cycle / 10.0f, loop->wakes_per_second, loop->wake_latency_us_avg, loop->wake_latency_us_max,
+    loop->estimated_ua / 1000.0f);
+  server.send(200, "application/json", json);
+}
+
+void handleApiPowerPost() {
+  if(server.hasArg("mode")) {
+    for(uint8_t mode = 0; mode < POWER_MODE_COUNT; mode++) {
+      if(server.arg("mode").equals(power_modes[mode]))
+        event_loop_configure((power_mode_t)mode);
+    }
+  }
+  handleApiPower();
+}
+
+// ms since boot at which each startup phase was reached, 0 when it was not (yet)
+void handleApiBoot() {
+  char json[BOOT_TIMELINE_JSON_SIZE];
+  boot_timeline_json(json, sizeof(json));
+  server.send(200, "application/json", json);
+}
+
+typedef struct {
+  chunk_writer_t* writer;
+  bool csv;
+  bool first;
+} list_writer_t;
+
+static void write_history_point(void* context, uint32_t time, int32_t value, uint16_t resolution) {
+  list_writer_t* history = (list_writer_t*) context;
+  if(history->csv)
+    chunk_printf(history->writer, "%u,%.2f,%u\n", time, (float) value / HISTORY_VALUE_SCALE, resolution);
+  else
+    chunk_printf(history->writer, "%s[%u,%.2f,%u]", history->first ? "" : ",", time, (float) value / HISTORY_VALUE_SCALE, resolution);
+  history->first = false;
+}
+
+static void write_history_entity(void* context, const char* entity) {
+  list_writer_t* history = (list_writer_t*) context;
+  chunk_printf(history->writer, "%s\"", history->first ? "" : ",");
+  chunk_append_escaped(history->writer, entity);
+  chunk_append(history->writer, "\"", 1);
+  history->first = false;
+}
+
+static void skip_history_point(void* context, uint32_t time, int32_t value, uint16_t resolution) {
+}
+
+// the uid as listed by /api/devices, 16 hex digits in the byte order of the node
+static bool parse_uid(const String& text, uint64_t* uid) {
+  uint8_t bytes[8];
+  if(text.length() != 2 * sizeof(bytes))
+    return false;
+  for(uint8_t index = 0; index < sizeof(bytes); index++) {
+    char digits[3] = { text[2 * index], text[2 * index + 1], 0 };
+    char* end;
+    bytes[index] = strtoul(digits, &end, 16);
+    if(*end)
+      return false;
+  }
+  memcpy(uid, bytes, sizeof(bytes));
+  return true;
+}
+
+/**
+ * @brief recent values of an entity, oldest first as [seconds since boot, value, resolution], a resolution of 0 is a raw point
+ * without entity the recorded entities of the node are listed, without uid the memory use of the store
+ */
+void handleApiHistory() {
+  uint32_t now = history_store_now();
+  if(!server.hasArg("uid")) {
+    const history_statistics_t* history = history_store_get_statistics();
+    char json[240];
+    snprintf(json, sizeof(json), "{\"capacity\":%u,\"series\":%u,\"psram\":%s,\"series_bytes\":%u,\"points\":%u,\"downsampled\":%u,"
+      "\"dropped\":%u,\"evictions\":%u,\"now\":%u}",
+      history->capacity, history->series, history->psram ? "true" : "false", history->series_bytes, history->points,
+      history->downsampled, history->dropped, history->evictions, now);
+    server.send(200, "application/json", json);
+    return;
+  }
+
+  uint64_t uid;
+  if(!parse_uid(server.arg("uid"), &uid)) {
+    server.send(400, "text/plain", "uid should be 16 hex digits");
+    return;
+  }
+
+  chunk_writer_t writer;
+  list_writer_t history = { &writer, server.arg("format").equals("csv"), true };
+  if(!server.hasArg("entity")) {
+    chunked_begin(&writer, "application/json");
+    chunk_append(&writer, "{\"entities\":[", 13);
+    history_store_entities(uid, write_history_entity, &history);
+    chunk_append(&writer, "]}", 2);
+    chunked_end(&writer);
+    return;
+  }
+
+  // nothing is newer than the end of time, only checks the entity is recorded before the response starts
+  String entity = server.arg("entity");
+  if(!history_store_query(uid, entity.c_str(), UINT32_MAX, skip_history_point, NULL)) {
+    server.send(404, "text/plain", "no history for this entity");
+    return;
+  }
+
+  // a negative from counts back from now
+  int32_t from = server.hasArg("from") ? strtol(server.arg("from").c_str(), NULL, 10) : 0;
+  if(from < 0)
+    from = (uint32_t)-from < now ? now + from : 0;
+
+  if(history.csv) {
+    chunked_begin(&writer, "text/csv");
+    chunk_append(&writer, "time,value,resolution\n", 22);
+    history_store_query(uid, entity.c_str(), from, write_history_point, &history);
+  } else {
+    chunked_begin(&writer, "application/json");
+    chunk_append(&writer, "{\"entity\":\"", 11);
+    chunk_append_escaped(&writer, entity.c_str());
+    chunk_printf(&writer, "\",\"now\":%u,\"points\":[", now);
+    history_store_query(uid, entity.c_str(), from, write_history_point, &history);
+    chunk_append(&writer, "]}", 2);
+  }
+  chunked_end(&writer);
+}
+
+static bool parse_hex_data(const String& text, uint8_t* data, uint8_t size) {
+  if(!text.length() || text.length() % 2 || text.length() > 2 * size)
+    return false;
+  for(uint8_t index = 0; index < text.length() / 2; index++) {
+    char digits[3] = { text[2 * index], text[2 * index + 1], 0 };
+    char* end;
+    data[index] = strtoul(digits, &end, 16);
+    if(*end)
+      return false;
+  }
+  return true;
+}
+
+// a decimal form field from 0 to maximum, nothing else may follow the digits
+static bool parse_number(const String& text, unsigned long maximum, unsigned long* value) {
+  char* end;
+  *value = strtoul(text.c_str(), &end, 10);
+  return text.length() && isdigit(text[0]) && !*end && *value <= maximum;
+}
+
+static void write_mail(void* context, const downlink_mail_t* mail) {
+  list_writer_t* list = (list_writer_t*) context;
+  uint8_t* uid = (uint8_t*) &mail->uid;
+  chunk_printf(list->writer, "%s{\"uid\":\"%02X%02X%02X%02X%02X%02X%02X%02X\",\"file\":%u,\"offset\":%u,\"length\":%u,",
+    list->first ? "" : ",", uid[0], uid[1], uid[2], uid[3], uid[4], uid[5], uid[6], uid[7], mail->file_id, mail->offset, mail->length);
+  chunk_printf(list->writer, "\"age\":%u,\"ttl\":%u,\"attempts\":%u,\"in_flight\":%s}",
+    (millis() - mail->queued) / 1000, mail->ttl, mail->attempts, mail->state == MAIL_IN_FLIGHT ? "true" : "false");
+  list->first = false;
+}
+
+// writes waiting for the next uplink of their node, and how they got delivered
+void handleApiMailbox() {
+  const downlink_mailbox_statistics_t* mailbox = downlink_mailbox_get_statistics();
+  chunk_writer_t writer;
+  chunked_begin(&writer, "application/json");
+  chunk_printf(&writer, "{\"depth\":%u,\"depth_high_water\":%u,\"nodes\":%u,\"queued\":%u,\"superseded\":%u,\"rejected\":%u,",
+    mailbox->depth, mailbox->depth_high_water, mailbox->nodes, mailbox->queued, mailbox->superseded, mailbox->rejected);
+  chunk_printf(&writer, "\"commands\":%u,\"writes\":%u,\"merged\":%u,\"delivered\":%u,\"retries\":%u,\"failed\":%u,\"expired\":%u,",
+    mailbox->commands, mailbox->writes, mailbox->merged, mailbox->delivered, mailbox->retries, mailbox->failed, mailbox->expired);
+  chunk_printf(&writer, "\"timeouts\":%u,\"latency_ms_avg\":%u,\"latency_ms_max\":%u,\"mail\":[",
+    mailbox->timeouts, mailbox->latency_ms_avg, mailbox->latency_ms_max);
+  list_writer_t list = { &writer, false, true };
+  downlink_mailbox_list(write_mail, &list);
+  chunk_append(&writer, "]}", 2);
+  chunked_end(&writer);
+}
+
+// queues a write of file data, the uid as on /api/devices, data in hex and ttl in seconds
+void handleApiMailboxPost() {
+  uint64_t uid;
+  uint8_t data[DOWNLINK_MAILBOX_DATA_SIZE];
+  if(!parse_uid(server.arg("uid"), &uid) || !parse_hex_data(server.arg("data"), data, sizeof(data))) {
+    server.send(400, "text/plain", "uid, file and data (hex, at most 32 bytes) are required");
+    return;
+  }
+  // the offset is a byte of the command, the write must end inside the file
+  uint8_t length = server.arg("data").length() / 2;
+  unsigned long file_id;
+  unsigned long offset = 0;
+  unsigned long ttl = DOWNLINK_MAILBOX_DEFAULT_TTL;
+  if(!parse_number(server.arg("file"), 255, &file_id) || (server.hasArg("offset") && !parse_number(server.arg("offset"), 255 - length, &offset))
+    || (server.hasArg("ttl") && (!parse_number(server.arg("ttl"), 0xFFFFFFFF, &ttl) || !ttl))) {
+    server.send(400, "text/plain", "file (0-255), offset (offset + length at most 255) and ttl (at least 1 s) are out of range");
+    return;
+  }
+  if(!downlink_mailbox_enqueue(uid, file_id, offset, length, data, ttl)) {
+    server.send(503, "text/plain", "mailbox full");
+    return;
+  }
+  handleApiMailbox();
+}
+
+static void write_dedup_window(void* context, uint8_t file_id, uint16_t window_ms) {
+  list_writer_t* list = (list_writer_t*) context;
+  chunk_printf(list->writer, "%s\"%u\":%u", list->first ? "" : ",", file_id, window_ms);
+  list->first = false;
+}
+
+// the duplicates dropped and the window in ms per file type, file types not listed use default_window
+void handleApiDedup() {
+  const uplink_dedup_statistics_t* dedup = uplink_dedup_get_statistics();
+  chunk_writer_t writer;
+  chunked_begin(&writer, "application/json");
+  chunk_printf(&writer, "{\"checked\":%u,\"duplicates\":%u,\"cross_modem\":%u,\"evictions\":%u,\"default_window\":%u,\"windows\":{",
+    dedup->checked, dedup->duplicates, dedup->cross_modem, dedup->evictions, UPLINK_DEDUP_DEFAULT_WINDOW);
+  list_writer_t list = { &writer, false, true };
+  uplink_dedup_list_windows(write_dedup_window, &list);
+  chunk_append(&writer, "}}", 2);
+  chunked_end(&writer);
+}
+
+// file=<id>&window=<ms> until the next boot, window=0 lets every copy of that file type through
+void handleApiDedupPost() {
+  unsigned long file_id;
+  unsigned long window;
+  if(!parse_number(server.arg("file"), 255, &file_id) || !parse_number(server.arg("window"), 65535, &window)) {
+    server.send(400, "text/plain", "file (0-255) and window (ms, 0-65535) are required");
+    return;
+  }
+  if(!uplink_dedup_set_window(file_id, window)) {
+    server.send(503, "text/plain", "too many file types with a window of their own");
+    return;
+  }
+  handleApiDedup();
+}
+
+void handleEvents() {
+  if(!event_stream_add_client(server.client()))
+    server.send(503, "text/plain", "too many event clients");
+}
+
+static void store_argument(String value, char_length_t destination) {
+  if(value.length() >= MAX_CREDENTIAL_SIZE) {
+    LOG_WARNING("argument too long, ignoring");
+    return;
+  }
+  *destination.length = value.length();
+  value.toCharArray(destination.content, value.length()+1);
 }
 
 void handlePost() {
-  DPRINTLN("handle post");
+  LOG_INFO("handle post");
   if(server.hasArg("SSID")) {
     String ssid = server.arg("SSID");
-    if(ssid.length()) {
-      *cached_data.wifi_ssid.length = ssid.length();
-      DPRINTLN(*cached_data.wifi_ssid.length);
-      ssid.toCharArray(cached_data.wifi_ssid.content, ssid.length()+1); 
-    }
+    if(ssid.length())
+      store_argument(ssid, cached_data.wifi_ssid);
   }
   if(server.hasArg("password")) {
     String pw = server.arg("password");
-    if(pw.length()) {
-      *cached_data.wifi_password.length = pw.length();
-      pw.toCharArray(cached_data.wifi_password.content, pw.length()+1); 
-    }
+    if(pw.length())
+      store_argument(pw, cached_data.wifi_password);
   }
   if(server.hasArg("broker")) {
     String broker = server.arg("broker");
-    if(broker.length()){
-      *cached_data.mqtt_broker.length = broker.length();
-      broker.toCharArray(cached_data.mqtt_broker.content, broker.length()+1); 
-    }
+    if(broker.length())
+      store_argument(broker, cached_data.mqtt_broker);
   }
   if(server.hasArg("user")) {
     String user = server.arg("user");
-    if(user.length()){
-      *cached_data.mqtt_user.length = user.length();
-      user.toCharArray(cached_data.mqtt_user.content, user.length()+1); 
-    }
+    if(user.length())
+      store_argument(user, cached_data.mqtt_user);
   }
   if(server.hasArg("mqttPassword")) {
-    String pw = server.arg("mqttPassword");
-    *cached_data.mqtt_password.length = pw.length();
-    pw.toCharArray(cached_data.mqtt_password.content, pw.length()+1); 
+    store_argument(server.arg("mqttPassword"), cached_data.mqtt_password);
   }
   if(server.hasArg("mqttPort")) {
     *cached_data.mqtt_port = strtoul(server.arg("mqttPort").c_str(), NULL, 10);
   }
+  if(server.hasArg("output")) {
+    *cached_data.output_mode = strtoul(server.arg("output").c_str(), NULL, 10);
+  }
+  if(server.hasArg("compactPrefix")) {
+    String prefix = server.arg("compactPrefix");
+    // the config slot would cut a longer prefix short, publishing under a topic nobody configured
+    if(prefix.length() >= MAX_TOPIC_PREFIX_SIZE)
+      LOG_WARNING("topic prefix longer than %u characters, ignoring", MAX_TOPIC_PREFIX_SIZE - 1);
+    else
+      store_argument(prefix, cached_data.compact_topic_prefix);
+  }
 
   if(update_callback)
     update_callback();
@@ -0,0 +1,188 @@
+#include "device_registry.h"
+
+#define EMPTY_UID 0
+#define MAX_DEVICES (DEVICE_REGISTRY_CAPACITY - DEVICE_REGISTRY_CAPACITY / 8)
+#define SLOT_MASK (DEVICE_REGISTRY_CAPACITY - 1)
+#define EVICTION_SAMPLES 8
+
+static device_record_t devices[DEVICE_REGISTRY_CAPACITY];
+static uint16_t device_count = 0;
+static uint32_t evictions = 0;
+static uint16_t eviction_cursor = 0;
+
+static uint16_t home_slot(uint64_t uid) {
+  // 64 bit finalizer of murmur3, spreads sequential uids over the table
+  uid ^= uid >> 33;
+  uid *= 0xff51afd7ed558ccdULL;
+  uid ^= uid >> 33;
+  uid *= 0xc4ceb9fe1a85ec53ULL;
+  uid ^= uid >> 33;
+  return uid & SLOT_MASK;
+}
+
+static uint16_t probe_distance(uint16_t slot) {
+  return (slot - home_slot(devices[slot].uid)) & SLOT_MASK;
+}
+
+// backward shift deletion keeps probe sequences intact without tombstones. Every entry up to the next
+// empty slot whose probe sequence passes the hole moves into it, not only the run right behind it
+static void remove_slot(uint16_t slot) {
+  uint16_t next = (slot + 1) & SLOT_MASK;
+  while(devices[next].uid != EMPTY_UID) {
+    if(probe_distance(next) >= ((next - slot) & SLOT_MASK)) {
+      devices[slot] = devices[next];
+      slot = next;
+    }
+    next = (next + 1) & SLOT_MASK;
+  }
+  memset(&devices[slot], 0, sizeof(device_record_t));
+  device_count--;
+}
+
+// a full table scan per new node would make every insert O(N), so only the occupied slots after a
+// rotating cursor are compared and the one silent longest among them goes, an approximation of LRU
+static void evict_oldest() {
+  uint16_t oldest = 0;
+  uint32_t oldest_age = 0;
+  uint32_t now = millis();
+  uint8_t sampled = 0;
+  while(sampled < EVICTION_SAMPLES) {
+    uint16_t slot = eviction_cursor;
+    eviction_cursor = (eviction_cursor + 1) & SLOT_MASK;
+    if(devices[slot].uid == EMPTY_UID)
+      continue;
+    if(!sampled++ || (now - devices[slot].last_seen) >= oldest_age) {
+      oldest = slot;
+      oldest_age = now - devices[slot].last_seen;
+    }
+  }
+  remove_slot(oldest);
+  evictions++;
+}
+
+static uint16_t find_slot(uint64_t uid) {
+  uint16_t slot = home_slot(uid);
+  while(devices[slot].uid != EMPTY_UID && devices[slot].uid != uid)
+    slot = (slot + 1) & SLOT_MASK;
+  return slot;
+}
+
+static uint8_t file_slot(int16_t file_id) {
+  int16_t slot = file_id - DEVICE_REGISTRY_FIRST_FILE_ID;
+  if(slot < 0 || slot >= DEVICE_REGISTRY_FILE_SLOTS - 1)
+    return DEVICE_REGISTRY_FILE_SLOTS - 1;
+  return slot;
+}
+
+static void update_ewma(uint16_t* ewma, uint8_t value) {
+  int32_t scaled = (int32_t)value << DEVICE_REGISTRY_EWMA_SHIFT;
+  *ewma += (scaled - (int32_t)*ewma) / 8;
+}
+
+void device_registry_init() {
+  memset(devices, 0, sizeof(devices));
+  device_count = 0;
+  eviction_cursor = 0;
+}
+
+device_record_t* device_registry_update(custom_file_contents_t* custom_file_content) {
+  uint64_t uid = custom_file_content->chip_id;
+  if(uid == EMPTY_UID)
+    return NULL;
+
+  uint16_t slot = find_slot(uid);
+  device_record_t* device = &devices[slot];
+
+  if(device->uid == EMPTY_UID) {
+    if(device_count >= MAX_DEVICES) {
+      evict_oldest();
+      slot = find_slot(uid);
+      device = &devices[slot];
+    }
+    device->uid = uid;
+    device->first_seen = millis();
+    device->rssi_ewma = custom_file_content->rssi << DEVICE_REGISTRY_EWMA_SHIFT;
+    device->rssi_min = custom_file_content->rssi;
+    device->rssi_max = custom_file_content->rssi;
+    device->link_budget_ewma = custom_file_content->link_budget << DEVICE_REGISTRY_EWMA_SHIFT;
+    device->link_budget_min = custom_file_content->link_budget;
+    device->link_budget_max = custom_file_content->link_budget;
+    device_count++;
+  }
+
+  device->last_seen = millis();
+  device->uplinks++;
+  device->file_uplinks[file_slot(custom_file_content->file_id)]++;
+
+  update_ewma(&device->rssi_ewma, custom_file_content->rssi);
+  device->rssi_min = min(device->rssi_min, custom_file_content->rssi);
+  device->rssi_max = max(device->rssi_max, custom_file_content->rssi);
+  update_ewma(&device->link_budget_ewma, custom_file_content->link_budget);
+  device->link_budget_min = min(device->link_budget_min, custom_file_content->link_budget);
+  device->link_budget_max = max(device->link_budget_max, custom_file_content->link_budget);
+  device->rssi_last = custom_file_content->rssi;
+  device->link_budget_last = custom_file_content->link_budget;
+  device->modem = custom_file_content->modem;
+  device->modems |= 1 << custom_file_content->modem;
+
+  if(custom_file_content->file_id == PUSH7_STATE_FILE_ID && custom_file_content->length >= sizeof(push7_state_file_t)) {
+    push7_state_file_t* state = (push7_state_file_t*) custom_file_content->buffer;
+    device->battery_voltage = state->battery_voltage;
+    device->hw_version = state->hw_version;
+    device->sw_version = state->sw_version;
+  }
+  return device;
+}
+
+static void replace_sample(uint16_t* ewma, uint8_t previous, uint8_t value) {
+  int32_t difference = ((int32_t)value - previous) << DEVICE_REGISTRY_EWMA_SHIFT;
+  *ewma += difference / 8;
+}
+
+/**
+ * @brief take a stronger copy of the last uplink, received on another modem, as the reception of that uplink
+ */
+void device_registry_merge_reception(custom_file_contents_t* custom_file_content) {
+  device_record_t* device = device_registry_find(custom_file_content->chip_id);
+  if(!device)
+    return;
+
+  device->modems |= 1 << custom_file_content->modem;
+  if(custom_file_content->rssi >= device->rssi_last)
+    return;
+
+  replace_sample(&device->rssi_ewma, device->rssi_last, custom_file_content->rssi);
+  replace_sample(&device->link_budget_ewma, device->link_budget_last, custom_file_content->link_budget);
+  device->rssi_min = min(device->rssi_min, custom_file_content->rssi);
+  device->link_budget_max = max(device->link_budget_max, custom_file_content->link_budget);
+  device->rssi_last = custom_file_content->rssi;
+  device->link_budget_last = custom_file_content->link_budget;
+  device->modem = custom_file_content->modem;
+}
+
+device_record_t* device_registry_find(uint64_t uid) {
+  uint16_t slot = find_slot(uid);
+  if(devices[slot].uid == EMPTY_UID)
+    return NULL;
+  return &devices[slot];
+}
+
+device_record_t* device_registry_get(uint16_t slot) {
+  if(slot >= DEVICE_REGISTRY_CAPACITY || devices[slot].uid == EMPTY_UID)
+    return NULL;
+  return &devices[slot];
+}
+
+uint16_t device_registry_count() {
+  return device_count;
+}
+
+uint32_t device_registry_evictions() {
+  return evictions;
+}
+
+uint8_t device_registry_file_id(uint8_t file_slot) {
+  if(file_slot >= DEVICE_REGISTRY_FILE_SLOTS - 1)
+    return 0;
+  return DEVICE_REGISTRY_FIRST_FILE_ID + file_slot;
+}
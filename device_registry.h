@@ -0,0 +1,54 @@
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+#include "structures.h"
+
+// power of two, table is kept at most 7/8 full
+#ifndef DEVICE_REGISTRY_CAPACITY
+#define DEVICE_REGISTRY_CAPACITY 128
+#endif
+
+// uplink counters per file id, everything outside this range goes in the last slot
+#define DEVICE_REGISTRY_FIRST_FILE_ID BUTTON_FILE_ID
+#define DEVICE_REGISTRY_FILE_SLOTS (HALL_EFFECT_CONFIG_FILE_ID - BUTTON_FILE_ID + 2)
+
+// rssi and link budget averages are kept as fixed point with 4 fractional bits
+#define DEVICE_REGISTRY_EWMA_SHIFT 4
+
+typedef struct {
+  uint64_t uid;
+  uint32_t first_seen;
+  uint32_t last_seen;
+  uint32_t uplinks;
+  uint16_t rssi_ewma;
+  uint16_t link_budget_ewma;
+  uint8_t rssi_min;
+  uint8_t rssi_max;
+  uint8_t link_budget_min;
+  uint8_t link_budget_max;
+  uint8_t rssi_last;
+  uint8_t link_budget_last;
+  uint8_t modem;  // the modem that heard the last uplink best
+  uint8_t modems; // bit per modem that ever heard the node
+  uint16_t battery_voltage;
+  uint8_t hw_version;
+  uint8_t sw_version;
+  uint16_t file_uplinks[DEVICE_REGISTRY_FILE_SLOTS];
+} device_record_t;
+
+void device_registry_init();
+
+device_record_t* device_registry_update(custom_file_contents_t* custom_file_content);
+
+void device_registry_merge_reception(custom_file_contents_t* custom_file_content);
+
+device_record_t* device_registry_find(uint64_t uid);
+
+device_record_t* device_registry_get(uint16_t slot);
+
+uint16_t device_registry_count();
+
+uint32_t device_registry_evictions();
+
+uint8_t device_registry_file_id(uint8_t file_slot);
+
+#endif
@@ -0,0 +1,276 @@
+#include "downlink_mailbox.h"
+#include "alp.h"
+#include "serial_interface.h"
+#include "logger.h"
+
+// the forward, the tag request and the writes have to fit in one D7 frame with its headers
+#define MAILBOX_COMMAND_SIZE 128
+#define MAILBOX_WRITE_SIZE 64
+#define MAILBOX_MAX_ATTEMPTS 3
+#define MAILBOX_MAX_TTL 2592000
+
+// the modem completes a forward within seconds, also when the node does not answer
+#define MAILBOX_RESPONSE_TIMEOUT 10000
+
+#define FORWARD_SIZE 14
+#define TAG_REQUEST_SIZE 2
+
+typedef struct {
+  uint8_t file_id;
+  uint8_t offset;
+  uint8_t length;
+  uint8_t data[MAILBOX_WRITE_SIZE];
+} write_t;
+
+static downlink_mail_t mails[DOWNLINK_MAILBOX_SIZE];
+static uint32_t next_sequence = 0;
+static uint8_t next_tag_id = 0;
+
+static write_t writes[DOWNLINK_MAILBOX_SIZE];
+static uint8_t command[MAILBOX_COMMAND_SIZE];
+
+static downlink_mailbox_statistics_t statistics;
+static uint64_t latency_sum = 0;
+
+void downlink_mailbox_init() {
+  memset(mails, 0, sizeof(mails));
+  memset(&statistics, 0, sizeof(statistics));
+  latency_sum = 0;
+}
+
+const downlink_mailbox_statistics_t* downlink_mailbox_get_statistics() {
+  statistics.nodes = 0;
+  for(uint8_t slot = 0; slot < DOWNLINK_MAILBOX_SIZE; slot++) {
+    if(mails[slot].state == MAIL_FREE)
+      continue;
+    uint8_t first = 0;
+    while(mails[first].state == MAIL_FREE || mails[first].uid != mails[slot].uid)
+      first++;
+    if(first == slot)
+      statistics.nodes++;
+  }
+  statistics.latency_ms_avg = statistics.delivered ? latency_sum / statistics.delivered : 0;
+  return &statistics;
+}
+
+void downlink_mailbox_list(downlink_mail_callback callback, void* context) {
+  for(uint8_t slot = 0; slot < DOWNLINK_MAILBOX_SIZE; slot++) {
+    if(mails[slot].state != MAIL_FREE)
+      callback(context, &mails[slot]);
+  }
+}
+
+static void release(downlink_mail_t* mail) {
+  mail->state = MAIL_FREE;
+  statistics.depth--;
+}
+
+bool downlink_mailbox_enqueue(uint64_t uid, uint8_t file_id, uint8_t offset, uint8_t length, const uint8_t* data, uint32_t ttl) {
+  if(!length || length > DOWNLINK_MAILBOX_DATA_SIZE || offset + length > 255 || !ttl)
+    return false;
+
+  // a write that is not sent yet and only covers bytes of this one would be overwritten anyway
+  downlink_mail_t* free_mail = NULL;
+  for(uint8_t slot = 0; slot < DOWNLINK_MAILBOX_SIZE; slot++) {
+    downlink_mail_t* mail = &mails[slot];
+    if(mail->state == MAIL_PENDING && mail->uid == uid && mail->file_id == file_id && mail->offset >= offset
+      && mail->offset + mail->length <= offset + length) {
+      release(mail);
+      statistics.superseded++;
+    }
+    if(mail->state == MAIL_FREE && !free_mail)
+      free_mail = mail;
+  }
+  if(!free_mail) {
+    LOG_WARNING("mailbox full, dropping write of file %u", file_id);
+    statistics.rejected++;
+    return false;
+  }
+
+  free_mail->uid = uid;
+  free_mail->sequence = next_sequence++;
+  free_mail->queued = millis();
+  free_mail->sent = 0;
+  free_mail->ttl = ttl < MAILBOX_MAX_TTL ? ttl : MAILBOX_MAX_TTL;
+  free_mail->state = MAIL_PENDING;
+  free_mail->attempts = 0;
+  free_mail->file_id = file_id;
+  free_mail->offset = offset;
+  free_mail->length = length;
+  memcpy(free_mail->data, data, length);
+
+  statistics.queued++;
+  if(++statistics.depth > statistics.depth_high_water)
+    statistics.depth_high_water = statistics.depth;
+  return true;
+}
+
+static uint8_t length_operand_size(uint8_t length) {
+  return length < 64 ? 1 : 2;
+}
+
+static uint8_t write_size(uint8_t offset, uint8_t length) {
+  return 2 + length_operand_size(offset) + length_operand_size(length) + length;
+}
+
+// the last write of the command the mail overlaps or touches, it is written after every earlier one so the mail can go in it
+static int8_t mergeable_write(uint8_t write_count, downlink_mail_t* mail) {
+  for(int8_t index = write_count - 1; index >= 0; index--) {
+    write_t* write = &writes[index];
+    if(write->file_id == mail->file_id && mail->offset <= write->offset + write->length && mail->offset + mail->length >= write->offset)
+      return index;
+  }
+  return -1;
+}
+
+/**
+ * @brief gather the pending mail of a node in queue order, merging overlapping writes to the same file
+ * @return the amount of writes, the mail they hold is marked in flight under the tag but not counted as sent
+ */
+static uint8_t collect_writes(uint64_t uid, uint8_t tag_id) {
+  uint8_t write_count = 0;
+  uint8_t size = FORWARD_SIZE + TAG_REQUEST_SIZE;
+  while(true) {
+    downlink_mail_t* mail = NULL;
+    for(uint8_t slot = 0; slot < DOWNLINK_MAILBOX_SIZE; slot++) {
+      downlink_mail_t* candidate = &mails[slot];
+      if(candidate->state == MAIL_PENDING && candidate->uid == uid && (!mail || candidate->sequence < mail->sequence))
+        mail = candidate;
+    }
+    if(!mail)
+      break;
+
+    // the order of the writes is kept, so a write that does not fit leaves the later ones for the next uplink too
+    int8_t index = mergeable_write(write_count, mail);
+    if(index >= 0) {
+      write_t* write = &writes[index];
+      uint8_t start = min(write->offset, mail->offset);
+      uint8_t end = max(write->offset + write->length, mail->offset + mail->length);
+      uint8_t grown = write_size(start, end - start) - write_size(write->offset, write->length);
+      if(end - start > MAILBOX_WRITE_SIZE)
+        index = -1;
+      else if(size + grown > MAILBOX_COMMAND_SIZE)
+        break;
+      else {
+        memmove(&write->data[write->offset - start], write->data, write->length);
+        memcpy(&write->data[mail->offset - start], mail->data, mail->length);
+        write->offset = start;
+        write->length = end - start;
+        size += grown;
+      }
+    }
+    if(index < 0) {
+      if(size + write_size(mail->offset, mail->length) > MAILBOX_COMMAND_SIZE)
+        break;
+      write_t* write = &writes[write_count++];
+      write->file_id = mail->file_id;
+      write->offset = mail->offset;
+      write->length = mail->length;
+      memcpy(write->data, mail->data, mail->length);
+      size += write_size(mail->offset, mail->length);
+    }
+
+    mail->state = MAIL_IN_FLIGHT;
+    mail->tag_id = tag_id;
+  }
+  return write_count;
+}
+
+/**
+ * @brief count the collected mail as an attempt once the command went out, or put it back as pending when it did not
+ * @return the amount of mail in the command
+ */
+static uint8_t settle_collected(uint8_t tag_id, bool sent) {
+  uint8_t mail_count = 0;
+  uint32_t now = millis();
+  for(uint8_t slot = 0; slot < DOWNLINK_MAILBOX_SIZE; slot++) {
+    downlink_mail_t* mail = &mails[slot];
+    if(mail->state != MAIL_IN_FLIGHT || mail->tag_id != tag_id)
+      continue;
+    if(!sent) {
+      mail->state = MAIL_PENDING;
+      continue;
+    }
+    mail->sent = now;
+    if(++mail->attempts > 1)
+      statistics.retries++;
+    mail_count++;
+  }
+  return mail_count;
+}
+
+void downlink_mailbox_uplink(uint64_t uid) {
+  if(!statistics.depth)
+    return;
+  // one command at a time per node, the copies of an uplink heard by other modems and the answer to the command itself end up here too
+  for(uint8_t slot = 0; slot < DOWNLINK_MAILBOX_SIZE; slot++) {
+    if(mails[slot].state == MAIL_IN_FLIGHT && mails[slot].uid == uid)
+      return;
+  }
+
+  uint8_t tag_id = next_tag_id++;
+  uint8_t write_count = collect_writes(uid, tag_id);
+  if(!write_count)
+    return;
+
+  uint8_t length = alp_append_forward_uid(command, (const uint8_t*) &uid);
+  length += alp_append_tag_request(&command[length], tag_id, true);
+  for(uint8_t index = 0; index < write_count; index++)
+    length += alp_append_write_file_data(&command[length], writes[index].file_id, writes[index].offset, writes[index].length, writes[index].data);
+
+  // the modem that heard the uplink first, the node only listens briefly so there is no time to wait for the other copies.
+  // When a bridge client owns that modem the mail waits for the next uplink
+  bool sent = serial_send_modem(serial_frame_modem(), command, length, SERIAL_MESSAGE_TYPE_ALP);
+  uint8_t mail_count = settle_collected(tag_id, sent);
+  if(!sent)
+    return;
+  statistics.commands++;
+  statistics.writes += write_count;
+  statistics.merged += mail_count - write_count;
+}
+
+static void complete(uint8_t tag_id, bool delivered) {
+  uint32_t now = millis();
+  for(uint8_t slot = 0; slot < DOWNLINK_MAILBOX_SIZE; slot++) {
+    downlink_mail_t* mail = &mails[slot];
+    if(mail->state != MAIL_IN_FLIGHT || mail->tag_id != tag_id)
+      continue;
+    if(delivered) {
+      uint32_t latency = now - mail->queued;
+      latency_sum += latency;
+      if(latency > statistics.latency_ms_max)
+        statistics.latency_ms_max = latency;
+      statistics.delivered++;
+      release(mail);
+    } else if(mail->attempts >= MAILBOX_MAX_ATTEMPTS) {
+      LOG_WARNING("giving up on write of file %u after %u attempts", mail->file_id, mail->attempts);
+      statistics.failed++;
+      release(mail);
+    } else {
+      mail->state = MAIL_PENDING;
+    }
+  }
+}
+
+// only the last response to a request tells whether it completed
+void downlink_mailbox_response(uint8_t tag_id, bool end_of_packet, bool error) {
+  if(end_of_packet)
+    complete(tag_id, !error);
+}
+
+void downlink_mailbox_handle() {
+  if(!statistics.depth)
+    return;
+  uint32_t now = millis();
+  for(uint8_t slot = 0; slot < DOWNLINK_MAILBOX_SIZE; slot++) {
+    downlink_mail_t* mail = &mails[slot];
+    if(mail->state == MAIL_PENDING && now - mail->queued >= mail->ttl * 1000) {
+      LOG_INFO("write of file %u expired", mail->file_id);
+      statistics.expired++;
+      release(mail);
+    } else if(mail->state == MAIL_IN_FLIGHT && now - mail->sent > MAILBOX_RESPONSE_TIMEOUT) {
+      statistics.timeouts++;
+      complete(mail->tag_id, false);
+    }
+  }
+}
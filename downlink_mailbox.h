@@ -0,0 +1,75 @@
+#ifndef DOWNLINK_MAILBOX_H
+#define DOWNLINK_MAILBOX_H
+#include "structures.h"
+
+// writes waiting for their node, shared by all nodes
+#define DOWNLINK_MAILBOX_SIZE 32
+#define DOWNLINK_MAILBOX_DATA_SIZE 32
+
+// seconds a write waits for its node before it is given up
+#define DOWNLINK_MAILBOX_DEFAULT_TTL 86400
+
+typedef enum {
+  MAIL_FREE,
+  MAIL_PENDING,   // waits for the next uplink of its node
+  MAIL_IN_FLIGHT, // sent, waits for the completion of its tag
+} mail_state_t;
+
+typedef struct {
+  uint64_t uid;
+  uint32_t sequence; // queue order, a later write to the same bytes wins
+  uint32_t queued;   // ms since boot
+  uint32_t sent;     // ms since boot of the last attempt
+  uint32_t ttl;      // seconds
+  mail_state_t state;
+  uint8_t attempts;
+  uint8_t tag_id;
+  uint8_t file_id;
+  uint8_t offset;
+  uint8_t length;
+  uint8_t data[DOWNLINK_MAILBOX_DATA_SIZE];
+} downlink_mail_t;
+
+typedef struct {
+  uint32_t queued;
+  uint32_t superseded; // replaced by a later write to the same bytes before it was sent
+  uint32_t rejected;   // mailbox full
+  uint32_t commands;   // forwards sent, one per uplink of a node with mail
+  uint32_t writes;     // writes in those commands, after merging
+  uint32_t merged;     // queued writes folded into another write of the same command
+  uint32_t delivered;
+  uint32_t retries;
+  uint32_t failed;     // given up after the last attempt
+  uint32_t expired;
+  uint32_t timeouts;   // commands the modem never completed
+  uint16_t depth;
+  uint16_t depth_high_water;
+  uint16_t nodes;      // nodes with mail
+  uint32_t latency_ms_avg; // from queued to the completion of the delivering command
+  uint32_t latency_ms_max;
+} downlink_mailbox_statistics_t;
+
+typedef void (*downlink_mail_callback) (void* context, const downlink_mail_t* mail);
+
+void downlink_mailbox_init();
+
+/**
+ * @brief queue a write of file data to a node, sent after the next uplink of the node when it listens
+ * @param ttl seconds the write may wait for the node, at least 1
+ * @return false when the data does not fit, would end past byte 255 of the file, or the mailbox is full
+ */
+bool downlink_mailbox_enqueue(uint64_t uid, uint8_t file_id, uint8_t offset, uint8_t length, const uint8_t* data, uint32_t ttl);
+
+// the node just transmitted and listens for a moment, its mail is sent on the modem that heard it
+void downlink_mailbox_uplink(uint64_t uid);
+
+void downlink_mailbox_response(uint8_t tag_id, bool end_of_packet, bool error);
+
+// expires mail and gives up on commands without completion
+void downlink_mailbox_handle();
+
+void downlink_mailbox_list(downlink_mail_callback callback, void* context);
+
+const downlink_mailbox_statistics_t* downlink_mailbox_get_statistics();
+
+#endif
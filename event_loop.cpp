@@ -0,0 +1,146 @@
+#include "event_loop.h"
+#include "serial_interface.h"
+#include "logger.h"
+#include <esp_pm.h>
+#include <esp_wifi.h>
+#include <esp_timer.h>
+
+#define CPU_MAX_FREQUENCY_MHZ 240
+// the UARTs run from the APB clock, which stays at 80 MHz down to this CPU frequency
+#define CPU_MIN_FREQUENCY_MHZ 80
+
+// sockets (web server, MQTT, bridge) have no wake up event, they are polled at this interval
+#define IDLE_POLL_INTERVAL_MS 10
+#define LIGHT_SLEEP_POLL_INTERVAL_MS 50
+
+#define STATISTICS_WINDOW_US 10000000
+
+// ESP32 datasheet figures for the current estimate: CPU at 240 MHz, clocked down to 80 MHz, and light sleep
+#define ACTIVE_CURRENT_UA 40000
+#define IDLE_CURRENT_UA 20000
+#define LIGHT_SLEEP_CURRENT_UA 800
+
+static TaskHandle_t loop_task = NULL;
+static power_mode_t power_mode = POWER_MODE_ACTIVE;
+
+// when the first event since the last wake arrived, 0 when there was none
+static volatile int64_t event_time = 0;
+
+static int64_t resumed = 0;
+static int64_t window_start = 0;
+static int64_t window_busy = 0;
+static uint32_t window_wakes = 0;
+static uint64_t latency_sum = 0;
+static uint32_t latency_count = 0;
+
+static event_loop_statistics_t statistics;
+
+static void modem_received() {
+  event_loop_notify();
+}
+
+void event_loop_notify() {
+  if(!event_time)
+    event_time = esp_timer_get_time();
+  if(loop_task)
+    xTaskNotifyGive(loop_task);
+}
+
+void event_loop_init() {
+  memset(&statistics, 0, sizeof(statistics));
+  loop_task = xTaskGetCurrentTaskHandle();
+  resumed = window_start = esp_timer_get_time();
+  serial_set_receive_callback(&modem_received);
+  event_loop_configure(POWER_MODE_IDLE);
+}
+
+static bool configure_power_management(power_mode_t mode) {
+  esp_pm_config_esp32_t config;
+  config.max_freq_mhz = CPU_MAX_FREQUENCY_MHZ;
+  config.min_freq_mhz = mode == POWER_MODE_ACTIVE ? CPU_MAX_FREQUENCY_MHZ : CPU_MIN_FREQUENCY_MHZ;
+  config.light_sleep_enable = mode == POWER_MODE_LIGHT_SLEEP;
+  esp_err_t result = esp_pm_configure(&config);
+  if(result != ESP_OK) {
+    LOG_WARNING("power management not available (%d), the loop still waits for events", result);
+    return false;
+  }
+  return true;
+}
+
+bool event_loop_configure(power_mode_t mode) {
+  if(mode >= POWER_MODE_COUNT)
+    return false;
+  // the bytes of a modem that cannot wake the chip would be lost while it sleeps
+  statistics.light_sleep_refused = mode == POWER_MODE_LIGHT_SLEEP && !serial_set_wakeup(true);
+  if(statistics.light_sleep_refused)
+    return false;
+  power_mode = mode;
+  statistics.mode = mode;
+  statistics.poll_interval_ms = mode == POWER_MODE_LIGHT_SLEEP ? LIGHT_SLEEP_POLL_INTERVAL_MS : IDLE_POLL_INTERVAL_MS;
+  statistics.pm_configured = configure_power_management(mode) && mode != POWER_MODE_ACTIVE;
+  // light sleep needs the radio in modem sleep, it then wakes for the beacons of the access point only
+  esp_wifi_set_ps(mode == POWER_MODE_ACTIVE ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM);
+  if(mode != POWER_MODE_LIGHT_SLEEP)
+    serial_set_wakeup(false);
+  LOG_INFO("power mode %u, poll interval %u ms", mode, statistics.poll_interval_ms);
+  return true;
+}
+
+static void close_window(int64_t now) {
+  int64_t window = now - window_start;
+  if(window < STATISTICS_WINDOW_US)
+    return;
+
+  statistics.duty_cycle = window_busy * 1000 / window;
+  statistics.wakes_per_second = (uint64_t)window_wakes * 1000000 / window;
+  uint32_t waiting_current = (power_mode == POWER_MODE_LIGHT_SLEEP && statistics.pm_configured) ? LIGHT_SLEEP_CURRENT_UA :
+    statistics.pm_configured ? IDLE_CURRENT_UA : ACTIVE_CURRENT_UA;
+  statistics.estimated_ua = (ACTIVE_CURRENT_UA * statistics.duty_cycle + waiting_current * (1000 - statistics.duty_cycle)) / 1000;
+  if(latency_count)
+    statistics.wake_latency_us_avg = latency_sum / latency_count;
+
+  window_start = now;
+  window_busy = 0;
+  window_wakes = 0;
+  latency_sum = 0;
+  latency_count = 0;
+}
+
+void event_loop_wait(uint32_t timeout_ms) {
+  int64_t now = esp_timer_get_time();
+  window_busy += now - resumed;
+  close_window(now);
+
+  if(power_mode == POWER_MODE_ACTIVE || timeout_ms == 0) {
+    event_time = 0;
+    resumed = now;
+    return;
+  }
+
+  if(timeout_ms > statistics.poll_interval_ms)
+    timeout_ms = statistics.poll_interval_ms;
+  statistics.waits++;
+  // an event during the previous pass leaves its notification, the wait then returns right away
+  uint32_t notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+  resumed = esp_timer_get_time();
+  window_wakes++;
+
+  if(!notified) {
+    statistics.wakes_timeout++;
+    return;
+  }
+  statistics.wakes_event++;
+  int64_t event = event_time;
+  event_time = 0;
+  if(event > now) {
+    uint32_t latency = resumed - event;
+    latency_sum += latency;
+    latency_count++;
+    if(latency > statistics.wake_latency_us_max)
+      statistics.wake_latency_us_max = latency;
+  }
+}
+
+const event_loop_statistics_t* event_loop_get_statistics() {
+  return &statistics;
+}
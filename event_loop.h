@@ -0,0 +1,46 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+#include "structures.h"
+
+// no wait other than the socket poll interval of the power mode
+#define EVENT_LOOP_NO_TIMEOUT 0xFFFFFFFF
+
+typedef enum {
+  POWER_MODE_ACTIVE,      // the loop spins, as fast as possible
+  POWER_MODE_IDLE,        // the loop waits for the modems or a poll of the sockets, the CPU clocks down in between
+  POWER_MODE_LIGHT_SLEEP, // as idle, and the chip light sleeps with the WiFi radio in modem sleep
+  POWER_MODE_COUNT
+} power_mode_t;
+
+typedef struct {
+  uint8_t mode;
+  bool pm_configured;           // frequency scaling (and light sleep) accepted by the power management
+  bool light_sleep_refused;     // light sleep was asked for, but a modem UART cannot wake the chip
+  uint16_t poll_interval_ms;
+  uint32_t waits;
+  uint32_t wakes_event;
+  uint32_t wakes_timeout;
+  uint16_t duty_cycle;          // per mille of the last window spent running the loop instead of waiting
+  uint32_t wakes_per_second;    // over the last window
+  uint32_t wake_latency_us_avg; // a modem event during a wait to the loop running again
+  uint32_t wake_latency_us_max;
+  uint32_t estimated_ua;        // CPU current estimated from the duty cycle and the power mode, without the radio
+} event_loop_statistics_t;
+
+void event_loop_init();
+
+// false when the mode is not possible with the attached modems, the current mode then stays
+bool event_loop_configure(power_mode_t mode);
+
+// wakes the loop out of its wait, safe to call from other tasks
+void event_loop_notify();
+
+/**
+ * @brief wait for an event, at most until the sockets are polled again
+ * @param timeout_ms the longest wait, 0 when the loop has more work right away
+ */
+void event_loop_wait(uint32_t timeout_ms);
+
+const event_loop_statistics_t* event_loop_get_statistics();
+
+#endif
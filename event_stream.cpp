@@ -0,0 +1,189 @@
+#include "event_stream.h"
+#include "socket_send.h"
+#include "logger.h"
+
+// all clients read from one ring of formatted events, each with its own cursor.
+// A client that falls more than EVENT_RING_SIZE events behind loses the oldest ones.
+#define EVENT_RING_SIZE 8
+#define MAX_EVENT_SIZE 512
+#define KEEPALIVE_INTERVAL 15000
+
+typedef struct {
+  uint32_t sequence;
+  uint16_t length;
+  char data[MAX_EVENT_SIZE];
+} event_t;
+
+typedef struct {
+  WiFiClient client;
+  bool active;
+  uint32_t next_sequence;
+  uint32_t dropped;
+  uint32_t reported_dropped;
+  uint16_t event_offset; // bytes of the next event the socket already took
+  unsigned long last_write;
+} event_client_t;
+
+static event_t events[EVENT_RING_SIZE];
+static uint32_t next_sequence = 0;
+
+static event_client_t clients[EVENT_STREAM_MAX_CLIENTS];
+static uint8_t active_clients = 0;
+
+static const char event_stream_header[] = "HTTP/1.1 200 OK\r\n" \
+  "Content-Type: text/event-stream\r\n" \
+  "Cache-Control: no-cache\r\n" \
+  "Connection: keep-alive\r\n" \
+  "Access-Control-Allow-Origin: *\r\n\r\n";
+
+void event_stream_init() {
+  for(uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+    clients[i].active = false;
+}
+
+bool event_stream_add_client(WiFiClient client) {
+  for(uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    if(clients[i].active)
+      continue;
+    clients[i].client = client;
+    clients[i].active = true;
+    clients[i].next_sequence = next_sequence;
+    clients[i].dropped = 0;
+    clients[i].reported_dropped = 0;
+    clients[i].event_offset = 0;
+    clients[i].last_write = millis();
+    clients[i].client.setNoDelay(true);
+    if(socket_send(clients[i].client, (const uint8_t*)event_stream_header, sizeof(event_stream_header) - 1) != sizeof(event_stream_header) - 1) {
+      clients[i].client.stop();
+      clients[i].active = false;
+      return false;
+    }
+    active_clients++;
+    return true;
+  }
+  LOG_WARNING("event stream full, rejecting client");
+  return false;
+}
+
+// the same escaping the web server applies to names and states, they end up in the page as they are
+static int append_escaped(char* buffer, int length, const char* value) {
+  for(; *value && length < MAX_EVENT_SIZE; value++) {
+    switch(*value) {
+      case '"': length += snprintf(&buffer[length], MAX_EVENT_SIZE - length, "&quot;"); break;
+      case '&': length += snprintf(&buffer[length], MAX_EVENT_SIZE - length, "&amp;"); break;
+      case '<': length += snprintf(&buffer[length], MAX_EVENT_SIZE - length, "&lt;"); break;
+      case '>': length += snprintf(&buffer[length], MAX_EVENT_SIZE - length, "&gt;"); break;
+      case '\\': length += snprintf(&buffer[length], MAX_EVENT_SIZE - length, "\\\\"); break;
+      default: buffer[length++] = *value; break;
+    }
+  }
+  return length;
+}
+
+void event_stream_push(custom_file_contents_t* custom_file_content, publish_object_t* objects, uint8_t amount) {
+  // formatting is only done when somebody is listening
+  if(!active_clients)
+    return;
+
+  // formatted aside, an event that does not fit must not take the slot of one a client still has to read
+  static char scratch[MAX_EVENT_SIZE];
+  int length = snprintf(scratch, MAX_EVENT_SIZE, "data: {\"ts\":%lu,\"uid\":\"%02X%02X%02X%02X%02X%02X%02X%02X\",\"file\":%d,\"rssi\":%d,\"lb\":%d,\"values\":{",
+    millis(), custom_file_content->uid[0], custom_file_content->uid[1], custom_file_content->uid[2], custom_file_content->uid[3],
+    custom_file_content->uid[4], custom_file_content->uid[5], custom_file_content->uid[6], custom_file_content->uid[7],
+    custom_file_content->file_id, custom_file_content->rssi, custom_file_content->link_budget);
+
+  for(uint8_t index = 0; index < amount && length < MAX_EVENT_SIZE; index++) {
+    length += snprintf(&scratch[length], MAX_EVENT_SIZE - length, "%s\"", index ? "," : "");
+    length = append_escaped(scratch, length, objects[index].name);
+    if(length < MAX_EVENT_SIZE)
+      length += snprintf(&scratch[length], MAX_EVENT_SIZE - length, "\":\"");
+    length = append_escaped(scratch, length, objects[index].state);
+    if(length < MAX_EVENT_SIZE)
+      length += snprintf(&scratch[length], MAX_EVENT_SIZE - length, "\"");
+  }
+
+  if(length < MAX_EVENT_SIZE)
+    length += snprintf(&scratch[length], MAX_EVENT_SIZE - length, "}}\n\n");
+
+  if(length >= MAX_EVENT_SIZE) {
+    LOG_WARNING("event of file %u too large for stream, skipping", custom_file_content->file_id);
+    return;
+  }
+
+  event_t* event = &events[next_sequence % EVENT_RING_SIZE];
+  memcpy(event->data, scratch, length);
+  event->length = length;
+  event->sequence = next_sequence++;
+}
+
+static void remove_client(event_client_t* event_client) {
+  LOG_INFO("event client left, dropped events: %u", event_client->dropped);
+  event_client->client.stop();
+  event_client->active = false;
+  active_clients--;
+}
+
+// notices are short, a socket that takes only part of one leaves the stream broken
+static bool send_notice(event_client_t* event_client, const char* notice, int length) {
+  return socket_send(event_client->client, (const uint8_t*)notice, length) == length;
+}
+
+void event_stream_handle() {
+  static char dropped_event[48];
+
+  for(uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    event_client_t* event_client = &clients[i];
+    if(!event_client->active)
+      continue;
+    if(!event_client->client.connected()) {
+      remove_client(event_client);
+      continue;
+    }
+    // a browser that does not read is skipped, the loop and the uart must not wait for it
+    if(!socket_writable(event_client->client))
+      continue;
+
+    // drop oldest: skip whatever got overwritten since the last visit
+    if(next_sequence - event_client->next_sequence > EVENT_RING_SIZE) {
+      if(event_client->event_offset) {
+        // the rest of the event it was in the middle of is gone
+        remove_client(event_client);
+        continue;
+      }
+      uint32_t oldest_available = next_sequence - EVENT_RING_SIZE;
+      event_client->dropped += oldest_available - event_client->next_sequence;
+      event_client->next_sequence = oldest_available;
+    }
+
+    if(!event_client->event_offset && event_client->dropped != event_client->reported_dropped) {
+      int length = sprintf(dropped_event, "event: dropped\ndata: {\"dropped\":%u}\n\n", event_client->dropped);
+      if(!send_notice(event_client, dropped_event, length)) {
+        remove_client(event_client);
+        continue;
+      }
+      event_client->reported_dropped = event_client->dropped;
+    }
+
+    // at most one event per client per loop, and only what the socket takes without blocking
+    if(event_client->next_sequence != next_sequence) {
+      event_t* event = &events[event_client->next_sequence % EVENT_RING_SIZE];
+      int sent = socket_send(event_client->client, (const uint8_t*)&event->data[event_client->event_offset], event->length - event_client->event_offset);
+      if(sent < 0) {
+        remove_client(event_client);
+        continue;
+      }
+      event_client->event_offset += sent;
+      if(event_client->event_offset < event->length)
+        continue;
+      event_client->event_offset = 0;
+      event_client->next_sequence++;
+      event_client->last_write = millis();
+    } else if(millis() - event_client->last_write > KEEPALIVE_INTERVAL) {
+      if(!send_notice(event_client, ": keepalive\n\n", 13)) {
+        remove_client(event_client);
+        continue;
+      }
+      event_client->last_write = millis();
+    }
+  }
+}
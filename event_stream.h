@@ -0,0 +1,16 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+#include "structures.h"
+#include <WiFiClient.h>
+
+#define EVENT_STREAM_MAX_CLIENTS 3
+
+void event_stream_init();
+
+bool event_stream_add_client(WiFiClient client);
+
+void event_stream_push(custom_file_contents_t* custom_file_content, publish_object_t* objects, uint8_t amount);
+
+void event_stream_handle();
+
+#endif
@@ -0,0 +1,163 @@
+#include "file_cache.h"
+#include "file_parser.h"
+#include "logger.h"
+
+// images of the most recently updated files, the least recently updated one is replaced when full
+#define FILE_CACHE_ENTRIES 64
+#define FILE_CACHE_PSRAM_ENTRIES 2048
+#define FILE_CACHE_BUCKETS 256
+#define NO_ENTRY 0xFFFF
+
+typedef struct {
+  uint64_t uid;
+  int16_t file_id;
+  uint8_t length;
+  uint64_t known; // bit per byte of the image that was received at least once
+  uint8_t image[FILE_CACHE_MAX_IMAGE];
+  uint16_t hash_next;
+  uint16_t lru_previous;
+  uint16_t lru_next;
+} file_image_t;
+
+static file_image_t* images = NULL;
+static uint16_t buckets[FILE_CACHE_BUCKETS];
+static uint16_t lru_head = NO_ENTRY; // most recently used
+static uint16_t lru_tail = NO_ENTRY;
+static file_cache_statistics_t statistics;
+
+void file_cache_init() {
+  memset(&statistics, 0, sizeof(statistics));
+  for(uint16_t i = 0; i < FILE_CACHE_BUCKETS; i++)
+    buckets[i] = NO_ENTRY;
+  lru_head = NO_ENTRY;
+  lru_tail = NO_ENTRY;
+  free(images);
+  images = NULL;
+
+  if(psramFound())
+    images = (file_image_t*) ps_malloc(FILE_CACHE_PSRAM_ENTRIES * sizeof(file_image_t));
+  if(images) {
+    statistics.capacity = FILE_CACHE_PSRAM_ENTRIES;
+    statistics.psram = true;
+  } else {
+    images = (file_image_t*) malloc(FILE_CACHE_ENTRIES * sizeof(file_image_t));
+    statistics.capacity = images ? FILE_CACHE_ENTRIES : 0;
+  }
+  if(!images)
+    LOG_ERROR("could not allocate file cache, partial updates are dropped");
+}
+
+const file_cache_statistics_t* file_cache_get_statistics() {
+  return &statistics;
+}
+
+static uint16_t bucket_of(uint64_t uid, int16_t file_id) {
+  uint64_t key = uid ^ ((uint64_t) file_id << 56);
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return key & (FILE_CACHE_BUCKETS - 1);
+}
+
+static void lru_unlink(uint16_t index) {
+  file_image_t* entry = &images[index];
+  if(entry->lru_previous != NO_ENTRY)
+    images[entry->lru_previous].lru_next = entry->lru_next;
+  else
+    lru_head = entry->lru_next;
+  if(entry->lru_next != NO_ENTRY)
+    images[entry->lru_next].lru_previous = entry->lru_previous;
+  else
+    lru_tail = entry->lru_previous;
+}
+
+static void lru_push_front(uint16_t index) {
+  images[index].lru_previous = NO_ENTRY;
+  images[index].lru_next = lru_head;
+  if(lru_head != NO_ENTRY)
+    images[lru_head].lru_previous = index;
+  lru_head = index;
+  if(lru_tail == NO_ENTRY)
+    lru_tail = index;
+}
+
+static void hash_unlink(uint16_t index) {
+  uint16_t* link = &buckets[bucket_of(images[index].uid, images[index].file_id)];
+  while(*link != index)
+    link = &images[*link].hash_next;
+  *link = images[index].hash_next;
+}
+
+static uint16_t find(uint64_t uid, int16_t file_id) {
+  for(uint16_t index = buckets[bucket_of(uid, file_id)]; index != NO_ENTRY; index = images[index].hash_next) {
+    if(images[index].uid == uid && images[index].file_id == file_id)
+      return index;
+  }
+  return NO_ENTRY;
+}
+
+static uint16_t insert(uint64_t uid, int16_t file_id) {
+  uint16_t index;
+  if(statistics.entries < statistics.capacity) {
+    index = statistics.entries++;
+  } else {
+    index = lru_tail;
+    lru_unlink(index);
+    hash_unlink(index);
+    statistics.evictions++;
+  }
+
+  memset(&images[index], 0, sizeof(file_image_t));
+  images[index].uid = uid;
+  images[index].file_id = file_id;
+  uint16_t bucket = bucket_of(uid, file_id);
+  images[index].hash_next = buckets[bucket];
+  buckets[bucket] = index;
+  lru_push_front(index);
+  return index;
+}
+
+static uint64_t byte_mask(uint8_t offset, uint8_t length) {
+  uint64_t mask = (length >= 64) ? ~0ULL : ((1ULL << length) - 1);
+  return mask << offset;
+}
+
+/**
+ * @brief merge an update into the cached image of its file and replace it with the full image
+ * @return false when bytes the parser needs were never received, the update is kept in the cache
+ */
+bool file_cache_merge(custom_file_contents_t* custom_file_content) {
+  uint16_t end = custom_file_content->offset + custom_file_content->length;
+  if(!images || end > FILE_CACHE_MAX_IMAGE)
+    return custom_file_content->offset == 0;
+
+  uint16_t index = find(custom_file_content->chip_id, custom_file_content->file_id);
+  if(index == NO_ENTRY) {
+    index = insert(custom_file_content->chip_id, custom_file_content->file_id);
+  } else {
+    lru_unlink(index);
+    lru_push_front(index);
+  }
+
+  file_image_t* entry = &images[index];
+  if(custom_file_content->offset != 0 || custom_file_content->length < entry->length)
+    statistics.merges++;
+  memcpy(&entry->image[custom_file_content->offset], custom_file_content->buffer, custom_file_content->length);
+  entry->known |= byte_mask(custom_file_content->offset, custom_file_content->length);
+  if(end > entry->length)
+    entry->length = end;
+
+  uint8_t required = file_parser_file_size(custom_file_content->file_id);
+  if(required > FILE_CACHE_MAX_IMAGE)
+    required = FILE_CACHE_MAX_IMAGE;
+  uint64_t required_mask = byte_mask(0, required ? required : entry->length);
+  if((entry->known & required_mask) != required_mask) {
+    statistics.incomplete++;
+    return false;
+  }
+
+  memcpy(custom_file_content->buffer, entry->image, entry->length);
+  custom_file_content->offset = 0;
+  custom_file_content->length = entry->length;
+  return true;
+}
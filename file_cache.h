@@ -0,0 +1,23 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+#include "structures.h"
+
+// files larger than this are passed through untouched
+#define FILE_CACHE_MAX_IMAGE 64
+
+typedef struct {
+  uint16_t capacity;
+  uint16_t entries;
+  bool psram;
+  uint32_t merges;     // partial updates merged into a cached image
+  uint32_t incomplete; // updates dropped because the rest of the image was never received
+  uint32_t evictions;
+} file_cache_statistics_t;
+
+void file_cache_init();
+
+bool file_cache_merge(custom_file_contents_t* custom_file_content);
+
+const file_cache_statistics_t* file_cache_get_statistics();
+
+#endif
@@ -1,167 +1,4 @@
 #include "file_parser.h"
-#include <Arduino.h>
-
-#define BUTTON_FILE_ID             51
-#define HUMIDITY_FILE_ID           53
-#define PUSH7_STATE_FILE_ID        56
-#define LIGHT_FILE_ID              57
-#define PIR_FILE_ID                58
-#define HALL_EFFECT_FILE_ID        59
-
-#define BUTTON_CONFIG_FILE_ID      61
-#define HUMIDITY_CONFIG_FILE_ID    63
-#define PUSH7_CONFIG_STATE_FILE_ID 66
-#define LIGHT_CONFIG_FILE_ID       67
-#define PIR_CONFIG_FILE_ID         68
-#define HALL_EFFECT_CONFIG_FILE_ID 69
-
-typedef struct {
-    union {
-        uint8_t bytes[3];
-        struct {
-            uint8_t button_id;
-            bool mask;
-            uint8_t buttons_state;
-        } __attribute__((__packed__));
-    };
-} button_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[4];
-        struct {
-            bool transmit_mask_0;
-            bool transmit_mask_1;
-            bool button_control_menu;
-            bool enabled;
-        } __attribute__((__packed__));
-    };
-} button_config_file_t;
-
-typedef struct
-{
-    union
-    {
-        uint8_t bytes[1];
-        struct
-        {
-            bool mask;
-        } __attribute__((__packed__));
-    };
-} pir_file_t;
-
-typedef struct
-{
-    union
-    {
-        uint8_t bytes[9];
-        struct
-        {
-            bool transmit_mask_0;
-            bool transmit_mask_1;
-            uint8_t filter_source; // PYD1598_FILTER_SOURCE_t
-            uint8_t window_time; // Window time = [RegisterValue] * 2s + 2s
-            uint8_t pulse_counter; // Amount of pulses = [RegisterValue] + 1
-            uint16_t blind_time; // seconds
-            uint8_t threshold;
-            bool enabled;
-        } __attribute__((__packed__));
-    };
-} pir_config_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[8];
-        struct {
-            int32_t humidity;
-            int32_t temperature;
-        } __attribute__((__packed__));
-    };
-} humidity_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[5];
-        struct {
-            uint32_t interval;
-            bool enabled;
-        } __attribute__((__packed__));
-    };
-} humidity_config_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[4];
-        struct {
-            uint16_t battery_voltage;
-            uint8_t hw_version;
-            uint8_t sw_version;
-        } __attribute__((__packed__));
-    };
-} push7_state_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[7];
-        struct {
-            uint32_t interval;
-            bool led_flash_state;
-            bool enabled;
-            uint8_t tx_power;
-        } __attribute__((__packed__));
-    };
-} push7_state_config_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[4];
-        struct {
-            uint32_t light_level;
-            uint16_t light_level_raw;
-            bool threshold_high_triggered;
-            bool threshold_low_triggered;
-        } __attribute__((__packed__));
-    };
-} light_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[8];
-        struct {
-            uint32_t interval;
-            uint8_t integration_time;
-            uint8_t persistence_protect_number;
-            uint8_t gain;
-            uint16_t threshold_high;
-            uint16_t threshold_low;
-            bool light_detection_mode;
-            uint8_t low_power_mode;
-            uint8_t interrupt_check_interval;
-            uint8_t threshold_menu_offset;
-            bool enabled;
-        } __attribute__((__packed__));
-    };
-} light_config_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[1];
-        struct {
-            bool mask;
-        } __attribute__((__packed__));
-    };
-} hall_effect_file_t;
-
-typedef struct {
-    union {
-        uint8_t bytes[3];
-        struct {
-            bool transmit_mask_0;
-            bool transmit_mask_1;
-            bool enabled;
-        } __attribute__((__packed__));
-    };
-} hall_effect_config_file_t;
 
 typedef struct {
   union {
@@ -178,7 +15,6 @@ typedef struct {
     light_config_file_t light_config_file;
     hall_effect_file_t hall_effect_file;
     hall_effect_config_file_t hall_effect_config_file;
-    gateway_status_file_t gateway_status_file;
   };
 } custom_file_t;
 
@@ -188,6 +24,135 @@ void file_parser_init(uint8_t max_size) {
   max_publish_results = max_size;
 }
 
+/**
+ * @brief size of the full image of a file this parser decodes
+ * @return the size in bytes, 0 for files it does not know
+ */
+uint8_t file_parser_file_size(int16_t file_id) {
+  switch(file_id) {
+    case BUTTON_FILE_ID:             return sizeof(button_file_t);
+    case HUMIDITY_FILE_ID:           return sizeof(humidity_file_t);
+    case PUSH7_STATE_FILE_ID:        return sizeof(push7_state_file_t);
+    case LIGHT_FILE_ID:              return sizeof(light_file_t);
+    case PIR_FILE_ID:                return sizeof(pir_file_t);
+    case HALL_EFFECT_FILE_ID:        return sizeof(hall_effect_file_t);
+    case BUTTON_CONFIG_FILE_ID:      return sizeof(button_config_file_t);
+    case HUMIDITY_CONFIG_FILE_ID:    return sizeof(humidity_config_file_t);
+    case PUSH7_CONFIG_STATE_FILE_ID: return sizeof(push7_state_config_file_t);
+    case LIGHT_CONFIG_FILE_ID:       return sizeof(light_config_file_t);
+    case PIR_CONFIG_FILE_ID:         return sizeof(pir_config_file_t);
+    case HALL_EFFECT_CONFIG_FILE_ID: return sizeof(hall_effect_config_file_t);
+  }
+  return 0;
+}
+
+static void field_uint(cbor_writer_t* writer, const char* name, uint32_t value) {
+  cbor_text(writer, name);
+  cbor_uint(writer, value);
+}
+
+static void field_int(cbor_writer_t* writer, const char* name, int32_t value) {
+  cbor_text(writer, name);
+  cbor_int(writer, value);
+}
+
+static void field_bool(cbor_writer_t* writer, const char* name, bool value) {
+  cbor_text(writer, name);
+  cbor_bool(writer, value);
+}
+
+/**
+ * @brief encode the fields of a file as a CBOR map in their raw units, straight from the file image
+ *
+ * Files this parser does not know, or that are incomplete, are encoded as {"raw": bytes}.
+ */
+void file_parser_encode_cbor(custom_file_contents_t* custom_file_contents, cbor_writer_t* writer)
+{
+  custom_file_t* file = (custom_file_t*) custom_file_contents->buffer;
+  uint8_t size = file_parser_file_size(custom_file_contents->file_id);
+  if(!size || custom_file_contents->offset != 0 || custom_file_contents->length < size) {
+    cbor_map(writer, 1);
+    cbor_text(writer, "raw");
+    cbor_bytes(writer, custom_file_contents->buffer, custom_file_contents->length);
+    return;
+  }
+
+  cbor_map_begin(writer);
+  switch(custom_file_contents->file_id) {
+    case BUTTON_FILE_ID:
+      field_uint(writer, "button_id", file->button_file.button_id);
+      field_bool(writer, "mask", file->button_file.mask);
+      field_uint(writer, "buttons_state", file->button_file.buttons_state);
+      break;
+    case HUMIDITY_FILE_ID:
+      field_int(writer, "humidity", file->humidity_file.humidity);
+      field_int(writer, "temperature", file->humidity_file.temperature);
+      break;
+    case PUSH7_STATE_FILE_ID:
+      field_uint(writer, "battery_voltage", file->push7_state_file.battery_voltage);
+      field_uint(writer, "hw_version", file->push7_state_file.hw_version);
+      field_uint(writer, "sw_version", file->push7_state_file.sw_version);
+      break;
+    case LIGHT_FILE_ID:
+      field_uint(writer, "light_level", file->light_file.light_level);
+      field_uint(writer, "light_level_raw", file->light_file.light_level_raw);
+      field_bool(writer, "threshold_high_triggered", file->light_file.threshold_high_triggered);
+      field_bool(writer, "threshold_low_triggered", file->light_file.threshold_low_triggered);
+      break;
+    case PIR_FILE_ID:
+      field_bool(writer, "mask", file->pir_file.mask);
+      break;
+    case HALL_EFFECT_FILE_ID:
+      field_bool(writer, "mask", file->hall_effect_file.mask);
+      break;
+    case BUTTON_CONFIG_FILE_ID:
+      field_bool(writer, "transmit_mask_0", file->button_config_file.transmit_mask_0);
+      field_bool(writer, "transmit_mask_1", file->button_config_file.transmit_mask_1);
+      field_bool(writer, "button_control_menu", file->button_config_file.button_control_menu);
+      field_bool(writer, "enabled", file->button_config_file.enabled);
+      break;
+    case HUMIDITY_CONFIG_FILE_ID:
+      field_uint(writer, "interval", file->humidity_config_file.interval);
+      field_bool(writer, "enabled", file->humidity_config_file.enabled);
+      break;
+    case PUSH7_CONFIG_STATE_FILE_ID:
+      field_uint(writer, "interval", file->push7_state_config_file.interval);
+      field_bool(writer, "led_flash_state", file->push7_state_config_file.led_flash_state);
+      field_bool(writer, "enabled", file->push7_state_config_file.enabled);
+      field_uint(writer, "tx_power", file->push7_state_config_file.tx_power);
+      break;
+    case LIGHT_CONFIG_FILE_ID:
+      field_uint(writer, "interval", file->light_config_file.interval);
+      field_uint(writer, "integration_time", file->light_config_file.integration_time);
+      field_uint(writer, "persistence_protect_number", file->light_config_file.persistence_protect_number);
+      field_uint(writer, "gain", file->light_config_file.gain);
+      field_uint(writer, "threshold_high", file->light_config_file.threshold_high);
+      field_uint(writer, "threshold_low", file->light_config_file.threshold_low);
+      field_bool(writer, "light_detection_mode", file->light_config_file.light_detection_mode);
+      field_uint(writer, "low_power_mode", file->light_config_file.low_power_mode);
+      field_uint(writer, "interrupt_check_interval", file->light_config_file.interrupt_check_interval);
+      field_uint(writer, "threshold_menu_offset", file->light_config_file.threshold_menu_offset);
+      field_bool(writer, "enabled", file->light_config_file.enabled);
+      break;
+    case PIR_CONFIG_FILE_ID:
+      field_bool(writer, "transmit_mask_0", file->pir_config_file.transmit_mask_0);
+      field_bool(writer, "transmit_mask_1", file->pir_config_file.transmit_mask_1);
+      field_uint(writer, "filter_source", file->pir_config_file.filter_source);
+      field_uint(writer, "window_time", file->pir_config_file.window_time);
+      field_uint(writer, "pulse_counter", file->pir_config_file.pulse_counter);
+      field_uint(writer, "blind_time", file->pir_config_file.blind_time);
+      field_uint(writer, "threshold", file->pir_config_file.threshold);
+      field_bool(writer, "enabled", file->pir_config_file.enabled);
+      break;
+    case HALL_EFFECT_CONFIG_FILE_ID:
+      field_bool(writer, "transmit_mask_0", file->hall_effect_config_file.transmit_mask_0);
+      field_bool(writer, "transmit_mask_1", file->hall_effect_config_file.transmit_mask_1);
+      field_bool(writer, "enabled", file->hall_effect_config_file.enabled);
+      break;
+  }
+  cbor_break(writer);
+}
+
 uint8_t parse_custom_files(custom_file_contents_t* custom_file_contents, publish_object_t* results)
 {
   custom_file_t* file = (custom_file_t*) custom_file_contents->buffer;
@@ -759,60 +724,6 @@ uint8_t parse_custom_files(custom_file_contents_t* custom_file_contents, publish
       number_of_publish_objects = 9;
       }
       break;
-    case GATEWAY_STATUS_FILE_ID:
-      {
-      sprintf(results[0].name, "heartbeat counter");
-      sprintf(results[0].object_id, "%s_heartbeat_counter", results[0].uid);
-      sprintf(results[0].component, "sensor");
-      sprintf(results[0].state_class, "measurement");
-      sprintf(results[0].state, "%i", file->gateway_status_file.heartbeat_counter);
-      sprintf(results[0].product, "IOWAY");
-      results[0].default_shown = true;
-
-      sprintf(results[0].sw_version, "0");
-
-      sprintf(results[0].model, "IOWAY_v0");
-
-      sprintf(results[1].uid, "%s", results[0].uid);
-      sprintf(results[1].name, "processed messages");
-      sprintf(results[1].object_id, "%s_processed_messages", results[0].uid);
-      sprintf(results[1].component, "sensor");
-      sprintf(results[1].state_class, "measurement");
-      sprintf(results[1].state, "%i", file->gateway_status_file.processed_messages);
-      sprintf(results[1].product, "IOWAY");
-      results[1].default_shown = true;
-
-      sprintf(results[2].uid, "%s", results[0].uid);
-      sprintf(results[2].name, "DASH7 modem reboots");
-      sprintf(results[2].object_id, "%s_dash7_modem_reboots", results[0].uid);
-      sprintf(results[2].component, "sensor");
-      sprintf(results[2].state_class, "measurement");
-      sprintf(results[2].state, "%i", file->gateway_status_file.dash7_modem_reboot_counter);
-      sprintf(results[2].product, "IOWAY");
-      results[2].default_shown = true;
-
-      sprintf(results[3].uid, "%s", results[0].uid);
-      sprintf(results[3].name, "Status interval");
-      sprintf(results[3].object_id, "%s_status_interval", results[0].uid);
-      sprintf(results[3].component, "sensor");
-      sprintf(results[3].device_class, "duration");
-      sprintf(results[3].category, "diagnostic");
-      sprintf(results[3].unit, "s");
-      sprintf(results[3].state, "%i", file->gateway_status_file.status_interval);
-      sprintf(results[3].product, "IOWAY");
-      results[3].default_shown = true;
-
-      sprintf(results[4].uid, "%s", results[0].uid);
-      sprintf(results[4].name, "rebooted");
-      sprintf(results[4].object_id, "%s_rebooted", results[0].uid);
-      sprintf(results[4].component, "binary_sensor");
-      sprintf(results[4].state, "%s", file->gateway_status_file.rebooted ? "ON" : "OFF");
-      sprintf(results[4].product, "IOWAY");
-      results[4].default_shown = true;
-
-      number_of_publish_objects = 5;
-      }
-      break;
   }
 
   return number_of_publish_objects;
@@ -1,9 +1,11 @@
 #ifndef FILE_PARSER_H
 #define FILE_PARSER_H
-#include <Arduino.h>
 #include "structures.h"
+#include "cbor.h"
 
 void file_parser_init(uint8_t max_size);
 uint8_t parse_custom_files(custom_file_contents_t* custom_file_contents, publish_object_t* results);
+uint8_t file_parser_file_size(int16_t file_id);
+void file_parser_encode_cbor(custom_file_contents_t* custom_file_contents, cbor_writer_t* writer);
 
 #endif
@@ -1,113 +1,271 @@
 #include "filesystem.h"
 #include <EEPROM.h>
+#include "CRC16.h"
 
-#define MAGIC_NUMBER 238
+// layout written by the first firmware versions: magic byte followed by length prefixed fields
+#define LEGACY_MAGIC_NUMBER 238
+
+#define CONFIG_MAGIC 0xD7C0
+#define CONFIG_SCHEMA_VERSION 2
+
+// two slots, the one with a valid crc and the highest sequence number is active
+#define CONFIG_SLOT_SIZE 600
+#define CONFIG_SLOT_COUNT 2
+#define NO_ACTIVE_SLOT 0xFF
+
+// the network cache lives behind the slots, it changes on its own and is not worth a config sequence
+#define NETWORK_CACHE_OFFSET (CONFIG_SLOT_SIZE * CONFIG_SLOT_COUNT)
+#define NETWORK_CACHE_SIZE 32
+#define NETWORK_CACHE_MAGIC 0xD7CA
 
 #define DEFAULT_MQTT_PORT 1883
 
+typedef struct {
+  uint8_t length;
+  char content[MAX_CREDENTIAL_SIZE];
+} __attribute__((__packed__)) config_string_t;
+
+typedef struct {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t flags;
+  uint16_t size; // bytes in use by this record, header included
+  uint16_t crc;  // over the whole record except this field
+  uint32_t sequence;
+} __attribute__((__packed__)) config_header_t;
+
+// schema version 2, new fields are only ever appended
+typedef struct {
+  config_header_t header;
+  config_string_t wifi_ssid;
+  config_string_t wifi_password;
+  config_string_t mqtt_broker;
+  config_string_t mqtt_user;
+  config_string_t mqtt_password;
+  uint32_t mqtt_port;
+  // added in version 2
+  uint8_t output_mode;
+  char compact_topic_prefix[MAX_TOPIC_PREFIX_SIZE]; // null terminated, a full config string would not fit the slot
+} __attribute__((__packed__)) config_record_t;
+
+static_assert(sizeof(config_record_t) <= CONFIG_SLOT_SIZE, "config record does not fit in a slot");
+
+typedef struct {
+  uint16_t magic;
+  uint16_t crc;
+  network_cache_t cache;
+} __attribute__((__packed__)) network_cache_record_t;
+
+static_assert(sizeof(network_cache_record_t) <= NETWORK_CACHE_SIZE, "network cache does not fit");
+
+static CRC16 crc_tool;
+static config_record_t active_record;
+static uint8_t active_slot = NO_ACTIVE_SLOT;
+static int filesystem_size;
+static network_cache_t network_cache;
+
+// fields older records do not have get these values
+static void set_defaults(config_record_t* record) {
+  memset(record, 0, sizeof(config_record_t));
+  record->mqtt_port = DEFAULT_MQTT_PORT;
+  record->output_mode = OUTPUT_MODE_HOME_ASSISTANT;
+}
+
+static uint16_t record_crc(const uint8_t* record, uint16_t size) {
+  crc_tool.restart();
+  crc_tool.add(record, offsetof(config_header_t, crc));
+  crc_tool.add(record + offsetof(config_header_t, sequence), size - offsetof(config_header_t, sequence));
+  return crc_tool.getCRC();
+}
+
+/**
+ * @brief load a slot into the record, validating header, crc and field bounds
+ * @return true if the slot holds a usable record
+ */
+static bool load_slot(uint8_t slot, config_record_t* record) {
+  static uint8_t raw[CONFIG_SLOT_SIZE];
+  EEPROM.readBytes(slot * CONFIG_SLOT_SIZE, raw, CONFIG_SLOT_SIZE);
+
+  config_header_t* header = (config_header_t*) raw;
+  if(header->magic != CONFIG_MAGIC || header->version == 0)
+    return false;
+  if(header->size < sizeof(config_header_t) || header->size > CONFIG_SLOT_SIZE)
+    return false;
+  if(record_crc(raw, header->size) != header->crc)
+    return false;
+
+  // records written by newer firmware keep the fields we know at the same place, older ones get defaults
+  set_defaults(record);
+  memcpy(record, raw, min((size_t)header->size, sizeof(config_record_t)));
+
+  config_string_t* strings[] = { &record->wifi_ssid, &record->wifi_password, &record->mqtt_broker, &record->mqtt_user, &record->mqtt_password };
+  for(uint8_t i = 0; i < 5; i++) {
+    if(strings[i]->length >= MAX_CREDENTIAL_SIZE)
+      return false;
+  }
+  record->compact_topic_prefix[MAX_TOPIC_PREFIX_SIZE - 1] = 0;
+  return true;
+}
+
+static bool read_legacy_string(int* offset, config_string_t* string) {
+  uint8_t length = EEPROM.read((*offset)++);
+  if(length >= MAX_CREDENTIAL_SIZE || *offset + length > filesystem_size)
+    return false;
+  string->length = length;
+  for(uint8_t i = 0; i < length; i++)
+    string->content[i] = EEPROM.read((*offset)++);
+  return true;
+}
+
+static bool load_legacy(config_record_t* record) {
+  if(EEPROM.read(0) != LEGACY_MAGIC_NUMBER)
+    return false;
+
+  set_defaults(record);
+  int offset = 1;
+  if(!read_legacy_string(&offset, &record->wifi_ssid) || !read_legacy_string(&offset, &record->wifi_password) ||
+     !read_legacy_string(&offset, &record->mqtt_broker) || !read_legacy_string(&offset, &record->mqtt_user) ||
+     !read_legacy_string(&offset, &record->mqtt_password))
+    return false;
+
+  uint8_t mqtt_port_length = EEPROM.read(offset++);
+  if(mqtt_port_length != sizeof(uint32_t))
+    return false;
+  EEPROM.readBytes(offset, &record->mqtt_port, sizeof(uint32_t));
+  return true;
+}
+
+static void copy_to_persisted(config_string_t* source, char_length_t destination) {
+  *destination.length = source->length;
+  memcpy(destination.content, source->content, source->length);
+  destination.content[source->length] = 0;
+}
+
+static void copy_from_persisted(char_length_t source, config_string_t* destination) {
+  uint8_t length = constrain(*source.length, 0, MAX_CREDENTIAL_SIZE - 1);
+  destination->length = length;
+  memcpy(destination->content, source.content, length);
+}
+
 void filesystem_init(int size) {
+  filesystem_size = size;
+  if(size < CONFIG_SLOT_SIZE * CONFIG_SLOT_COUNT)
+    DPRINTLN("ERROR - filesystem too small for two config slots");
   EEPROM.begin(size);
+
+  crc_tool.setPolynome(0x1021);
+  crc_tool.setStartXOR(0xFFFF);
+
+  network_cache_record_t record;
+  memset(&network_cache, 0, sizeof(network_cache));
+  if(size < NETWORK_CACHE_OFFSET + NETWORK_CACHE_SIZE)
+    return;
+  EEPROM.readBytes(NETWORK_CACHE_OFFSET, &record, sizeof(record));
+  crc_tool.restart();
+  crc_tool.add((uint8_t*)&record.cache, sizeof(network_cache_t));
+  if(record.magic == NETWORK_CACHE_MAGIC && record.crc == crc_tool.getCRC())
+    network_cache = record.cache;
 }
 
-void filesystem_read(persisted_data_t data) {
-  int offset = 0;
-  if(EEPROM.read(offset) != MAGIC_NUMBER) {
-    DPRINTLN("first byte is not magic number, broadcasting for credentials");
-    *data.wifi_ssid.length = 0;
-    *data.wifi_password.length = 0;
-    *data.mqtt_broker.length = 0;
-    *data.mqtt_user.length = 0;
-    *data.mqtt_password.length = 0;
-    *data.mqtt_port = DEFAULT_MQTT_PORT;
+bool filesystem_read_network_cache(network_cache_t* cache) {
+  *cache = network_cache;
+  return network_cache.channel || network_cache.broker_ip;
+}
+
+void filesystem_write_network_cache(const network_cache_t* cache) {
+  if(filesystem_size < NETWORK_CACHE_OFFSET + NETWORK_CACHE_SIZE || !memcmp(cache, &network_cache, sizeof(network_cache_t)))
     return;
-  }
-  offset += 1;
 
-  *data.wifi_ssid.length = EEPROM.read(offset);
-  offset += 1;
-  for(int i = 0; i < *data.wifi_ssid.length; i++) {
-    data.wifi_ssid.content[i] = EEPROM.read(offset);
-    offset += 1;
+  network_cache_record_t record;
+  record.magic = NETWORK_CACHE_MAGIC;
+  record.cache = *cache;
+  crc_tool.restart();
+  crc_tool.add((uint8_t*)&record.cache, sizeof(network_cache_t));
+  record.crc = crc_tool.getCRC();
+  EEPROM.writeBytes(NETWORK_CACHE_OFFSET, &record, sizeof(record));
+  if(!EEPROM.commit()) {
+    DPRINTLN("ERROR - network cache commit failed");
+    return;
   }
+  network_cache = *cache;
+}
 
-  *data.wifi_password.length = EEPROM.read(offset);
-  offset += 1;
-  for(int i = 0; i < *data.wifi_password.length; i++) {
-    data.wifi_password.content[i] = EEPROM.read(offset);
-    offset += 1;
-  }
+void filesystem_read(persisted_data_t data) {
+  static config_record_t candidate;
+  unsigned long start = micros();
 
-  *data.mqtt_broker.length = EEPROM.read(offset);
-  offset += 1;
-  for(int i = 0; i < *data.mqtt_broker.length; i++) {
-    data.mqtt_broker.content[i] = EEPROM.read(offset);
-    offset += 1;
+  active_slot = NO_ACTIVE_SLOT;
+  for(uint8_t slot = 0; slot < CONFIG_SLOT_COUNT; slot++) {
+    if(!load_slot(slot, &candidate))
+      continue;
+    if(active_slot == NO_ACTIVE_SLOT || (int32_t)(candidate.header.sequence - active_record.header.sequence) > 0) {
+      active_record = candidate;
+      active_slot = slot;
+    }
   }
 
-  *data.mqtt_user.length = EEPROM.read(offset);
-  offset += 1;
-  for(int i = 0; i < *data.mqtt_user.length; i++) {
-    data.mqtt_user.content[i] = EEPROM.read(offset);
-    offset += 1;
+  if(active_slot == NO_ACTIVE_SLOT) {
+    if(load_legacy(&active_record)) {
+      DPRINTLN("upgrading legacy configuration");
+    } else {
+      DPRINTLN("no valid configuration, broadcasting for credentials");
+      set_defaults(&active_record);
+    }
   }
 
-  *data.mqtt_password.length = EEPROM.read(offset);
-  offset += 1;
-  for(int i = 0; i < *data.mqtt_password.length; i++) {
-    data.mqtt_password.content[i] = EEPROM.read(offset);
-    offset += 1;
-  }
+  copy_to_persisted(&active_record.wifi_ssid, data.wifi_ssid);
+  copy_to_persisted(&active_record.wifi_password, data.wifi_password);
+  copy_to_persisted(&active_record.mqtt_broker, data.mqtt_broker);
+  copy_to_persisted(&active_record.mqtt_user, data.mqtt_user);
+  copy_to_persisted(&active_record.mqtt_password, data.mqtt_password);
+  *data.mqtt_port = active_record.mqtt_port;
+  *data.output_mode = active_record.output_mode;
+  *data.compact_topic_prefix.length = strlen(active_record.compact_topic_prefix);
+  strcpy(data.compact_topic_prefix.content, active_record.compact_topic_prefix);
 
-  uint8_t mqtt_port_length = EEPROM.read(offset);
-  offset += 1;
-  for(int i = 0; i < mqtt_port_length; i++) {
-    uint8_t* mqtt_port_ptr = (uint8_t*) data.mqtt_port;
-    mqtt_port_ptr[i] = EEPROM.read(offset);
-    offset += 1;
-  }
+  DPRINT("configuration loaded in ");
+  DPRINT(micros() - start);
+  DPRINTLN(" us");
 }
 
 void filesystem_write(persisted_data_t data) {
-  int offset = 0;
-  EEPROM.write(offset, MAGIC_NUMBER);
-  offset += 1;
-  EEPROM.write(offset, *data.wifi_ssid.length);
-  offset += 1;
-  for(int i = 0; i < *data.wifi_ssid.length; i++) {
-    EEPROM.write(offset, data.wifi_ssid.content[i]);
-    offset += 1;
-  }
-  EEPROM.write(offset, *data.wifi_password.length);
-  offset += 1;
-  for(int i = 0; i < *data.wifi_password.length; i++) {
-    EEPROM.write(offset, data.wifi_password.content[i]);
-    offset += 1;
-  }
-  EEPROM.write(offset, *data.mqtt_broker.length);
-  offset += 1;
-  for(int i = 0; i < *data.mqtt_broker.length; i++) {
-    EEPROM.write(offset, data.mqtt_broker.content[i]);
-    offset += 1;
-  }
-  EEPROM.write(offset, *data.mqtt_user.length);
-  offset += 1;
-  for(int i = 0; i < *data.mqtt_user.length; i++) {
-    EEPROM.write(offset, data.mqtt_user.content[i]);
-    offset += 1;
-  }
-  EEPROM.write(offset, *data.mqtt_password.length);
-  offset += 1;
-  for(int i = 0; i < *data.mqtt_password.length; i++) {
-    EEPROM.write(offset, data.mqtt_password.content[i]);
-    offset += 1;
+  static config_record_t record;
+  unsigned long start = micros();
+
+  memset(&record, 0, sizeof(config_record_t));
+  copy_from_persisted(data.wifi_ssid, &record.wifi_ssid);
+  copy_from_persisted(data.wifi_password, &record.wifi_password);
+  copy_from_persisted(data.mqtt_broker, &record.mqtt_broker);
+  copy_from_persisted(data.mqtt_user, &record.mqtt_user);
+  copy_from_persisted(data.mqtt_password, &record.mqtt_password);
+  record.mqtt_port = *data.mqtt_port;
+  record.output_mode = *data.output_mode;
+  strncpy(record.compact_topic_prefix, data.compact_topic_prefix.content, min(*data.compact_topic_prefix.length, MAX_TOPIC_PREFIX_SIZE - 1));
+
+  if(active_slot != NO_ACTIVE_SLOT && active_record.header.version == CONFIG_SCHEMA_VERSION &&
+     !memcmp(((uint8_t*)&record) + sizeof(config_header_t), ((uint8_t*)&active_record) + sizeof(config_header_t), sizeof(config_record_t) - sizeof(config_header_t))) {
+    DPRINTLN("configuration unchanged, skipping commit");
+    return;
   }
-  uint8_t mqtt_port_length = 4;
-  EEPROM.write(offset, mqtt_port_length);
-  offset += 1;
-  for(int i = 0; i < mqtt_port_length; i++) {
-    uint8_t* port_buf = (uint8_t*) data.mqtt_port;
-    EEPROM.write(offset, port_buf[i]);
-    offset += 1;
+
+  record.header.magic = CONFIG_MAGIC;
+  record.header.version = CONFIG_SCHEMA_VERSION;
+  record.header.size = sizeof(config_record_t);
+  record.header.sequence = (active_slot == NO_ACTIVE_SLOT) ? 1 : active_record.header.sequence + 1;
+  record.header.crc = record_crc((uint8_t*)&record, sizeof(config_record_t));
+
+  // never overwrite the active slot, without one slot 1 is used so a legacy layout at 0 survives until the commit
+  uint8_t target_slot = (active_slot == NO_ACTIVE_SLOT) ? 1 : (active_slot + 1) % CONFIG_SLOT_COUNT;
+  EEPROM.writeBytes(target_slot * CONFIG_SLOT_SIZE, &record, sizeof(config_record_t));
+  if(!EEPROM.commit()) {
+    DPRINTLN("ERROR - configuration commit failed");
+    return;
   }
-  EEPROM.commit();
+
+  active_record = record;
+  active_slot = target_slot;
+
+  DPRINT("configuration committed in ");
+  DPRINT(micros() - start);
+  DPRINTLN(" us");
 }
@@ -5,5 +5,7 @@
 void filesystem_init(int size);
 void filesystem_read(persisted_data_t data);
 void filesystem_write(persisted_data_t data);
+bool filesystem_read_network_cache(network_cache_t* cache);
+void filesystem_write_network_cache(const network_cache_t* cache);
 
 #endif
@@ -0,0 +1,405 @@
+#include "frame_capture.h"
+#include <LittleFS.h>
+#include <esp_timer.h>
+#include "socket_send.h"
+#include "logger.h"
+
+// frames are stored back to back in a byte ring, an index ring keeps where each one starts.
+// A frame never wraps around the end of the buffer, the unused tail is skipped instead.
+#define CAPTURE_BUFFER_SIZE 8192
+#define CAPTURE_MAX_RECORDS 128
+#define CAPTURE_MAX_FRAME (8 + 255)
+
+// bytes sent to a download client per loop, only as much as its socket takes without blocking
+#define DOWNLOAD_BUDGET 1024
+
+#define SPILL_FILE "/capture.bin"
+#define SPILL_OLD_FILE "/capture.1.bin"
+#define SPILL_MAX_SIZE 131072
+#define SPILL_BATCH_RECORDS 16
+#define SPILL_INTERVAL 2000
+
+// flash writes can take tens of milliseconds, they run in a task of their own instead of the main loop
+#define SPILL_TASK_STACK 4096
+#define SPILL_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define SPILL_TASK_INTERVAL_MS 100
+
+#define RAW_RECORD_HEADER_SIZE 11
+#define PCAP_RECORD_HEADER_SIZE 16
+#define SPILL_BUFFER_SIZE (SPILL_BATCH_RECORDS * (RAW_RECORD_HEADER_SIZE + CAPTURE_MAX_FRAME))
+// a record, or the http and pcap headers that start a download
+#define DOWNLOAD_BUFFER_SIZE (PCAP_RECORD_HEADER_SIZE + 1 + CAPTURE_MAX_FRAME)
+
+typedef struct {
+  int64_t timestamp;
+  uint16_t offset;
+  uint16_t length;
+  uint8_t flags;
+} capture_entry_t;
+
+typedef struct {
+  WiFiClient client;
+  bool active;
+  capture_format_t format;
+  uint32_t next_sequence;
+  uint32_t end_sequence;
+  File file;
+  uint8_t file_index;
+  // the piece the socket has not fully taken yet, kept until it has
+  uint8_t buffer[DOWNLOAD_BUFFER_SIZE];
+  uint16_t length;
+  uint16_t offset;
+} capture_download_t;
+
+static uint8_t* ring = NULL;
+static capture_entry_t entries[CAPTURE_MAX_RECORDS];
+static uint16_t write_offset = 0;
+static uint32_t oldest_sequence = 0;
+static uint32_t next_sequence = 0;
+
+static uint32_t spill_sequence = 0;
+static unsigned long last_spill = 0;
+static bool filesystem_mounted = false;
+
+// the main loop copies a batch of records here, the spill task owns the buffer until it sets the size back to 0
+static uint8_t* spill_buffer = NULL;
+static volatile uint16_t spill_buffer_size = 0;
+static volatile uint8_t spill_buffer_records = 0;
+static bool spill_task_started = false;
+static portMUX_TYPE spill_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static capture_download_t download;
+static frame_capture_statistics_t statistics;
+
+static uint8_t record_buffer[PCAP_RECORD_HEADER_SIZE + 1 + CAPTURE_MAX_FRAME];
+
+static const char* spill_files[] = { SPILL_OLD_FILE, SPILL_FILE };
+
+static const char download_header[] = "HTTP/1.1 200 OK\r\n" \
+  "Content-Type: application/octet-stream\r\n" \
+  "Content-Disposition: attachment; filename=\"capture.%s\"\r\n" \
+  "Cache-Control: no-store\r\n" \
+  "Connection: close\r\n\r\n";
+
+void frame_capture_init() {
+  download.active = false;
+  write_offset = 0;
+  oldest_sequence = 0;
+  next_sequence = 0;
+  spill_sequence = 0;
+  memset(&statistics, 0, sizeof(statistics));
+}
+
+/**
+ * @brief enable or disable capturing, the ring is only allocated the first time capture is enabled
+ */
+bool frame_capture_enable(bool enable) {
+  if(enable && !ring) {
+    ring = (uint8_t*) malloc(CAPTURE_BUFFER_SIZE);
+    if(!ring) {
+      LOG_ERROR("could not allocate %u bytes for frame capture", CAPTURE_BUFFER_SIZE);
+      return false;
+    }
+  }
+  statistics.enabled = enable;
+  return true;
+}
+
+static void spill_task(void* parameters);
+
+bool frame_capture_spill(bool enable) {
+  if(enable && !filesystem_mounted) {
+    filesystem_mounted = LittleFS.begin(true);
+    if(!filesystem_mounted) {
+      LOG_ERROR("could not mount filesystem for capture spill");
+      return false;
+    }
+  }
+  if(enable && !spill_buffer) {
+    spill_buffer = (uint8_t*) malloc(SPILL_BUFFER_SIZE);
+    if(!spill_buffer) {
+      LOG_ERROR("could not allocate %u bytes for capture spill", SPILL_BUFFER_SIZE);
+      return false;
+    }
+  }
+  if(enable && !spill_task_started)
+    spill_task_started = xTaskCreatePinnedToCore(spill_task, "capture spill", SPILL_TASK_STACK, NULL, SPILL_TASK_PRIORITY, NULL, 0) == pdPASS;
+  // only frames captured from now on are spilled
+  spill_sequence = next_sequence;
+  last_spill = millis();
+  statistics.spilling = enable;
+  return true;
+}
+
+const frame_capture_statistics_t* frame_capture_get_statistics() {
+  statistics.buffered = next_sequence - oldest_sequence;
+  return &statistics;
+}
+
+static capture_entry_t* entry(uint32_t sequence) {
+  return &entries[sequence % CAPTURE_MAX_RECORDS];
+}
+
+// drop the oldest frames for as long as they occupy the range about to be written
+static void evict_range(uint16_t start, uint16_t length) {
+  while(oldest_sequence != next_sequence) {
+    capture_entry_t* oldest = entry(oldest_sequence);
+    if(oldest->offset >= start + length || start >= oldest->offset + oldest->length)
+      return;
+    oldest_sequence++;
+    statistics.overwritten++;
+  }
+}
+
+void frame_capture_record(uint8_t modem, const uint8_t* header, uint8_t header_length, const uint8_t* payload, uint8_t payload_length, bool crc_ok) {
+  if(!statistics.enabled)
+    return;
+
+  uint16_t length = header_length + payload_length;
+  if(length > CAPTURE_MAX_FRAME)
+    return;
+  if(write_offset + length > CAPTURE_BUFFER_SIZE) {
+    evict_range(write_offset, CAPTURE_BUFFER_SIZE - write_offset);
+    write_offset = 0;
+  }
+  evict_range(write_offset, length);
+  if(next_sequence - oldest_sequence == CAPTURE_MAX_RECORDS) {
+    oldest_sequence++;
+    statistics.overwritten++;
+  }
+
+  capture_entry_t* new_entry = entry(next_sequence);
+  new_entry->timestamp = esp_timer_get_time();
+  new_entry->offset = write_offset;
+  new_entry->length = length;
+  new_entry->flags = (crc_ok ? FRAME_CAPTURE_FLAG_CRC_OK : 0) | ((modem << FRAME_CAPTURE_MODEM_SHIFT) & FRAME_CAPTURE_MODEM_MASK);
+  memcpy(&ring[write_offset], header, header_length);
+  memcpy(&ring[write_offset + header_length], payload, payload_length);
+
+  write_offset += length;
+  next_sequence++;
+  statistics.frames++;
+}
+
+static void put_le(uint8_t* destination, uint64_t value, uint8_t size) {
+  for(uint8_t i = 0; i < size; i++)
+    destination[i] = (value >> (8 * i)) & 0xFF;
+}
+
+/**
+ * @brief serialize a captured frame with the record header of the given format into record_buffer
+ * @return the amount of bytes in record_buffer
+ */
+static uint16_t serialize(capture_entry_t* captured, capture_format_t format) {
+  uint16_t index = 0;
+  if(format == CAPTURE_FORMAT_PCAP) {
+    // the packet starts with the flags byte so a dissector can tell frames with a bad crc apart
+    put_le(&record_buffer[index], captured->timestamp / 1000000, 4);
+    put_le(&record_buffer[index + 4], captured->timestamp % 1000000, 4);
+    put_le(&record_buffer[index + 8], captured->length + 1, 4);
+    put_le(&record_buffer[index + 12], captured->length + 1, 4);
+    index += PCAP_RECORD_HEADER_SIZE;
+    record_buffer[index++] = captured->flags;
+  } else {
+    put_le(&record_buffer[index], captured->timestamp, 8);
+    record_buffer[index + 8] = captured->flags;
+    put_le(&record_buffer[index + 9], captured->length, 2);
+    index += RAW_RECORD_HEADER_SIZE;
+  }
+  memcpy(&record_buffer[index], &ring[captured->offset], captured->length);
+  return index + captured->length;
+}
+
+static void spill_task(void* parameters) {
+  for(;;) {
+    vTaskDelay(pdMS_TO_TICKS(SPILL_TASK_INTERVAL_MS));
+    portENTER_CRITICAL(&spill_lock);
+    uint16_t size = spill_buffer_size;
+    uint8_t records = spill_buffer_records;
+    portEXIT_CRITICAL(&spill_lock);
+    if(!size)
+      continue;
+
+    File file = LittleFS.open(SPILL_FILE, FILE_APPEND);
+    bool written = file;
+    if(written) {
+      file.write(spill_buffer, size);
+      bool full = file.size() > SPILL_MAX_SIZE;
+      file.close();
+      if(full) {
+        LittleFS.remove(SPILL_OLD_FILE);
+        LittleFS.rename(SPILL_FILE, SPILL_OLD_FILE);
+      }
+    } else {
+      LOG_ERROR("could not open capture spill file");
+      statistics.spilling = false;
+    }
+
+    portENTER_CRITICAL(&spill_lock);
+    if(written)
+      statistics.spilled += records;
+    else
+      statistics.spill_dropped += records;
+    spill_buffer_size = 0;
+    portEXIT_CRITICAL(&spill_lock);
+  }
+}
+
+// hand the next batch of records to the spill task, frames captured while it still writes the previous batch wait in the ring
+static void spill() {
+  uint32_t pending = next_sequence - spill_sequence;
+  if(!pending || (pending < SPILL_BATCH_RECORDS && millis() - last_spill < SPILL_INTERVAL))
+    return;
+  portENTER_CRITICAL(&spill_lock);
+  bool busy = spill_buffer_size;
+  portEXIT_CRITICAL(&spill_lock);
+  // the spilled files are not written while a download reads them
+  if(busy || (download.active && download.format == CAPTURE_FORMAT_SPILL))
+    return;
+  last_spill = millis();
+
+  if(spill_sequence - oldest_sequence > next_sequence - oldest_sequence) {
+    statistics.spill_dropped += oldest_sequence - spill_sequence;
+    spill_sequence = oldest_sequence;
+  }
+
+  uint16_t size = 0;
+  uint8_t records = 0;
+  while(records < SPILL_BATCH_RECORDS && spill_sequence != next_sequence) {
+    uint16_t length = serialize(entry(spill_sequence++), CAPTURE_FORMAT_RAW);
+    memcpy(&spill_buffer[size], record_buffer, length);
+    size += length;
+    records++;
+  }
+
+  portENTER_CRITICAL(&spill_lock);
+  spill_buffer_records = records;
+  spill_buffer_size = size;
+  portEXIT_CRITICAL(&spill_lock);
+}
+
+// false when the connection failed, a socket that is full keeps the rest of the piece for the next loop
+static bool send_pending() {
+  int sent = socket_send(download.client, &download.buffer[download.offset], download.length - download.offset);
+  if(sent < 0)
+    return false;
+  download.offset += sent;
+  return true;
+}
+
+bool frame_capture_download(WiFiClient client, capture_format_t format) {
+  if(download.active)
+    return false;
+  if(format == CAPTURE_FORMAT_SPILL) {
+    if(!filesystem_mounted && !(filesystem_mounted = LittleFS.begin(true)))
+      return false;
+    // the spill task may still append to or rotate the files it would read
+    portENTER_CRITICAL(&spill_lock);
+    bool busy = spill_buffer_size;
+    portEXIT_CRITICAL(&spill_lock);
+    if(busy)
+      return false;
+  }
+
+  download.client = client;
+  download.active = true;
+  download.format = format;
+  download.next_sequence = oldest_sequence;
+  download.end_sequence = next_sequence;
+  download.file_index = 0;
+
+  download.offset = 0;
+  download.length = snprintf((char*)download.buffer, sizeof(download.buffer), download_header, format == CAPTURE_FORMAT_PCAP ? "pcap" : "bin");
+  if(format == CAPTURE_FORMAT_PCAP) {
+    uint8_t* global_header = &download.buffer[download.length];
+    put_le(&global_header[0], 0xA1B2C3D4, 4); // microsecond timestamps, relative to boot
+    put_le(&global_header[4], 2, 2);
+    put_le(&global_header[6], 4, 2);
+    put_le(&global_header[8], 0, 8);
+    put_le(&global_header[16], 65535, 4);
+    put_le(&global_header[20], FRAME_CAPTURE_PCAP_LINKTYPE, 4);
+    download.length += 24;
+  }
+  send_pending();
+  return true;
+}
+
+static void finish_download() {
+  if(download.file)
+    download.file.close();
+  download.client.stop();
+  download.active = false;
+}
+
+// the next piece of the spilled files, false once both are sent
+static bool next_spilled() {
+  while(download.file_index < 2) {
+    if(!download.file) {
+      download.file = LittleFS.open(spill_files[download.file_index], FILE_READ);
+      if(!download.file) {
+        download.file_index++;
+        continue;
+      }
+    }
+    size_t length = download.file.read(download.buffer, sizeof(download.buffer));
+    if(length) {
+      download.length = length;
+      download.offset = 0;
+      return true;
+    }
+    download.file.close();
+    download.file_index++;
+  }
+  return false;
+}
+
+// the next captured record, false when there is none left to send
+static bool next_captured() {
+  // capture went on while the download ran, once every frame up to its end is overwritten there is nothing left to send
+  if(download.end_sequence - oldest_sequence > next_sequence - oldest_sequence)
+    return false;
+  // frames overwritten while the download is running are skipped
+  if(download.next_sequence - oldest_sequence > next_sequence - oldest_sequence)
+    download.next_sequence = oldest_sequence;
+  if(download.next_sequence == download.end_sequence)
+    return false;
+
+  download.length = serialize(entry(download.next_sequence++), download.format);
+  download.offset = 0;
+  memcpy(download.buffer, record_buffer, download.length);
+  return true;
+}
+
+void frame_capture_handle() {
+  if(statistics.spilling)
+    spill();
+
+  if(!download.active)
+    return;
+  if(!download.client.connected()) {
+    finish_download();
+    return;
+  }
+  // a client that does not read is left alone, the loop never waits for it
+  if(!socket_writable(download.client))
+    return;
+
+  uint16_t sent = 0;
+  while(sent < DOWNLOAD_BUDGET) {
+    if(download.offset == download.length) {
+      bool more = (download.format == CAPTURE_FORMAT_SPILL) ? next_spilled() : next_captured();
+      if(!more) {
+        finish_download();
+        return;
+      }
+    }
+    uint16_t offset = download.offset;
+    if(!send_pending()) {
+      finish_download();
+      return;
+    }
+    sent += download.offset - offset;
+    if(download.offset < download.length)
+      return;
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+#include "structures.h"
+#include <WiFiClient.h>
+
+#define FRAME_CAPTURE_FLAG_CRC_OK 0x01
+// the modem the frame was received on
+#define FRAME_CAPTURE_MODEM_SHIFT 1
+#define FRAME_CAPTURE_MODEM_MASK  0x06
+
+// pcap link type reserved for private use, the packet data is the flags byte, the modem header and the payload
+#define FRAME_CAPTURE_PCAP_LINKTYPE 147
+
+typedef enum {
+  CAPTURE_FORMAT_PCAP,
+  CAPTURE_FORMAT_RAW,   // records of timestamp (us, u64 le), flags (u8), length (u16 le), modem header and payload
+  CAPTURE_FORMAT_SPILL, // the records spilled to flash, same layout as raw
+} capture_format_t;
+
+typedef struct {
+  bool enabled;
+  bool spilling;
+  uint32_t frames;
+  uint32_t overwritten;
+  uint32_t spilled;
+  uint32_t spill_dropped;
+  uint16_t buffered;
+} frame_capture_statistics_t;
+
+void frame_capture_init();
+
+bool frame_capture_enable(bool enable);
+
+bool frame_capture_spill(bool enable);
+
+void frame_capture_record(uint8_t modem, const uint8_t* header, uint8_t header_length, const uint8_t* payload, uint8_t payload_length, bool crc_ok);
+
+bool frame_capture_download(WiFiClient client, capture_format_t format);
+
+void frame_capture_handle();
+
+const frame_capture_statistics_t* frame_capture_get_statistics();
+
+#endif
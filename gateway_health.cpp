@@ -0,0 +1,123 @@
+#include "gateway_health.h"
+#include "serial_interface.h"
+#include "mqtt_interface.h"
+#include "histogram.h"
+#include "uplink_dedup.h"
+#include "publish_scheduler.h"
+#include <esp_timer.h>
+
+#define MAX_HEALTH_JSON_SIZE 512
+
+typedef struct {
+  const char* key;
+  const char* name;
+  const char* unit;
+  const char* device_class;
+  const char* state_class;
+  const char* icon;
+} health_entity_t;
+
+static const health_entity_t entities[] = {
+  { "uptime",           "uptime",               "s",  "duration",  "total_increasing", "" },
+  { "processed",        "processed messages",   "",   "",          "total_increasing", "mdi:email-check" },
+  { "frames",           "modem frames",         "",   "",          "total_increasing", "mdi:serial-port" },
+  { "crc_errors",       "modem crc errors",     "",   "",          "total_increasing", "mdi:alert-circle" },
+  { "dropped_frames",   "dropped modem frames", "",   "",          "total_increasing", "mdi:alert-circle" },
+  { "duplicates",       "duplicate uplinks",    "",   "",          "total_increasing", "mdi:content-copy" },
+  { "ring_high_water",  "serial ring high water", "B", "data_size", "measurement",     "" },
+  { "modem_reboots",    "DASH7 modem reboots",  "",   "",          "total_increasing", "mdi:restart" },
+  { "publish_failures", "publish failures",     "",   "",          "total_increasing", "mdi:alert-circle" },
+  { "publish_dropped",  "dropped publishes",    "",   "",          "total_increasing", "mdi:alert-circle" },
+  { "reconnects",       "mqtt reconnects",      "",   "",          "total_increasing", "mdi:lan-connect" },
+  { "heap",             "free heap",            "B",  "data_size", "measurement",      "" },
+  { "min_heap",         "minimum free heap",    "B",  "data_size", "measurement",      "" },
+  { "loop_p99",         "loop time p99",        "us", "duration",  "measurement",      "" },
+};
+
+#define NUMBER_OF_ENTITIES (sizeof(entities) / sizeof(entities[0]))
+
+static char uid_string[17];
+static char health_topic[40];
+static char value_templates[NUMBER_OF_ENTITIES][40];
+static uint16_t status_interval;
+
+static uint32_t processed_messages = 0;
+static uint32_t modem_reboots = 0;
+static uint32_t announced_connects = 0;
+
+// loop times are collected per interval, so the p99 reflects the last interval only
+static histogram_t loop_times;
+
+void gateway_health_init(const char* gateway_id, uint16_t interval) {
+  uint64_t chip_id = ESP.getEfuseMac();
+  uint8_t* uid = (uint8_t*) &chip_id;
+  sprintf(uid_string, "%02X%02X%02X%02X%02X%02X%02X%02X", uid[0], uid[1], uid[2], uid[3], uid[4], uid[5], uid[6], uid[7]);
+  sprintf(health_topic, "d7/health/%s", gateway_id);
+  for(uint8_t i = 0; i < NUMBER_OF_ENTITIES; i++)
+    sprintf(value_templates[i], "{{ value_json.%s }}", entities[i].key);
+
+  status_interval = interval;
+  histogram_reset(&loop_times);
+}
+
+void gateway_health_processed(uint8_t amount) {
+  processed_messages += amount;
+}
+
+void gateway_health_modem_rebooted() {
+  modem_reboots++;
+}
+
+void gateway_health_loop_time(uint32_t duration_us) {
+  histogram_record(&loop_times, duration_us);
+}
+
+// discovery is sent once per mqtt connection, all entities read from the one health document
+static void announce_entities() {
+  static publish_object_t object;
+
+  for(uint8_t i = 0; i < NUMBER_OF_ENTITIES; i++) {
+    memset(&object, 0, sizeof(publish_object_t));
+    sprintf(object.uid, "%s", uid_string);
+    sprintf(object.name, "%s", entities[i].name);
+    sprintf(object.object_id, "%s_%s", uid_string, entities[i].key);
+    sprintf(object.component, "sensor");
+    sprintf(object.category, "diagnostic");
+    sprintf(object.unit, "%s", entities[i].unit);
+    sprintf(object.device_class, "%s", entities[i].device_class);
+    sprintf(object.state_class, "%s", entities[i].state_class);
+    sprintf(object.icon, "%s", entities[i].icon);
+    sprintf(object.product, "IOWAY");
+    sprintf(object.model, "IOWAY_v0");
+    sprintf(object.sw_version, "0");
+    object.default_shown = true;
+    object.state_topic = health_topic;
+    object.value_template = value_templates[i];
+    publish_scheduler_enqueue(-1, &object, 1, 0);
+  }
+}
+
+void gateway_health_publish() {
+  static char health_json[MAX_HEALTH_JSON_SIZE];
+  const serial_statistics_t* serial_statistics = serial_get_statistics();
+  const mqtt_statistics_t* mqtt_statistics = mqtt_interface_get_statistics();
+  const uplink_dedup_statistics_t* dedup_statistics = uplink_dedup_get_statistics();
+  const publish_scheduler_statistics_t* scheduler_statistics = publish_scheduler_get_statistics();
+  uint32_t publish_dropped = 0;
+  for(uint8_t publish_class = 0; publish_class < PUBLISH_CLASS_COUNT; publish_class++)
+    publish_dropped += scheduler_statistics->dropped[publish_class];
+
+  if(announced_connects != mqtt_statistics->connects) {
+    announce_entities();
+    announced_connects = mqtt_statistics->connects;
+  }
+
+  snprintf(health_json, MAX_HEALTH_JSON_SIZE, "{\"uptime\":%llu,\"interval\":%u,\"processed\":%u,\"frames\":%u,\"crc_errors\":%u,\"dropped_frames\":%u,\"duplicates\":%u," \
+    "\"ring_high_water\":%u,\"modem_reboots\":%u,\"publish_failures\":%u,\"publish_dropped\":%u,\"reconnects\":%u,\"heap\":%u,\"min_heap\":%u,\"loop_p99\":%u}",
+    (unsigned long long)(esp_timer_get_time() / 1000000), status_interval, processed_messages, serial_statistics->frames, serial_statistics->crc_errors,
+    serial_statistics->dropped_frames, dedup_statistics->duplicates, serial_statistics->ring_high_water, modem_reboots, mqtt_statistics->publish_failures, publish_dropped,
+    mqtt_statistics->connects ? mqtt_statistics->connects - 1 : 0, ESP.getFreeHeap(), ESP.getMinFreeHeap(), histogram_percentile(&loop_times, 99));
+
+  mqtt_interface_publish_raw(health_topic, health_json, true);
+  histogram_reset(&loop_times);
+}
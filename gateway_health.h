@@ -0,0 +1,15 @@
+#ifndef GATEWAY_HEALTH_H
+#define GATEWAY_HEALTH_H
+#include "structures.h"
+
+void gateway_health_init(const char* gateway_id, uint16_t interval);
+
+void gateway_health_processed(uint8_t amount);
+
+void gateway_health_modem_rebooted();
+
+void gateway_health_loop_time(uint32_t duration_us);
+
+void gateway_health_publish();
+
+#endif
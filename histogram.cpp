@@ -0,0 +1,47 @@
+#include "histogram.h"
+
+static uint16_t bucket_index(uint32_t value_us) {
+  if(value_us < HISTOGRAM_SUB_BUCKETS)
+    return value_us;
+  uint8_t magnitude = 31 - __builtin_clz(value_us) - HISTOGRAM_SUB_BUCKET_BITS + 1;
+  if(magnitude >= HISTOGRAM_MAGNITUDES)
+    return HISTOGRAM_BUCKETS - 1;
+  return magnitude * HISTOGRAM_SUB_BUCKETS + ((value_us >> (magnitude - 1)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static uint32_t bucket_upper_bound(uint16_t index) {
+  uint8_t magnitude = index / HISTOGRAM_SUB_BUCKETS;
+  uint32_t sub_bucket = index % HISTOGRAM_SUB_BUCKETS;
+  if(magnitude == 0)
+    return sub_bucket;
+  return ((HISTOGRAM_SUB_BUCKETS + sub_bucket + 1) << (magnitude - 1)) - 1;
+}
+
+void histogram_reset(histogram_t* histogram) {
+  memset(histogram, 0, sizeof(histogram_t));
+}
+
+void histogram_record(histogram_t* histogram, uint32_t value_us) {
+  histogram->buckets[bucket_index(value_us)]++;
+  histogram->count++;
+  histogram->sum_us += value_us;
+  if(value_us > histogram->max_us)
+    histogram->max_us = value_us;
+}
+
+uint32_t histogram_percentile(histogram_t* histogram, uint8_t percent) {
+  uint32_t target = ((uint64_t)histogram->count * percent + 99) / 100;
+  uint32_t seen = 0;
+  for(uint16_t index = 0; index < HISTOGRAM_BUCKETS; index++) {
+    seen += histogram->buckets[index];
+    if(seen >= target && seen)
+      return min(bucket_upper_bound(index), histogram->max_us);
+  }
+  return histogram->max_us;
+}
+
+uint32_t histogram_mean(histogram_t* histogram) {
+  if(!histogram->count)
+    return 0;
+  return histogram->sum_us / histogram->count;
+}
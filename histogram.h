@@ -0,0 +1,27 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+#include "structures.h"
+
+// log-linear buckets like HdrHistogram: every power of two microseconds is split in 8 sub buckets,
+// so any reported percentile is within 12.5% of the real value
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAGNITUDES 24
+#define HISTOGRAM_BUCKETS (HISTOGRAM_MAGNITUDES * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint64_t sum_us;
+  uint32_t max_us;
+} histogram_t;
+
+void histogram_reset(histogram_t* histogram);
+
+void histogram_record(histogram_t* histogram, uint32_t value_us);
+
+uint32_t histogram_percentile(histogram_t* histogram, uint8_t percent);
+
+uint32_t histogram_mean(histogram_t* histogram);
+
+#endif
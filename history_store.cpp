@@ -0,0 +1,367 @@
+#include "history_store.h"
+#include "logger.h"
+#include <esp_timer.h>
+
+// series of the most recently updated entities, the least recently updated one is replaced when full
+#define HISTORY_SERIES 24
+#define HISTORY_PSRAM_SERIES 4096
+// PSRAM left to the rest of the gateway, the store takes what is free beyond it up to the maximum above
+#define PSRAM_RESERVE (512 * 1024)
+#define HISTORY_BUCKETS 512
+#define NO_SERIES 0xFFFF
+
+// a chunk holds a run of points: the time deltas grow from the front, the value deltas from the back
+#define CHUNK_SIZE 64
+#define CHUNK_HEADER_SIZE 11
+#define CHUNK_DATA_SIZE (CHUNK_SIZE - CHUNK_HEADER_SIZE)
+#define MAX_VARINT_SIZE 5
+
+// full resolution first, every aged chunk is folded into the means of the next tier
+#define TIERS 3
+#define TIER_CHUNKS_TOTAL 8
+static const uint8_t tier_chunks[TIERS] = { 4, 2, 2 };
+static const uint8_t tier_first_chunk[TIERS] = { 0, 4, 6 };
+static const uint16_t tier_resolution[TIERS] = { 0, 300, 1800 };
+
+typedef struct {
+  uint32_t base_time;
+  int32_t base_value;
+  uint8_t count;
+  uint8_t time_length;
+  uint8_t value_length;
+  uint8_t data[CHUNK_DATA_SIZE];
+} __attribute__((__packed__)) chunk_t;
+
+static_assert(sizeof(chunk_t) == CHUNK_SIZE, "chunk header size is off");
+
+// the mean of a tier that is still collecting points
+typedef struct {
+  uint32_t time;
+  int64_t sum;
+  uint16_t count;
+} bucket_t;
+
+typedef struct {
+  uint64_t uid;
+  char entity[HISTORY_ENTITY_SIZE];
+  uint16_t hash_next;
+  uint16_t lru_previous;
+  uint16_t lru_next;
+  uint8_t oldest_chunk[TIERS];
+  uint8_t used_chunks[TIERS];
+  uint32_t last_time[TIERS];
+  int32_t last_value[TIERS];
+  bucket_t bucket[TIERS];
+  chunk_t chunks[TIER_CHUNKS_TOTAL];
+} series_t;
+
+static series_t* series = NULL;
+static uint16_t buckets[HISTORY_BUCKETS];
+static uint16_t lru_head = NO_SERIES; // most recently used
+static uint16_t lru_tail = NO_SERIES;
+static history_statistics_t statistics;
+
+void history_store_init() {
+  memset(&statistics, 0, sizeof(statistics));
+  statistics.series_bytes = sizeof(series_t);
+  for(uint16_t i = 0; i < HISTORY_BUCKETS; i++)
+    buckets[i] = NO_SERIES;
+
+  uint32_t psram_series = 0;
+  if(psramFound() && ESP.getFreePsram() > PSRAM_RESERVE)
+    psram_series = min((uint32_t)HISTORY_PSRAM_SERIES, (uint32_t)((ESP.getFreePsram() - PSRAM_RESERVE) / sizeof(series_t)));
+  if(psram_series > HISTORY_SERIES)
+    series = (series_t*) ps_malloc(psram_series * sizeof(series_t));
+  if(series) {
+    statistics.capacity = psram_series;
+    statistics.psram = true;
+  } else {
+    series = (series_t*) malloc(HISTORY_SERIES * sizeof(series_t));
+    statistics.capacity = series ? HISTORY_SERIES : 0;
+  }
+  if(!series)
+    LOG_ERROR("could not allocate history store, no history is kept");
+}
+
+const history_statistics_t* history_store_get_statistics() {
+  return &statistics;
+}
+
+uint32_t history_store_now() {
+  return esp_timer_get_time() / 1000000;
+}
+
+static uint16_t bucket_of(uint64_t uid, const char* entity) {
+  uint64_t key = uid;
+  for(; *entity; entity++)
+    key = (key ^ (uint8_t)*entity) * 0x100000001b3ULL;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return key & (HISTORY_BUCKETS - 1);
+}
+
+static void lru_unlink(uint16_t index) {
+  series_t* entry = &series[index];
+  if(entry->lru_previous != NO_SERIES)
+    series[entry->lru_previous].lru_next = entry->lru_next;
+  else
+    lru_head = entry->lru_next;
+  if(entry->lru_next != NO_SERIES)
+    series[entry->lru_next].lru_previous = entry->lru_previous;
+  else
+    lru_tail = entry->lru_previous;
+}
+
+static void lru_push_front(uint16_t index) {
+  series[index].lru_previous = NO_SERIES;
+  series[index].lru_next = lru_head;
+  if(lru_head != NO_SERIES)
+    series[lru_head].lru_previous = index;
+  lru_head = index;
+  if(lru_tail == NO_SERIES)
+    lru_tail = index;
+}
+
+static void hash_unlink(uint16_t index) {
+  uint16_t* link = &buckets[bucket_of(series[index].uid, series[index].entity)];
+  while(*link != index)
+    link = &series[*link].hash_next;
+  *link = series[index].hash_next;
+}
+
+static uint16_t find(uint64_t uid, const char* entity) {
+  for(uint16_t index = buckets[bucket_of(uid, entity)]; index != NO_SERIES; index = series[index].hash_next) {
+    if(series[index].uid == uid && !strcmp(series[index].entity, entity))
+      return index;
+  }
+  return NO_SERIES;
+}
+
+static uint16_t insert(uint64_t uid, const char* entity) {
+  uint16_t index;
+  if(statistics.series < statistics.capacity) {
+    index = statistics.series++;
+  } else {
+    index = lru_tail;
+    lru_unlink(index);
+    hash_unlink(index);
+    statistics.evictions++;
+  }
+
+  // the chunks are only read up to their count, they need no clearing
+  series_t* entry = &series[index];
+  memset(entry, 0, offsetof(series_t, chunks));
+  entry->uid = uid;
+  strcpy(entry->entity, entity);
+  uint16_t bucket = bucket_of(uid, entity);
+  entry->hash_next = buckets[bucket];
+  buckets[bucket] = index;
+  lru_push_front(index);
+  return index;
+}
+
+static uint8_t encode_varint(uint32_t value, uint8_t* encoded) {
+  uint8_t length = 0;
+  while(value >= 0x80) {
+    encoded[length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  encoded[length++] = value;
+  return length;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static chunk_t* chunk_at(series_t* entry, uint8_t tier, uint8_t position) {
+  return &entry->chunks[tier_first_chunk[tier] + (entry->oldest_chunk[tier] + position) % tier_chunks[tier]];
+}
+
+// rounded, the coarsest tier is a mean of means and would drift down with truncation
+static int32_t mean(bucket_t* bucket) {
+  int64_t half = bucket->sum < 0 ? -(bucket->count / 2) : bucket->count / 2;
+  return (bucket->sum + half) / bucket->count;
+}
+
+static void fold(series_t* entry, uint8_t tier, uint32_t time, int32_t value);
+
+/**
+ * @brief walk the points of a chunk, into the callback from a query or folded into the next tier without one
+ */
+static void decode_chunk(chunk_t* chunk, series_t* entry, uint8_t next_tier, uint32_t from, history_point_callback callback, void* context, uint16_t resolution) {
+  uint32_t time = chunk->base_time;
+  int32_t value = chunk->base_value;
+  uint8_t time_index = 0;
+  uint8_t value_index = 0;
+  for(uint8_t point = 0; point < chunk->count; point++) {
+    if(point) {
+      uint32_t delta = 0;
+      uint8_t shift = 0;
+      do {
+        delta |= (uint32_t)(chunk->data[time_index] & 0x7F) << shift;
+        shift += 7;
+      } while(chunk->data[time_index++] & 0x80);
+      time += delta;
+
+      delta = 0;
+      shift = 0;
+      uint8_t byte;
+      do {
+        byte = chunk->data[CHUNK_DATA_SIZE - 1 - value_index++];
+        delta |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+      } while(byte & 0x80);
+      value += unzigzag(delta);
+    }
+    if(!callback)
+      fold(entry, next_tier, time, value);
+    else if(time >= from)
+      callback(context, time, value, resolution);
+  }
+}
+
+static void append(series_t* entry, uint8_t tier, uint32_t time, int32_t value);
+
+// the oldest chunk of a full tier makes room, its points live on as means in the next tier
+static void age_oldest_chunk(series_t* entry, uint8_t tier) {
+  chunk_t* oldest = chunk_at(entry, tier, 0);
+  if(tier + 1 < TIERS) {
+    decode_chunk(oldest, entry, tier + 1, 0, NULL, NULL, 0);
+    statistics.downsampled += oldest->count;
+  } else {
+    statistics.dropped += oldest->count;
+  }
+  entry->oldest_chunk[tier] = (entry->oldest_chunk[tier] + 1) % tier_chunks[tier];
+  entry->used_chunks[tier]--;
+}
+
+static void fold(series_t* entry, uint8_t tier, uint32_t time, int32_t value) {
+  bucket_t* bucket = &entry->bucket[tier];
+  uint32_t bucket_time = time - time % tier_resolution[tier];
+  if(bucket->count && bucket->time != bucket_time) {
+    append(entry, tier, bucket->time, mean(bucket));
+    bucket->count = 0;
+  }
+  if(!bucket->count) {
+    bucket->time = bucket_time;
+    bucket->sum = 0;
+  }
+  bucket->sum += value;
+  bucket->count++;
+}
+
+static void append(series_t* entry, uint8_t tier, uint32_t time, int32_t value) {
+  uint8_t encoded_time[MAX_VARINT_SIZE];
+  uint8_t encoded_value[MAX_VARINT_SIZE];
+  uint8_t time_length = 0;
+  uint8_t value_length = 0;
+  chunk_t* chunk = NULL;
+
+  if(entry->used_chunks[tier]) {
+    chunk = chunk_at(entry, tier, entry->used_chunks[tier] - 1);
+    time_length = encode_varint(time - entry->last_time[tier], encoded_time);
+    value_length = encode_varint(zigzag(value - entry->last_value[tier]), encoded_value);
+    if(chunk->time_length + chunk->value_length + time_length + value_length > CHUNK_DATA_SIZE || chunk->count == 0xFF)
+      chunk = NULL;
+  }
+  entry->last_time[tier] = time;
+  entry->last_value[tier] = value;
+
+  if(chunk) {
+    memcpy(&chunk->data[chunk->time_length], encoded_time, time_length);
+    chunk->time_length += time_length;
+    for(uint8_t i = 0; i < value_length; i++)
+      chunk->data[CHUNK_DATA_SIZE - 1 - chunk->value_length++] = encoded_value[i];
+    chunk->count++;
+    return;
+  }
+
+  if(entry->used_chunks[tier] == tier_chunks[tier])
+    age_oldest_chunk(entry, tier);
+  chunk = chunk_at(entry, tier, entry->used_chunks[tier]++);
+  chunk->base_time = time;
+  chunk->base_value = value;
+  chunk->count = 1;
+  chunk->time_length = 0;
+  chunk->value_length = 0;
+}
+
+static bool numeric_state(publish_object_t* object, int32_t* value) {
+  if(!strcmp(object->state, "ON") || !strcmp(object->state, "OFF")) {
+    *value = object->state[1] == 'N' ? HISTORY_VALUE_SCALE : 0;
+    return true;
+  }
+  if(object->state[0] == 0)
+    return false;
+
+  char* end;
+  float number = strtof(object->state, &end);
+  if(*end != 0 || number > INT32_MAX / HISTORY_VALUE_SCALE || number < INT32_MIN / HISTORY_VALUE_SCALE)
+    return false;
+  *value = lroundf(number * HISTORY_VALUE_SCALE);
+  return true;
+}
+
+void history_store_record(custom_file_contents_t* custom_file_content, publish_object_t* objects, uint8_t amount) {
+  if(!series)
+    return;
+
+  uint32_t now = history_store_now();
+  for(uint8_t i = 0; i < amount; i++) {
+    // entities sharing a state topic carry no state of their own
+    const char* entity = strchr(objects[i].object_id, '_');
+    int32_t value;
+    if(objects[i].state_topic || !entity || strlen(entity + 1) >= HISTORY_ENTITY_SIZE || !numeric_state(&objects[i], &value))
+      continue;
+    entity++;
+
+    uint16_t index = find(custom_file_content->chip_id, entity);
+    if(index == NO_SERIES) {
+      index = insert(custom_file_content->chip_id, entity);
+    } else {
+      lru_unlink(index);
+      lru_push_front(index);
+    }
+    append(&series[index], 0, now, value);
+    statistics.points++;
+  }
+}
+
+bool history_store_query(uint64_t uid, const char* entity, uint32_t from, history_point_callback callback, void* context) {
+  if(!series)
+    return false;
+  uint16_t index = find(uid, entity);
+  if(index == NO_SERIES)
+    return false;
+
+  // coarsest first, each tier only holds points older than those of the tier before it
+  series_t* entry = &series[index];
+  for(int8_t tier = TIERS - 1; tier >= 0; tier--) {
+    for(uint8_t position = 0; position < entry->used_chunks[tier]; position++) {
+      // a chunk ends before the next one starts, the last chunk before the open bucket or the finer tier
+      bool last = position + 1 == entry->used_chunks[tier];
+      if(!last && chunk_at(entry, tier, position + 1)->base_time < from)
+        continue;
+      if(last && entry->last_time[tier] < from)
+        continue;
+      decode_chunk(chunk_at(entry, tier, position), entry, 0, from, callback, context, tier_resolution[tier]);
+    }
+    bucket_t* bucket = &entry->bucket[tier];
+    if(tier && bucket->count && bucket->time >= from)
+      callback(context, bucket->time, mean(bucket), tier_resolution[tier]);
+  }
+  return true;
+}
+
+void history_store_entities(uint64_t uid, history_entity_callback callback, void* context) {
+  for(uint16_t index = 0; series && index < statistics.series; index++) {
+    if(series[index].uid == uid)
+      callback(context, series[index].entity);
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+#include "structures.h"
+
+// entity names longer than this are not recorded
+#define HISTORY_ENTITY_SIZE 24
+
+// values are kept as fixed point with two decimals
+#define HISTORY_VALUE_SCALE 100
+
+typedef struct {
+  uint16_t capacity;
+  uint16_t series;
+  bool psram;
+  uint16_t series_bytes; // memory per (uid, entity), the bound on its history
+  uint32_t points;       // recorded at full resolution
+  uint32_t downsampled;  // aged points folded into a coarser tier
+  uint32_t dropped;      // points aged out of the coarsest tier
+  uint32_t evictions;    // series replaced by a newer one
+} history_statistics_t;
+
+// gets the points oldest first, time in seconds since boot and the value scaled by HISTORY_VALUE_SCALE
+typedef void (*history_point_callback) (void* context, uint32_t time, int32_t value, uint16_t resolution);
+typedef void (*history_entity_callback) (void* context, const char* entity);
+
+void history_store_init();
+
+// records every numeric (or ON/OFF) state of the entities of an uplink
+void history_store_record(custom_file_contents_t* custom_file_content, publish_object_t* objects, uint8_t amount);
+
+/**
+ * @brief hand the history of one entity of a node to a callback
+ * @param from seconds since boot, older points are skipped
+ * @return false when nothing is recorded for the entity
+ */
+bool history_store_query(uint64_t uid, const char* entity, uint32_t from, history_point_callback callback, void* context);
+
+void history_store_entities(uint64_t uid, history_entity_callback callback, void* context);
+
+uint32_t history_store_now();
+
+const history_statistics_t* history_store_get_statistics();
+
+#endif
@@ -0,0 +1,47 @@
+// the CPU side of loading and committing the configuration, on the device the flash write of the commit comes on top
+#include <benchmark/benchmark.h>
+#include <EEPROM.h>
+#include "filesystem.h"
+#include "persisted.h"
+
+#define FILESYSTEM_SIZE 1232
+
+static host_config_t configs[2];
+
+static void setup_configs() {
+  for(uint8_t index = 0; index < 2; index++) {
+    host_set(configs[index].ssid, &configs[index].ssid_length, index ? "second" : "first");
+    host_set(configs[index].broker, &configs[index].broker_length, "broker.local");
+    configs[index].port = 1883;
+  }
+}
+
+// both slots valid, the newer one wins
+static void BM_FilesystemBoot(benchmark::State& state) {
+  setup_configs();
+  EEPROM.host_image().assign(FILESYSTEM_SIZE, 0xFF);
+  EEPROM.host_reboot();
+  filesystem_init(FILESYSTEM_SIZE);
+  filesystem_write(host_persisted(&configs[0]));
+  filesystem_write(host_persisted(&configs[1]));
+  host_config_t read;
+  for(auto _ : state) {
+    EEPROM.host_reboot();
+    filesystem_init(FILESYSTEM_SIZE);
+    filesystem_read(host_persisted(&read));
+  }
+  Serial.host_reset();
+}
+BENCHMARK(BM_FilesystemBoot);
+
+static void BM_FilesystemCommit(benchmark::State& state) {
+  setup_configs();
+  EEPROM.host_image().assign(FILESYSTEM_SIZE, 0xFF);
+  EEPROM.host_reboot();
+  filesystem_init(FILESYSTEM_SIZE);
+  uint8_t next = 0;
+  for(auto _ : state)
+    filesystem_write(host_persisted(&configs[next++ & 1]));
+  Serial.host_reset();
+}
+BENCHMARK(BM_FilesystemCommit);
@@ -0,0 +1,71 @@
+// the history store under 1000 nodes with 3 entities each, reporting once a minute for a day
+#include <benchmark/benchmark.h>
+#include <math.h>
+#include <chrono>
+#include "history_store.h"
+
+#define NODES 1000
+#define MINUTES (24 * 60)
+
+static custom_file_contents_t contents;
+static publish_object_t objects[3];
+static uint32_t uplinks = 0;
+
+// the nodes take turns, so each one reports once per 60 s of gateway time, returns the time recording took
+static double record_uplink() {
+  uint32_t node = uplinks % NODES;
+  uint32_t minute = uplinks / NODES;
+  contents.chip_id = 0xD7E0000000000000ULL + node;
+  snprintf(objects[0].object_id, sizeof(objects[0].object_id), "D7E%013X_temperature", node);
+  snprintf(objects[0].state, sizeof(objects[0].state), "%.2f", 20 + 3 * sin((minute + node) / 90.0) + (uplinks % 7) / 100.0);
+  snprintf(objects[1].object_id, sizeof(objects[1].object_id), "D7E%013X_humidity", node);
+  snprintf(objects[1].state, sizeof(objects[1].state), "%u", 40 + (minute / 30 + node) % 20);
+  snprintf(objects[2].object_id, sizeof(objects[2].object_id), "D7E%013X_button1", node);
+  snprintf(objects[2].state, sizeof(objects[2].state), "%s", (minute + node) % 7 ? "OFF" : "ON");
+  auto start = std::chrono::steady_clock::now();
+  history_store_record(&contents, objects, 3);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  host_advance_time(60000 / NODES);
+  uplinks++;
+  return elapsed.count();
+}
+
+// a store in PSRAM that already holds a day of history, so every tier is full
+static void setup_store() {
+  static bool done = false;
+  if(done)
+    return;
+  done = true;
+  host_set_psram(4 * 1024 * 1024);
+  history_store_init();
+  while(uplinks < NODES * MINUTES)
+    record_uplink();
+}
+
+// timed by hand, formatting the states of an uplink takes longer than recording them
+static void BM_HistoryRecord(benchmark::State& state) {
+  setup_store();
+  const history_statistics_t* statistics = history_store_get_statistics();
+  uint32_t evictions = statistics->evictions;
+  for(auto _ : state)
+    state.SetIterationTime(record_uplink());
+  state.counters["points/s"] = benchmark::Counter(state.iterations() * 3, benchmark::Counter::kIsRate);
+  state.counters["series"] = statistics->series;
+  state.counters["evictions"] = statistics->evictions - evictions;
+}
+BENCHMARK(BM_HistoryRecord)->UseManualTime();
+
+static void count_point(void* context, uint32_t time, int32_t value, uint16_t resolution) {
+  (*(uint32_t*) context)++;
+}
+
+// everything kept for one entity, what /api/history streams without a from
+static void BM_HistoryQuery(benchmark::State& state) {
+  setup_store();
+  uint32_t node = 0;
+  uint32_t points = 0;
+  for(auto _ : state)
+    history_store_query(0xD7E0000000000000ULL + node++ % NODES, "temperature", 0, count_point, &points);
+  state.counters["points/query"] = benchmark::Counter(points, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_HistoryQuery);
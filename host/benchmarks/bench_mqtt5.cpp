@@ -0,0 +1,98 @@
+// bytes the states of humidity uplinks take over MQTT 5 with topic aliases and user properties against MQTT 3.1.1,
+// the broker is played by the socket of the shim, which answers the CONNACK with the topic alias maximum of the run
+#include <benchmark/benchmark.h>
+#include "persisted.h"
+#include "file_parser.h"
+#include "mqtt_interface.h"
+#include "mqtt5_client.h"
+#include "WiFiClient.h"
+#include "PubSubClient.h"
+
+#define NODES 12
+#define MAX_PUBLISH_OBJECTS 12
+
+extern WiFiClient wifi_client;
+
+static publish_object_t results[MAX_PUBLISH_OBJECTS];
+static host_socket_t* broker = NULL;
+static uint8_t broker_topic_aliases = 0;
+
+static void accept_mqtt5(host_socket_t* socket) {
+  const uint8_t connack[] = { 0x20, 0x06, 0x00, 0x00, 0x03, 0x22, 0x00, broker_topic_aliases };
+  socket->received.insert(socket->received.end(), connack, connack + sizeof(connack));
+  broker = socket;
+}
+
+static void setup_gateway(uint8_t topic_aliases) {
+  file_parser_init(MAX_PUBLISH_OBJECTS);
+  static host_config_t config = {};
+  host_set(config.broker, &config.broker_length, "127.0.0.1");
+  config.port = 1883;
+  persisted_data_t persisted = host_persisted(&config);
+  mqtt_interface_config_changed(persisted);
+  static char client_name[] = "bench";
+  mqtt5_client_enable(topic_aliases);
+  mqtt_interface_connect(client_name, persisted);
+  // the MQTT 5 connection is opened once the 3.1.1 one is up
+  broker_topic_aliases = topic_aliases;
+  host_on_connect = accept_mqtt5;
+  mqtt_interface_connect(client_name, persisted);
+  host_on_connect = NULL;
+}
+
+// the uplink of a node as the sketch hands it to mqtt_interface_publish
+static uint8_t humidity_uplink(uint32_t uplink) {
+  uint32_t node = uplink % NODES;
+  uint8_t humidity[] = { (uint8_t) (0xC0 + (uplink / NODES + node) % 16), 0x01, 0x00, 0x00, (uint8_t) (0xD0 + node % 8), 0x00, 0x00, 0x00 };
+  custom_file_contents_t contents = {};
+  contents.file_id = HUMIDITY_FILE_ID;
+  contents.length = sizeof(humidity);
+  memcpy(contents.buffer, humidity, sizeof(humidity));
+  contents.chip_id = 0xE0D7000000000000ULL | node;
+  uint8_t amount = parse_custom_files(&contents, results);
+  for(uint8_t index = 0; index < amount; index++) {
+    results[index].rssi = 60 + node;
+    results[index].received = 3600000 + uplink * 1500;
+  }
+  return amount;
+}
+
+// 0 publishes everything over 3.1.1, otherwise the states go over MQTT 5 with this many topic aliases, 10 is the
+// default of mosquitto, discovery stays on 3.1.1 in both
+static void BM_StateBytes(benchmark::State& state) {
+  setup_gateway(state.range(0));
+  if(state.range(0) && !mqtt5_client_connected()) {
+    state.SkipWithError("no MQTT 5 connection");
+    return;
+  }
+  const mqtt5_statistics_t* statistics = mqtt5_client_get_statistics();
+  uint32_t hits = statistics->alias_hits;
+  uint32_t misses = statistics->alias_misses;
+  uint64_t config_bytes = 0;
+  uint64_t state_bytes = 0;
+  uint32_t uplinks = 0;
+  for(auto _ : state) {
+    uint8_t amount = humidity_uplink(uplinks++);
+    for(uint8_t index = 0; index < amount; index++) {
+      uint64_t before = PubSubClient::host_bytes;
+      if(!mqtt_interface_publish_config(&results[index]))
+        continue;
+      config_bytes += PubSubClient::host_bytes - before;
+      before = PubSubClient::host_bytes;
+      size_t written = broker ? broker->written.size() : 0;
+      mqtt_interface_publish_state(&results[index]);
+      state_bytes += PubSubClient::host_bytes - before + (broker ? broker->written.size() - written : 0);
+    }
+    mqtt_interface_flush();
+    wifi_client.host_socket()->written.clear();
+    if(broker)
+      broker->written.clear();
+  }
+  state.counters["state bytes/uplink"] = benchmark::Counter(state_bytes, benchmark::Counter::kAvgIterations);
+  state.counters["bytes/uplink"] = benchmark::Counter(config_bytes + state_bytes, benchmark::Counter::kAvgIterations);
+  if(state.range(0))
+    state.counters["alias hits %"] = 100.0 * (statistics->alias_hits - hits) / (statistics->alias_hits - hits + statistics->alias_misses - misses);
+  mqtt5_client_enable(false);
+  broker = NULL;
+}
+BENCHMARK(BM_StateBytes)->Arg(0)->Arg(10)->Arg(32);
@@ -0,0 +1,254 @@
+// throughput of the uplink path on a host, from modem bytes to MQTT packets
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include "frames.h"
+#include "persisted.h"
+#include "alp.h"
+#include "file_parser.h"
+#include "filesystem.h"
+#include "mqtt_interface.h"
+#include "pipeline_stats.h"
+#include "publish_scheduler.h"
+#include "publishes.h"
+#include "WiFiClient.h"
+#include "PubSubClient.h"
+
+#define MAX_CUSTOM_FILES 2
+#define MAX_PUBLISH_OBJECTS 12
+
+extern WiFiClient wifi_client;
+
+static uint8_t output_buffer[256];
+static custom_file_contents_t custom_files[MAX_CUSTOM_FILES];
+static publish_object_t results[MAX_PUBLISH_OBJECTS];
+
+static const uint8_t humidity[] = { 0xC7, 0x01, 0x00, 0x00, 0xD5, 0x00, 0x00, 0x00 };
+
+static std::vector<uint8_t> uplink_frame(uint32_t node) {
+  return host_frame(node, SERIAL_MESSAGE_TYPE_ALP, host_uplink(0xE0D7000000000000ULL | node, 60 + node % 40, HUMIDITY_FILE_ID, humidity, sizeof(humidity)));
+}
+
+static void setup_gateway() {
+  static bool done = false;
+  if(done)
+    return;
+  done = true;
+  serial_interface_init(NULL, output_buffer);
+  alp_init(custom_files, MAX_CUSTOM_FILES);
+  file_parser_init(MAX_PUBLISH_OBJECTS);
+  filesystem_init(1232);
+
+  static host_config_t config = {};
+  host_set(config.broker, &config.broker_length, "127.0.0.1");
+  config.port = 1883;
+  persisted_data_t persisted = host_persisted(&config);
+  mqtt_interface_config_changed(persisted);
+  static char client_name[] = "bench";
+  mqtt_interface_connect(client_name, persisted);
+}
+
+// a frame arrives on the modem UART and is framed, checked and copied out
+static void BM_SerialFrames(benchmark::State& state) {
+  setup_gateway();
+  std::vector<uint8_t> frame = uplink_frame(1);
+  for(auto _ : state) {
+    Serial.host_inject(frame.data(), frame.size());
+    serial_handle();
+    uint8_t length;
+    while(!(length = serial_parse()));
+    benchmark::DoNotOptimize(length);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["frames/s"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_SerialFrames);
+
+// framing, ALP and the file parser for uplinks of 100 nodes
+static void BM_ParseUplinks(benchmark::State& state) {
+  setup_gateway();
+  std::vector<std::vector<uint8_t>> frames;
+  for(uint32_t node = 0; node < 100; node++)
+    frames.push_back(uplink_frame(node));
+  size_t next = 0;
+  for(auto _ : state) {
+    std::vector<uint8_t>& frame = frames[next++ % frames.size()];
+    Serial.host_inject(frame.data(), frame.size());
+    serial_handle();
+    uint8_t length;
+    while(!(length = serial_parse()));
+    uint8_t files = alp_parse(output_buffer, length);
+    for(uint8_t index = 0; index < files; index++)
+      benchmark::DoNotOptimize(parse_custom_files(&custom_files[index], results));
+  }
+  state.counters["uplinks/s"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_ParseUplinks);
+
+// the discovery and state JSON of one uplink, built and written to the socket
+static void BM_PublishUplink(benchmark::State& state) {
+  setup_gateway();
+  mqtt_interface_coalesce(state.range(0));
+  custom_file_contents_t contents = {};
+  contents.file_id = HUMIDITY_FILE_ID;
+  contents.length = sizeof(humidity);
+  memcpy(contents.buffer, humidity, sizeof(humidity));
+  contents.chip_id = 0xE0D7000000000001ULL;
+  uint8_t amount = parse_custom_files(&contents, results);
+  uint64_t bytes = PubSubClient::host_bytes;
+  uint32_t segments = mqtt_interface_get_coalescing_statistics()->segments;
+  for(auto _ : state) {
+    mqtt_interface_publish(results, amount);
+    mqtt_interface_flush();
+    wifi_client.host_socket()->written.clear();
+  }
+  state.counters["uplinks/s"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+  state.counters["json bytes/s"] = benchmark::Counter(PubSubClient::host_bytes - bytes, benchmark::Counter::kIsRate);
+  state.counters["segments"] = benchmark::Counter(mqtt_interface_get_coalescing_statistics()->segments - segments, benchmark::Counter::kAvgIterations);
+  mqtt_interface_coalesce(false);
+}
+BENCHMARK(BM_PublishUplink)->Arg(0)->Arg(1);
+
+// 802.11n MCS7 at 20 MHz: DIFS, the mean backoff, the HT preamble, SIFS and the ACK cost every frame,
+// the segment adds its MAC, LLC, IP and TCP headers and goes at 65 Mbit/s
+#define AIRTIME_FRAME_US 197.5
+#define AIRTIME_FRAME_HEADERS 76
+#define AIRTIME_MBITS 65
+
+// the publishes of a light config uplink, every config and state of it, with and without coalescing
+static void BM_LightConfigUplink(benchmark::State& state) {
+  setup_gateway();
+  mqtt_interface_coalesce(state.range(0));
+  custom_file_contents_t contents = {};
+  contents.file_id = LIGHT_CONFIG_FILE_ID;
+  contents.length = sizeof(light_config_file_t);
+  light_config_file_t* config = (light_config_file_t*) contents.buffer;
+  config->interval = 600;
+  config->threshold_high = 2000;
+  config->threshold_low = 100;
+  config->enabled = true;
+  contents.chip_id = 0xE0D7000000000001ULL;
+  uint8_t amount = parse_custom_files(&contents, results);
+  host_socket_t* socket = wifi_client.host_socket();
+  uint32_t publishes = PubSubClient::host_publishes;
+  uint64_t writes = 0;
+  uint64_t bytes = 0;
+  for(auto _ : state) {
+    socket->written.clear();
+    uint32_t before = socket->writes;
+    mqtt_interface_publish(results, amount);
+    mqtt_interface_flush();
+    writes += socket->writes - before;
+    bytes += socket->written.size();
+  }
+  double airtime_us = writes * AIRTIME_FRAME_US + (bytes + writes * AIRTIME_FRAME_HEADERS) * 8.0 / AIRTIME_MBITS;
+  state.counters["publishes"] = benchmark::Counter(PubSubClient::host_publishes - publishes, benchmark::Counter::kAvgIterations);
+  state.counters["socket writes"] = benchmark::Counter(writes, benchmark::Counter::kAvgIterations);
+  state.counters["bytes/write"] = writes ? (double) bytes / writes : 0;
+  state.counters["airtime ms"] = benchmark::Counter(airtime_us / 1000, benchmark::Counter::kAvgIterations);
+  mqtt_interface_coalesce(false);
+}
+BENCHMARK(BM_LightConfigUplink)->Arg(0)->Arg(1);
+
+// a stage percentile from the json the gateway reports in /api/latency
+static double stage_value(const char* stage, const char* field) {
+  static char json[1400];
+  pipeline_stats_json(json, sizeof(json));
+  std::string key = std::string("\"") + stage + "\":{";
+  const char* entry = strstr(json, key.c_str());
+  std::string name = std::string("\"") + field + "\":";
+  const char* value = entry ? strstr(entry, name.c_str()) : NULL;
+  return value ? atof(value + name.size()) : 0;
+}
+
+// a button press right behind the 24 publishes of a light config uplink, through the scheduler with its
+// token bucket, loop passes of 5 ms while it drains and a second between uplinks
+static void BM_ButtonBehindLightConfig(benchmark::State& state) {
+  setup_gateway();
+  publish_scheduler_init();
+  host_socket_t* socket = wifi_client.host_socket();
+  uint32_t node = 0;
+  for(auto _ : state) {
+    light_config_file_t light_config = {};
+    custom_file_contents_t contents = {};
+    contents.file_id = LIGHT_CONFIG_FILE_ID;
+    contents.chip_id = 0xE0D7000000000000ULL | node++ % 100;
+    contents.length = sizeof(light_config);
+    memcpy(contents.buffer, &light_config, sizeof(light_config));
+    uint8_t amount = parse_custom_files(&contents, results);
+    publish_scheduler_enqueue(LIGHT_CONFIG_FILE_ID, results, amount, pipeline_stats_now());
+
+    button_file_t button = {};
+    button.mask = true;
+    contents.file_id = BUTTON_FILE_ID;
+    contents.length = sizeof(button);
+    memcpy(contents.buffer, &button, sizeof(button));
+    amount = parse_custom_files(&contents, results);
+    std::string button_topic = std::string("homeassistant/binary_sensor/") + results[0].object_id + "/state";
+    publish_scheduler_enqueue(BUTTON_FILE_ID, results, amount, pipeline_stats_now());
+
+    socket->written.clear();
+    while(!publish_scheduler_idle()) {
+      publish_scheduler_handle();
+      host_advance_time(5);
+    }
+    mqtt_interface_flush();
+    std::vector<std::string> topics = host_published_topics(socket);
+    if(topics.empty() || topics[0] != button_topic) {
+      state.SkipWithError("the button state was not published first");
+      break;
+    }
+    host_advance_time(1000);
+  }
+  state.counters["realtime p50 us"] = stage_value("realtime", "p50");
+  state.counters["realtime p99 us"] = stage_value("realtime", "p99");
+  state.counters["diagnostic p50 us"] = stage_value("diagnostic", "p50");
+  state.counters["diagnostic p99 us"] = stage_value("diagnostic", "p99");
+}
+BENCHMARK(BM_ButtonBehindLightConfig);
+
+// records, calibrated ns per record and uplinks so far, from the json the gateway reports in /api/latency
+static void instrumentation(double* records, double* record_ns, double* uplinks) {
+  static char json[1400];
+  pipeline_stats_json(json, sizeof(json));
+  const char* overhead = strstr(json, "\"overhead\"");
+  const char* total = strstr(json, "\"total\":{\"n\":");
+  *records = overhead ? atof(overhead + 22) : 0;
+  *record_ns = overhead ? atof(strstr(overhead, "\"ns_avg\":") + 9) : 0;
+  *uplinks = total ? atof(total + 13) : 0;
+}
+
+// the whole uplink with the instrumentation of the sketch, its records at the cost calibrated by the gateway
+static void BM_InstrumentedUplink(benchmark::State& state) {
+  setup_gateway();
+  std::vector<uint8_t> frame = uplink_frame(1);
+  double records_before, record_ns, uplinks_before;
+  instrumentation(&records_before, &record_ns, &uplinks_before);
+  auto start = std::chrono::steady_clock::now();
+  for(auto _ : state) {
+    Serial.host_inject(frame.data(), frame.size());
+    serial_handle();
+    uint8_t length;
+    while(!(length = serial_parse()));
+    STATS_START(alp_start);
+    uint8_t files = alp_parse(output_buffer, length);
+    STATS_STOP(STAGE_ALP, alp_start);
+    for(uint8_t index = 0; index < files; index++) {
+      STATS_START(parse_start);
+      uint8_t amount = parse_custom_files(&custom_files[index], results);
+      STATS_STOP(STAGE_FILE_PARSER, parse_start);
+      mqtt_interface_publish(results, amount);
+    }
+    mqtt_interface_flush();
+    STATS_STOP(STAGE_TOTAL, serial_frame_arrival());
+    wifi_client.host_socket()->written.clear();
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  double records, uplinks;
+  instrumentation(&records, &record_ns, &uplinks);
+  records -= records_before;
+  state.counters["records/uplink"] = records / (uplinks - uplinks_before);
+  state.counters["record ns"] = record_ns;
+  // share of the time the loop took, the injected frames and socket bookkeeping included
+  state.counters["overhead %"] = 100 * records * record_ns / elapsed.count();
+}
+BENCHMARK(BM_InstrumentedUplink);
@@ -0,0 +1,47 @@
+// the registry under a fleet of 10k nodes, built once with the device capacity and once with room for all of them
+#include <benchmark/benchmark.h>
+#include <random>
+#include "device_registry.h"
+
+static void update(custom_file_contents_t* contents, uint64_t uid) {
+  contents->chip_id = uid;
+  contents->rssi = 40 + uid % 60;
+  device_registry_update(contents);
+}
+
+// uplinks of nodes in random order, once the fleet outgrows the table every new node evicts one
+static void BM_RegistryUpdate(benchmark::State& state) {
+  device_registry_init();
+  uint32_t nodes = state.range(0);
+  std::mt19937 random(1);
+  custom_file_contents_t contents = {};
+  contents.file_id = HUMIDITY_FILE_ID;
+  uint32_t evictions = device_registry_evictions();
+  for(auto _ : state) {
+    update(&contents, 0xD7E0000000000000ULL + random() % nodes);
+    host_advance_time(1);
+  }
+  state.counters["capacity"] = DEVICE_REGISTRY_CAPACITY;
+  state.counters["evictions/update"] = benchmark::Counter(device_registry_evictions() - evictions, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RegistryUpdate)->Arg(100)->Arg(10000);
+
+// lookups of nodes that are in the table, the cost must not grow with the amount of nodes
+static void BM_RegistryFind(benchmark::State& state) {
+  device_registry_init();
+  uint32_t nodes = min((uint32_t) state.range(0), (uint32_t) (DEVICE_REGISTRY_CAPACITY - DEVICE_REGISTRY_CAPACITY / 8));
+  custom_file_contents_t contents = {};
+  contents.file_id = HUMIDITY_FILE_ID;
+  std::vector<uint64_t> uids;
+  for(uint32_t node = 0; node < nodes; node++) {
+    uids.push_back(0xD7E0000000000000ULL + node * 7919);
+    update(&contents, uids.back());
+  }
+  std::shuffle(uids.begin(), uids.end(), std::mt19937(2));
+  size_t next = 0;
+  for(auto _ : state)
+    benchmark::DoNotOptimize(device_registry_find(uids[next++ % uids.size()]));
+  state.counters["capacity"] = DEVICE_REGISTRY_CAPACITY;
+  state.counters["nodes"] = nodes;
+}
+BENCHMARK(BM_RegistryFind)->Arg(100)->Arg(10000);
@@ -0,0 +1,83 @@
+// the mailbox of the gateway against the forwards tools/modem_emulator.py answers, queueing writes to the nodes it heard:
+//   downlink_mailbox_harness <seconds> <writes per second> <pty of the modem>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include "uplinks.h"
+#include "downlink_mailbox.h"
+
+#define LIGHT_CONFIG_TTL 600
+
+typedef struct {
+  uint8_t offset;
+  uint8_t length;
+} field_t;
+
+// the light config settings tools/modem_emulator.py expects writes to
+static const field_t fields[] = { { 0, 4 }, { 7, 2 }, { 9, 2 }, { 13, 1 } };
+
+static std::vector<uint64_t> nodes;
+
+static void uplink(uint64_t uid) {
+  if(std::find(nodes.begin(), nodes.end(), uid) == nodes.end())
+    nodes.push_back(uid);
+  downlink_mailbox_uplink(uid);
+}
+
+static int open_terminal(const char* path) {
+  int file_descriptor = open(path, O_RDWR | O_NOCTTY);
+  if(file_descriptor < 0)
+    return -1;
+  struct termios settings;
+  tcgetattr(file_descriptor, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(file_descriptor, TCSANOW, &settings);
+  return file_descriptor;
+}
+
+int main(int argc, char** argv) {
+  if(argc != 4) {
+    fprintf(stderr, "usage: %s <seconds> <writes per second> <pty of the modem>\n", argv[0]);
+    return 2;
+  }
+  int file_descriptor = open_terminal(argv[3]);
+  if(file_descriptor < 0) {
+    perror(argv[3]);
+    return 2;
+  }
+  Serial.host_attach(file_descriptor);
+
+  host_uplinks_init();
+  alp_set_callbacks(uplink, downlink_mailbox_response);
+  downlink_mailbox_init();
+
+  std::mt19937 random(1);
+  std::exponential_distribution<double> gap(atof(argv[2]));
+  host_uplink_counts_t counts = {};
+  unsigned long start = millis();
+  unsigned long end = start + atoi(argv[1]) * 1000UL;
+  double next_write = start + 1000 * gap(random);
+  while((long) (end - millis()) > 0) {
+    bool busy = host_uplinks_handle(&counts);
+    downlink_mailbox_handle();
+    if(millis() >= next_write && !nodes.empty()) {
+      const field_t* field = &fields[random() % 4];
+      uint8_t data[4];
+      for(uint8_t index = 0; index < field->length; index++)
+        data[index] = random();
+      downlink_mailbox_enqueue(nodes[random() % nodes.size()], LIGHT_CONFIG_FILE_ID, field->offset, field->length, data, LIGHT_CONFIG_TTL);
+      next_write += 1000 * gap(random);
+    }
+    if(!busy)
+      usleep(200);
+  }
+
+  const downlink_mailbox_statistics_t* mailbox = downlink_mailbox_get_statistics();
+  printf("uplinks %u, nodes %u\n", counts.uplinks, (uint32_t) nodes.size());
+  printf("queued %u, superseded %u, rejected %u, commands %u, writes %u, merged %u, delivered %u, retries %u, failed %u, expired %u, "
+    "timeouts %u, depth %u\n", mailbox->queued, mailbox->superseded, mailbox->rejected, mailbox->commands, mailbox->writes, mailbox->merged,
+    mailbox->delivered, mailbox->retries, mailbox->failed, mailbox->expired, mailbox->timeouts, mailbox->depth);
+  return 0;
+}
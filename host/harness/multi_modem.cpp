@@ -0,0 +1,48 @@
+// the uplink path of the gateway fed by real pseudo terminals, e.g. two of tools/modem_emulator.py --modems 2:
+//   multi_modem_harness <seconds> <pty of modem 0> <pty of modem 1>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "uplinks.h"
+
+static int open_terminal(const char* path) {
+  int file_descriptor = open(path, O_RDWR | O_NOCTTY);
+  if(file_descriptor < 0)
+    return -1;
+  struct termios settings;
+  tcgetattr(file_descriptor, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(file_descriptor, TCSANOW, &settings);
+  return file_descriptor;
+}
+
+int main(int argc, char** argv) {
+  if(argc != 4) {
+    fprintf(stderr, "usage: %s <seconds> <pty of modem 0> <pty of modem 1>\n", argv[0]);
+    return 2;
+  }
+  HardwareSerial* ports[] = { &Serial, &Serial1 };
+  for(int modem = 0; modem < 2; modem++) {
+    int file_descriptor = open_terminal(argv[2 + modem]);
+    if(file_descriptor < 0) {
+      perror(argv[2 + modem]);
+      return 2;
+    }
+    ports[modem]->host_attach(file_descriptor);
+  }
+
+  host_uplinks_init();
+  host_uplink_counts_t counts = {};
+  unsigned long end = millis() + atoi(argv[1]) * 1000UL;
+  while((long) (end - millis()) > 0) {
+    if(!host_uplinks_handle(&counts))
+      usleep(200);
+  }
+
+  const serial_statistics_t* serial = serial_get_statistics();
+  const uplink_dedup_statistics_t* dedup = uplink_dedup_get_statistics();
+  printf("frames %u, crc errors %u, dropped frames %u\n", serial->frames, serial->crc_errors, serial->dropped_frames);
+  printf("uplinks %u, new %u, duplicates %u, cross modem %u, stronger copies %u, nodes %u\n", counts.uplinks, counts.new_uplinks,
+    dedup->duplicates, dedup->cross_modem, counts.stronger_copies, device_registry_count());
+  return 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# nodes that listen for half a second after their uplinks, every write queued on the mailbox has to be accounted for:
+#   run_downlink_mailbox.sh <downlink_mailbox_harness> <modem_emulator.py> [seconds]
+harness=$1
+emulator=$2
+seconds=${3:-5}
+output=$(mktemp)
+trap 'rm -f "$output"' EXIT
+
+python3 -u "$emulator" --devices 10 --rate 10 --listen-window 0.5 --duration "$seconds" --seed 1 > "$output" &
+emulator_pid=$!
+while ! grep -q 'listening on' "$output"; do
+  kill -0 $emulator_pid 2>/dev/null || { cat "$output"; exit 1; }
+  sleep 0.1
+done
+pty=$(sed -n 's/^modem emulator listening on //p' "$output")
+
+result=$("$harness" "$seconds" 4 "$pty") || exit 1
+wait $emulator_pid
+cat "$output"
+echo "$result"
+
+value() {
+  echo "$result" | sed -n "s/.*\\b$1 \\([0-9]*\\).*/\\1/p"
+}
+forwards=$(sed -n 's/^downlinks: commands \([0-9]*\),.*/\1/p' "$output")
+answered=$(sed -n 's/^downlinks: .*delivered \([0-9]*\).*/\1/p' "$output")
+queued=$(value queued)
+left=$(($(value delivered) + $(value superseded) + $(value failed) + $(value expired) + $(value depth)))
+
+# the emulator saw every command, some reached a listening node, and each queued write ended up somewhere
+[ "$(value commands)" -eq "${forwards:-0}" ] || { echo "FAIL: $(value commands) commands sent, ${forwards:-0} received"; exit 1; }
+[ "${answered:-0}" -gt 0 ] && [ "$(value delivered)" -gt 0 ] || { echo "FAIL: nothing delivered"; exit 1; }
+[ "$queued" -eq "$left" ] || { echo "FAIL: $queued writes queued, $left accounted for"; exit 1; }
+echo "PASS"
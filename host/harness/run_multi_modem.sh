@@ -0,0 +1,33 @@
+#!/bin/sh
+# two emulated modems that hear every uplink, each uplink has to come out of the gateway once:
+#   run_multi_modem.sh <multi_modem_harness> <modem_emulator.py> [seconds]
+harness=$1
+emulator=$2
+seconds=${3:-5}
+output=$(mktemp)
+trap 'rm -f "$output"' EXIT
+
+python3 -u "$emulator" --modems 2 --coverage 1 --devices 20 --rate 20 --duration "$seconds" --seed 1 > "$output" &
+emulator_pid=$!
+while [ "$(grep -c 'listening on' "$output")" -lt 2 ]; do
+  kill -0 $emulator_pid 2>/dev/null || { cat "$output"; exit 1; }
+  sleep 0.1
+done
+ptys=$(sed -n 's/^modem emulator listening on //p' "$output")
+
+result=$("$harness" $((seconds + 2)) $ptys) || exit 1
+wait $emulator_pid
+cat "$output"
+echo "$result"
+
+sent=$(sed -n 's/^sent \([0-9]*\) uplinks.*/\1/p' "$output")
+copies=$(sed -n 's/.* \([0-9]*\) copies on other modems$/\1/p' "$output")
+uplinks=$(echo "$result" | sed -n 's/^uplinks \([0-9]*\),.*/\1/p')
+new=$(echo "$result" | sed -n 's/.*, new \([0-9]*\),.*/\1/p')
+cross=$(echo "$result" | sed -n 's/.*, cross modem \([0-9]*\),.*/\1/p')
+
+# every frame arrived, every copy of the second modem was recognized and no uplink was handled twice
+[ "$uplinks" -eq $((sent + copies)) ] || { echo "FAIL: $uplinks uplinks parsed, $((sent + copies)) sent"; exit 1; }
+[ "$cross" -eq "$copies" ] || { echo "FAIL: $cross cross modem duplicates, $copies copies sent"; exit 1; }
+[ "$new" -le "$sent" ] || { echo "FAIL: $new uplinks handled, only $sent sent"; exit 1; }
+echo "PASS"
@@ -0,0 +1,32 @@
+// the CRC16 library with the settings the serial framing uses, polynome and start value, no reflection
+#ifndef CRC16_H
+#define CRC16_H
+#include "arduino_shim.h"
+
+class CRC16 {
+  public:
+    void setPolynome(uint16_t polynome) { this->polynome = polynome; }
+    void setStartXOR(uint16_t start) { this->start = start; }
+    void setEndXOR(uint16_t end) { this->end = end; }
+    void setReverseIn(bool reverse) {}
+    void setReverseOut(bool reverse) {}
+    void restart() { crc = start; }
+    void add(uint8_t value) {
+      crc ^= (uint16_t) value << 8;
+      for(uint8_t bit = 0; bit < 8; bit++)
+        crc = crc & 0x8000 ? (crc << 1) ^ polynome : crc << 1;
+    }
+    void add(const uint8_t* values, uint16_t length) {
+      for(uint16_t index = 0; index < length; index++)
+        add(values[index]);
+    }
+    uint16_t getCRC() { return crc ^ end; }
+
+  private:
+    uint16_t polynome = 0x1021;
+    uint16_t start = 0;
+    uint16_t end = 0;
+    uint16_t crc = 0;
+};
+
+#endif
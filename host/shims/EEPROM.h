@@ -0,0 +1,36 @@
+// the emulated EEPROM of the ESP32 core, a RAM copy that commit() writes back to the flash image
+#ifndef EEPROM_H
+#define EEPROM_H
+#include "arduino_shim.h"
+
+class EEPROMClass {
+  public:
+    bool begin(size_t size);
+    void end() {}
+    uint8_t read(int address) { return address < (int) ram.size() ? ram[address] : 0; }
+    void write(int address, uint8_t value) { if(address < (int) ram.size()) ram[address] = value; }
+    size_t readBytes(int address, void* value, size_t length);
+    size_t writeBytes(int address, const void* value, size_t length);
+    bool commit();
+    uint8_t* getDataPtr() { return ram.data(); }
+    size_t length() { return ram.size(); }
+
+    // power fails after this many bytes of the next commit reached the flash image, the rest keeps its old content
+    void host_cut_power_after(size_t bytes) { cut_after = bytes; }
+    bool host_power_was_cut() { return power_cut; }
+    // a reboot, the RAM copy is read back from the flash image on the next begin()
+    void host_reboot() { ram.clear(); power_cut = false; cut_after = SIZE_MAX; }
+    std::vector<uint8_t>& host_image() { return image; }
+    uint32_t host_commits() { return commits; }
+
+  private:
+    std::vector<uint8_t> ram;
+    std::vector<uint8_t> image;
+    size_t cut_after = SIZE_MAX;
+    bool power_cut = false;
+    uint32_t commits = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef ESPMDNS_H
+#define ESPMDNS_H
+#include "arduino_shim.h"
+
+// no responders on a host, every query times out
+class MDNSResponder {
+  public:
+    bool begin(const char* name) { return true; }
+    IPAddress queryHost(const char* host, uint32_t timeout = 2000) { return IPAddress(); }
+};
+
+extern MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,50 @@
+// LittleFS in memory, files live as long as the process
+#ifndef LITTLEFS_H
+#define LITTLEFS_H
+#include "arduino_shim.h"
+#include <map>
+#include <memory>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+class File : public Stream {
+  public:
+    File() {}
+    File(std::shared_ptr<std::vector<uint8_t>> content, bool append) : content(content), position_(append ? content->size() : 0) {}
+    size_t write(uint8_t data) { return write(&data, 1); }
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    int available() { return content ? content->size() - position_ : 0; }
+    int read() { return available() ? (*content)[position_++] : -1; }
+    size_t read(uint8_t* buffer, size_t size);
+    int peek() { return available() ? (*content)[position_] : -1; }
+    size_t size() { return content ? content->size() : 0; }
+    bool seek(uint32_t position) { position_ = min((size_t) position, size()); return true; }
+    size_t position() { return position_; }
+    void close() { content.reset(); }
+    operator bool() const { return (bool) content; }
+
+  private:
+    std::shared_ptr<std::vector<uint8_t>> content;
+    size_t position_ = 0;
+};
+
+class LittleFSFS {
+  public:
+    bool begin(bool format_on_fail = false) { return true; }
+    File open(const char* path, const char* mode = FILE_READ);
+    bool exists(const char* path) { return files.count(path); }
+    bool remove(const char* path) { return files.erase(path); }
+    bool rename(const char* from, const char* to);
+    size_t totalBytes() { return 1 << 20; }
+    size_t usedBytes();
+
+  private:
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+};
+
+extern LittleFSFS LittleFS;
+
+#endif
@@ -0,0 +1,43 @@
+// PubSubClient without a broker, publishes succeed while connected and are counted
+#ifndef PUBSUBCLIENT_H
+#define PUBSUBCLIENT_H
+#include "Client.h"
+#include <functional>
+#include <vector>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient {
+  public:
+    PubSubClient(Client& client) : client(&client) {}
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) { return *this; }
+    PubSubClient& setServer(IPAddress ip, uint16_t port) { return *this; }
+    PubSubClient& setServer(const char* host, uint16_t port) { return *this; }
+    PubSubClient& setBufferSize(uint16_t size) { return *this; }
+    PubSubClient& setKeepAlive(uint16_t seconds) { return *this; }
+    PubSubClient& setSocketTimeout(uint16_t seconds) { return *this; }
+    bool connect(const char* id, const char* user = NULL, const char* password = NULL) { return connected_ = client->connect(IPAddress(), 0); }
+    bool connected() { return connected_; }
+    bool loop() { return connected_; }
+    bool publish(const char* topic, const char* payload, bool retained = false) { return publish(topic, (const uint8_t*) payload, strlen(payload), retained); }
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained = false);
+    bool beginPublish(const char* topic, unsigned int length, bool retained);
+    size_t write(uint8_t data) { return write(&data, 1); }
+    size_t write(const uint8_t* buffer, size_t size);
+    int endPublish() { return connected_; }
+    bool subscribe(const char* topic) { return connected_; }
+    void disconnect() { connected_ = false; }
+    int state() { return connected_ ? 0 : -1; }
+
+    // over all instances, so a test sees what the gateway published
+    static uint32_t host_publishes;
+    static uint64_t host_bytes;
+
+  private:
+    std::vector<uint8_t> publish_header(const char* topic, unsigned int length, bool retained);
+
+    Client* client;
+    bool connected_ = false;
+};
+
+#endif
@@ -0,0 +1,8 @@
+// only included for its types, the web server itself is not part of the host build
+#ifndef WEBSERVER_H
+#define WEBSERVER_H
+#include "WiFiClient.h"
+
+typedef enum { HTTP_ANY, HTTP_GET, HTTP_POST } HTTPMethod;
+
+#endif
@@ -0,0 +1,52 @@
+// a TCP client without a network, copies share what was written and what the peer sends, like copies of a WiFiClient share the socket
+#ifndef WIFI_CLIENT_H
+#define WIFI_CLIENT_H
+#include "Client.h"
+#include <memory>
+
+typedef struct {
+  bool connected;
+  std::vector<uint8_t> written;
+  std::deque<uint8_t> received;
+  size_t write_limit; // bytes the socket takes before writes fail, e.g. a peer that stopped reading
+  uint32_t writes;
+} host_socket_t;
+
+// called when a client connects, e.g. to queue the CONNACK of a broker
+extern void (*host_on_connect)(host_socket_t* socket);
+
+class WiFiClient : public Client {
+  public:
+    WiFiClient() : socket(std::make_shared<host_socket_t>()) { socket->connected = false; socket->write_limit = SIZE_MAX; socket->writes = 0; }
+    int connect(IPAddress ip, uint16_t port) { return host_connect(); }
+    int connect(const char* host, uint16_t port) { return host_connect(); }
+    size_t write(uint8_t data) { return write(&data, 1); }
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    int available() { return socket->received.size(); }
+    int read();
+    int read(uint8_t* buffer, size_t size);
+    int peek() { return socket->received.empty() ? -1 : socket->received.front(); }
+    void flush() {}
+    void stop() { socket->connected = false; }
+    uint8_t connected() { return socket->connected; }
+    operator bool() { return socket->connected; }
+    void setNoDelay(bool enabled) {}
+    int setTimeout(uint32_t seconds) { return 0; }
+    int fd() const { return -1; }
+    IPAddress remoteIP() { return IPAddress(127, 0, 0, 1); }
+
+    host_socket_t* host_socket() { return socket.get(); }
+
+  private:
+    std::shared_ptr<host_socket_t> socket;
+
+    int host_connect() {
+      socket->connected = true;
+      if(host_on_connect)
+        host_on_connect(socket.get());
+      return 1;
+    }
+};
+
+#endif
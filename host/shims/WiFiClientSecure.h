@@ -0,0 +1,10 @@
+#ifndef WIFI_CLIENT_SECURE_H
+#define WIFI_CLIENT_SECURE_H
+#include "WiFiClient.h"
+
+class WiFiClientSecure : public WiFiClient {
+  public:
+    void setInsecure() {}
+};
+
+#endif
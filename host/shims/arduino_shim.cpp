@@ -0,0 +1,292 @@
+#include "arduino_shim.h"
+#include "CRC16.h"
+#include "EEPROM.h"
+#include "LittleFS.h"
+#include "WiFiClient.h"
+#include "PubSubClient.h"
+#include "ESPmDNS.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "driver/uart.h"
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+EspClass ESP;
+EEPROMClass EEPROM;
+LittleFSFS LittleFS;
+MDNSResponder MDNS;
+
+uint32_t PubSubClient::host_publishes = 0;
+uint64_t PubSubClient::host_bytes = 0;
+
+static const auto start = std::chrono::steady_clock::now();
+static uint64_t advanced_us = 0;
+static size_t psram_size = 0;
+static size_t psram_used = 0;
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() + advanced_us;
+}
+
+unsigned long millis() {
+  return esp_timer_get_time() / 1000;
+}
+
+unsigned long micros() {
+  return esp_timer_get_time();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void host_advance_time(uint32_t ms) {
+  advanced_us += (uint64_t) ms * 1000;
+}
+
+// a 240 MHz cycle counter on the same clock, fine enough to time a few instructions
+uint32_t EspClass::getCycleCount() {
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() + advanced_us * 1000;
+  return ns * 240 / 1000;
+}
+
+uint32_t EspClass::getFreePsram() {
+  return psram_size - psram_used;
+}
+
+bool psramFound() {
+  return psram_size;
+}
+
+void* ps_malloc(size_t size) {
+  if(size > psram_size - psram_used)
+    return NULL;
+  psram_used += size;
+  return malloc(size);
+}
+
+void host_set_psram(size_t size) {
+  psram_size = size;
+  psram_used = 0;
+}
+
+static uint8_t pin_levels[40];
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  if(pin < sizeof(pin_levels))
+    pin_levels[pin] = level;
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < sizeof(pin_levels) ? pin_levels[pin] : LOW;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack, void* parameters, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  std::thread(task, parameters).detach();
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks);
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source) {
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(int uart) {
+  return uart == 0 || uart == 1 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart, int threshold) {
+  return uart == 0 || uart == 1 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+void HardwareSerial::poll_file_descriptor() {
+  if(file_descriptor < 0)
+    return;
+  uint8_t buffer[256];
+  ssize_t length;
+  fcntl(file_descriptor, F_SETFL, fcntl(file_descriptor, F_GETFL) | O_NONBLOCK);
+  while((length = ::read(file_descriptor, buffer, sizeof(buffer))) > 0)
+    received.insert(received.end(), buffer, buffer + length);
+}
+
+int HardwareSerial::available() {
+  if(received.empty())
+    poll_file_descriptor();
+  return received.size();
+}
+
+int HardwareSerial::read() {
+  if(!available())
+    return -1;
+  uint8_t data = received.front();
+  received.pop_front();
+  return data;
+}
+
+int HardwareSerial::peek() {
+  return available() ? received.front() : -1;
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t size) {
+  if(file_descriptor >= 0)
+    return ::write(file_descriptor, data, size) == (ssize_t) size ? size : 0;
+  written.insert(written.end(), data, data + size);
+  return size;
+}
+
+bool EEPROMClass::begin(size_t size) {
+  if(image.size() < size)
+    image.resize(size, 0xFF);
+  ram.assign(image.begin(), image.begin() + size);
+  return true;
+}
+
+size_t EEPROMClass::readBytes(int address, void* value, size_t length) {
+  if(address + length > ram.size())
+    return 0;
+  memcpy(value, &ram[address], length);
+  return length;
+}
+
+size_t EEPROMClass::writeBytes(int address, const void* value, size_t length) {
+  if(address + length > ram.size())
+    return 0;
+  memcpy(&ram[address], value, length);
+  return length;
+}
+
+bool EEPROMClass::commit() {
+  if(power_cut)
+    return false;
+  commits++;
+  for(size_t address = 0; address < ram.size(); address++) {
+    if(image[address] == ram[address])
+      continue;
+    if(!cut_after) {
+      power_cut = true;
+      return false;
+    }
+    cut_after--;
+    image[address] = ram[address];
+  }
+  return true;
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if(!content)
+    return 0;
+  if(position_ + size > content->size())
+    content->resize(position_ + size);
+  memcpy(&(*content)[position_], buffer, size);
+  position_ += size;
+  return size;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  size = min(size, (size_t) available());
+  memcpy(buffer, &(*content)[position_], size);
+  position_ += size;
+  return size;
+}
+
+File LittleFSFS::open(const char* path, const char* mode) {
+  auto file = files.find(path);
+  if(!strcmp(mode, FILE_READ))
+    return file == files.end() ? File() : File(file->second, false);
+  if(file == files.end() || !strcmp(mode, FILE_WRITE))
+    file = files.insert_or_assign(path, std::make_shared<std::vector<uint8_t>>()).first;
+  return File(file->second, true);
+}
+
+bool LittleFSFS::rename(const char* from, const char* to) {
+  auto file = files.find(from);
+  if(file == files.end())
+    return false;
+  files[to] = file->second;
+  files.erase(file);
+  return true;
+}
+
+size_t LittleFSFS::usedBytes() {
+  size_t used = 0;
+  for(auto& file : files)
+    used += file.second->size();
+  return used;
+}
+
+void (*host_on_connect)(host_socket_t* socket) = NULL;
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  if(!socket->connected || socket->written.size() + size > socket->write_limit)
+    return 0;
+  socket->written.insert(socket->written.end(), buffer, buffer + size);
+  socket->writes++;
+  return size;
+}
+
+int WiFiClient::read() {
+  if(socket->received.empty())
+    return -1;
+  uint8_t data = socket->received.front();
+  socket->received.pop_front();
+  return data;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  size_t length = 0;
+  while(length < size && !socket->received.empty()) {
+    buffer[length++] = socket->received.front();
+    socket->received.pop_front();
+  }
+  return length;
+}
+
+// the PUBLISH packet as PubSubClient frames it, fixed header, topic and payload, handed to the client in one write
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  if(!connected_)
+    return false;
+  std::vector<uint8_t> packet = publish_header(topic, length, retained);
+  packet.insert(packet.end(), payload, payload + length);
+  host_publishes++;
+  return write(packet.data(), packet.size()) == packet.size();
+}
+
+// the header and topic in one write, the payload follows in the writes of the caller
+bool PubSubClient::beginPublish(const char* topic, unsigned int length, bool retained) {
+  if(!connected_)
+    return false;
+  std::vector<uint8_t> header = publish_header(topic, length, retained);
+  host_publishes++;
+  return write(header.data(), header.size()) == header.size();
+}
+
+std::vector<uint8_t> PubSubClient::publish_header(const char* topic, unsigned int length, bool retained) {
+  uint16_t topic_length = strlen(topic);
+  uint32_t remaining = 2 + topic_length + length;
+  std::vector<uint8_t> header = { (uint8_t) (0x30 | retained) };
+  do {
+    header.push_back(remaining & 0x7F);
+    remaining >>= 7;
+    if(remaining)
+      header.back() |= 0x80;
+  } while(remaining);
+  header.push_back(topic_length >> 8);
+  header.push_back(topic_length);
+  header.insert(header.end(), topic, topic + topic_length);
+  return header;
+}
+
+size_t PubSubClient::write(const uint8_t* buffer, size_t size) {
+  host_bytes += size;
+  return client->write(buffer, size);
+}
@@ -0,0 +1,211 @@
+// the parts of the Arduino ESP32 core the gateway modules use, enough to build and run them on a host
+#ifndef ARDUINO_SHIM_H
+#define ARDUINO_SHIM_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <type_traits>
+
+typedef uint8_t byte;
+
+#define HEX 16
+#define DEC 10
+#define PROGMEM
+#define PGM_P const char*
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+#define RX 3
+#define TX 1
+#define RX1 9
+#define TX1 10
+#define SERIAL_8N1 0x800001c
+
+template<class T, class U> typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template<class T, class U> typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+
+// time runs with the host clock, tests move it forward to reach timeouts without waiting
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void host_advance_time(uint32_t ms);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+
+// no PSRAM unless a test enables it, ps_malloc then hands out host memory
+bool psramFound();
+void* ps_malloc(size_t size);
+void host_set_psram(size_t size);
+
+class String {
+  public:
+    String() {}
+    String(const char* text) : value(text ? text : "") {}
+    String(const std::string& text) : value(text) {}
+    explicit String(int number) : value(std::to_string(number)) {}
+    explicit String(unsigned int number) : value(std::to_string(number)) {}
+    explicit String(long number) : value(std::to_string(number)) {}
+    explicit String(unsigned long number) : value(std::to_string(number)) {}
+    unsigned int length() const { return value.size(); }
+    const char* c_str() const { return value.c_str(); }
+    void toCharArray(char* buffer, unsigned int size) const { snprintf(buffer, size, "%s", value.c_str()); }
+    bool equals(const char* text) const { return value == text; }
+    bool equals(const String& text) const { return value == text.value; }
+    bool operator==(const char* text) const { return value == text; }
+    bool startsWith(const char* text) const { return value.rfind(text, 0) == 0; }
+    int toInt() const { return atoi(value.c_str()); }
+    char operator[](unsigned int index) const { return index < value.size() ? value[index] : 0; }
+    String& operator+=(const String& text) { value += text.value; return *this; }
+    String& operator+=(const char* text) { value += text; return *this; }
+    String& operator+=(unsigned long number) { value += std::to_string(number); return *this; }
+  private:
+    std::string value;
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t* data, size_t size) {
+      for(size_t index = 0; index < size; index++)
+        write(data[index]);
+      return size;
+    }
+    size_t write(const char* text) { return write((const uint8_t*) text, strlen(text)); }
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char character) { return write((uint8_t) character); }
+    size_t print(int number, int base = DEC) { return print((long) number, base); }
+    size_t print(unsigned int number, int base = DEC) { return print((unsigned long) number, base); }
+    size_t print(long number, int base = DEC) { return printf(base == HEX ? "%lx" : "%ld", number); }
+    size_t print(unsigned long number, int base = DEC) { return printf(base == HEX ? "%lx" : "%lu", number); }
+    size_t print(double number) { return printf("%.2f", number); }
+    template<class T> size_t println(const T& value) { return print(value) + println(); }
+    template<class T> size_t println(const T& value, int base) { return print(value, base) + println(); }
+    size_t println() { return write("\r\n"); }
+    size_t printf(const char* format, ...) {
+      char buffer[256];
+      va_list args;
+      va_start(args, format);
+      int length = vsnprintf(buffer, sizeof(buffer), format, args);
+      va_end(args);
+      return length > 0 ? write((const uint8_t*) buffer, min((size_t) length, sizeof(buffer) - 1)) : 0;
+    }
+    virtual void flush() {}
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long timeout) {}
+};
+
+/**
+ * @brief a UART as two byte queues, a test feeds what the modem sends and takes what the gateway wrote
+ * attached to a file descriptor, e.g. a pseudo terminal of tools/modem_emulator.py, it reads and writes that instead
+ */
+class HardwareSerial : public Stream {
+  public:
+    HardwareSerial(int uart) : uart(uart) {}
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rx = -1, int8_t tx = -1, bool invert = false) {}
+    void end() {}
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t data) { return write(&data, 1); }
+    size_t write(const uint8_t* data, size_t size);
+    using Print::write;
+    void onReceive(void (*callback)(), bool only_on_timeout = true) {}
+    size_t setRxBufferSize(size_t size) { return size; }
+    int availableForWrite() { return 128; }
+
+    void host_inject(const uint8_t* data, size_t size) { received.insert(received.end(), data, data + size); }
+    void host_attach(int file_descriptor) { this->file_descriptor = file_descriptor; }
+    std::vector<uint8_t> host_take_written() { std::vector<uint8_t> data; data.swap(written); return data; }
+    void host_reset() { received.clear(); written.clear(); }
+
+  private:
+    void poll_file_descriptor();
+    int uart;
+    int file_descriptor = -1;
+    std::deque<uint8_t> received;
+    std::vector<uint8_t> written;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+class Printable {};
+
+class IPAddress : public Printable {
+  public:
+    IPAddress() : address(0) {}
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth) : address(first | second << 8 | third << 16 | (uint32_t) fourth << 24) {}
+    IPAddress(uint32_t address) : address(address) {}
+    operator uint32_t() const { return address; }
+    uint8_t operator[](int index) const { return address >> (8 * index); }
+    bool operator==(const IPAddress& other) const { return address == other.address; }
+    String toString() const {
+      char text[16];
+      snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+      return String(text);
+    }
+  private:
+    uint32_t address;
+};
+
+class EspClass {
+  public:
+    uint64_t getEfuseMac() { return 0x0000AABBCCDDEEFFULL; }
+    uint32_t getFreeHeap() { return 200000; }
+    uint32_t getMinFreeHeap() { return 180000; }
+    uint32_t getMaxAllocHeap() { return 110000; }
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getFreePsram();
+    void restart() { exit(0); }
+};
+
+extern EspClass ESP;
+
+// FreeRTOS, a host run has a single task
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef struct { int owner; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_ISR(mux)
+#define portEXIT_CRITICAL_ISR(mux)
+#define pdMS_TO_TICKS(ms) (ms)
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define tskIDLE_PRIORITY 0
+#define portTICK_PERIOD_MS 1
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack, void* parameters, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef DRIVER_GPIO_H
+#define DRIVER_GPIO_H
+// the pins of the ESP32 that can drive an output, 34 to 39 are inputs only
+#define GPIO_NUM_MAX 40
+#define GPIO_IS_VALID_OUTPUT_GPIO(pin) ((pin) >= 0 && (pin) < 34 && (pin) != 20 && (pin) != 24 && ((pin) < 28 || (pin) > 31))
+#endif
@@ -0,0 +1,6 @@
+#ifndef DRIVER_UART_H
+#define DRIVER_UART_H
+#include "../esp_err.h"
+typedef int uart_port_t;
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart, int threshold);
+#endif
@@ -0,0 +1,8 @@
+#ifndef ESP_SLEEP_H
+#define ESP_SLEEP_H
+#include "esp_err.h"
+typedef enum { ESP_SLEEP_WAKEUP_UART = 8 } esp_sleep_source_t;
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source);
+// like the ESP32, only UART0 and UART1 can wake the chip from light sleep
+esp_err_t esp_sleep_enable_uart_wakeup(int uart);
+#endif
@@ -0,0 +1,6 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+#include <stdint.h>
+// microseconds on the same clock as millis()
+int64_t esp_timer_get_time();
+#endif
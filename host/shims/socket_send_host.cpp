@@ -0,0 +1,18 @@
+// the socket of a host client takes bytes up to its write limit, a test lowers the limit to play a peer that stopped reading
+#include "socket_send.h"
+
+int socket_send(WiFiClient& client, const uint8_t* data, size_t length) {
+  host_socket_t* socket = client.host_socket();
+  if(!socket->connected)
+    return -1;
+  size_t room = socket->written.size() < socket->write_limit ? socket->write_limit - socket->written.size() : 0;
+  size_t sent = min(length, room);
+  if(sent)
+    client.write(data, sent);
+  return sent;
+}
+
+bool socket_writable(WiFiClient& client) {
+  host_socket_t* socket = client.host_socket();
+  return socket->connected && socket->written.size() < socket->write_limit;
+}
@@ -0,0 +1,26 @@
+// the station is always up on a host, names only resolve when they are addresses
+#include "WiFi_interface.h"
+
+void WiFi_init(const char* access_point_ssid, bool has_credentials) {}
+
+bool WiFi_connect(char* ssid, int ssid_length, char* password, int password_length) {
+  return true;
+}
+
+bool WiFi_interface_is_connected() {
+  return true;
+}
+
+bool WiFi_access_point_active() {
+  return false;
+}
+
+void WiFi_advertising_disable() {}
+
+bool WiFi_get_ip_by_name(char* host, IPAddress* resulting_ip) {
+  unsigned int parts[4];
+  if(sscanf(host, "%u.%u.%u.%u", &parts[0], &parts[1], &parts[2], &parts[3]) != 4)
+    return false;
+  *resulting_ip = IPAddress(parts[0], parts[1], parts[2], parts[3]);
+  return true;
+}
@@ -0,0 +1,40 @@
+// builds what a modem sends, the same frames tools/modem_emulator.py produces
+#ifndef HOST_FRAMES_H
+#define HOST_FRAMES_H
+#include "CRC16.h"
+#include "serial_interface.h"
+
+#define ALP_OP_RETURN_FILE_DATA 0x20
+#define ALP_OP_STATUS           0x22
+#define ALP_OP_RESPONSE_TAG     0x23
+#define D7_INTERFACE_ID         0xD7
+
+// the interface status of a node heard at rssi, followed by a return file data with the whole file
+static inline std::vector<uint8_t> host_uplink(uint64_t uid, uint8_t rssi, uint8_t file_id, const uint8_t* data, uint8_t length) {
+  std::vector<uint8_t> payload = { ALP_OP_STATUS, D7_INTERFACE_ID, 20, 0, 0, 0, rssi, (uint8_t) (140 - min(rssi, (uint8_t) 140)), 0, 0, 0, 0, 0, 0, 0 };
+  payload.insert(payload.end(), (const uint8_t*) &uid, (const uint8_t*) &uid + 8);
+  payload.insert(payload.end(), { ALP_OP_RETURN_FILE_DATA, file_id, 0, length });
+  payload.insert(payload.end(), data, data + length);
+  return payload;
+}
+
+// the completion of a tagged request, with end of packet set
+static inline std::vector<uint8_t> host_response_tag(uint8_t tag_id, bool error) {
+  return { (uint8_t) (ALP_OP_RESPONSE_TAG | 0x80 | (error ? 0x40 : 0)), tag_id };
+}
+
+static inline std::vector<uint8_t> host_frame(uint8_t counter, uint8_t type, const std::vector<uint8_t>& payload) {
+  CRC16 crc;
+  crc.setPolynome(0x1021);
+  crc.setStartXOR(0xFFFF);
+  crc.restart();
+  crc.add(payload.data(), payload.size());
+  uint16_t value = crc.getCRC();
+  std::vector<uint8_t> frame(7 + payload.size());
+  const uint8_t header[7] = { 0xC0, 0, counter, type, (uint8_t) payload.size(), (uint8_t) (value >> 8), (uint8_t) value };
+  memcpy(frame.data(), header, sizeof(header));
+  memcpy(&frame[7], payload.data(), payload.size());
+  return frame;
+}
+
+#endif
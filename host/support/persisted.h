@@ -0,0 +1,40 @@
+// the buffers persisted_data_t points into, like the globals of the sketch
+#ifndef HOST_PERSISTED_H
+#define HOST_PERSISTED_H
+#include "structures.h"
+
+typedef struct {
+  char ssid[MAX_CREDENTIAL_SIZE];
+  char password[MAX_CREDENTIAL_SIZE];
+  char broker[MAX_CREDENTIAL_SIZE];
+  char user[MAX_CREDENTIAL_SIZE];
+  char mqtt_password[MAX_CREDENTIAL_SIZE];
+  char prefix[MAX_CREDENTIAL_SIZE];
+  int ssid_length;
+  int password_length;
+  int broker_length;
+  int user_length;
+  int mqtt_password_length;
+  int prefix_length;
+  uint32_t port;
+  uint8_t output_mode;
+} host_config_t;
+
+static inline persisted_data_t host_persisted(host_config_t* config) {
+  return {
+    { &config->ssid_length, config->ssid },
+    { &config->password_length, config->password },
+    { &config->broker_length, config->broker },
+    { &config->user_length, config->user },
+    { &config->mqtt_password_length, config->mqtt_password },
+    &config->port,
+    &config->output_mode,
+    { &config->prefix_length, config->prefix },
+  };
+}
+
+static inline void host_set(char* content, int* length, const char* value) {
+  *length = snprintf(content, MAX_CREDENTIAL_SIZE, "%s", value);
+}
+
+#endif
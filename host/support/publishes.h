@@ -0,0 +1,30 @@
+// the topics of the MQTT 3.1.1 PUBLISH packets a socket got, in the order they were written
+#ifndef HOST_PUBLISHES_H
+#define HOST_PUBLISHES_H
+#include <string>
+#include <vector>
+#include "WiFiClient.h"
+
+static inline std::vector<std::string> host_published_topics(host_socket_t* socket) {
+  std::vector<std::string> topics;
+  const std::vector<uint8_t>& written = socket->written;
+  size_t index = 0;
+  while(index + 2 <= written.size()) {
+    uint8_t type = written[index++];
+    uint32_t remaining = 0;
+    for(uint8_t shift = 0; index < written.size(); shift += 7) {
+      uint8_t digit = written[index++];
+      remaining |= (uint32_t) (digit & 0x7F) << shift;
+      if(!(digit & 0x80))
+        break;
+    }
+    if((type & 0xF0) == 0x30 && index + 2 <= written.size()) {
+      uint16_t topic_length = (written[index] << 8) | written[index + 1];
+      topics.push_back(std::string(written.begin() + index + 2, written.begin() + min(index + 2 + topic_length, written.size())));
+    }
+    index += remaining;
+  }
+  return topics;
+}
+
+#endif
@@ -0,0 +1,53 @@
+// the uplink half of loop() in the sketch: framing on every modem, ALP, merging the copies of other modems and the registry
+#ifndef HOST_UPLINKS_H
+#define HOST_UPLINKS_H
+#include "serial_interface.h"
+#include "alp.h"
+#include "uplink_dedup.h"
+#include "device_registry.h"
+
+#define HOST_MAX_CUSTOM_FILES 2
+
+typedef struct {
+  uint32_t frames;
+  uint32_t uplinks;
+  uint32_t new_uplinks;
+  uint32_t stronger_copies;
+} host_uplink_counts_t;
+
+static uint8_t host_output_buffer[256];
+static custom_file_contents_t host_custom_files[HOST_MAX_CUSTOM_FILES];
+
+static inline void host_uplinks_init() {
+  serial_interface_init(NULL, host_output_buffer);
+  alp_init(host_custom_files, HOST_MAX_CUSTOM_FILES);
+  uplink_dedup_init();
+  device_registry_init();
+}
+
+// one pass of the loop, false when no modem completed a frame in it
+static inline bool host_uplinks_handle(host_uplink_counts_t* counts) {
+  serial_handle();
+  uint8_t length = serial_parse();
+  if(!length)
+    return false;
+  counts->frames++;
+  uint8_t files = alp_parse(host_output_buffer, length);
+  for(uint8_t index = 0; index < files; index++) {
+    custom_file_contents_t* file = &host_custom_files[index];
+    file->modem = serial_frame_modem();
+    counts->uplinks++;
+    uplink_dedup_result_t result = uplink_dedup_check(file);
+    if(result == UPLINK_STRONGER_COPY) {
+      counts->stronger_copies++;
+      device_registry_merge_reception(file);
+    }
+    if(result != UPLINK_NEW)
+      continue;
+    counts->new_uplinks++;
+    device_registry_update(file);
+  }
+  return true;
+}
+
+#endif
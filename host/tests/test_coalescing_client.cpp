@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include "coalescing_client.h"
+#include "WiFiClient.h"
+
+static const uint8_t packet[100] = {};
+
+class Coalescing : public testing::Test {
+  protected:
+    WiFiClient wifi;
+    CoalescingClient client = CoalescingClient(&wifi);
+
+    void SetUp() override {
+      client.connect(IPAddress(127, 0, 0, 1), 1883);
+    }
+};
+
+TEST_F(Coalescing, SmallPacketsShareASegment) {
+  for(int index = 0; index < 5; index++)
+    ASSERT_EQ(client.write(packet, sizeof(packet)), sizeof(packet));
+  EXPECT_TRUE(wifi.host_socket()->written.empty());
+  EXPECT_TRUE(client.flush_idle());
+  EXPECT_EQ(wifi.host_socket()->written.size(), 5 * sizeof(packet));
+  EXPECT_EQ(wifi.host_socket()->writes, 1u);
+  EXPECT_EQ(client.get_statistics()->lost, 0u);
+}
+
+TEST_F(Coalescing, FullBufferIsSentRightAway) {
+  for(int index = 0; index < 15; index++)
+    client.write(packet, sizeof(packet));
+  EXPECT_EQ(wifi.host_socket()->written.size(), 14 * sizeof(packet));
+  EXPECT_EQ(client.get_statistics()->flush_full, 1u);
+}
+
+// the MQTT client was told the packets were written, a failed segment write has to show up somewhere
+TEST_F(Coalescing, PacketsOfAFailedSegmentAreCountedAsLost) {
+  for(int index = 0; index < 3; index++)
+    ASSERT_EQ(client.write(packet, sizeof(packet)), sizeof(packet));
+  wifi.host_socket()->write_limit = 0;
+  EXPECT_FALSE(client.flush_idle());
+  EXPECT_FALSE(client.connected());
+  const coalescing_statistics_t* statistics = client.get_statistics();
+  EXPECT_EQ(statistics->failures, 1u);
+  EXPECT_EQ(statistics->lost, 3u);
+}
+
+TEST_F(Coalescing, PacketsDroppedByAReconnectAreCountedAsLost) {
+  client.write(packet, sizeof(packet));
+  client.connect(IPAddress(127, 0, 0, 1), 1883);
+  EXPECT_EQ(client.get_statistics()->lost, 1u);
+  EXPECT_TRUE(client.flush_idle());
+  EXPECT_TRUE(wifi.host_socket()->written.empty());
+}
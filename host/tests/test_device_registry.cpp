@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include "device_registry.h"
+
+static device_record_t* update(uint64_t uid, uint8_t rssi) {
+  custom_file_contents_t contents = {};
+  contents.file_id = HUMIDITY_FILE_ID;
+  contents.chip_id = uid;
+  contents.rssi = rssi;
+  return device_registry_update(&contents);
+}
+
+TEST(DeviceRegistry, KeepsStatisticsPerNode) {
+  device_registry_init();
+  update(1, 50);
+  update(2, 70);
+  device_record_t* device = update(1, 60);
+  ASSERT_EQ(device, device_registry_find(1));
+  EXPECT_EQ(device->uplinks, 2u);
+  EXPECT_EQ(device->rssi_min, 50);
+  EXPECT_EQ(device->rssi_max, 60);
+  EXPECT_EQ(device->rssi_last, 60);
+  EXPECT_EQ(device_registry_count(), 2);
+  EXPECT_EQ(device_registry_find(3), nullptr);
+}
+
+TEST(DeviceRegistry, EvictsSilentNodesWhenFull) {
+  device_registry_init();
+  uint32_t evictions = device_registry_evictions();
+  const uint16_t max_devices = DEVICE_REGISTRY_CAPACITY - DEVICE_REGISTRY_CAPACITY / 8;
+  for(uint64_t uid = 1; uid <= 10000; uid++) {
+    // a node that keeps reporting is never the one that goes
+    update(0xACE0000, 80);
+    update(uid, 60);
+    host_advance_time(1);
+  }
+  EXPECT_EQ(device_registry_count(), max_devices);
+  EXPECT_EQ(device_registry_evictions() - evictions, 10000u + 1 - max_devices);
+  ASSERT_NE(device_registry_find(0xACE0000), nullptr);
+  EXPECT_EQ(device_registry_find(0xACE0000)->uplinks, 10000u);
+  EXPECT_NE(device_registry_find(10000), nullptr);
+  // every node still in the table can be found after all the backward shifts
+  for(uint16_t slot = 0; slot < DEVICE_REGISTRY_CAPACITY; slot++) {
+    device_record_t* device = device_registry_get(slot);
+    if(device)
+      EXPECT_EQ(device_registry_find(device->uid), device);
+  }
+}
@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include "alp.h"
+#include "downlink_mailbox.h"
+#include "serial_interface.h"
+
+#define NODE 0xE0D7000000000001ULL
+#define TTL 60
+#define RESPONSE_TIMEOUT 10000
+
+static uint8_t output_buffer[256];
+
+static uint8_t ones[] = { 1, 1, 1, 1 };
+static uint8_t twos[] = { 2, 2, 2, 2 };
+static uint8_t threes[] = { 3, 3 };
+
+static void collect_mail(void* context, const downlink_mail_t* mail) {
+  ((std::vector<downlink_mail_t>*) context)->push_back(*mail);
+}
+
+static std::vector<downlink_mail_t> mails() {
+  std::vector<downlink_mail_t> list;
+  downlink_mailbox_list(collect_mail, &list);
+  return list;
+}
+
+// what modem 0 got, the frame header of the serial interface in front of the ALP command
+static std::vector<uint8_t> sent_command() {
+  std::vector<uint8_t> written = Serial.host_take_written();
+  return written.size() > 7 ? std::vector<uint8_t>(written.begin() + 7, written.end()) : written;
+}
+
+class DownlinkMailbox : public testing::Test {
+  protected:
+    void SetUp() override {
+      serial_interface_init(NULL, output_buffer);
+      Serial.host_reset();
+      downlink_mailbox_init();
+    }
+
+    void TearDown() override {
+      serial_set_exclusive(0, false);
+    }
+
+    // the completion of the command the node is waiting for
+    void respond(bool error) {
+      std::vector<downlink_mail_t> list = mails();
+      ASSERT_FALSE(list.empty());
+      downlink_mailbox_response(list[0].tag_id, false, false);
+      downlink_mailbox_response(list[0].tag_id, true, error);
+    }
+};
+
+TEST_F(DownlinkMailbox, WritesWaitForAnUplink) {
+  ASSERT_TRUE(downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 0, 4, ones, TTL));
+  downlink_mailbox_handle();
+  EXPECT_TRUE(Serial.host_take_written().empty());
+  downlink_mailbox_uplink(NODE + 1);
+  EXPECT_TRUE(Serial.host_take_written().empty());
+  downlink_mailbox_uplink(NODE);
+  EXPECT_FALSE(sent_command().empty());
+  EXPECT_EQ(downlink_mailbox_get_statistics()->commands, 1u);
+}
+
+TEST_F(DownlinkMailbox, OverlappingWritesAreMergedInQueueOrder) {
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 8, 4, twos, TTL);
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 3, 2, threes, TTL);
+  downlink_mailbox_enqueue(NODE, PIR_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  // covers all bytes of the earlier write to 8, which is not sent anymore
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 8, 4, ones, TTL);
+  downlink_mailbox_uplink(NODE);
+
+  uint8_t merged[] = { 1, 1, 1, 3, 3 };
+  uint8_t writes[64];
+  uint8_t length = alp_append_write_file_data(writes, LIGHT_CONFIG_FILE_ID, 0, sizeof(merged), merged);
+  length += alp_append_write_file_data(&writes[length], PIR_CONFIG_FILE_ID, 0, 4, ones);
+  length += alp_append_write_file_data(&writes[length], LIGHT_CONFIG_FILE_ID, 8, 4, ones);
+  std::vector<uint8_t> command = sent_command();
+  ASSERT_GT(command.size(), length);
+  EXPECT_EQ(std::vector<uint8_t>(command.end() - length, command.end()), std::vector<uint8_t>(writes, writes + length));
+
+  const downlink_mailbox_statistics_t* statistics = downlink_mailbox_get_statistics();
+  EXPECT_EQ(statistics->superseded, 1u);
+  EXPECT_EQ(statistics->writes, 3u);
+  EXPECT_EQ(statistics->merged, 1u);
+}
+
+TEST_F(DownlinkMailbox, OneCommandPerNodeAtATime) {
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  downlink_mailbox_uplink(NODE);
+  sent_command();
+  downlink_mailbox_enqueue(NODE, PIR_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  downlink_mailbox_uplink(NODE);
+  EXPECT_TRUE(Serial.host_take_written().empty());
+
+  respond(false);
+  downlink_mailbox_uplink(NODE);
+  EXPECT_FALSE(sent_command().empty());
+  EXPECT_EQ(downlink_mailbox_get_statistics()->commands, 2u);
+}
+
+TEST_F(DownlinkMailbox, DeliveredWhenTheCommandCompletes) {
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  downlink_mailbox_enqueue(NODE, PIR_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  downlink_mailbox_uplink(NODE);
+  respond(false);
+  const downlink_mailbox_statistics_t* statistics = downlink_mailbox_get_statistics();
+  EXPECT_EQ(statistics->delivered, 2u);
+  EXPECT_EQ(statistics->depth, 0u);
+  EXPECT_TRUE(mails().empty());
+}
+
+TEST_F(DownlinkMailbox, RetriedAtLaterUplinksUntilGivenUp) {
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  downlink_mailbox_uplink(NODE);
+  respond(true);
+  ASSERT_EQ(mails().size(), 1u);
+  EXPECT_EQ(mails()[0].state, MAIL_PENDING);
+
+  // the modem never completes the second attempt
+  downlink_mailbox_uplink(NODE);
+  host_advance_time(RESPONSE_TIMEOUT + 1);
+  downlink_mailbox_handle();
+  EXPECT_EQ(mails()[0].state, MAIL_PENDING);
+
+  downlink_mailbox_uplink(NODE);
+  respond(true);
+  const downlink_mailbox_statistics_t* statistics = downlink_mailbox_get_statistics();
+  EXPECT_EQ(statistics->commands, 3u);
+  EXPECT_EQ(statistics->retries, 2u);
+  EXPECT_EQ(statistics->timeouts, 1u);
+  EXPECT_EQ(statistics->failed, 1u);
+  EXPECT_TRUE(mails().empty());
+}
+
+TEST_F(DownlinkMailbox, PendingWritesExpire) {
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  host_advance_time(TTL * 1000);
+  downlink_mailbox_handle();
+  EXPECT_EQ(downlink_mailbox_get_statistics()->expired, 1u);
+  EXPECT_TRUE(mails().empty());
+}
+
+TEST_F(DownlinkMailbox, WaitsWhileABridgeClientOwnsTheModem) {
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 0, 4, ones, TTL);
+  downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 3, 2, threes, TTL);
+  serial_set_exclusive(0, true);
+  downlink_mailbox_uplink(NODE);
+  EXPECT_TRUE(Serial.host_take_written().empty());
+  const downlink_mailbox_statistics_t* statistics = downlink_mailbox_get_statistics();
+  EXPECT_EQ(statistics->commands, 0u);
+  EXPECT_EQ(statistics->writes, 0u);
+  EXPECT_EQ(statistics->merged, 0u);
+  for(const downlink_mail_t& mail : mails()) {
+    EXPECT_EQ(mail.state, MAIL_PENDING);
+    EXPECT_EQ(mail.attempts, 0);
+  }
+
+  serial_set_exclusive(0, false);
+  downlink_mailbox_uplink(NODE);
+  EXPECT_FALSE(sent_command().empty());
+  EXPECT_EQ(statistics->commands, 1u);
+  EXPECT_EQ(statistics->merged, 1u);
+  EXPECT_EQ(statistics->retries, 0u);
+  for(const downlink_mail_t& mail : mails()) {
+    EXPECT_EQ(mail.state, MAIL_IN_FLIGHT);
+    EXPECT_EQ(mail.attempts, 1);
+  }
+}
+
+TEST_F(DownlinkMailbox, WritesPastTheFileOrWithoutTtlAreRejected) {
+  EXPECT_FALSE(downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 253, 4, ones, TTL));
+  EXPECT_FALSE(downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 0, 4, ones, 0));
+  EXPECT_TRUE(downlink_mailbox_enqueue(NODE, LIGHT_CONFIG_FILE_ID, 251, 4, ones, TTL));
+  EXPECT_EQ(mails().size(), 1u);
+}
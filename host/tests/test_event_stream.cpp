@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include "event_stream.h"
+
+static std::string received(WiFiClient& client) {
+  std::vector<uint8_t>& written = client.host_socket()->written;
+  std::string text(written.begin(), written.end());
+  written.clear();
+  return text;
+}
+
+static void push(publish_object_t* object, const char* name, const char* state) {
+  custom_file_contents_t contents = {};
+  contents.file_id = PIR_FILE_ID;
+  memset(object, 0, sizeof(publish_object_t));
+  snprintf(object->name, sizeof(object->name), "%s", name);
+  snprintf(object->state, sizeof(object->state), "%s", state);
+  event_stream_push(&contents, object, 1);
+}
+
+TEST(EventStream, OversizedEventKeepsTheOneInItsSlot) {
+  event_stream_init();
+  WiFiClient client;
+  client.connect(IPAddress(), 0);
+  ASSERT_TRUE(event_stream_add_client(client));
+  received(client);
+
+  // the ring is full and the client has not read any of it yet
+  publish_object_t objects[12];
+  char state[4];
+  for(uint8_t event = 0; event < 8; event++) {
+    snprintf(state, sizeof(state), "%u", event);
+    push(&objects[0], "motion", state);
+  }
+  // twelve full entities do not fit in one event
+  for(uint8_t index = 0; index < 12; index++) {
+    memset(objects[index].name, 'n', sizeof(objects[index].name) - 1);
+    memset(objects[index].state, 's', sizeof(objects[index].state) - 1);
+  }
+  custom_file_contents_t contents = {};
+  event_stream_push(&contents, objects, 12);
+
+  for(uint8_t event = 0; event < 8; event++) {
+    event_stream_handle();
+    snprintf(state, sizeof(state), "%u", event);
+    EXPECT_NE(received(client).find("\"motion\":\"" + std::string(state) + "\""), std::string::npos) << "event " << (int) event;
+  }
+  event_stream_handle();
+  EXPECT_EQ(received(client), "");
+  client.stop();
+  event_stream_handle();
+}
+
+TEST(EventStream, NamesAndStatesAreEscaped) {
+  event_stream_init();
+  WiFiClient client;
+  client.connect(IPAddress(), 0);
+  ASSERT_TRUE(event_stream_add_client(client));
+  received(client);
+
+  publish_object_t object;
+  push(&object, "a \"quoted\" <name>", "1\\2");
+  event_stream_handle();
+  EXPECT_NE(received(client).find("\"a &quot;quoted&quot; &lt;name&gt;\":\"1\\\\2\""), std::string::npos);
+  client.stop();
+  event_stream_handle();
+}
+
+TEST(EventStream, StalledClientResumesWhereItStopped) {
+  event_stream_init();
+  WiFiClient client;
+  client.connect(IPAddress(), 0);
+  ASSERT_TRUE(event_stream_add_client(client));
+  received(client);
+
+  publish_object_t object;
+  push(&object, "motion", "detected");
+  // the socket buffer only takes the start of the event, the rest goes once the browser reads again
+  client.host_socket()->write_limit = 10;
+  event_stream_handle();
+  event_stream_handle();
+  std::string text = received(client);
+  EXPECT_EQ(text.size(), 10u);
+  client.host_socket()->write_limit = SIZE_MAX;
+  event_stream_handle();
+  text += received(client);
+  EXPECT_EQ(text.rfind("data: {", 0), 0u);
+  EXPECT_NE(text.find("\"motion\":\"detected\"}}\n\n"), std::string::npos);
+  client.stop();
+  event_stream_handle();
+}
+
+TEST(EventStream, ClientLosingTheRestOfAnEventIsDropped) {
+  event_stream_init();
+  WiFiClient client;
+  client.connect(IPAddress(), 0);
+  ASSERT_TRUE(event_stream_add_client(client));
+  received(client);
+
+  publish_object_t object;
+  push(&object, "motion", "0");
+  client.host_socket()->write_limit = 10;
+  event_stream_handle();
+  // the event it is halfway through gets overwritten
+  for(uint8_t event = 0; event < 8; event++)
+    push(&object, "motion", "1");
+  client.host_socket()->write_limit = SIZE_MAX;
+  event_stream_handle();
+  EXPECT_FALSE(client.connected());
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "file_cache.h"
+
+#define NODE 0xE0D7000000000001ULL
+#define RAM_ENTRIES 64
+
+static const uint8_t image[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+static custom_file_contents_t update(uint64_t uid, uint8_t offset, uint8_t length, const uint8_t* data) {
+  custom_file_contents_t contents = {};
+  contents.file_id = HUMIDITY_FILE_ID;
+  contents.chip_id = uid;
+  contents.offset = offset;
+  contents.length = length;
+  memcpy(contents.buffer, data, length);
+  return contents;
+}
+
+class FileCache : public testing::Test {
+  protected:
+    void SetUp() override {
+      host_set_psram(0);
+      file_cache_init();
+    }
+};
+
+TEST_F(FileCache, FullImagePassesThrough) {
+  custom_file_contents_t contents = update(NODE, 0, sizeof(image), image);
+  ASSERT_TRUE(file_cache_merge(&contents));
+  EXPECT_EQ(std::vector<uint8_t>(contents.buffer, contents.buffer + contents.length), std::vector<uint8_t>(image, image + sizeof(image)));
+  EXPECT_EQ(file_cache_get_statistics()->merges, 0u);
+}
+
+TEST_F(FileCache, PartialOffsetIsMergedIntoTheImage) {
+  custom_file_contents_t contents = update(NODE, 0, sizeof(image), image);
+  ASSERT_TRUE(file_cache_merge(&contents));
+  const uint8_t temperature[] = { 0xAA, 0xBB };
+  contents = update(NODE, 4, sizeof(temperature), temperature);
+  ASSERT_TRUE(file_cache_merge(&contents));
+
+  // the parser gets the whole file from offset 0, with the new bytes in place
+  const uint8_t merged[] = { 1, 2, 3, 4, 0xAA, 0xBB, 7, 8 };
+  EXPECT_EQ(contents.offset, 0);
+  EXPECT_EQ(std::vector<uint8_t>(contents.buffer, contents.buffer + contents.length), std::vector<uint8_t>(merged, merged + sizeof(merged)));
+  EXPECT_EQ(file_cache_get_statistics()->merges, 1u);
+}
+
+TEST_F(FileCache, IncompleteImageIsHeldBack) {
+  custom_file_contents_t contents = update(NODE, 4, 4, &image[4]);
+  EXPECT_FALSE(file_cache_merge(&contents));
+  EXPECT_EQ(file_cache_get_statistics()->incomplete, 1u);
+
+  // the missing start completes the image the earlier update left in the cache
+  contents = update(NODE, 0, 4, image);
+  ASSERT_TRUE(file_cache_merge(&contents));
+  EXPECT_EQ(std::vector<uint8_t>(contents.buffer, contents.buffer + contents.length), std::vector<uint8_t>(image, image + sizeof(image)));
+}
+
+TEST_F(FileCache, ImagesOfOtherNodesAreKeptApart) {
+  custom_file_contents_t contents = update(NODE, 0, sizeof(image), image);
+  file_cache_merge(&contents);
+  contents = update(NODE + 1, 4, 4, &image[4]);
+  EXPECT_FALSE(file_cache_merge(&contents));
+}
+
+TEST_F(FileCache, LeastRecentlyUpdatedImageIsEvicted) {
+  const file_cache_statistics_t* statistics = file_cache_get_statistics();
+  ASSERT_EQ(statistics->capacity, RAM_ENTRIES);
+  for(uint64_t node = 0; node < RAM_ENTRIES; node++) {
+    custom_file_contents_t contents = update(NODE + node, 0, sizeof(image), image);
+    file_cache_merge(&contents);
+  }
+  // the first node updates again, so the second one is the least recently updated
+  custom_file_contents_t contents = update(NODE, 0, sizeof(image), image);
+  file_cache_merge(&contents);
+  contents = update(NODE + RAM_ENTRIES, 0, sizeof(image), image);
+  file_cache_merge(&contents);
+  EXPECT_EQ(statistics->evictions, 1u);
+  EXPECT_EQ(statistics->entries, RAM_ENTRIES);
+
+  contents = update(NODE, 4, 4, &image[4]);
+  EXPECT_TRUE(file_cache_merge(&contents));
+  contents = update(NODE + 1, 4, 4, &image[4]);
+  EXPECT_FALSE(file_cache_merge(&contents));
+}
+
+// the parser gets them as they came, a part of one cannot be completed
+TEST_F(FileCache, LargeFilesBypassTheCache) {
+  uint8_t data[FILE_CACHE_MAX_IMAGE + 1] = {};
+  custom_file_contents_t contents = update(NODE, 0, sizeof(data), data);
+  EXPECT_TRUE(file_cache_merge(&contents));
+  contents = update(NODE, 8, FILE_CACHE_MAX_IMAGE, data);
+  EXPECT_FALSE(file_cache_merge(&contents));
+  EXPECT_EQ(file_cache_get_statistics()->entries, 0u);
+}
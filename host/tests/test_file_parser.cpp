@@ -0,0 +1,107 @@
+// golden output of the parser per file ID, run with GOLDEN_UPDATE=1 to rewrite host/golden after an intended change
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include "file_parser.h"
+
+#define MAX_RESULTS 12
+
+typedef struct {
+  int16_t file_id;
+  uint8_t length;
+  uint8_t bytes[16];
+} sample_t;
+
+// one image per file a node sends, with values a sensor would report
+static const sample_t samples[] = {
+  { BUTTON_FILE_ID,             3, { 0x02, 0x01, 0x04 } },
+  { HUMIDITY_FILE_ID,           8, { 0xC7, 0x01, 0x00, 0x00, 0xD5, 0x00, 0x00, 0x00 } },
+  { PUSH7_STATE_FILE_ID,        4, { 0x2A, 0x0B, 0x02, 0x07 } },
+  { LIGHT_FILE_ID,              8, { 0x39, 0x30, 0x00, 0x00, 0xE8, 0x03, 0x01, 0x00 } },
+  { PIR_FILE_ID,                1, { 0x01 } },
+  { HALL_EFFECT_FILE_ID,        1, { 0x00 } },
+  { BUTTON_CONFIG_FILE_ID,      4, { 0x01, 0x00, 0x01, 0x01 } },
+  { HUMIDITY_CONFIG_FILE_ID,    5, { 0x3C, 0x00, 0x00, 0x00, 0x01 } },
+  { PUSH7_CONFIG_STATE_FILE_ID, 7, { 0x10, 0x0E, 0x00, 0x00, 0x01, 0x01, 0x0E } },
+  { LIGHT_CONFIG_FILE_ID,      16, { 0x3C, 0x00, 0x00, 0x00, 0x02, 0x01, 0x03, 0xD0, 0x07, 0x64, 0x00, 0x01, 0x00, 0x05, 0x01, 0x01 } },
+  { PIR_CONFIG_FILE_ID,         9, { 0x01, 0x00, 0x01, 0x02, 0x01, 0x0A, 0x00, 0x20, 0x01 } },
+  { HALL_EFFECT_CONFIG_FILE_ID, 3, { 0x01, 0x01, 0x01 } },
+};
+
+static std::string render(const sample_t* sample) {
+  custom_file_contents_t contents = {};
+  contents.file_id = sample->file_id;
+  contents.length = sample->length;
+  memcpy(contents.buffer, sample->bytes, sample->length);
+  const uint8_t uid[8] = { 0xE0, 0x02, 0x2A, 0x00, 0x00, 0x12, 0x34, 0x56 };
+  memcpy(contents.uid, uid, sizeof(uid));
+  contents.rssi = 87;
+
+  publish_object_t results[MAX_RESULTS];
+  file_parser_init(MAX_RESULTS);
+  uint8_t amount = parse_custom_files(&contents, results);
+
+  std::ostringstream text;
+  for(uint8_t index = 0; index < amount; index++) {
+    publish_object_t* object = &results[index];
+    text << object->uid << " " << object->object_id << "\n"
+         << "  name=" << object->name << " component=" << object->component << " category=" << object->category
+         << " unit=" << object->unit << " icon=" << object->icon << " state_class=" << object->state_class
+         << " device_class=" << object->device_class << " sw_version=" << object->sw_version << " model=" << object->model
+         << " shown=" << object->default_shown << "\n"
+         << "  state=" << object->state << "\n";
+  }
+
+  uint8_t buffer[256];
+  cbor_writer_t writer;
+  cbor_init(&writer, buffer, sizeof(buffer));
+  file_parser_encode_cbor(&contents, &writer);
+  text << "cbor";
+  char hex[3];
+  for(uint16_t index = 0; index < writer.length; index++) {
+    snprintf(hex, sizeof(hex), "%02x", buffer[index]);
+    text << (index % 32 ? "" : "\n  ") << hex;
+  }
+  text << "\n";
+  return text.str();
+}
+
+class FileParserGolden : public testing::TestWithParam<sample_t> {};
+
+TEST_P(FileParserGolden, MatchesGoldenOutput) {
+  std::string path = std::string(GOLDEN_DIR) + "/file_" + std::to_string(GetParam().file_id) + ".txt";
+  std::string output = render(&GetParam());
+  if(getenv("GOLDEN_UPDATE")) {
+    std::ofstream(path) << output;
+    return;
+  }
+  std::ifstream golden(path);
+  ASSERT_TRUE(golden.good()) << path << " is missing, run with GOLDEN_UPDATE=1 to create it";
+  std::stringstream expected;
+  expected << golden.rdbuf();
+  EXPECT_EQ(expected.str(), output);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllFiles, FileParserGolden, testing::ValuesIn(samples),
+  [](const testing::TestParamInfo<sample_t>& info) { return "file_" + std::to_string(info.param.file_id); });
+
+TEST(FileParser, UnknownFileHasNoResults) {
+  sample_t sample = { 42, 2, { 0x01, 0x02 } };
+  // nothing to publish, the CBOR document is {"raw": h'0102'}
+  EXPECT_EQ(render(&sample), "cbor\n  a163726177420102\n");
+}
+
+TEST(FileParser, PartialFileIsEncodedRaw) {
+  custom_file_contents_t contents = {};
+  contents.file_id = HUMIDITY_FILE_ID;
+  contents.offset = 4;
+  contents.length = 4;
+  uint8_t buffer[32];
+  cbor_writer_t writer;
+  cbor_init(&writer, buffer, sizeof(buffer));
+  file_parser_encode_cbor(&contents, &writer);
+  // {"raw": h'00000000'}
+  const uint8_t expected[] = { 0xA1, 0x63, 'r', 'a', 'w', 0x44, 0, 0, 0, 0 };
+  ASSERT_EQ(writer.length, sizeof(expected));
+  EXPECT_EQ(0, memcmp(buffer, expected, sizeof(expected)));
+}
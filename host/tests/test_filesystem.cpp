@@ -0,0 +1,168 @@
+// the configuration has to survive a power cut at any point of a commit, with either the old or the new record
+#include <gtest/gtest.h>
+#include <EEPROM.h>
+#include "filesystem.h"
+#include "persisted.h"
+
+#define FILESYSTEM_SIZE 1232
+
+static void configure(host_config_t* config, const char* ssid, const char* broker, uint32_t port, const char* prefix) {
+  memset(config, 0, sizeof(host_config_t));
+  host_set(config->ssid, &config->ssid_length, ssid);
+  host_set(config->password, &config->password_length, "secret");
+  host_set(config->broker, &config->broker_length, broker);
+  host_set(config->user, &config->user_length, "user");
+  host_set(config->mqtt_password, &config->mqtt_password_length, "password");
+  host_set(config->prefix, &config->prefix_length, prefix);
+  config->port = port;
+  config->output_mode = OUTPUT_MODE_COMPACT;
+}
+
+static bool same(host_config_t* read, host_config_t* written) {
+  return !strcmp(read->ssid, written->ssid) && !strcmp(read->broker, written->broker) && !strcmp(read->prefix, written->prefix)
+    && read->ssid_length == written->ssid_length && read->port == written->port && read->output_mode == written->output_mode;
+}
+
+static void boot(host_config_t* read) {
+  EEPROM.host_reboot();
+  filesystem_init(FILESYSTEM_SIZE);
+  memset(read, 0, sizeof(host_config_t));
+  filesystem_read(host_persisted(read));
+}
+
+static void erase() {
+  EEPROM.host_image().assign(FILESYSTEM_SIZE, 0xFF);
+}
+
+class Filesystem : public testing::Test {
+  protected:
+    void SetUp() override {
+      erase();
+      configure(&first, "first", "10.0.0.1", 1883, "d7/first");
+      configure(&second, "second", "broker.local", 8883, "d7/second");
+      configure(&third, "third", "10.0.0.3", 1884, "d7/third");
+    }
+    host_config_t first, second, third, read;
+};
+
+TEST_F(Filesystem, EmptyImageGetsDefaults) {
+  boot(&read);
+  EXPECT_EQ(read.ssid_length, 0);
+  EXPECT_EQ(read.port, 1883u);
+  EXPECT_EQ(read.output_mode, OUTPUT_MODE_HOME_ASSISTANT);
+}
+
+TEST_F(Filesystem, WritesAlternateBetweenSlots) {
+  for(host_config_t* config : { &first, &second, &third, &first }) {
+    boot(&read);
+    filesystem_write(host_persisted(config));
+    boot(&read);
+    EXPECT_TRUE(same(&read, config));
+  }
+}
+
+TEST_F(Filesystem, UnchangedConfigurationIsNotCommitted) {
+  boot(&read);
+  filesystem_write(host_persisted(&first));
+  uint32_t commits = EEPROM.host_commits();
+  filesystem_write(host_persisted(&first));
+  EXPECT_EQ(EEPROM.host_commits(), commits);
+}
+
+// cut the power after every byte of the commit that reached flash, bytes that do not change are not counted.
+// The first commit goes into the empty slot, the second over the slot of the oldest record
+TEST_F(Filesystem, PowerCutAtEveryOffsetKeepsOldOrNewRecord) {
+  boot(&read);
+  filesystem_write(host_persisted(&first));
+  host_config_t* previous = &first;
+  for(host_config_t* next : { &second, &third }) {
+    std::vector<uint8_t> before = EEPROM.host_image();
+    size_t cut = 0;
+    for(;; cut++) {
+      EEPROM.host_image() = before;
+      boot(&read);
+      EEPROM.host_cut_power_after(cut);
+      filesystem_write(host_persisted(next));
+      if(!EEPROM.host_power_was_cut())
+        break;
+      boot(&read);
+      // the torn record is never taken before the whole of it is written
+      ASSERT_TRUE(same(&read, previous)) << "cut after " << cut << " bytes";
+    }
+    EXPECT_GT(cut, 0u);
+    boot(&read);
+    EXPECT_TRUE(same(&read, next));
+    previous = next;
+  }
+}
+
+// a single corrupted byte anywhere in the newest record falls back to the record before it
+TEST_F(Filesystem, CorruptionAtEveryOffsetFallsBackToPreviousRecord) {
+  boot(&read);
+  filesystem_write(host_persisted(&first));
+  boot(&read);
+  filesystem_write(host_persisted(&second));
+  std::vector<uint8_t> written = EEPROM.host_image();
+  // the second record went to slot 0, its header holds the size of the record behind the magic, version and flags
+  uint16_t size = written[4] | written[5] << 8;
+  ASSERT_GT(size, 500);
+  for(size_t offset = 0; offset < 600; offset++) {
+    EEPROM.host_image() = written;
+    EEPROM.host_image()[offset] ^= 0x5A;
+    boot(&read);
+    EXPECT_TRUE(same(&read, offset < size ? &first : &second)) << "offset " << offset;
+  }
+}
+
+static void write_legacy(host_config_t* config) {
+  std::vector<uint8_t>& image = EEPROM.host_image();
+  size_t offset = 0;
+  image[offset++] = 238;
+  for(const char* value : { config->ssid, config->password, config->broker, config->user, config->mqtt_password }) {
+    image[offset++] = strlen(value);
+    memcpy(&image[offset], value, strlen(value));
+    offset += strlen(value);
+  }
+  image[offset++] = sizeof(uint32_t);
+  memcpy(&image[offset], &config->port, sizeof(uint32_t));
+}
+
+TEST_F(Filesystem, LegacyLayoutIsUpgraded) {
+  write_legacy(&first);
+  boot(&read);
+  EXPECT_STREQ(read.ssid, "first");
+  EXPECT_STREQ(read.broker, "10.0.0.1");
+  EXPECT_EQ(read.port, 1883u);
+  EXPECT_EQ(read.output_mode, OUTPUT_MODE_HOME_ASSISTANT);
+
+  filesystem_write(host_persisted(&second));
+  boot(&read);
+  EXPECT_TRUE(same(&read, &second));
+}
+
+// the upgrade writes slot 1, the legacy bytes at the start of slot 0 stay until a later commit
+TEST_F(Filesystem, PowerCutDuringUpgradeKeepsLegacyConfiguration) {
+  write_legacy(&first);
+  std::vector<uint8_t> before = EEPROM.host_image();
+  for(size_t cut = 0;; cut++) {
+    EEPROM.host_image() = before;
+    boot(&read);
+    EEPROM.host_cut_power_after(cut);
+    filesystem_write(host_persisted(&second));
+    if(!EEPROM.host_power_was_cut())
+      break;
+    boot(&read);
+    ASSERT_STREQ(read.ssid, "first") << "cut after " << cut << " bytes";
+  }
+}
+
+TEST_F(Filesystem, NetworkCacheSurvivesConfigurationWrites) {
+  boot(&read);
+  network_cache_t cache = { { 1, 2, 3, 4, 5, 6 }, 11, 0x1234, 0x0100000A };
+  filesystem_write_network_cache(&cache);
+  filesystem_write(host_persisted(&first));
+  boot(&read);
+  network_cache_t loaded;
+  ASSERT_TRUE(filesystem_read_network_cache(&loaded));
+  EXPECT_EQ(0, memcmp(&loaded, &cache, sizeof(cache)));
+}
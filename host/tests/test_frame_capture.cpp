@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <LittleFS.h>
+#include "frame_capture.h"
+
+#define HEADER_SIZE 7
+#define PAYLOAD_SIZE 193
+#define RECORD_SIZE (11 + HEADER_SIZE + PAYLOAD_SIZE)
+
+static void capture(uint32_t frames) {
+  static const uint8_t header[HEADER_SIZE] = { 0xC0, 0x00 };
+  static uint8_t payload[PAYLOAD_SIZE];
+  for(uint32_t frame = 0; frame < frames; frame++)
+    frame_capture_record(0, header, HEADER_SIZE, payload, PAYLOAD_SIZE, true);
+}
+
+TEST(FrameCapture, DownloadEndsOnceCaptureLappedIt) {
+  frame_capture_init();
+  ASSERT_TRUE(frame_capture_enable(true));
+  capture(10);
+  WiFiClient client;
+  client.connect("127.0.0.1", 80);
+  ASSERT_TRUE(frame_capture_download(client, CAPTURE_FORMAT_RAW));
+  frame_capture_handle();
+  ASSERT_TRUE(client.connected());
+
+  // the ring holds about 40 of these frames, every frame the download was going to send is overwritten
+  capture(100);
+  for(int loop = 0; loop < 3 && client.connected(); loop++)
+    frame_capture_handle();
+  EXPECT_FALSE(client.connected());
+}
+
+TEST(FrameCapture, DownloadSendsEveryFrame) {
+  frame_capture_init();
+  ASSERT_TRUE(frame_capture_enable(true));
+  capture(10);
+  WiFiClient client;
+  client.connect("127.0.0.1", 80);
+  ASSERT_TRUE(frame_capture_download(client, CAPTURE_FORMAT_RAW));
+  size_t header_size = client.host_socket()->written.size();
+  for(int loop = 0; loop < 10 && client.connected(); loop++)
+    frame_capture_handle();
+  EXPECT_FALSE(client.connected());
+  EXPECT_EQ(client.host_socket()->written.size() - header_size, 10u * RECORD_SIZE);
+}
+
+TEST(FrameCapture, SpillIsWrittenOutsideTheLoop) {
+  frame_capture_init();
+  ASSERT_TRUE(frame_capture_enable(true));
+  ASSERT_TRUE(frame_capture_spill(true));
+  capture(16);
+  frame_capture_handle();
+  // the loop only hands the batch over, the spill task writes it
+  for(int wait = 0; wait < 100 && frame_capture_get_statistics()->spilled < 16; wait++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(frame_capture_get_statistics()->spilled, 16u);
+  File file = LittleFS.open("/capture.bin", FILE_READ);
+  ASSERT_TRUE(file);
+  EXPECT_EQ(file.size(), 16u * RECORD_SIZE);
+}
+
+TEST(FrameCapture, StalledDownloadResumesWithoutLosingBytes) {
+  frame_capture_init();
+  ASSERT_TRUE(frame_capture_enable(true));
+  capture(10);
+  WiFiClient client;
+  client.connect("127.0.0.1", 80);
+  client.host_socket()->write_limit = 300;
+  ASSERT_TRUE(frame_capture_download(client, CAPTURE_FORMAT_RAW));
+  size_t header_size = client.host_socket()->written.size();
+  // the socket is full, the loop goes on without waiting for the client
+  for(int loop = 0; loop < 5; loop++)
+    frame_capture_handle();
+  EXPECT_TRUE(client.connected());
+  EXPECT_EQ(client.host_socket()->written.size(), 300u);
+
+  client.host_socket()->write_limit = SIZE_MAX;
+  for(int loop = 0; loop < 10 && client.connected(); loop++)
+    frame_capture_handle();
+  EXPECT_FALSE(client.connected());
+  EXPECT_EQ(client.host_socket()->written.size() - header_size, 10u * RECORD_SIZE);
+}
+
+TEST(FrameCapture, SpillDownloadWaitsForTheBatchInFlight) {
+  frame_capture_init();
+  ASSERT_TRUE(frame_capture_enable(true));
+  ASSERT_TRUE(frame_capture_spill(true));
+  capture(16);
+  frame_capture_handle();
+  WiFiClient client;
+  client.connect("127.0.0.1", 80);
+  // the spill task writes the batch within its 100 ms interval, until then the files may still change
+  EXPECT_FALSE(frame_capture_download(client, CAPTURE_FORMAT_SPILL));
+  for(int wait = 0; wait < 100 && frame_capture_get_statistics()->spilled < 16; wait++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_TRUE(frame_capture_download(client, CAPTURE_FORMAT_SPILL));
+  frame_capture_spill(false);
+  for(int loop = 0; loop < 100 && client.connected(); loop++)
+    frame_capture_handle();
+  EXPECT_FALSE(client.connected());
+}
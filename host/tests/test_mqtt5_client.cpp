@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "persisted.h"
+#include "mqtt_interface.h"
+#include "mqtt5_client.h"
+#include "WiFiClient.h"
+#include "PubSubClient.h"
+
+#define TOPIC "homeassistant/sensor/E0D7000000000001_humidity/state"
+
+static host_socket_t* broker = NULL;
+
+// a broker that grants 4 topic aliases
+static void accept(host_socket_t* socket) {
+  const uint8_t connack[] = { 0x20, 0x06, 0x00, 0x00, 0x03, 0x22, 0x00, 0x04 };
+  socket->received.insert(socket->received.end(), connack, connack + sizeof(connack));
+  broker = socket;
+}
+
+static bool publish(const char* topic, uint16_t length = 2) {
+  static uint8_t payload[600];
+  return mqtt5_client_publish(topic, payload, length, true, 0, NULL, 0);
+}
+
+// whether the last packet the broker got carries the topic, or only its alias
+static bool topic_sent(size_t from) {
+  std::string written(broker->written.begin() + from, broker->written.end());
+  return written.find(TOPIC) != std::string::npos;
+}
+
+class Mqtt5Client : public testing::Test {
+  protected:
+    void SetUp() override {
+      mqtt5_client_enable(true);
+      host_on_connect = accept;
+      ASSERT_TRUE(mqtt5_client_connect(IPAddress(127, 0, 0, 1), NULL, 1883, "test-v5", NULL, NULL));
+      host_on_connect = NULL;
+    }
+
+    void TearDown() override {
+      mqtt5_client_enable(false);
+    }
+};
+
+TEST_F(Mqtt5Client, RepeatedTopicIsSentAsAlias) {
+  uint32_t hits = mqtt5_client_get_statistics()->alias_hits;
+  ASSERT_TRUE(publish(TOPIC));
+  size_t written = broker->written.size();
+  ASSERT_TRUE(publish(TOPIC));
+  EXPECT_FALSE(topic_sent(written));
+  EXPECT_EQ(mqtt5_client_get_statistics()->alias_hits - hits, 1u);
+}
+
+TEST_F(Mqtt5Client, TooLargePublishMapsNoAlias) {
+  EXPECT_FALSE(publish(TOPIC, 500));
+  size_t written = broker->written.size();
+  ASSERT_TRUE(publish(TOPIC));
+  EXPECT_TRUE(topic_sent(written));
+}
+
+TEST_F(Mqtt5Client, FailedWriteMapsNoAlias) {
+  broker->write_limit = broker->written.size();
+  EXPECT_FALSE(publish(TOPIC));
+  broker->write_limit = SIZE_MAX;
+  size_t written = broker->written.size();
+  ASSERT_TRUE(publish(TOPIC));
+  EXPECT_TRUE(topic_sent(written));
+}
+
+// with MQTT 5 enabled but not connected the signal strength is a state of its own again
+TEST(Mqtt5Interface, SignalStrengthIsPublishedWithoutConnection) {
+  static host_config_t config = {};
+  host_set(config.broker, &config.broker_length, "127.0.0.1");
+  config.port = 1883;
+  persisted_data_t persisted = host_persisted(&config);
+  mqtt_interface_config_changed(persisted);
+  static char client_name[] = "test";
+  ASSERT_TRUE(mqtt_interface_connect(client_name, persisted));
+  mqtt5_client_enable(true);
+  ASSERT_FALSE(mqtt5_client_connected());
+
+  publish_object_t object = {};
+  sprintf(object.component, "sensor");
+  sprintf(object.object_id, "E0D7000000000001_received_signal_strength");
+  sprintf(object.device_class, "signal_strength");
+  sprintf(object.state, "-70");
+  object.received = 1000;
+  uint32_t publishes = PubSubClient::host_publishes;
+  uint32_t folded = mqtt5_client_get_statistics()->folded;
+  EXPECT_TRUE(mqtt_interface_publish_config(&object));
+  EXPECT_TRUE(mqtt_interface_publish_state(&object));
+  mqtt_interface_flush();
+  EXPECT_EQ(PubSubClient::host_publishes - publishes, 2u);
+  EXPECT_EQ(mqtt5_client_get_statistics()->folded, folded);
+  mqtt5_client_enable(false);
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include "frames.h"
+#include "uplinks.h"
+
+#define NODES 10
+#define MODEM0_RSSI 80
+#define MODEM1_RSSI 60
+
+static const uint8_t humidity[] = { 0xC7, 0x01, 0x00, 0x00, 0xD5, 0x00, 0x00, 0x00 };
+
+static uint64_t node_uid(uint32_t node) {
+  return 0xE0D7000000000000ULL | node;
+}
+
+// both modems hear every node, modem 1 the stronger. Frames interleave per modem as they would from two UARTs
+class MultiModem : public testing::Test {
+  protected:
+    void SetUp() override {
+      Serial.host_reset();
+      Serial1.host_reset();
+      host_uplinks_init();
+      ASSERT_EQ(serial_modem_count(), 2);
+    }
+
+    host_uplink_counts_t run(bool modem1_first) {
+      host_uplink_counts_t counts = {};
+      for(uint32_t node = 0; node < NODES; node++) {
+        std::vector<uint8_t> first = host_frame(node, SERIAL_MESSAGE_TYPE_ALP, host_uplink(node_uid(node), MODEM0_RSSI, HUMIDITY_FILE_ID, humidity, sizeof(humidity)));
+        std::vector<uint8_t> second = host_frame(node, SERIAL_MESSAGE_TYPE_ALP, host_uplink(node_uid(node), MODEM1_RSSI, HUMIDITY_FILE_ID, humidity, sizeof(humidity)));
+        (modem1_first ? Serial1 : Serial).host_inject(first.data(), first.size());
+        (modem1_first ? Serial : Serial1).host_inject(second.data(), second.size());
+        // a pass parses either a header or a payload per modem
+        for(int pass = 0; pass < 8; pass++)
+          host_uplinks_handle(&counts);
+      }
+      return counts;
+    }
+};
+
+TEST_F(MultiModem, EveryUplinkIsHandledOnce) {
+  host_uplink_counts_t counts = run(false);
+  EXPECT_EQ(counts.frames, 2u * NODES);
+  EXPECT_EQ(counts.new_uplinks, (uint32_t) NODES);
+  EXPECT_EQ(uplink_dedup_get_statistics()->cross_modem, (uint32_t) NODES);
+  EXPECT_EQ(device_registry_count(), NODES);
+}
+
+TEST_F(MultiModem, StrongerCopyReplacesTheFirstReception) {
+  // serial_parse steps the modems round robin from modem 0, so its copy at 80 comes before the one of modem 1 at 60
+  host_uplink_counts_t counts = run(false);
+  EXPECT_EQ(counts.stronger_copies, (uint32_t) NODES);
+  for(uint32_t node = 0; node < NODES; node++) {
+    device_record_t* device = device_registry_find(node_uid(node));
+    ASSERT_NE(device, nullptr);
+    EXPECT_EQ(device->uplinks, 1u);
+    EXPECT_EQ(device->modem, 1);
+    EXPECT_EQ(device->modems, 0x03);
+    EXPECT_EQ(device->rssi_last, MODEM1_RSSI);
+  }
+}
+
+TEST_F(MultiModem, WeakerCopyLeavesTheFirstReception) {
+  // swapping the UARTs gives modem 0 the stronger reception, the copy of modem 1 changes nothing
+  host_uplink_counts_t counts = run(true);
+  EXPECT_EQ(counts.new_uplinks, (uint32_t) NODES);
+  EXPECT_EQ(counts.stronger_copies, 0u);
+  for(uint32_t node = 0; node < NODES; node++)
+    EXPECT_EQ(device_registry_find(node_uid(node))->modem, 0);
+}
@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include "pipeline_stats.h"
+
+static std::string stats_json() {
+  static char json[1400];
+  EXPECT_NE(pipeline_stats_json(json, sizeof(json)), 0);
+  return json;
+}
+
+TEST(PipelineStats, LatencyIsMeasuredInMicroseconds) {
+  STATS_START(start);
+  host_advance_time(5);
+  STATS_STOP(STAGE_ALP, start);
+  std::string json = stats_json();
+  EXPECT_NE(json.find("\"alp\":{\"n\":1,"), std::string::npos) << json;
+  // the 5 ms land in the histogram bucket holding 5000 us, independent of the CPU frequency
+  uint32_t max = atoi(json.c_str() + json.find("\"max\":", json.find("\"alp\"")) + 6);
+  EXPECT_GE(max, 5000u);
+  EXPECT_LT(max, 5100u);
+}
+
+TEST(PipelineStats, OverheadIsReported) {
+  for(int record = 0; record < 1000; record++) {
+    STATS_START(start);
+    STATS_STOP(STAGE_TOTAL, start);
+  }
+  std::string json = stats_json();
+  ASSERT_NE(json.find("\"overhead\":{\"records\":1000,"), std::string::npos) << json;
+  EXPECT_EQ(json.back(), '}');
+}
+
+TEST(PipelineStats, TooSmallBufferGivesNothing) {
+  char json[64];
+  EXPECT_EQ(pipeline_stats_json(json, sizeof(json)), 0);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include "persisted.h"
+#include "publishes.h"
+#include "file_parser.h"
+#include "mqtt_interface.h"
+#include "publish_scheduler.h"
+#include "pipeline_stats.h"
+
+#define NODE 0xE0D7000000000001ULL
+#define MAX_PUBLISH_OBJECTS 12
+// a loop pass that only publishes waits this long for the next event
+#define LOOP_PASS_MS 5
+
+extern WiFiClient wifi_client;
+
+static publish_object_t results[MAX_PUBLISH_OBJECTS];
+
+static uint8_t parse(uint64_t uid, int16_t file_id, const void* data, uint8_t length) {
+  custom_file_contents_t contents = {};
+  contents.file_id = file_id;
+  contents.chip_id = uid;
+  contents.length = length;
+  memcpy(contents.buffer, data, length);
+  return parse_custom_files(&contents, results);
+}
+
+class PublishScheduler : public testing::Test {
+  protected:
+    void SetUp() override {
+      file_parser_init(MAX_PUBLISH_OBJECTS);
+      static host_config_t config = {};
+      host_set(config.broker, &config.broker_length, "127.0.0.1");
+      config.port = 1883;
+      persisted_data_t persisted = host_persisted(&config);
+      mqtt_interface_config_changed(persisted);
+      static char client_name[] = "test";
+      ASSERT_TRUE(mqtt_interface_connect(client_name, persisted));
+      publish_scheduler_init();
+      wifi_client.host_socket()->written.clear();
+    }
+
+    void drain() {
+      while(!publish_scheduler_idle()) {
+        publish_scheduler_handle();
+        host_advance_time(LOOP_PASS_MS);
+      }
+      mqtt_interface_flush();
+    }
+};
+
+// the button press comes in right behind the 24 publishes of a light config uplink
+TEST_F(PublishScheduler, ButtonStateOvertakesALightConfig) {
+  light_config_file_t light_config = {};
+  uint8_t amount = parse(NODE, LIGHT_CONFIG_FILE_ID, &light_config, sizeof(light_config));
+  publish_scheduler_enqueue(LIGHT_CONFIG_FILE_ID, results, amount, pipeline_stats_now());
+  button_file_t button = {};
+  button.mask = true;
+  amount = parse(NODE + 1, BUTTON_FILE_ID, &button, sizeof(button));
+  std::string button_topic = std::string("homeassistant/binary_sensor/") + results[0].object_id + "/state";
+  publish_scheduler_enqueue(BUTTON_FILE_ID, results, amount, pipeline_stats_now());
+  drain();
+
+  std::vector<std::string> topics = host_published_topics(wifi_client.host_socket());
+  ASSERT_GE(topics.size(), 24u);
+  EXPECT_EQ(topics[0], button_topic);
+  const publish_scheduler_statistics_t* statistics = publish_scheduler_get_statistics();
+  EXPECT_EQ(statistics->published[PUBLISH_CLASS_REALTIME], 1u);
+  for(uint8_t publish_class = 0; publish_class < PUBLISH_CLASS_COUNT; publish_class++)
+    EXPECT_EQ(statistics->dropped[publish_class], 0u);
+}
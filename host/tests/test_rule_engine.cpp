@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+#include "rule_engine.h"
+
+static uint8_t load(const char* rules_text) {
+  return rule_engine_load(rules_text);
+}
+
+TEST(RuleEngine, GpioRuleOnAFreePinLoads) {
+  EXPECT_EQ(load("* 51 button1 == on gpio 2 high\n* 51 button1 == off gpio 25 toggle\n"), 2);
+  EXPECT_EQ(rule_engine_get_statistics()->rejected_lines, 0);
+}
+
+TEST(RuleEngine, GpioRulesOnReservedPinsAreRejected) {
+  const char* pins[] = {
+    "-1", "40", "99", "2x",   // no pin at all
+    "34", "39",               // inputs only
+    "6", "11",                // SPI flash
+    "13",                     // modem busy
+    "1", "3",                 // Serial
+    "32", "33",               // modem 1 of the host build
+  };
+  for(const char* pin : pins) {
+    std::string rule = std::string("* 51 button1 == on gpio ") + pin + " high";
+    EXPECT_EQ(load(rule.c_str()), 0) << "pin " << pin;
+    EXPECT_EQ(rule_engine_get_statistics()->rejected_lines, 1) << "pin " << pin;
+  }
+}
+
+TEST(RuleEngine, AlpRulesOutsideTheFileAreRejected) {
+  EXPECT_EQ(load("* 51 button1 == on alp 0123456789ABCDEF 8 251 01020304"), 1);
+  const char* actions[] = {
+    "256 0 01",         // file 0 once truncated
+    "8 256 01",         // offset 0 once truncated
+    "8 252 01020304",   // ends past byte 255
+    "8 -1 01", "8 1x 01", "x 0 01",
+  };
+  for(const char* action : actions) {
+    std::string rule = std::string("* 51 button1 == on alp 0123456789ABCDEF ") + action;
+    EXPECT_EQ(load(rule.c_str()), 0) << action;
+    EXPECT_EQ(rule_engine_get_statistics()->rejected_lines, 1) << action;
+  }
+}
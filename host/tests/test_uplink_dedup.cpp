@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include "uplink_dedup.h"
+
+#define NODE 0xE0D7000000000001ULL
+#define DEDUP_CAPACITY (32 * 4)
+
+static custom_file_contents_t uplink(uint64_t uid, int16_t file_id, uint8_t value, uint8_t modem = 0, uint8_t rssi = 70) {
+  custom_file_contents_t contents = {};
+  contents.file_id = file_id;
+  contents.chip_id = uid;
+  contents.length = 4;
+  contents.buffer[0] = value;
+  contents.modem = modem;
+  contents.rssi = rssi;
+  return contents;
+}
+
+class UplinkDedup : public testing::Test {
+  protected:
+    void SetUp() override {
+      uplink_dedup_init();
+    }
+
+    uplink_dedup_result_t check(custom_file_contents_t contents) {
+      return uplink_dedup_check(&contents);
+    }
+};
+
+TEST_F(UplinkDedup, CopiesWithinTheWindowAreDropped) {
+  EXPECT_EQ(check(uplink(NODE, HUMIDITY_FILE_ID, 1)), UPLINK_NEW);
+  EXPECT_EQ(check(uplink(NODE, HUMIDITY_FILE_ID, 1)), UPLINK_DUPLICATE);
+  // another value, file or node is not a copy
+  EXPECT_EQ(check(uplink(NODE, HUMIDITY_FILE_ID, 2)), UPLINK_NEW);
+  EXPECT_EQ(check(uplink(NODE, LIGHT_FILE_ID, 1)), UPLINK_NEW);
+  EXPECT_EQ(check(uplink(NODE + 1, HUMIDITY_FILE_ID, 1)), UPLINK_NEW);
+  EXPECT_EQ(uplink_dedup_get_statistics()->duplicates, 1u);
+}
+
+TEST_F(UplinkDedup, WindowExpires) {
+  check(uplink(NODE, HUMIDITY_FILE_ID, 1));
+  host_advance_time(UPLINK_DEDUP_DEFAULT_WINDOW - 100);
+  EXPECT_EQ(check(uplink(NODE, HUMIDITY_FILE_ID, 1)), UPLINK_DUPLICATE);
+  // a copy does not extend the window, a value that keeps repeating still comes through once per window
+  host_advance_time(100);
+  EXPECT_EQ(check(uplink(NODE, HUMIDITY_FILE_ID, 1)), UPLINK_NEW);
+}
+
+TEST_F(UplinkDedup, EventsHaveAShorterWindow) {
+  check(uplink(NODE, BUTTON_FILE_ID, 1));
+  host_advance_time(1000);
+  EXPECT_EQ(check(uplink(NODE, BUTTON_FILE_ID, 1)), UPLINK_NEW);
+}
+
+TEST_F(UplinkDedup, WindowIsSetPerFileType) {
+  ASSERT_TRUE(uplink_dedup_set_window(HUMIDITY_FILE_ID, 5000));
+  check(uplink(NODE, HUMIDITY_FILE_ID, 1));
+  host_advance_time(4000);
+  EXPECT_EQ(check(uplink(NODE, HUMIDITY_FILE_ID, 1)), UPLINK_DUPLICATE);
+
+  ASSERT_TRUE(uplink_dedup_set_window(BUTTON_FILE_ID, 0));
+  check(uplink(NODE, BUTTON_FILE_ID, 1));
+  EXPECT_EQ(check(uplink(NODE, BUTTON_FILE_ID, 1)), UPLINK_NEW);
+
+  // a new boot starts from the defaults
+  uplink_dedup_init();
+  check(uplink(NODE, BUTTON_FILE_ID, 1));
+  EXPECT_EQ(check(uplink(NODE, BUTTON_FILE_ID, 1)), UPLINK_DUPLICATE);
+}
+
+TEST_F(UplinkDedup, StrongerCopyOnAnotherModemReplacesTheReception) {
+  check(uplink(NODE, HUMIDITY_FILE_ID, 1, 0, 80));
+  EXPECT_EQ(check(uplink(NODE, HUMIDITY_FILE_ID, 1, 1, 90)), UPLINK_DUPLICATE);
+  EXPECT_EQ(check(uplink(NODE, HUMIDITY_FILE_ID, 1, 1, 60)), UPLINK_STRONGER_COPY);
+  EXPECT_EQ(uplink_dedup_get_statistics()->cross_modem, 2u);
+}
+
+// more uplinks within one window than the cache holds, the earliest ones lose their entry
+TEST_F(UplinkDedup, FullCacheEvictsLiveEntries) {
+  const uint32_t uplinks = 2 * DEDUP_CAPACITY;
+  for(uint32_t node = 0; node < uplinks; node++)
+    ASSERT_EQ(check(uplink(NODE + node, HUMIDITY_FILE_ID, 1)), UPLINK_NEW);
+  const uplink_dedup_statistics_t* statistics = uplink_dedup_get_statistics();
+  EXPECT_GE(statistics->evictions, uplinks - DEDUP_CAPACITY);
+
+  uint32_t dropped = 0;
+  for(uint32_t node = 0; node < uplinks; node++)
+    dropped += check(uplink(NODE + node, HUMIDITY_FILE_ID, 1)) == UPLINK_DUPLICATE;
+  EXPECT_LE(dropped, (uint32_t) DEDUP_CAPACITY);
+  EXPECT_GT(dropped, 0u);
+}
@@ -0,0 +1,111 @@
+#include "logger.h"
+
+#define LOG_RING_SIZE 64
+#define LOG_LINE_SIZE 160
+#define DRAIN_INTERVAL_MS 50
+#define DRAIN_TASK_STACK 3072
+#define DRAIN_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+// on boards without a separate debug UART the modem shares Serial, logs are then only available over http
+#if defined(ARDUINO_ESP32_POE)
+  #define LOG_TO_SERIAL
+#endif
+
+typedef struct {
+  uint32_t timestamp;
+  const char* format;
+  uint32_t args[4];
+  log_level_t level;
+} log_record_t;
+
+static const char* level_names[] = { "E", "W", "I", "D" };
+
+static log_record_t records[LOG_RING_SIZE];
+static uint32_t next_sequence = 0;
+static log_level_t runtime_level = LOG_DEFAULT_LEVEL;
+
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool copy_record(uint32_t sequence, log_record_t* record) {
+  bool available;
+  portENTER_CRITICAL(&ring_lock);
+  available = (next_sequence - sequence) <= LOG_RING_SIZE && sequence != next_sequence;
+  if(available)
+    *record = records[sequence % LOG_RING_SIZE];
+  portEXIT_CRITICAL(&ring_lock);
+  return available;
+}
+
+#ifdef LOG_TO_SERIAL
+static void drain_task(void* parameters) {
+  static char line[LOG_LINE_SIZE];
+  uint32_t drained = 0;
+
+  for(;;) {
+    if(next_sequence - drained > LOG_RING_SIZE) {
+      Serial.printf("[log] %u records dropped\n", next_sequence - drained - LOG_RING_SIZE);
+      drained = next_sequence - LOG_RING_SIZE;
+    }
+    while(drained != next_sequence) {
+      uint16_t length = logger_format(drained++, line, sizeof(line));
+      if(length)
+        Serial.println(line);
+    }
+    vTaskDelay(pdMS_TO_TICKS(DRAIN_INTERVAL_MS));
+  }
+}
+#endif
+
+void logger_init() {
+#ifdef LOG_TO_SERIAL
+  xTaskCreatePinnedToCore(drain_task, "logger", DRAIN_TASK_STACK, NULL, DRAIN_TASK_PRIORITY, NULL, 0);
+#endif
+}
+
+void logger_log(log_level_t level, const char* format, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+  if(level > runtime_level)
+    return;
+
+  portENTER_CRITICAL(&ring_lock);
+  log_record_t* record = &records[next_sequence % LOG_RING_SIZE];
+  record->timestamp = millis();
+  record->format = format;
+  record->args[0] = arg0;
+  record->args[1] = arg1;
+  record->args[2] = arg2;
+  record->args[3] = arg3;
+  record->level = level;
+  next_sequence++;
+  portEXIT_CRITICAL(&ring_lock);
+}
+
+void logger_set_level(log_level_t level) {
+  runtime_level = level;
+}
+
+log_level_t logger_get_level() {
+  return runtime_level;
+}
+
+uint32_t logger_oldest_sequence() {
+  return next_sequence > LOG_RING_SIZE ? next_sequence - LOG_RING_SIZE : 0;
+}
+
+uint32_t logger_next_sequence() {
+  return next_sequence;
+}
+
+/**
+ * @brief format a record that is still in the ring
+ * @return the length of the line, 0 if the record was already overwritten
+ */
+uint16_t logger_format(uint32_t sequence, char* buffer, uint16_t size) {
+  log_record_t record;
+  if(!copy_record(sequence, &record))
+    return 0;
+
+  int length = snprintf(buffer, size, "%10u %s ", record.timestamp, level_names[record.level]);
+  if(length < size)
+    length += snprintf(&buffer[length], size - length, record.format, record.args[0], record.args[1], record.args[2], record.args[3]);
+  return min(length, size - 1);
+}
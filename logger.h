@@ -0,0 +1,45 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+#include "structures.h"
+
+typedef enum {
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_WARNING,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_DEBUG,
+} log_level_t;
+
+// statements above this level are compiled out, the runtime level filters the rest.
+// Debug statements are only built in with the core debug level at debug or verbose, or with -DLOG_COMPILE_LEVEL=LOG_LEVEL_DEBUG
+#ifndef LOG_COMPILE_LEVEL
+#if defined(CORE_DEBUG_LEVEL) && CORE_DEBUG_LEVEL >= 4
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+
+// formatting is deferred to the drain task: the format has to be a string literal and
+// only integer arguments (at most 4) are allowed, no %s or floats
+#define LOG_AT(level, format, ...) do { if((level) <= LOG_COMPILE_LEVEL) logger_log(level, format, ##__VA_ARGS__); } while(0)
+#define LOG_ERROR(format, ...)   LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#define LOG_WARNING(format, ...) LOG_AT(LOG_LEVEL_WARNING, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...)    LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...)   LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+
+void logger_init();
+
+void logger_log(log_level_t level, const char* format, uint32_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0, uint32_t arg3 = 0);
+
+void logger_set_level(log_level_t level);
+
+log_level_t logger_get_level();
+
+uint32_t logger_oldest_sequence();
+
+uint32_t logger_next_sequence();
+
+uint16_t logger_format(uint32_t sequence, char* buffer, uint16_t size);
+
+#endif
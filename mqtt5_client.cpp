@@ -0,0 +1,351 @@
+#include "mqtt5_client.h"
+#include <WiFiClient.h>
+#include "logger.h"
+
+#define MQTT_CONNECT    0x10
+#define MQTT_CONNACK    0x20
+#define MQTT_PUBLISH    0x30
+#define MQTT_PINGREQ    0xC0
+#define MQTT_DISCONNECT 0xE0
+
+#define MQTT_PROTOCOL_LEVEL 5
+#define MQTT_FLAG_USER      0x80
+#define MQTT_FLAG_PASSWORD  0x40
+#define MQTT_FLAG_CLEAN     0x02
+#define MQTT_PUBLISH_RETAIN 0x01
+
+#define PROPERTY_MESSAGE_EXPIRY      0x02
+#define PROPERTY_TOPIC_ALIAS_MAXIMUM 0x22
+#define PROPERTY_TOPIC_ALIAS         0x23
+#define PROPERTY_USER_PROPERTY       0x26
+
+#define KEEP_ALIVE 15
+#define CONNACK_TIMEOUT 2000
+#define MAX_PACKET_SIZE 512
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct {
+  uint64_t topic_hash; // 0 for an alias that is not mapped yet
+  uint32_t last_used;
+} topic_alias_t;
+
+static WiFiClient client;
+static uint8_t packet[MAX_PACKET_SIZE];
+static topic_alias_t aliases[MQTT5_MAX_TOPIC_ALIASES];
+static uint16_t alias_count = 0;
+static uint32_t alias_clock = 0;
+static unsigned long last_sent = 0;
+
+static mqtt5_statistics_t statistics;
+
+void mqtt5_client_enable(bool enable) {
+  statistics.enabled = enable;
+  if(!enable)
+    mqtt5_client_disconnect();
+}
+
+const mqtt5_statistics_t* mqtt5_client_get_statistics() {
+  return &statistics;
+}
+
+bool mqtt5_client_connected() {
+  return statistics.enabled && client.connected();
+}
+
+void mqtt5_client_disconnect() {
+  if(client.connected()) {
+    uint8_t disconnect[] = { MQTT_DISCONNECT, 0 };
+    client.write(disconnect, sizeof(disconnect));
+  }
+  client.stop();
+}
+
+static uint8_t varint_size(uint32_t value) {
+  uint8_t size = 1;
+  while(value >= 128) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static uint16_t put_varint(uint8_t* buffer, uint32_t value) {
+  uint16_t index = 0;
+  do {
+    uint8_t digit = value & 0x7F;
+    value >>= 7;
+    buffer[index++] = value ? digit | 0x80 : digit;
+  } while(value);
+  return index;
+}
+
+static uint16_t put_u16(uint8_t* buffer, uint16_t value) {
+  buffer[0] = value >> 8;
+  buffer[1] = value;
+  return 2;
+}
+
+static uint16_t put_string(uint8_t* buffer, const char* string, uint16_t length) {
+  put_u16(buffer, length);
+  memcpy(&buffer[2], string, length);
+  return 2 + length;
+}
+
+// fixed header and the body that was built after it, moved into place once its length is known
+static uint16_t finish_packet(uint8_t type, uint8_t* body, uint16_t body_length) {
+  uint8_t header[5];
+  header[0] = type;
+  uint16_t header_length = 1 + put_varint(&header[1], body_length);
+  memmove(&packet[header_length], body, body_length);
+  memcpy(packet, header, header_length);
+  return header_length + body_length;
+}
+
+static uint16_t property_length(uint8_t property, const uint8_t* data) {
+  switch(property) {
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+      return 1;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+      return 2;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+      return 4;
+    case 0x26:
+      {
+      uint16_t name_length = (data[0] << 8) | data[1];
+      return 2 + name_length + 2 + ((data[2 + name_length] << 8) | data[3 + name_length]);
+      }
+    default: // strings and binary data
+      return 2 + ((data[0] << 8) | data[1]);
+  }
+}
+
+static bool read_bytes(uint8_t* buffer, uint16_t length) {
+  unsigned long start = millis();
+  uint16_t received = 0;
+  while(received < length) {
+    if(millis() - start > CONNACK_TIMEOUT || !client.connected())
+      return false;
+    int read = client.read(&buffer[received], length - received);
+    if(read > 0)
+      received += read;
+    else
+      delay(1);
+  }
+  return true;
+}
+
+/**
+ * @brief wait for the CONNACK and take the topic alias maximum the broker grants
+ */
+static bool read_connack() {
+  uint8_t type;
+  uint32_t remaining = 0;
+  if(!read_bytes(&type, 1) || type != MQTT_CONNACK)
+    return false;
+  for(uint8_t shift = 0; shift < 28; shift += 7) {
+    uint8_t digit;
+    if(!read_bytes(&digit, 1))
+      return false;
+    remaining |= (uint32_t)(digit & 0x7F) << shift;
+    if(!(digit & 0x80))
+      break;
+  }
+  if(remaining < 3 || remaining > MAX_PACKET_SIZE || !read_bytes(packet, remaining))
+    return false;
+  if(packet[1] != 0) {
+    LOG_ERROR("mqtt5 connect refused with reason %02x", packet[1]);
+    return false;
+  }
+
+  statistics.topic_alias_maximum = 0;
+  uint16_t index = 2;
+  uint32_t properties_length = 0;
+  for(uint8_t shift = 0; index < remaining; shift += 7) {
+    uint8_t digit = packet[index++];
+    properties_length |= (uint32_t)(digit & 0x7F) << shift;
+    if(!(digit & 0x80))
+      break;
+  }
+  uint16_t end = min((uint32_t)remaining, index + properties_length);
+  while(index < end) {
+    uint8_t property = packet[index++];
+    if(property == PROPERTY_TOPIC_ALIAS_MAXIMUM)
+      statistics.topic_alias_maximum = (packet[index] << 8) | packet[index + 1];
+    index += property_length(property, &packet[index]);
+  }
+  return true;
+}
+
+/**
+ * @brief open the MQTT 5 connection next to the 3.1.1 one, aliases start empty on every connection
+ * @param host used when set, otherwise ip
+ */
+bool mqtt5_client_connect(IPAddress ip, const char* host, uint16_t port, const char* client_id, const char* user, const char* password) {
+  if(!statistics.enabled)
+    return false;
+  if(client.connected())
+    return true;
+
+  if(!(host ? client.connect(host, port) : client.connect(ip, port)))
+    return false;
+  client.setNoDelay(true);
+
+  uint8_t* body = &packet[5];
+  uint16_t length = 0;
+  uint16_t user_length = user ? strlen(user) : 0;
+  uint16_t password_length = password ? strlen(password) : 0;
+  length += put_string(&body[length], "MQTT", 4);
+  body[length++] = MQTT_PROTOCOL_LEVEL;
+  body[length++] = MQTT_FLAG_CLEAN | (user_length ? MQTT_FLAG_USER : 0) | (password_length ? MQTT_FLAG_PASSWORD : 0);
+  length += put_u16(&body[length], KEEP_ALIVE);
+  body[length++] = 0; // no connect properties, the broker sends no aliases to a client that does not ask for them
+  length += put_string(&body[length], client_id, strlen(client_id));
+  if(user_length)
+    length += put_string(&body[length], user, user_length);
+  if(password_length)
+    length += put_string(&body[length], password, password_length);
+
+  length = finish_packet(MQTT_CONNECT, body, length);
+  if(client.write(packet, length) != length || !read_connack()) {
+    client.stop();
+    return false;
+  }
+
+  alias_count = min((uint16_t)MQTT5_MAX_TOPIC_ALIASES, statistics.topic_alias_maximum);
+  memset(aliases, 0, sizeof(aliases));
+  last_sent = millis();
+  statistics.connects++;
+  LOG_INFO("mqtt5 connected, %u topic aliases", alias_count);
+  return true;
+}
+
+void mqtt5_client_loop() {
+  if(!mqtt5_client_connected())
+    return;
+  // nothing is subscribed, whatever the broker sends is a PINGRESP or a DISCONNECT
+  while(client.available())
+    client.read();
+  if(millis() - last_sent > KEEP_ALIVE * 1000 / 2) {
+    uint8_t ping[] = { MQTT_PINGREQ, 0 };
+    client.write(ping, sizeof(ping));
+    last_sent = millis();
+  }
+}
+
+static uint64_t topic_hash(const char* topic) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for(const char* c = topic; *c; c++) {
+    hash ^= (uint8_t)*c;
+    hash *= FNV_PRIME;
+  }
+  return hash ? hash : 1;
+}
+
+/**
+ * @brief find the alias of a topic, or the least recently used one to map it to
+ * @param known set when the broker already knows the mapping, so the topic can be left out
+ * @return the alias, 0 when the broker does not allow aliases, a new mapping is only stored once its publish is sent
+ */
+static uint16_t alias_of(uint64_t hash, bool* known) {
+  *known = false;
+  if(!alias_count)
+    return 0;
+  uint16_t victim = 0;
+  for(uint16_t index = 0; index < alias_count; index++) {
+    if(aliases[index].topic_hash == hash) {
+      *known = true;
+      return index + 1;
+    }
+    if(aliases[index].last_used < aliases[victim].last_used)
+      victim = index;
+  }
+  return victim + 1;
+}
+
+static uint32_t v311_publish_size(uint16_t topic_length, uint16_t payload_length) {
+  uint32_t remaining = 2 + topic_length + payload_length;
+  return 1 + varint_size(remaining) + remaining;
+}
+
+// a state that is not published because it travels as a user property
+void mqtt5_client_count_folded(const char* topic, uint16_t length) {
+  statistics.folded++;
+  statistics.v311_bytes += v311_publish_size(strlen(topic), length);
+}
+
+/**
+ * @brief publish at QoS 0 with a topic alias when the broker allows them
+ * @param expiry_interval seconds the broker keeps the message, 0 for no expiry
+ */
+bool mqtt5_client_publish(const char* topic, const uint8_t* payload, uint16_t length, bool retained, uint32_t expiry_interval,
+  const mqtt5_user_property_t* properties, uint8_t property_count) {
+  if(!mqtt5_client_connected())
+    return false;
+
+  uint8_t* body = &packet[5];
+  uint16_t body_size = MAX_PACKET_SIZE - 5;
+  uint16_t topic_length = strlen(topic);
+  uint64_t hash = topic_hash(topic);
+  bool known;
+  uint16_t alias = alias_of(hash, &known);
+
+  // properties are collected first, their length goes in front of them
+  uint8_t properties_buffer[128];
+  uint16_t properties_length = 0;
+  if(expiry_interval) {
+    properties_buffer[properties_length++] = PROPERTY_MESSAGE_EXPIRY;
+    properties_buffer[properties_length++] = expiry_interval >> 24;
+    properties_buffer[properties_length++] = expiry_interval >> 16;
+    properties_buffer[properties_length++] = expiry_interval >> 8;
+    properties_buffer[properties_length++] = expiry_interval;
+  }
+  if(alias) {
+    properties_buffer[properties_length++] = PROPERTY_TOPIC_ALIAS;
+    properties_length += put_u16(&properties_buffer[properties_length], alias);
+  }
+  for(uint8_t index = 0; index < property_count; index++) {
+    uint16_t name_length = strlen(properties[index].name);
+    uint16_t value_length = strlen(properties[index].value);
+    if(properties_length + 5 + name_length + value_length > sizeof(properties_buffer))
+      break;
+    properties_buffer[properties_length++] = PROPERTY_USER_PROPERTY;
+    properties_length += put_string(&properties_buffer[properties_length], properties[index].name, name_length);
+    properties_length += put_string(&properties_buffer[properties_length], properties[index].value, value_length);
+  }
+
+  uint16_t sent_topic_length = known ? 0 : topic_length;
+  if(2 + sent_topic_length + 4 + properties_length + length > body_size) {
+    statistics.publish_failures++;
+    return false;
+  }
+  uint16_t body_length = put_string(body, topic, sent_topic_length);
+  body_length += put_varint(&body[body_length], properties_length);
+  memcpy(&body[body_length], properties_buffer, properties_length);
+  body_length += properties_length;
+  memcpy(&body[body_length], payload, length);
+  body_length += length;
+
+  uint16_t packet_length = finish_packet(MQTT_PUBLISH | (retained ? MQTT_PUBLISH_RETAIN : 0), body, body_length);
+  if(client.write(packet, packet_length) != packet_length) {
+    // the broker may have missed a new mapping, forget them all
+    memset(aliases, 0, sizeof(aliases));
+    statistics.publish_failures++;
+    return false;
+  }
+
+  if(alias) {
+    aliases[alias - 1].topic_hash = hash;
+    aliases[alias - 1].last_used = ++alias_clock;
+  }
+  last_sent = millis();
+  statistics.publishes++;
+  statistics.bytes += packet_length;
+  statistics.v311_bytes += v311_publish_size(topic_length, length);
+  if(known)
+    statistics.alias_hits++;
+  else
+    statistics.alias_misses++;
+  return true;
+}
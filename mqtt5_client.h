@@ -0,0 +1,43 @@
+#ifndef MQTT5_CLIENT_H
+#define MQTT5_CLIENT_H
+#include "structures.h"
+
+// aliases kept per connection, the broker may allow fewer
+#define MQTT5_MAX_TOPIC_ALIASES 32
+
+typedef struct {
+  const char* name;
+  const char* value;
+} mqtt5_user_property_t;
+
+typedef struct {
+  bool enabled;
+  uint32_t connects;
+  uint16_t topic_alias_maximum; // granted by the broker in CONNACK
+  uint32_t publishes;
+  uint32_t publish_failures;
+  uint32_t alias_hits;    // publishes that sent the alias only
+  uint32_t alias_misses;  // publishes that sent the topic, with a new or reused alias
+  uint32_t bytes;         // bytes sent in PUBLISH packets
+  uint32_t v311_bytes;    // bytes the same states take as MQTT 3.1.1 publishes, folded ones included
+  uint32_t folded;        // signal strength states sent as user properties instead
+} mqtt5_statistics_t;
+
+void mqtt5_client_enable(bool enable);
+
+bool mqtt5_client_connect(IPAddress ip, const char* host, uint16_t port, const char* client_id, const char* user, const char* password);
+
+bool mqtt5_client_connected();
+
+void mqtt5_client_disconnect();
+
+void mqtt5_client_loop();
+
+bool mqtt5_client_publish(const char* topic, const uint8_t* payload, uint16_t length, bool retained, uint32_t expiry_interval,
+  const mqtt5_user_property_t* properties, uint8_t property_count);
+
+void mqtt5_client_count_folded(const char* topic, uint16_t length);
+
+const mqtt5_statistics_t* mqtt5_client_get_statistics();
+
+#endif
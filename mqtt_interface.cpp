@@ -6,16 +6,41 @@
 #include <WiFiClient.h>
 #include <string>
 #include <WebServer.h>
+#include "pipeline_stats.h"
+#include "logger.h"
+#include "mqtt5_client.h"
+#include "coalescing_client.h"
+#include "filesystem.h"
+#include "boot_timeline.h"
 
 #define MAX_MQTT_LENGTH 250
 
+// the MQTT 5 connection is only tried on the plain port, and not more often than this
+#define MQTT5_PORT 1883
+#define MQTT5_RETRY_INTERVAL 30000
+
+// retained states expire on the broker when a node stops reporting for a day
+#define MQTT5_STATE_EXPIRY 86400
+
 // Global clients
 WiFiClient wifi_client;
 WiFiClientSecure wifi_client_secure;
+CoalescingClient mqtt_socket(&wifi_client);
 PubSubClient* mqtt_client = nullptr;
 
 static bool configuration_changed = true;
 
+static IPAddress broker_ip;
+static const char* broker_host = nullptr;
+static uint16_t broker_port;
+static unsigned long mqtt5_attempt = 0;
+static bool mqtt5_attempted = false;
+static uint32_t broker_hash = 0;
+static bool broker_ip_cached = false;
+static bool broker_cache_failed = false;
+
+static mqtt_statistics_t statistics;
+
 void downlink(char* topic, byte* message, unsigned int length) {
 
 }
@@ -26,6 +51,30 @@ static bool address_is_ip(char_length_t mqtt_broker) {
     return (broker.find_first_not_of("1234567890.") == std::string::npos);
 }
 
+static uint32_t hash_broker(char_length_t mqtt_broker) {
+    uint32_t hash = 2166136261;
+    for(int i = 0; i < *mqtt_broker.length; i++)
+        hash = (hash ^ (uint8_t)mqtt_broker.content[i]) * 16777619;
+    return hash;
+}
+
+// the address the broker had on the last good connection, saves the mDNS query of up to seconds on a boot
+static bool cached_broker_ip(IPAddress* server_ip) {
+    network_cache_t cache;
+    if(broker_cache_failed || !filesystem_read_network_cache(&cache) || !cache.broker_ip || cache.broker_hash != broker_hash)
+        return false;
+    *server_ip = IPAddress(cache.broker_ip);
+    return true;
+}
+
+static void remember_broker_ip() {
+    network_cache_t cache;
+    filesystem_read_network_cache(&cache);
+    cache.broker_hash = broker_hash;
+    cache.broker_ip = (uint32_t)broker_ip;
+    filesystem_write_network_cache(&cache);
+}
+
 static bool update_configuration(persisted_data_t persisted_data) {
     if(!configuration_changed)
         return true;
@@ -40,31 +89,36 @@ static bool update_configuration(persisted_data_t persisted_data) {
     if (mqtt_client != nullptr) {
         delete mqtt_client;
     }
+    mqtt5_client_disconnect();
+    mqtt5_attempted = false;
 
     IPAddress server_ip;
     bool use_raw = false;
-    server_ip = MDNS.queryHost(persisted_data.mqtt_broker.content);
+    broker_hash = hash_broker(persisted_data.mqtt_broker);
+    broker_ip_cached = cached_broker_ip(&server_ip);
+    if(!broker_ip_cached)
+        server_ip = MDNS.queryHost(persisted_data.mqtt_broker.content);
     
     if(server_ip.toString().equals("0.0.0.0")) {
         // Check if the address is only built of numbers and dots, if not use it as url instead.
         use_raw = !address_is_ip(persisted_data.mqtt_broker);
         if(!use_raw) {
             if(!WiFi_get_ip_by_name(persisted_data.mqtt_broker.content, &server_ip)) {
-                DPRINTLN("No valid IP found for mqtt broker");
+                LOG_ERROR("No valid IP found for mqtt broker");
                 return false;
             }
         }
     }
-    DPRINT("Set mqtt server to ");
-    DPRINTLN(server_ip);
+    LOG_INFO("Set mqtt server to %u.%u.%u.%u", server_ip[0], server_ip[1], server_ip[2], server_ip[3]);
 
     // Choose appropriate client based on port
     if (*persisted_data.mqtt_port == 1883) {
-        mqtt_client = new PubSubClient(wifi_client);
+        mqtt_socket.set_client(&wifi_client);
     } else {
         wifi_client_secure.setInsecure();
-        mqtt_client = new PubSubClient(wifi_client_secure);
+        mqtt_socket.set_client(&wifi_client_secure);
     }
+    mqtt_client = new PubSubClient(mqtt_socket);
 
     mqtt_client->setCallback(downlink);
 
@@ -73,6 +127,9 @@ static bool update_configuration(persisted_data_t persisted_data) {
     } else {
         mqtt_client->setServer(server_ip, *persisted_data.mqtt_port);
     }
+    broker_ip = server_ip;
+    broker_host = use_raw ? persisted_data.mqtt_broker.content : nullptr;
+    broker_port = *persisted_data.mqtt_port;
     configuration_changed = false;
     return true;
 }
@@ -83,6 +140,21 @@ bool mqtt_interface_config_changed(persisted_data_t persisted_data) {
     return update_configuration(persisted_data);
 }
 
+// the MQTT 5 connection sits next to the 3.1.1 one and only carries states, discovery stays on 3.1.1
+static void connect_mqtt5(const char* client_name, persisted_data_t persisted_data) {
+    if(!mqtt5_client_get_statistics()->enabled || broker_port != MQTT5_PORT || mqtt5_client_connected())
+        return;
+    if(mqtt5_attempted && millis() - mqtt5_attempt < MQTT5_RETRY_INTERVAL)
+        return;
+    mqtt5_attempted = true;
+    mqtt5_attempt = millis();
+
+    static char client_id[40];
+    snprintf(client_id, sizeof(client_id), "%s-v5", client_name);
+    if(!mqtt5_client_connect(broker_ip, broker_host, broker_port, client_id, persisted_data.mqtt_user.content, persisted_data.mqtt_password.content))
+        LOG_WARNING("mqtt5 connection failed, states stay on 3.1.1");
+}
+
 bool mqtt_interface_connect(char* client_name, persisted_data_t persisted_data) {
 
     // configuration valid
@@ -95,40 +167,95 @@ bool mqtt_interface_connect(char* client_name, persisted_data_t persisted_data)
     }
 
     // already connected
-    if(mqtt_client->connected())
+    if(mqtt_client->connected()) {
+        connect_mqtt5(client_name, persisted_data);
         return true;
+    }
 
-    DPRINTLN("trying to connect to mqtt");
+    LOG_INFO("trying to connect to mqtt");
 
     // connect successful
-    if(!mqtt_client->connect(client_name, persisted_data.mqtt_user.content, persisted_data.mqtt_password.content))
+    if(!mqtt_client->connect(client_name, persisted_data.mqtt_user.content, persisted_data.mqtt_password.content)) {
+        // the broker may have moved, look it up again on the next try
+        if(broker_ip_cached) {
+            LOG_WARNING("cached broker address failed, resolving again");
+            broker_cache_failed = true;
+            configuration_changed = true;
+        }
         return false;
+    }
 
-    DPRINTLN("connected to MQTT");
+    LOG_INFO("connected to MQTT");
+    statistics.connects++;
+    boot_timeline_mark(BOOT_MQTT_CONNECTED);
+    if(!broker_host)
+        remember_broker_ip();
     return true;
 }
 
+bool mqtt_interface_connected() {
+    return mqtt_client != nullptr && mqtt_client->connected();
+}
+
 void mqtt_interface_handle() {
     if (mqtt_client != nullptr) {
         mqtt_client->loop();
+        mqtt_socket.poll();
     }
+    mqtt5_client_loop();
 }
 
-static bool publish_in_parts(char* topic, char* to_publish, uint32_t length) {
+bool mqtt_interface_flush() {
+    return mqtt_socket.flush_idle();
+}
+
+void mqtt_interface_coalesce(bool enabled) {
+    mqtt_socket.set_enabled(enabled);
+}
+
+const coalescing_statistics_t* mqtt_interface_get_coalescing_statistics() {
+    return mqtt_socket.get_statistics();
+}
+
+// the signal strength of an uplink rides along with its states as a user property
+static bool folded_into_properties(publish_object_t* object) {
+    return object->received && mqtt5_client_connected() && !strcmp(object->device_class, "signal_strength");
+}
+
+static bool publish_state_mqtt5(publish_object_t* object, const char* state_topic) {
+    if(folded_into_properties(object)) {
+        mqtt5_client_count_folded(state_topic, strlen(object->state));
+        return true;
+    }
+
+    char rssi[4];
+    char received[11];
+    // millis() of the gateway when the uplink was handled, not a wall clock time
+    mqtt5_user_property_t properties[2] = { { "rssi", rssi }, { "uptime_ms", received } };
+    sprintf(rssi, "%u", object->rssi);
+    sprintf(received, "%u", object->received);
+    return mqtt5_client_publish(state_topic, (const uint8_t*)object->state, strlen(object->state), true, MQTT5_STATE_EXPIRY,
+        properties, object->received ? 2 : 0);
+}
+
+static bool publish_in_parts(const char* topic, const char* to_publish, uint32_t length, bool retained = true) {
     if (mqtt_client == nullptr) {
         return false;
     }
 
     if(length < MAX_MQTT_LENGTH) {
-        if(!mqtt_client->publish(topic, to_publish, true)) {
-            DPRINTLN("publish of single frame failed, abort");
+        if(!mqtt_client->publish(topic, (const uint8_t*)to_publish, length, retained)) {
+            LOG_ERROR("publish of single frame failed, abort");
+            statistics.publish_failures++;
             return false;
         }
+        statistics.publishes++;
         return true;
     }
 
-    if(!mqtt_client->beginPublish(topic, length, true)) {
-        DPRINTLN("begin publish went wrong, abort");
+    if(!mqtt_client->beginPublish(topic, length, retained)) {
+        LOG_ERROR("begin publish went wrong, abort");
+        statistics.publish_failures++;
         return false;
     }
     for(uint16_t i = 0; i < length; i += MAX_MQTT_LENGTH) {
@@ -137,13 +264,25 @@ static bool publish_in_parts(char* topic, char* to_publish, uint32_t length) {
     }
     
     if(!mqtt_client->endPublish()) {
-        DPRINTLN("end publish went wrong, abort");
+        LOG_ERROR("end publish went wrong, abort");
+        statistics.publish_failures++;
         return false;
     }
+    statistics.publishes++;
     return true;
 }
 
-void mqtt_interface_publish(publish_object_t* objects, uint8_t amount) {
+static void state_topic_of(publish_object_t* object, char* topic, uint8_t size) {
+    if(object->state_topic)
+        snprintf(topic, size, "%s", object->state_topic);
+    else
+        snprintf(topic, size, "homeassistant/%s/%s/state", object->component, object->object_id);
+}
+
+bool mqtt_interface_publish_config(publish_object_t* object) {
+    if(folded_into_properties(object))
+        return true;
+
     static char state_topic[100];
     static char config_topic[100];
 
@@ -156,62 +295,115 @@ void mqtt_interface_publish(publish_object_t* objects, uint8_t amount) {
     static char icon_string[40];
     static char state_class_string[50];
     static char unit_string[30];
+    static char value_template_string[80];
+    static char attributes_string[130];
     static char config_json[900];
 
+    STATS_SAMPLE(json_start);
+    state_topic_of(object, state_topic, sizeof(state_topic));
+    sprintf(config_topic, "homeassistant/%s/%s/config", object->component, object->object_id);
+
+
+    if(object->model[0] != 0)
+        sprintf(model_string, ",\"mdl\":\"%s\"", object->model);
+    else
+        sprintf(model_string, "");
+    
+    if(object->sw_version[0] != 0)
+        sprintf(sw_version_string, ",\"sw\":\"%s\"", object->sw_version);
+    else
+        sprintf(sw_version_string, "");
+
+    if(object->product[0] == 0) // default to Push7
+        sprintf(object->product, "Push7");
+    
+    sprintf(device_string, "\"mf\":\"LiQuiBit\",\"name\":\"%s_%s\",\"ids\":[\"%s\"]%s%s", object->product, object->uid, object->uid, model_string, sw_version_string);
+
+
+    if(object->category[0] != 0)
+        sprintf(category_string, ",\"ent_cat\":\"%s\"", object->category);
+    else
+        sprintf(category_string, "");
+
+    if(object->device_class[0] != 0)
+        sprintf(device_class_string, ",\"dev_cla\":\"%s\"", object->device_class);
+    else
+        sprintf(device_class_string, "");
+
+    if(object->icon[0] != 0)
+        sprintf(icon_string, ",\"ic\":\"%s\"", object->icon);
+    else
+        sprintf(icon_string, "");
+
+    if(object->state_class[0] != 0)
+        sprintf(state_class_string, ",\"stat_cla\":\"%s\"", object->state_class);
+    else
+        sprintf(state_class_string, "");
+
+    if(object->unit[0] != 0)
+        sprintf(unit_string, ",\"unit_of_meas\":\"%s\"", object->unit);
+    else
+        sprintf(unit_string, "");
+
+    if(object->value_template)
+        snprintf(value_template_string, sizeof(value_template_string), ",\"val_tpl\":\"%s\"", object->value_template);
+    else
+        sprintf(value_template_string, "");
+
+    if(object->attributes)
+        snprintf(attributes_string, sizeof(attributes_string), ",\"json_attr_t\":\"homeassistant/%s/%s/attributes\"", object->component, object->object_id);
+    else
+        sprintf(attributes_string, "");
+    
+    sprintf(config_json, "{\"dev\":{%s},\"name\":\"%s\",\"qos\":1,\"uniq_id\":\"%s\",\"obj_id\":\"%s\",\"enabled_by_default\":%s,\"stat_t\":\"%s\"%s%s%s%s%s%s%s}", 
+        device_string, object->name, object->object_id, object->object_id, object->default_shown ? "true" : "false", 
+        state_topic, category_string, device_class_string, icon_string, state_class_string, unit_string, value_template_string, attributes_string);
+
+    STATS_STOP_SAMPLE(STAGE_DISCOVERY_JSON, json_start);
+
+    LOG_DEBUG("publishing config of %u bytes", strlen(config_json));
+
+    STATS_SAMPLE(publish_start);
+    bool published = publish_in_parts(config_topic, config_json, strlen(config_json));
+    STATS_STOP_SAMPLE(STAGE_PUBLISH, publish_start);
+    return published;
+}
+
+bool mqtt_interface_publish_state(publish_object_t* object) {
+    static char state_topic[100];
+
+    // entities sharing a state topic get their state from whoever owns that topic
+    if(object->state_topic)
+        return true;
+
+    state_topic_of(object, state_topic, sizeof(state_topic));
+    STATS_SAMPLE(publish_start);
+    bool published = mqtt5_client_connected() ? publish_state_mqtt5(object, state_topic) : publish_in_parts(state_topic, object->state, strlen(object->state));
+    STATS_STOP_SAMPLE(STAGE_PUBLISH, publish_start);
+    return published;
+}
+
+void mqtt_interface_publish(publish_object_t* objects, uint8_t amount) {
     for(uint8_t index = 0; index < amount; index++) {
-        sprintf(state_topic, "homeassistant/%s/%s/state", objects[index].component, objects[index].object_id);
-        sprintf(config_topic, "homeassistant/%s/%s/config", objects[index].component, objects[index].object_id);
-
-
-        if(objects[index].model[0] != 0)
-            sprintf(model_string, ",\"mdl\":\"%s\"", objects[index].model);
-        else
-            sprintf(model_string, "");
-        
-        if(objects[index].sw_version[0] != 0)
-            sprintf(sw_version_string, ",\"sw\":\"%s\"", objects[index].sw_version);
-        else
-            sprintf(sw_version_string, "");
-
-        if(objects[index].product[0] == 0) // default to Push7
-            sprintf(objects[index].product, "Push7");
-        
-        sprintf(device_string, "\"mf\":\"LiQuiBit\",\"name\":\"%s_%s\",\"ids\":[\"%s\"]%s%s", objects[index].product, objects[index].uid, objects[index].uid, model_string, sw_version_string);
-
-
-        if(objects[index].category[0] != 0)
-            sprintf(category_string, ",\"ent_cat\":\"%s\"", objects[index].category);
-        else
-            sprintf(category_string, "");
-
-        if(objects[index].device_class[0] != 0)
-            sprintf(device_class_string, ",\"dev_cla\":\"%s\"", objects[index].device_class);
-        else
-            sprintf(device_class_string, "");
-
-        if(objects[index].icon[0] != 0)
-            sprintf(icon_string, ",\"ic\":\"%s\"", objects[index].icon);
-        else
-            sprintf(icon_string, "");
-
-        if(objects[index].state_class[0] != 0)
-            sprintf(state_class_string, ",\"stat_cla\":\"%s\"", objects[index].state_class);
-        else
-            sprintf(state_class_string, "");
-
-        if(objects[index].unit[0] != 0)
-            sprintf(unit_string, ",\"unit_of_meas\":\"%s\"", objects[index].unit);
-        else
-            sprintf(unit_string, "");
-        
-        sprintf(config_json, "{\"dev\":{%s},\"name\":\"%s\",\"qos\":1,\"uniq_id\":\"%s\",\"obj_id\":\"%s\",\"enabled_by_default\":%s,\"stat_t\":\"%s\"%s%s%s%s%s}", 
-    device_string, objects[index].name, objects[index].object_id, objects[index].object_id, objects[index].default_shown ? "true" : "false", 
-    state_topic, category_string, device_class_string, icon_string, state_class_string, unit_string);
-
-        DPRINTLN(config_json);
-        DPRINTLN(objects[index].state);
-
-        if(publish_in_parts(config_topic, config_json, strlen(config_json)))
-            publish_in_parts(state_topic, objects[index].state, strlen(objects[index].state));
+        if(mqtt_interface_publish_config(&objects[index]))
+            mqtt_interface_publish_state(&objects[index]);
+    }
+}
+
+const mqtt_statistics_t* mqtt_interface_get_statistics() {
+    return &statistics;
+}
+
+bool mqtt_interface_publish_raw(const char* topic, const char* payload, bool retained) {
+    if (mqtt_client == nullptr) {
+        return false;
+    }
+    return publish_in_parts(topic, payload, strlen(payload), retained);
+}
+
+bool mqtt_interface_publish_binary(const char* topic, const uint8_t* payload, uint16_t length, bool retained) {
+    if (mqtt_client == nullptr) {
+        return false;
     }
+    return publish_in_parts(topic, (const char*)payload, length, retained);
 }
@@ -1,6 +1,13 @@
 #ifndef MQTT_INTERFACE_H
 #define MQTT_INTERFACE_H
 #include "structures.h"
+#include "coalescing_client.h"
+
+typedef struct {
+  uint32_t connects;
+  uint32_t publishes;
+  uint32_t publish_failures;
+} mqtt_statistics_t;
 
 bool mqtt_interface_config_changed(persisted_data_t persisted_data);
 
@@ -8,6 +15,25 @@ bool mqtt_interface_connect(char* client_name, persisted_data_t persisted_data);
 
 void mqtt_interface_handle();
 
+// sends the packets still held for coalescing, for when the loop has nothing more to publish, false when they were lost
+bool mqtt_interface_flush();
+
+void mqtt_interface_coalesce(bool enabled);
+
 void mqtt_interface_publish(publish_object_t* objects, uint8_t amount);
 
+bool mqtt_interface_publish_config(publish_object_t* object);
+
+bool mqtt_interface_publish_state(publish_object_t* object);
+
+bool mqtt_interface_connected();
+
+bool mqtt_interface_publish_raw(const char* topic, const char* payload, bool retained);
+
+bool mqtt_interface_publish_binary(const char* topic, const uint8_t* payload, uint16_t length, bool retained);
+
+const mqtt_statistics_t* mqtt_interface_get_statistics();
+
+const coalescing_statistics_t* mqtt_interface_get_coalescing_statistics();
+
 #endif
@@ -0,0 +1,63 @@
+#include "pipeline_stats.h"
+#include <esp_timer.h>
+
+static const char* stage_names[STAGE_COUNT] = { "serial", "alp", "file_parser", "discovery_json", "publish", "total", "realtime", "measurement", "diagnostic", "discovery" };
+
+static histogram_t histograms[STAGE_COUNT];
+
+#define CALIBRATION_RECORDS 256
+
+// the instrumentation times itself once instead of on every record, a record never spans a wait, so the CPU runs at full speed
+static uint32_t overhead_records = 0;
+static uint32_t record_ns = 0;
+static uint8_t samples = 0;
+
+// esp_timer keeps its rate when frequency scaling clocks the CPU down between loop passes, the cycle counter does not
+uint32_t pipeline_stats_now() {
+  return esp_timer_get_time();
+}
+
+uint32_t pipeline_stats_sample() {
+  if(++samples % PIPELINE_STATS_SAMPLE)
+    return 0;
+  uint32_t now = pipeline_stats_now();
+  return now ? now : 1;
+}
+
+void pipeline_stats_record(pipeline_stage_t stage, uint32_t start_us) {
+  histogram_record(&histograms[stage], pipeline_stats_now() - start_us);
+  overhead_records++;
+}
+
+// the two timestamps and the histogram update of a record, into a histogram of its own
+static void calibrate() {
+  static histogram_t scratch;
+  histogram_reset(&scratch);
+  uint32_t start = ESP.getCycleCount();
+  for(uint16_t record = 0; record < CALIBRATION_RECORDS; record++) {
+    uint32_t timestamp = pipeline_stats_now();
+    histogram_record(&scratch, pipeline_stats_now() - timestamp);
+  }
+  uint32_t cycles = ESP.getCycleCount() - start;
+  record_ns = (uint64_t)cycles * 1000 / ESP.getCpuFreqMHz() / CALIBRATION_RECORDS;
+  if(!record_ns)
+    record_ns = 1;
+}
+
+uint16_t pipeline_stats_json(char* buffer, uint16_t size) {
+  int length = snprintf(buffer, size, "{");
+  for(uint8_t stage = 0; stage < STAGE_COUNT && length < size; stage++) {
+    histogram_t* histogram = &histograms[stage];
+    length += snprintf(&buffer[length], size - length, "%s\"%s\":{\"n\":%u,\"mean\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}",
+      stage ? "," : "", stage_names[stage], histogram->count, histogram_mean(histogram),
+      histogram_percentile(histogram, 50), histogram_percentile(histogram, 90), histogram_percentile(histogram, 99), histogram->max_us);
+  }
+  // share of the time of all uplinks, from the first byte to the last publish, spent in the instrumentation
+  if(!record_ns)
+    calibrate();
+  uint64_t total_us = histograms[STAGE_TOTAL].sum_us;
+  if(length < size)
+    length += snprintf(&buffer[length], size - length, ",\"overhead\":{\"records\":%u,\"ns_avg\":%u,\"percent\":%.3f}}",
+      overhead_records, record_ns, total_us ? (double)overhead_records * record_ns / total_us / 10 : 0.0);
+  return length < size ? length : 0;
+}
@@ -0,0 +1,48 @@
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+#include "structures.h"
+#include "histogram.h"
+
+// comment out to compile all latency instrumentation out of the pipeline
+#define PIPELINE_STATS
+
+// the discovery json and publish stages run for every entity and time one in this many, all other stages every time
+#define PIPELINE_STATS_SAMPLE 16
+
+typedef enum {
+  STAGE_SERIAL,          // first byte on the UART until the frame passed its CRC
+  STAGE_ALP,             // alp_parse
+  STAGE_FILE_PARSER,     // parse_custom_files
+  STAGE_DISCOVERY_JSON,  // building topics and discovery json, sampled
+  STAGE_PUBLISH,         // handing config and state to the mqtt client, sampled
+  STAGE_TOTAL,           // first byte on the UART until all publishes of the uplink are queued
+  STAGE_REALTIME,        // first byte on the UART until the state of a realtime entity is published
+  STAGE_MEASUREMENT,     // same for measurement entities
+  STAGE_DIAGNOSTIC,      // same for diagnostic and config entities
+  STAGE_DISCOVERY,       // first byte on the UART until the discovery config is published
+  STAGE_COUNT
+} pipeline_stage_t;
+
+#ifdef PIPELINE_STATS
+  #define STATS_START(timestamp) uint32_t timestamp = pipeline_stats_now()
+  #define STATS_STOP(stage, timestamp) pipeline_stats_record(stage, timestamp)
+  #define STATS_SAMPLE(timestamp) uint32_t timestamp = pipeline_stats_sample()
+  #define STATS_STOP_SAMPLE(stage, timestamp) (timestamp ? pipeline_stats_record(stage, timestamp) : (void)0)
+#else
+  #define STATS_START(timestamp)
+  #define STATS_STOP(stage, timestamp)
+  #define STATS_SAMPLE(timestamp)
+  #define STATS_STOP_SAMPLE(stage, timestamp)
+#endif
+
+uint32_t pipeline_stats_now();
+
+// pipeline_stats_now() for one in PIPELINE_STATS_SAMPLE calls, 0 for the others
+uint32_t pipeline_stats_sample();
+
+// start_us is a pipeline_stats_now() timestamp
+void pipeline_stats_record(pipeline_stage_t stage, uint32_t start_us);
+
+uint16_t pipeline_stats_json(char* buffer, uint16_t size);
+
+#endif
@@ -0,0 +1,221 @@
+#include "publish_scheduler.h"
+#include "mqtt_interface.h"
+#include "pipeline_stats.h"
+#include "logger.h"
+#include "boot_timeline.h"
+
+// entities waiting to be published, shared by all classes. An entity is referenced by its state
+// entry in its own class and by its config entry in the discovery class.
+#define POOL_SIZE 40
+#define NO_ITEM 0xFF
+
+// token bucket towards the broker, in publishes
+#define PUBLISH_RATE 40
+#define PUBLISH_BURST 20
+#define TOKEN 1000
+
+// keeps the uart serviced while a large backlog drains
+#define MAX_PUBLISHES_PER_LOOP 4
+#define MAX_ATTEMPTS 3
+
+typedef struct {
+  publish_object_t object;
+  uint32_t arrival;
+  uint8_t references;
+} publish_item_t;
+
+typedef struct {
+  uint8_t items[POOL_SIZE];
+  uint8_t head;
+  uint8_t count;
+  uint8_t attempts;
+} publish_queue_t;
+
+static publish_item_t pool[POOL_SIZE];
+static publish_queue_t queues[PUBLISH_CLASS_COUNT];
+static uint8_t items_in_use = 0;
+
+static uint32_t tokens = PUBLISH_BURST * TOKEN;
+static unsigned long last_refill = 0;
+
+static publish_scheduler_statistics_t statistics;
+
+void publish_scheduler_init() {
+  memset(pool, 0, sizeof(pool));
+  memset(queues, 0, sizeof(queues));
+  memset(&statistics, 0, sizeof(statistics));
+  items_in_use = 0;
+}
+
+const publish_scheduler_statistics_t* publish_scheduler_get_statistics() {
+  for(uint8_t publish_class = 0; publish_class < PUBLISH_CLASS_COUNT; publish_class++)
+    statistics.pending[publish_class] = queues[publish_class].count;
+  return &statistics;
+}
+
+static publish_class_t classify(int16_t file_id, publish_object_t* object) {
+  if(file_id >= BUTTON_CONFIG_FILE_ID && file_id <= HALL_EFFECT_CONFIG_FILE_ID)
+    return PUBLISH_CLASS_DIAGNOSTIC;
+  if(object->category[0] != 0)
+    return PUBLISH_CLASS_DIAGNOSTIC;
+  if(file_id == BUTTON_FILE_ID || file_id == PIR_FILE_ID || file_id == HALL_EFFECT_FILE_ID)
+    return PUBLISH_CLASS_REALTIME;
+  return PUBLISH_CLASS_MEASUREMENT;
+}
+
+static uint8_t queue_at(publish_queue_t* queue, uint8_t position) {
+  return queue->items[(queue->head + position) % POOL_SIZE];
+}
+
+static void release(uint8_t item) {
+  if(--pool[item].references == 0)
+    items_in_use--;
+}
+
+static void push(publish_class_t publish_class, uint8_t item) {
+  publish_queue_t* queue = &queues[publish_class];
+  queue->items[(queue->head + queue->count) % POOL_SIZE] = item;
+  queue->count++;
+  pool[item].references++;
+  statistics.queued[publish_class]++;
+}
+
+static void pop(publish_class_t publish_class) {
+  publish_queue_t* queue = &queues[publish_class];
+  release(queue->items[queue->head]);
+  queue->head = (queue->head + 1) % POOL_SIZE;
+  queue->count--;
+  queue->attempts = 0;
+}
+
+static bool config_queued(const char* object_id) {
+  publish_queue_t* queue = &queues[PUBLISH_CLASS_DISCOVERY];
+  for(uint8_t position = 0; position < queue->count; position++) {
+    if(!strcmp(pool[queue_at(queue, position)].object.object_id, object_id))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief get a free pool item, dropping the oldest entries of classes with the same or a lower priority when the pool is full
+ * @return the index of the item, NO_ITEM if only higher priority entries are queued
+ */
+static uint8_t allocate(publish_class_t priority) {
+  while(items_in_use == POOL_SIZE) {
+    int8_t victim = PUBLISH_CLASS_DISCOVERY;
+    while(victim >= (int8_t)priority && !queues[victim].count)
+      victim--;
+    if(victim < (int8_t)priority)
+      return NO_ITEM;
+    pop((publish_class_t)victim);
+    statistics.dropped[victim]++;
+  }
+  for(uint8_t item = 0; item < POOL_SIZE; item++) {
+    if(!pool[item].references) {
+      items_in_use++;
+      if(items_in_use > statistics.pool_high_water)
+        statistics.pool_high_water = items_in_use;
+      return item;
+    }
+  }
+  return NO_ITEM;
+}
+
+/**
+ * @brief queue the discovery config and state of each entity, the state in the class of its file and entity
+ * @param file_id the file the entities were parsed from, -1 for entities of the gateway itself
+ * @param arrival pipeline_stats_now() at the moment the uplink arrived, 0 when unknown
+ */
+void publish_scheduler_enqueue(int16_t file_id, publish_object_t* objects, uint8_t amount, uint32_t arrival) {
+  for(uint8_t index = 0; index < amount; index++) {
+    publish_object_t* object = &objects[index];
+    // a config that is still queued is published once, the entity description does not change between uplinks
+    bool needs_config = !config_queued(object->object_id);
+    bool needs_state = !object->state_topic;
+    if(!needs_config)
+      statistics.coalesced++;
+    if(!needs_config && !needs_state)
+      continue;
+
+    publish_class_t publish_class = needs_state ? classify(file_id, object) : PUBLISH_CLASS_DISCOVERY;
+    uint8_t item = allocate(publish_class);
+    if(item == NO_ITEM) {
+      LOG_WARNING("publish queue full, dropping entity of file %d", file_id);
+      statistics.dropped[publish_class]++;
+      continue;
+    }
+
+    pool[item].object = *object;
+    pool[item].arrival = arrival;
+    pool[item].references = 0;
+    if(needs_state)
+      push(publish_class, item);
+    if(needs_config)
+      push(PUBLISH_CLASS_DISCOVERY, item);
+  }
+}
+
+// queue only the state of an entity that was announced before
+void publish_scheduler_enqueue_state(publish_class_t publish_class, publish_object_t* object, uint32_t arrival) {
+  uint8_t item = allocate(publish_class);
+  if(item == NO_ITEM) {
+    statistics.dropped[publish_class]++;
+    return;
+  }
+  pool[item].object = *object;
+  pool[item].arrival = arrival;
+  pool[item].references = 0;
+  push(publish_class, item);
+}
+
+static void refill() {
+  unsigned long now = millis();
+  tokens += (now - last_refill) * PUBLISH_RATE;
+  if(tokens > PUBLISH_BURST * TOKEN)
+    tokens = PUBLISH_BURST * TOKEN;
+  last_refill = now;
+}
+
+bool publish_scheduler_idle() {
+  return !items_in_use;
+}
+
+void publish_scheduler_handle() {
+  refill();
+  if(!mqtt_interface_connected())
+    return;
+
+  for(uint8_t published = 0; published < MAX_PUBLISHES_PER_LOOP && tokens >= TOKEN; published++) {
+    uint8_t publish_class = 0;
+    while(publish_class < PUBLISH_CLASS_COUNT && !queues[publish_class].count)
+      publish_class++;
+    if(publish_class == PUBLISH_CLASS_COUNT)
+      return;
+
+    publish_queue_t* queue = &queues[publish_class];
+    publish_item_t* item = &pool[queue->items[queue->head]];
+    bool ok = (publish_class == PUBLISH_CLASS_DISCOVERY) ? mqtt_interface_publish_config(&item->object) : mqtt_interface_publish_state(&item->object);
+    // a realtime state counts as published once it reached the socket, not when it sits in the coalescing buffer
+    if(ok && publish_class == PUBLISH_CLASS_REALTIME)
+      ok = mqtt_interface_flush();
+    tokens -= TOKEN;
+
+    if(!ok) {
+      // retried on the next loops, given up when it keeps failing so one bad entity cannot block its class
+      if(++queue->attempts < MAX_ATTEMPTS)
+        return;
+      LOG_ERROR("giving up on publish of class %u", publish_class);
+      statistics.dropped[publish_class]++;
+      pop((publish_class_t)publish_class);
+      return;
+    }
+
+    if(item->arrival)
+      STATS_STOP((pipeline_stage_t)(STAGE_REALTIME + publish_class), item->arrival);
+    if(publish_class != PUBLISH_CLASS_DISCOVERY && item->object.received)
+      boot_timeline_mark(BOOT_FIRST_PUBLISH);
+    statistics.published[publish_class]++;
+    pop((publish_class_t)publish_class);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef PUBLISH_SCHEDULER_H
+#define PUBLISH_SCHEDULER_H
+#include "structures.h"
+
+// highest priority first
+typedef enum {
+  PUBLISH_CLASS_REALTIME,    // states of button, PIR and hall effect events
+  PUBLISH_CLASS_MEASUREMENT, // states of sensor readings
+  PUBLISH_CLASS_DIAGNOSTIC,  // states of diagnostic and config entities
+  PUBLISH_CLASS_DISCOVERY,   // home assistant discovery configs
+  PUBLISH_CLASS_COUNT
+} publish_class_t;
+
+typedef struct {
+  uint32_t queued[PUBLISH_CLASS_COUNT];
+  uint32_t published[PUBLISH_CLASS_COUNT];
+  uint32_t dropped[PUBLISH_CLASS_COUNT];
+  uint32_t coalesced;
+  uint8_t pending[PUBLISH_CLASS_COUNT];
+  uint8_t pool_high_water;
+} publish_scheduler_statistics_t;
+
+void publish_scheduler_init();
+
+void publish_scheduler_enqueue(int16_t file_id, publish_object_t* objects, uint8_t amount, uint32_t arrival);
+
+void publish_scheduler_enqueue_state(publish_class_t publish_class, publish_object_t* object, uint32_t arrival);
+
+void publish_scheduler_handle();
+
+bool publish_scheduler_idle();
+
+const publish_scheduler_statistics_t* publish_scheduler_get_statistics();
+
+#endif
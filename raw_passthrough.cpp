@@ -0,0 +1,114 @@
+#include "raw_passthrough.h"
+#include "file_parser.h"
+#include "mqtt_interface.h"
+#include "logger.h"
+
+// a batch is a version byte and a record count followed by records of
+// arrival (u32 le, ms since boot), modem (u8), length (u8) and the validated ALP payload
+#define BATCH_VERSION 1
+#define BATCH_HEADER_SIZE 2
+#define RECORD_HEADER_SIZE 6
+#define MAX_BATCH_SIZE 1024
+
+// frames arriving back to back share a publish, a batch is sent once the uart was quiet this long
+#define BATCH_IDLE_MS 10
+#define BATCH_MAX_AGE_MS 100
+
+static char raw_topic[40];
+static uint8_t batch[MAX_BATCH_SIZE];
+static uint16_t batch_length = 0;
+static uint8_t batch_count = 0;
+static uint32_t batch_started = 0;
+static uint32_t last_frame = 0;
+
+static raw_passthrough_statistics_t statistics;
+
+void raw_passthrough_init(const char* gateway_id) {
+  memset(&statistics, 0, sizeof(statistics));
+  snprintf(raw_topic, sizeof(raw_topic), "d7/raw/%s", gateway_id);
+  batch_length = 0;
+  batch_count = 0;
+}
+
+void raw_passthrough_set_mode(passthrough_mode_t mode) {
+  statistics.mode = mode;
+}
+
+// false when frames are only passed through, the caller then skips alp_parse
+bool raw_passthrough_decode() {
+  return statistics.mode != PASSTHROUGH_ONLY;
+}
+
+const raw_passthrough_statistics_t* raw_passthrough_get_statistics() {
+  return &statistics;
+}
+
+static bool has_unknown_file(custom_file_contents_t* custom_files, uint8_t amount) {
+  if(!amount)
+    return true;
+  for(uint8_t index = 0; index < amount; index++) {
+    if(!file_parser_file_size(custom_files[index].file_id))
+      return true;
+  }
+  return false;
+}
+
+static void flush() {
+  if(!batch_count)
+    return;
+  batch[0] = BATCH_VERSION;
+  batch[1] = batch_count;
+  if(mqtt_interface_connected() && mqtt_interface_publish_binary(raw_topic, batch, batch_length, false)) {
+    statistics.batches++;
+    statistics.bytes += batch_length;
+  } else {
+    statistics.dropped_frames += batch_count;
+  }
+  batch_length = 0;
+  batch_count = 0;
+}
+
+/**
+ * @brief append the payload of a validated frame to the batch, straight from the serial output buffer
+ * @param custom_files the files alp_parse found in the payload, decides whether the frame is unknown
+ */
+void raw_passthrough_push(const uint8_t* payload, uint8_t length, uint8_t modem, custom_file_contents_t* custom_files, uint8_t amount) {
+  if(statistics.mode == PASSTHROUGH_OFF)
+    return;
+  if(statistics.mode == PASSTHROUGH_UNKNOWN && !has_unknown_file(custom_files, amount))
+    return;
+
+  uint16_t record_length = RECORD_HEADER_SIZE + length;
+  if(BATCH_HEADER_SIZE + record_length > MAX_BATCH_SIZE) {
+    statistics.dropped_frames++;
+    return;
+  }
+  if(batch_length + record_length > MAX_BATCH_SIZE || batch_count == 0xFF)
+    flush();
+
+  uint32_t now = millis();
+  if(!batch_count) {
+    batch_length = BATCH_HEADER_SIZE;
+    batch_started = now;
+  }
+  uint8_t* record = &batch[batch_length];
+  record[0] = now;
+  record[1] = now >> 8;
+  record[2] = now >> 16;
+  record[3] = now >> 24;
+  record[4] = modem;
+  record[5] = length;
+  memcpy(&record[RECORD_HEADER_SIZE], payload, length);
+  batch_length += record_length;
+  batch_count++;
+  last_frame = now;
+  statistics.frames++;
+}
+
+void raw_passthrough_handle() {
+  if(!batch_count)
+    return;
+  uint32_t now = millis();
+  if(now - last_frame >= BATCH_IDLE_MS || now - batch_started >= BATCH_MAX_AGE_MS)
+    flush();
+}
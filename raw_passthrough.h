@@ -0,0 +1,32 @@
+#ifndef RAW_PASSTHROUGH_H
+#define RAW_PASSTHROUGH_H
+#include "structures.h"
+
+typedef enum {
+  PASSTHROUGH_OFF,
+  PASSTHROUGH_UNKNOWN, // frames without a file the gateway decodes
+  PASSTHROUGH_ALL,     // every frame, decoded as well
+  PASSTHROUGH_ONLY,    // every frame, the gateway does not decode them
+} passthrough_mode_t;
+
+typedef struct {
+  passthrough_mode_t mode;
+  uint32_t frames;
+  uint32_t batches;
+  uint32_t bytes;
+  uint32_t dropped_frames; // batches that could not be published, or frames larger than a batch
+} raw_passthrough_statistics_t;
+
+void raw_passthrough_init(const char* gateway_id);
+
+void raw_passthrough_set_mode(passthrough_mode_t mode);
+
+bool raw_passthrough_decode();
+
+void raw_passthrough_push(const uint8_t* payload, uint8_t length, uint8_t modem, custom_file_contents_t* custom_files, uint8_t amount);
+
+void raw_passthrough_handle();
+
+const raw_passthrough_statistics_t* raw_passthrough_get_statistics();
+
+#endif
@@ -0,0 +1,391 @@
+#include "rule_engine.h"
+#include <LittleFS.h>
+#include <driver/gpio.h>
+#include "downlink_mailbox.h"
+#include "mqtt_interface.h"
+#include "logger.h"
+
+// one rule per line, '#' starts a comment:
+//   <uid|*> <file id> <entity> <==|!=|>|<|>=|<=> <value> gpio <pin> <high|low|toggle>
+//   <uid|*> <file id> <entity> <op> <value> publish <topic> <payload>
+//   <uid|*> <file id> <entity> <op> <value> alp <uid> <file id> <offset> <hex data>
+// the entity is the object id without the uid, e.g. button2, hall_effect or temperature
+#define MAX_RULES_FILE_SIZE 2048
+#define MAX_LINE_SIZE 160
+#define MAX_ALP_DATA 16
+
+// rules are chained per bucket of (uid, file id), an uplink only looks at two chains
+#define RULE_BUCKETS 16
+#define NO_RULE 0xFF
+#define WILDCARD_UID 0
+
+#define GPIO_TOGGLE 2
+
+typedef enum {
+  OPERATOR_EQUAL,
+  OPERATOR_NOT_EQUAL,
+  OPERATOR_GREATER,
+  OPERATOR_LESS,
+  OPERATOR_GREATER_EQUAL,
+  OPERATOR_LESS_EQUAL,
+} rule_operator_t;
+
+typedef enum {
+  ACTION_GPIO,
+  ACTION_PUBLISH,
+  ACTION_ALP,
+} rule_action_t;
+
+typedef struct {
+  uint64_t uid;
+  int16_t file_id;
+  char entity[24];
+  rule_operator_t comparison;
+  char value[20];
+  float number;
+  bool numeric;
+  rule_action_t action;
+  union {
+    struct {
+      uint8_t pin;
+      uint8_t level;
+    } gpio;
+    struct {
+      char topic[64];
+      char payload[32];
+    } publish;
+    struct {
+      uint8_t uid[8];
+      uint8_t file_id;
+      uint8_t offset;
+      uint8_t length;
+      uint8_t data[MAX_ALP_DATA];
+    } alp;
+  };
+  uint32_t hits;
+  uint8_t next;
+} rule_t;
+
+static const char* operator_names[] = { "==", "!=", ">", "<", ">=", "<=" };
+static const char* action_names[] = { "gpio", "publish", "alp" };
+
+static rule_t rules[RULE_ENGINE_MAX_RULES];
+static uint8_t buckets[RULE_BUCKETS];
+static rule_engine_statistics_t statistics;
+
+static uint8_t bucket_of(uint64_t uid, int16_t file_id) {
+  uint64_t key = uid ^ ((uint64_t) file_id << 56);
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return key & (RULE_BUCKETS - 1);
+}
+
+static bool parse_hex(const char* text, uint8_t* destination, uint8_t size) {
+  if(strlen(text) != size * 2)
+    return false;
+  for(uint8_t i = 0; i < size; i++) {
+    char byte[3] = { text[2 * i], text[2 * i + 1], 0 };
+    char* end;
+    destination[i] = strtoul(byte, &end, 16);
+    if(*end != 0)
+      return false;
+  }
+  return true;
+}
+
+static bool parse_byte(const char* text, uint8_t* destination) {
+  char* end;
+  unsigned long value = strtoul(text, &end, 10);
+  if(!isdigit(*text) || *end || value > 255)
+    return false;
+  *destination = value;
+  return true;
+}
+
+static bool parse_operator(const char* text, rule_operator_t* comparison) {
+  for(uint8_t i = 0; i < sizeof(operator_names) / sizeof(operator_names[0]); i++) {
+    if(!strcmp(text, operator_names[i])) {
+      *comparison = (rule_operator_t) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// pins 6 to 11 hold the SPI flash, the others are taken by the modem and the UARTs
+static bool gpio_available(long pin) {
+  if(pin < 0 || pin >= GPIO_NUM_MAX || !GPIO_IS_VALID_OUTPUT_GPIO(pin))
+    return false;
+  if(pin >= 6 && pin <= 11)
+    return false;
+  if(pin == ESP_BUSY_PIN || pin == RX || pin == TX)
+    return false;
+#if defined(ARDUINO_ESP32_POE)
+  if(pin == RX1 || pin == TX1)
+    return false;
+#endif
+#ifdef MODEM1_SERIAL
+  if(pin == MODEM1_RX || pin == MODEM1_TX)
+    return false;
+#endif
+#ifdef MODEM2_SERIAL
+  if(pin == MODEM2_RX || pin == MODEM2_TX)
+    return false;
+#endif
+  return true;
+}
+
+static bool parse_action(rule_t* rule, char** save) {
+  char* action = strtok_r(NULL, " \t", save);
+  if(!action)
+    return false;
+
+  if(!strcmp(action, "gpio")) {
+    char* pin = strtok_r(NULL, " \t", save);
+    char* level = strtok_r(NULL, " \t", save);
+    if(!pin || !level)
+      return false;
+    char* end;
+    long number = strtol(pin, &end, 10);
+    if(*end != 0 || !gpio_available(number))
+      return false;
+    rule->action = ACTION_GPIO;
+    rule->gpio.pin = number;
+    if(!strcmp(level, "high"))
+      rule->gpio.level = HIGH;
+    else if(!strcmp(level, "low"))
+      rule->gpio.level = LOW;
+    else if(!strcmp(level, "toggle"))
+      rule->gpio.level = GPIO_TOGGLE;
+    else
+      return false;
+    return true;
+  }
+
+  if(!strcmp(action, "publish")) {
+    char* topic = strtok_r(NULL, " \t", save);
+    char* payload = strtok_r(NULL, "", save);
+    if(!topic || !payload || strlen(topic) >= sizeof(rule->publish.topic) || strlen(payload) >= sizeof(rule->publish.payload))
+      return false;
+    rule->action = ACTION_PUBLISH;
+    strcpy(rule->publish.topic, topic);
+    strcpy(rule->publish.payload, payload);
+    return true;
+  }
+
+  if(!strcmp(action, "alp")) {
+    char* uid = strtok_r(NULL, " \t", save);
+    char* file_id = strtok_r(NULL, " \t", save);
+    char* offset = strtok_r(NULL, " \t", save);
+    char* data = strtok_r(NULL, " \t", save);
+    if(!uid || !file_id || !offset || !data || !parse_hex(uid, rule->alp.uid, 8))
+      return false;
+    uint8_t length = strlen(data) / 2;
+    if(!length || length > MAX_ALP_DATA || !parse_hex(data, rule->alp.data, length))
+      return false;
+    // the write has to end inside the file, an offset of 256 must not wrap around to 0
+    if(!parse_byte(file_id, &rule->alp.file_id) || !parse_byte(offset, &rule->alp.offset) || rule->alp.offset + length > 255)
+      return false;
+    rule->action = ACTION_ALP;
+    rule->alp.length = length;
+    return true;
+  }
+  return false;
+}
+
+static bool parse_rule(char* line, rule_t* rule) {
+  char* save;
+  char* uid = strtok_r(line, " \t", &save);
+  char* file_id = strtok_r(NULL, " \t", &save);
+  char* entity = strtok_r(NULL, " \t", &save);
+  char* comparison = strtok_r(NULL, " \t", &save);
+  char* value = strtok_r(NULL, " \t", &save);
+  if(!uid || !file_id || !entity || !comparison || !value)
+    return false;
+
+  memset(rule, 0, sizeof(rule_t));
+  if(strcmp(uid, "*") && !parse_hex(uid, (uint8_t*) &rule->uid, 8))
+    return false;
+  rule->file_id = atoi(file_id);
+  if(strlen(entity) >= sizeof(rule->entity) || strlen(value) >= sizeof(rule->value))
+    return false;
+  strcpy(rule->entity, entity);
+  strcpy(rule->value, value);
+  if(!parse_operator(comparison, &rule->comparison))
+    return false;
+
+  char* end;
+  rule->number = strtof(value, &end);
+  rule->numeric = (*end == 0);
+  // ordering only makes sense on numbers
+  if(!rule->numeric && rule->comparison != OPERATOR_EQUAL && rule->comparison != OPERATOR_NOT_EQUAL)
+    return false;
+
+  return parse_action(rule, &save);
+}
+
+/**
+ * @brief compile rules from text, replacing the current ones
+ * @return the amount of rules loaded, lines that do not parse are skipped and counted
+ */
+uint8_t rule_engine_load(const char* rules_text) {
+  static char line[MAX_LINE_SIZE];
+
+  memset(buckets, NO_RULE, sizeof(buckets));
+  statistics.rules = 0;
+  statistics.rejected_lines = 0;
+
+  while(*rules_text) {
+    const char* line_end = strchr(rules_text, '\n');
+    size_t length = line_end ? line_end - rules_text : strlen(rules_text);
+    if(length < MAX_LINE_SIZE) {
+      memcpy(line, rules_text, length);
+      line[length] = 0;
+      char* comment = strchr(line, '#');
+      if(comment)
+        *comment = 0;
+      char* carriage_return = strchr(line, '\r');
+      if(carriage_return)
+        *carriage_return = 0;
+    } else {
+      line[0] = '!';
+      line[1] = 0;
+    }
+    rules_text += line_end ? length + 1 : length;
+
+    if(strspn(line, " \t") == strlen(line))
+      continue;
+    if(statistics.rules == RULE_ENGINE_MAX_RULES || !parse_rule(line, &rules[statistics.rules])) {
+      statistics.rejected_lines++;
+      continue;
+    }
+
+    rule_t* rule = &rules[statistics.rules];
+    if(rule->action == ACTION_GPIO)
+      pinMode(rule->gpio.pin, OUTPUT);
+    uint8_t bucket = bucket_of(rule->uid, rule->file_id);
+    rule->next = buckets[bucket];
+    buckets[bucket] = statistics.rules++;
+  }
+
+  LOG_INFO("loaded %u rules, %u lines rejected", statistics.rules, statistics.rejected_lines);
+  return statistics.rules;
+}
+
+void rule_engine_init() {
+  static char rules_text[MAX_RULES_FILE_SIZE + 1];
+
+  memset(buckets, NO_RULE, sizeof(buckets));
+  memset(&statistics, 0, sizeof(statistics));
+  if(!LittleFS.begin(true) || !LittleFS.exists(RULE_ENGINE_FILE))
+    return;
+
+  File file = LittleFS.open(RULE_ENGINE_FILE, FILE_READ);
+  size_t length = file.read((uint8_t*) rules_text, MAX_RULES_FILE_SIZE);
+  file.close();
+  rules_text[length] = 0;
+  rule_engine_load(rules_text);
+}
+
+bool rule_engine_store(const char* rules_text) {
+  if(strlen(rules_text) > MAX_RULES_FILE_SIZE)
+    return false;
+  File file = LittleFS.open(RULE_ENGINE_FILE, FILE_WRITE);
+  if(!file)
+    return false;
+  file.write((const uint8_t*) rules_text, strlen(rules_text));
+  file.close();
+  rule_engine_load(rules_text);
+  return true;
+}
+
+const rule_engine_statistics_t* rule_engine_get_statistics() {
+  return &statistics;
+}
+
+static bool condition_holds(rule_t* rule, publish_object_t* object) {
+  if(!rule->numeric)
+    return (strcmp(object->state, rule->value) == 0) == (rule->comparison == OPERATOR_EQUAL);
+
+  char* end;
+  float value = strtof(object->state, &end);
+  if(end == object->state)
+    return false;
+  switch(rule->comparison) {
+    case OPERATOR_EQUAL:         return value == rule->number;
+    case OPERATOR_NOT_EQUAL:     return value != rule->number;
+    case OPERATOR_GREATER:       return value > rule->number;
+    case OPERATOR_LESS:          return value < rule->number;
+    case OPERATOR_GREATER_EQUAL: return value >= rule->number;
+    case OPERATOR_LESS_EQUAL:    return value <= rule->number;
+  }
+  return false;
+}
+
+static void execute(rule_t* rule) {
+  switch(rule->action) {
+    case ACTION_GPIO:
+      digitalWrite(rule->gpio.pin, rule->gpio.level == GPIO_TOGGLE ? !digitalRead(rule->gpio.pin) : rule->gpio.level);
+      break;
+    case ACTION_PUBLISH:
+      if(mqtt_interface_connected())
+        mqtt_interface_publish_raw(rule->publish.topic, rule->publish.payload, false);
+      break;
+    case ACTION_ALP:
+      {
+      // the target is probably asleep, the write waits for its next uplink
+      uint64_t target;
+      memcpy(&target, rule->alp.uid, sizeof(target));
+      downlink_mailbox_enqueue(target, rule->alp.file_id, rule->alp.offset, rule->alp.length, rule->alp.data, DOWNLINK_MAILBOX_DEFAULT_TTL);
+      }
+      break;
+  }
+}
+
+static void evaluate_chain(uint8_t bucket, uint64_t uid, int16_t file_id, publish_object_t* objects, uint8_t amount) {
+  for(uint8_t index = buckets[bucket]; index != NO_RULE; index = rules[index].next) {
+    rule_t* rule = &rules[index];
+    if(rule->uid != uid || rule->file_id != file_id)
+      continue;
+    for(uint8_t i = 0; i < amount; i++) {
+      const char* entity = strchr(objects[i].object_id, '_');
+      if(!entity || strcmp(entity + 1, rule->entity) || !condition_holds(rule, &objects[i]))
+        continue;
+      execute(rule);
+      rule->hits++;
+      statistics.hits++;
+    }
+  }
+}
+
+/**
+ * @brief run the rules of this node and file, and the wildcard rules of this file, against the parsed entities
+ */
+void rule_engine_evaluate(custom_file_contents_t* custom_file_content, publish_object_t* objects, uint8_t amount) {
+  if(!statistics.rules)
+    return;
+
+  statistics.evaluations++;
+  uint64_t uid = custom_file_content->chip_id;
+  evaluate_chain(bucket_of(uid, custom_file_content->file_id), uid, custom_file_content->file_id, objects, amount);
+  if(uid != WILDCARD_UID)
+    evaluate_chain(bucket_of(WILDCARD_UID, custom_file_content->file_id), WILDCARD_UID, custom_file_content->file_id, objects, amount);
+}
+
+uint16_t rule_engine_json(char* buffer, uint16_t size) {
+  int length = snprintf(buffer, size, "{\"evaluations\":%u,\"rejected_lines\":%u,\"rules\":[", statistics.evaluations, statistics.rejected_lines);
+  for(uint8_t index = 0; index < statistics.rules && length < size; index++) {
+    rule_t* rule = &rules[index];
+    uint8_t* uid = (uint8_t*) &rule->uid;
+    char uid_string[17] = "*";
+    if(rule->uid != WILDCARD_UID)
+      sprintf(uid_string, "%02X%02X%02X%02X%02X%02X%02X%02X", uid[0], uid[1], uid[2], uid[3], uid[4], uid[5], uid[6], uid[7]);
+    length += snprintf(&buffer[length], size - length, "%s{\"uid\":\"%s\",\"file\":%d,\"entity\":\"%s\",\"op\":\"%s\",\"value\":\"%s\",\"action\":\"%s\",\"hits\":%u}",
+      index ? "," : "", uid_string, rule->file_id, rule->entity,
+      operator_names[rule->comparison], rule->value, action_names[rule->action], rule->hits);
+  }
+  if(length < size)
+    length += snprintf(&buffer[length], size - length, "]}");
+  return length < size ? length : 0;
+}
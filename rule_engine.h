@@ -0,0 +1,27 @@
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+#include "structures.h"
+
+#define RULE_ENGINE_MAX_RULES 32
+#define RULE_ENGINE_FILE "/rules.txt"
+
+typedef struct {
+  uint8_t rules;
+  uint16_t rejected_lines;
+  uint32_t evaluations;
+  uint32_t hits;
+} rule_engine_statistics_t;
+
+void rule_engine_init();
+
+uint8_t rule_engine_load(const char* rules_text);
+
+bool rule_engine_store(const char* rules_text);
+
+void rule_engine_evaluate(custom_file_contents_t* custom_file_content, publish_object_t* objects, uint8_t amount);
+
+uint16_t rule_engine_json(char* buffer, uint16_t size);
+
+const rule_engine_statistics_t* rule_engine_get_statistics();
+
+#endif
@@ -0,0 +1,204 @@
+#include "serial_bridge.h"
+#include "serial_interface.h"
+#include "socket_send.h"
+#include "logger.h"
+#include <WiFiServer.h>
+
+#define MODEM_HEADER_SIZE      7
+#define MODEM_HEADER_SYNC_BYTE 0xC0
+#define MODEM_HEADER_VERSION   0
+#define MAX_FRAME_SIZE (MODEM_HEADER_SIZE + 255)
+
+// client bytes taken per loop, keeps the uart serviced while a client floods the bridge
+#define MAX_READ_PER_LOOP 256
+
+#define RATE_WINDOW_MS 1000
+
+// modem bytes waiting for the client, about 350 ms of a 115200 baud UART
+#define TX_RING_SIZE 4096
+
+static WiFiServer server(SERIAL_BRIDGE_PORT);
+static WiFiClient client;
+static bool server_started = false;
+
+// a client frame is collected until it is complete, so it never interleaves with a frame of the gateway
+static uint8_t frame[MAX_FRAME_SIZE];
+static uint16_t frame_length = 0;
+static uint32_t frame_start = 0;
+static uint32_t latency_sum = 0;
+
+// the socket is written from serial_bridge_handle() without blocking, a stalled client must not hold up the uart ingest
+static uint8_t* tx_ring = NULL;
+static uint16_t tx_head = 0;
+static uint16_t tx_used = 0;
+
+static uint32_t window_start = 0;
+static uint32_t window_to_client = 0;
+static uint32_t window_from_client = 0;
+
+static serial_bridge_statistics_t statistics;
+
+void serial_bridge_init() {
+  memset(&statistics, 0, sizeof(statistics));
+}
+
+const serial_bridge_statistics_t* serial_bridge_get_statistics() {
+  statistics.connected = client && client.connected();
+  return &statistics;
+}
+
+// modem bytes from the ingest ring, what does not fit the tx ring is dropped and counted
+static void tee(uint8_t modem, const uint8_t* data, uint16_t length) {
+  if(modem != statistics.modem || !length || !client || !client.connected())
+    return;
+  uint16_t room = tx_ring ? TX_RING_SIZE - tx_used : 0;
+  if(length > room) {
+    statistics.short_writes += length - room;
+    length = room;
+  }
+  for(uint16_t index = 0; index < length; index++)
+    tx_ring[(tx_head + tx_used + index) % TX_RING_SIZE] = data[index];
+  tx_used += length;
+}
+
+static void drain_tx_ring() {
+  while(tx_used) {
+    uint16_t length = min((uint16_t) (TX_RING_SIZE - tx_head), tx_used);
+    uint32_t start = micros();
+    int written = socket_send(client, &tx_ring[tx_head], length);
+    uint32_t duration = micros() - start;
+    if(duration > statistics.write_us_max)
+      statistics.write_us_max = duration;
+    if(written <= 0)
+      return;
+    tx_head = (tx_head + written) % TX_RING_SIZE;
+    tx_used -= written;
+    statistics.bytes_to_client += written;
+    window_to_client += written;
+  }
+}
+
+static void release_client() {
+  if(statistics.exclusive)
+    serial_set_exclusive(statistics.modem, false);
+  client.stop();
+  frame_length = 0;
+  tx_head = 0;
+  tx_used = 0;
+}
+
+/**
+ * @brief enable the bridge on port 2217 and select the modem it mirrors
+ * @param exclusive while a client is connected, the gateway neither decodes nor sends on that modem
+ */
+void serial_bridge_configure(bool enabled, uint8_t modem, bool exclusive) {
+  if(client && client.connected())
+    release_client();
+  statistics.enabled = enabled;
+  statistics.modem = modem < serial_modem_count() ? modem : 0;
+  statistics.exclusive = exclusive;
+  if(enabled && !tx_ring) {
+    tx_ring = (uint8_t*) malloc(TX_RING_SIZE);
+    if(!tx_ring)
+      LOG_ERROR("no memory for the bridge tx ring, modem bytes are not mirrored");
+  }
+  serial_set_tee(enabled ? tee : NULL);
+  if(enabled && !server_started) {
+    server.begin();
+    server.setNoDelay(true);
+    server_started = true;
+  } else if(!enabled && server_started) {
+    server.end();
+    server_started = false;
+  }
+}
+
+static void record_frame_latency() {
+  uint32_t latency = micros() - frame_start;
+  if(latency > statistics.frame_latency_us_max)
+    statistics.frame_latency_us_max = latency;
+  latency_sum += latency;
+  statistics.frames_from_client++;
+  statistics.frame_latency_us_avg = latency_sum / statistics.frames_from_client;
+}
+
+static void client_byte(uint8_t value) {
+  if(!frame_length) {
+    if(value != MODEM_HEADER_SYNC_BYTE) {
+      statistics.skipped_bytes++;
+      return;
+    }
+    frame_start = micros();
+  }
+  frame[frame_length++] = value;
+  if(frame_length == 2 && value != MODEM_HEADER_VERSION) {
+    statistics.skipped_bytes += 2;
+    frame_length = 0;
+    return;
+  }
+  if(frame_length >= MODEM_HEADER_SIZE && frame_length == MODEM_HEADER_SIZE + frame[4]) {
+    serial_write(statistics.modem, frame, frame_length);
+    record_frame_latency();
+    frame_length = 0;
+  }
+}
+
+static void update_rates() {
+  uint32_t now = millis();
+  if(now - window_start < RATE_WINDOW_MS)
+    return;
+  statistics.rate_to_client = window_to_client * 1000 / (now - window_start);
+  statistics.rate_from_client = window_from_client * 1000 / (now - window_start);
+  window_to_client = 0;
+  window_from_client = 0;
+  window_start = now;
+}
+
+void serial_bridge_handle() {
+  update_rates();
+  if(!statistics.enabled)
+    return;
+
+  if(server.hasClient()) {
+    if(client && client.connected()) {
+      // one client at a time, a second one would fight over the modem
+      server.available().stop();
+    } else {
+      client = server.available();
+      client.setNoDelay(true);
+      statistics.connects++;
+      frame_length = 0;
+      tx_head = 0;
+      tx_used = 0;
+      if(statistics.exclusive)
+        serial_set_exclusive(statistics.modem, true);
+      LOG_INFO("bridge client connected to modem %u", statistics.modem);
+    }
+  }
+  if(!client)
+    return;
+  if(!client.connected()) {
+    LOG_INFO("bridge client disconnected");
+    release_client();
+    return;
+  }
+  drain_tx_ring();
+
+  static uint8_t received[MAX_READ_PER_LOOP];
+  int available = client.available();
+  if(available <= 0)
+    return;
+  int length = client.read(received, min(available, MAX_READ_PER_LOOP));
+  if(length <= 0)
+    return;
+  statistics.bytes_from_client += length;
+  window_from_client += length;
+
+  // an exclusive client may talk to the modem outside the frame protocol, e.g. to its bootloader
+  if(statistics.exclusive) {
+    serial_write(statistics.modem, received, length);
+    return;
+  }
+  for(int index = 0; index < length; index++)
+    client_byte(received[index]);
+}
@@ -0,0 +1,36 @@
+#ifndef SERIAL_BRIDGE_H
+#define SERIAL_BRIDGE_H
+#include "structures.h"
+
+// uncomment to allow enabling the raw TCP bridge to the modems, it has no authentication
+// #define SERIAL_BRIDGE
+
+#define SERIAL_BRIDGE_PORT 2217
+
+typedef struct {
+  bool enabled;
+  bool exclusive;
+  bool connected;
+  uint8_t modem;
+  uint32_t connects;
+  uint32_t bytes_to_client;
+  uint32_t bytes_from_client;
+  uint32_t frames_from_client;
+  uint32_t skipped_bytes;        // client bytes outside a frame, dropped unless exclusive
+  uint32_t short_writes;         // modem bytes dropped because the client fell behind and the tx ring was full
+  uint32_t rate_to_client;       // bytes per second over the last second
+  uint32_t rate_from_client;
+  uint32_t write_us_max;         // longest non-blocking send to the client
+  uint32_t frame_latency_us_max; // first byte of a client frame received to the frame written to the modem
+  uint32_t frame_latency_us_avg;
+} serial_bridge_statistics_t;
+
+void serial_bridge_init();
+
+void serial_bridge_configure(bool enabled, uint8_t modem, bool exclusive);
+
+void serial_bridge_handle();
+
+const serial_bridge_statistics_t* serial_bridge_get_statistics();
+
+#endif
@@ -1,35 +1,203 @@
 #include "serial_interface.h"
 #include "CRC16.h"
+#include "pipeline_stats.h"
+#include "logger.h"
+#include "frame_capture.h"
+#include <esp_sleep.h>
+#include <driver/uart.h>
 
 #define MODEM_HEADER_SIZE      7
 #define MODEM_HEADER_SYNC_BYTE 0xC0
 #define MODEM_HEADER_VERSION   0
 
-#define SERIAL_MESSAGE_TYPE_ALP      1
-#define SERIAL_MESSAGE_TYPE_REBOOTED 5
-
 #define MAX_SERIAL_BUFFER_SIZE 256
 
-static modem_rebooted_callback reboot_cb;
+// the UART driver buffers what arrives while the loop is busy, e.g. during setup, before it reaches the ring
+#define UART_RX_BUFFER_SIZE 2048
 
-static uint8_t buffer[MAX_SERIAL_BUFFER_SIZE];
-static uint8_t index_start = 0;
-static uint8_t index_end = 0;
+// rising edges on RX that wake the chip from light sleep, the bytes carrying them are lost
+#define UART_WAKEUP_THRESHOLD 3
 
-static bool header_parsed = false;
-static uint8_t payload_length;
-static uint8_t packet_type;
-static uint16_t crc;
+// every modem has its own framer, the frames of all modems are decoded into the one output buffer
+typedef struct {
+  HardwareSerial* port; // NULL for the first modem, it goes through the DATA macros
+  uint8_t buffer[MAX_SERIAL_BUFFER_SIZE];
+  uint8_t index_start;
+  uint8_t index_end;
+  uint8_t index_tee;
+  bool exclusive; // a bridge client owns the modem, frames are not decoded and the gateway does not send
+  bool header_parsed;
+  uint8_t header[MODEM_HEADER_SIZE];
+  uint8_t payload_length;
+  uint8_t packet_type;
+  uint16_t crc;
+  uint8_t frame_counter;
+  uint32_t frame_arrival;
+  bool overflowing;
+  serial_statistics_t statistics;
+} serial_framer_t;
+
+static modem_rebooted_callback reboot_cb;
+static serial_tee_callback tee_cb = NULL;
+
+static serial_framer_t framers[SERIAL_MAX_MODEMS];
+static uint8_t modem_count = 0;
+static uint8_t next_modem = 0;
 
 static uint8_t* output_buffer;
 
 static CRC16 crc_tool;
 
-static uint16_t get_serial_size();
-static void memcpy_serial_overflow(uint8_t* dest, uint8_t length, uint8_t offset);
+static uint32_t frame_arrival = 0;
+static uint8_t frame_modem = 0;
+
+static serial_statistics_t total_statistics;
+
+static uint16_t get_serial_size(serial_framer_t* framer);
+static void memcpy_serial_overflow(serial_framer_t* framer, uint8_t* dest, uint8_t length, uint8_t offset);
+
+/**
+ * @brief pipeline_stats_now() at the moment the first byte of the last parsed frame was seen on the UART
+ */
+uint32_t serial_frame_arrival() {
+  return frame_arrival;
+}
+
+// the modem the last parsed frame was received on
+uint8_t serial_frame_modem() {
+  return frame_modem;
+}
+
+uint8_t serial_modem_count() {
+  return modem_count;
+}
+
+const serial_statistics_t* serial_get_modem_statistics(uint8_t modem) {
+  if(modem >= modem_count)
+    return NULL;
+  return &framers[modem].statistics;
+}
+
+// totals over all modems, the high water mark is the one of the fullest ring
+const serial_statistics_t* serial_get_statistics() {
+  memset(&total_statistics, 0, sizeof(total_statistics));
+  for(uint8_t modem = 0; modem < modem_count; modem++) {
+    serial_statistics_t* statistics = &framers[modem].statistics;
+    total_statistics.frames += statistics->frames;
+    total_statistics.crc_errors += statistics->crc_errors;
+    total_statistics.dropped_frames += statistics->dropped_frames;
+    total_statistics.dropped_bytes += statistics->dropped_bytes;
+    total_statistics.skipped_bytes += statistics->skipped_bytes;
+    total_statistics.ring_high_water = max(total_statistics.ring_high_water, statistics->ring_high_water);
+  }
+  return &total_statistics;
+}
+
+static int modem_available(serial_framer_t* framer) {
+  return framer->port ? framer->port->available() : DATAREADY();
+}
+
+static uint8_t modem_read(serial_framer_t* framer) {
+  return framer->port ? framer->port->read() : DATAREAD();
+}
+
+static void modem_write(serial_framer_t* framer, const uint8_t* data, uint16_t length) {
+  if(framer->port)
+    framer->port->write(data, length);
+  else
+    DATAWRITE(data, length);
+}
+
+void serial_set_tee(serial_tee_callback callback) {
+  tee_cb = callback;
+  for(uint8_t modem = 0; modem < modem_count; modem++)
+    framers[modem].index_tee = framers[modem].index_end;
+}
+
+void serial_set_exclusive(uint8_t modem, bool exclusive) {
+  if(modem >= modem_count)
+    return;
+  framers[modem].exclusive = exclusive;
+  framers[modem].header_parsed = false;
+  framers[modem].index_start = framers[modem].index_end;
+}
+
+void serial_set_receive_callback(void (*callback)()) {
+  for(uint8_t modem = 0; modem < modem_count; modem++) {
+    if(framers[modem].port)
+      framers[modem].port->onReceive(callback, false);
+    else
+      DATARECEIVE(callback, false);
+  }
+}
+
+static int8_t modem_uart(serial_framer_t* framer) {
+  if(!framer->port)
+    return DATAUART;
+  return framer->port == &Serial1 ? 1 : framer->port == &Serial2 ? 2 : 0;
+}
+
+/**
+ * @brief in light sleep the UARTs stop, a modem has to send a preamble before its frame that the framer then skips
+ * @return false when a modem cannot wake the chip, e.g. on UART2 or without receive events. No modem wakes it then.
+ */
+bool serial_set_wakeup(bool enabled) {
+  if(!enabled) {
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_UART);
+    return true;
+  }
+  for(uint8_t modem = 0; modem < modem_count; modem++) {
+    int8_t uart = modem_uart(&framers[modem]);
+    if(uart < 0 || uart_set_wakeup_threshold((uart_port_t)uart, UART_WAKEUP_THRESHOLD) != ESP_OK
+      || esp_sleep_enable_uart_wakeup(uart) != ESP_OK) {
+      LOG_WARNING("modem %u on uart %d cannot wake the chip from light sleep", modem, uart);
+      esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_UART);
+      return false;
+    }
+  }
+  return true;
+}
+
+// bytes for the modem that are already framed, e.g. by a bridge client
+void serial_write(uint8_t modem, const uint8_t* data, uint16_t length) {
+  if(modem < modem_count)
+    modem_write(&framers[modem], data, length);
+}
+
+// hands the new bytes of the ring to the tee in place, in two parts when they wrap
+static void tee(serial_framer_t* framer, uint8_t modem) {
+  if(framer->index_tee == framer->index_end)
+    return;
+  if(framer->index_tee < framer->index_end) {
+    tee_cb(modem, &framer->buffer[framer->index_tee], framer->index_end - framer->index_tee);
+  } else {
+    tee_cb(modem, &framer->buffer[framer->index_tee], MAX_SERIAL_BUFFER_SIZE - framer->index_tee);
+    if(framer->index_end)
+      tee_cb(modem, framer->buffer, framer->index_end);
+  }
+  framer->index_tee = framer->index_end;
+}
+
+static void add_modem(HardwareSerial* port, int8_t rx, int8_t tx) {
+  if(modem_count == SERIAL_MAX_MODEMS)
+    return;
+  port->setRxBufferSize(UART_RX_BUFFER_SIZE);
+  port->begin(DATARATE, SERIAL_8N1, rx, tx, false);
+  framers[modem_count++].port = port;
+}
 
 void serial_interface_init(modem_rebooted_callback reboot_callback, uint8_t* output_buffer_pointer) {
+  memset(framers, 0, sizeof(framers));
+  DATARXBUFFER(UART_RX_BUFFER_SIZE);
   DATABEGIN();
+  modem_count = 1;
+#ifdef MODEM1_SERIAL
+  add_modem(&MODEM1_SERIAL, MODEM1_RX, MODEM1_TX);
+#endif
+#ifdef MODEM2_SERIAL
+  add_modem(&MODEM2_SERIAL, MODEM2_RX, MODEM2_TX);
+#endif
+
   reboot_cb = reboot_callback;
   output_buffer = output_buffer_pointer;
 
@@ -37,67 +205,129 @@ void serial_interface_init(modem_rebooted_callback reboot_callback, uint8_t* out
   crc_tool.setStartXOR(0xFFFF);
 }
 
+static void framer_handle(serial_framer_t* framer) {
+#ifdef PIPELINE_STATS
+  if(modem_available(framer) && get_serial_size(framer) == 0)
+    framer->frame_arrival = pipeline_stats_now();
+#endif
+  while(modem_available(framer)) {
+    // when the ring is full the new bytes are dropped, one lost frame is counted per overflow
+    if(get_serial_size(framer) == MAX_SERIAL_BUFFER_SIZE - 1) {
+      modem_read(framer);
+      framer->statistics.dropped_bytes++;
+      if(!framer->overflowing)
+        framer->statistics.dropped_frames++;
+      framer->overflowing = true;
+      continue;
+    }
+    framer->overflowing = false;
+    framer->buffer[framer->index_end] = modem_read(framer);
+    framer->index_end++;
+  }
+  uint16_t size = get_serial_size(framer);
+  if(size > framer->statistics.ring_high_water)
+    framer->statistics.ring_high_water = size;
+}
+
+static void framer_tee(serial_framer_t* framer, uint8_t modem) {
+  if(tee_cb)
+    tee(framer, modem);
+  else
+    framer->index_tee = framer->index_end;
+  // nothing is decoded while a client owns the modem
+  if(framer->exclusive)
+    framer->index_start = framer->index_end;
+}
+
 void serial_handle() {
-  while(DATAREADY()) {
-    buffer[index_end] = DATAREAD();
-    index_end++;
+  for(uint8_t modem = 0; modem < modem_count; modem++) {
+    framer_handle(&framers[modem]);
+    framer_tee(&framers[modem], modem);
   }
 }
 
-uint8_t serial_parse() {
-  if(!header_parsed) {
-    if(get_serial_size() > MODEM_HEADER_SIZE) {
+static uint8_t framer_parse(serial_framer_t* framer, uint8_t modem) {
+  if(!framer->header_parsed) {
+    if(get_serial_size(framer) > MODEM_HEADER_SIZE) {
       // check sync byte and version, otherwise skip byte
-      uint8_t local_index = index_start;
-      if((buffer[local_index++] == MODEM_HEADER_SYNC_BYTE) && (buffer[local_index++] == MODEM_HEADER_VERSION)) {
-        uint8_t counter = buffer[local_index++];
-        packet_type = buffer[local_index++];
-        payload_length = buffer[local_index++];
-        crc = buffer[local_index++] << 8;
-        crc += buffer[local_index++];
-        header_parsed = true;
+      uint8_t local_index = framer->index_start;
+      if((framer->buffer[local_index++] == MODEM_HEADER_SYNC_BYTE) && (framer->buffer[local_index++] == MODEM_HEADER_VERSION)) {
+        uint8_t counter = framer->buffer[local_index++];
+        framer->packet_type = framer->buffer[local_index++];
+        framer->payload_length = framer->buffer[local_index++];
+        framer->crc = framer->buffer[local_index++] << 8;
+        framer->crc += framer->buffer[local_index++];
+        memcpy_serial_overflow(framer, framer->header, MODEM_HEADER_SIZE, 0);
+        framer->header_parsed = true;
       } else {
-        DPRINT("not header material ");
-        DPRINTLN(buffer[index_start]);
-        index_start++;
+        LOG_DEBUG("modem %u: not header material %02x", modem, framer->buffer[framer->index_start]);
+        framer->statistics.skipped_bytes++;
+        framer->index_start++;
       }
     }
   } else {
-    if(get_serial_size() >= payload_length) {
-      uint8_t local_idx = index_start + MODEM_HEADER_SIZE;
+    if(get_serial_size(framer) >= framer->payload_length) {
+      framer->header_parsed = false;
+
+      memcpy_serial_overflow(framer, output_buffer, framer->payload_length, MODEM_HEADER_SIZE);
 
-      header_parsed = false;
-      
-      memcpy_serial_overflow(output_buffer, payload_length, MODEM_HEADER_SIZE);
-      
       crc_tool.restart();
-      crc_tool.add(output_buffer, payload_length);
-      if(crc != crc_tool.getCRC()) {
-        DPRINTLN("CRC did not match, skipping a byte");
-        index_start++;
+      crc_tool.add(output_buffer, framer->payload_length);
+      bool crc_ok = (framer->crc == crc_tool.getCRC());
+      frame_capture_record(modem, framer->header, MODEM_HEADER_SIZE, output_buffer, framer->payload_length, crc_ok);
+      if(!crc_ok) {
+        LOG_WARNING("modem %u: CRC did not match, skipping a byte", modem);
+        framer->statistics.crc_errors++;
+        framer->index_start++;
         return 0;
       }
-      
-      index_start += MODEM_HEADER_SIZE;
-      switch(packet_type){
+
+      framer->index_start += MODEM_HEADER_SIZE;
+      framer->statistics.frames++;
+      switch(framer->packet_type){
         case SERIAL_MESSAGE_TYPE_REBOOTED: //reboot
           if(reboot_cb)
-            reboot_cb(buffer[index_start]);
-          index_start += 1;
+            reboot_cb(modem, framer->buffer[framer->index_start]);
+          framer->index_start += 1;
           break;
         case SERIAL_MESSAGE_TYPE_ALP:
         default:
-          index_start += payload_length;
-          return payload_length;
+          framer->index_start += framer->payload_length;
+          frame_arrival = framer->frame_arrival;
+          frame_modem = modem;
+          STATS_STOP(STAGE_SERIAL, frame_arrival);
+          return framer->payload_length;
       }
     }
   }
   return 0;
 }
 
-void serial_send(uint8_t* data, uint8_t length, uint8_t type) {
-  static uint8_t frame_counter = 0;
+/**
+ * @brief advance the framers one step, starting after the modem that delivered the last frame so a busy modem cannot starve the others
+ * @return the length of the payload in the output buffer, 0 if no modem completed a frame
+ */
+uint8_t serial_parse() {
+  for(uint8_t attempt = 0; attempt < modem_count; attempt++) {
+    uint8_t modem = next_modem;
+    next_modem = (next_modem + 1) % modem_count;
+    uint8_t payload_length = framer_parse(&framers[modem], modem);
+    if(payload_length)
+      return payload_length;
+  }
+  return 0;
+}
+
+// false when the frame was not sent because a bridge client owns the modem
+bool serial_send_modem(uint8_t modem, uint8_t* data, uint8_t length, uint8_t type) {
+  if(modem >= modem_count)
+    modem = 0;
+  serial_framer_t* framer = &framers[modem];
   uint8_t header[MODEM_HEADER_SIZE];
+  if(framer->exclusive) {
+    LOG_WARNING("modem %u is owned by a bridge client, not sending", modem);
+    return false;
+  }
 
   crc_tool.restart();
   crc_tool.add(data, length);
@@ -105,31 +335,36 @@ void serial_send(uint8_t* data, uint8_t length, uint8_t type) {
 
   header[0] = MODEM_HEADER_SYNC_BYTE;
   header[1] = MODEM_HEADER_VERSION;
-  header[2] = frame_counter++;
+  header[2] = framer->frame_counter++;
   header[3] = type;
   header[4] = length;
   header[5] = calculated_crc >> 8;
   header[6] = calculated_crc & 0xFF;
 
-  DATAWRITE(header, MODEM_HEADER_SIZE);
-  DATAWRITE(data, length);
+  modem_write(framer, header, MODEM_HEADER_SIZE);
+  modem_write(framer, data, length);
+  return true;
+}
+
+bool serial_send(uint8_t* data, uint8_t length, uint8_t type) {
+  return serial_send_modem(0, data, length, type);
 }
 
-static void memcpy_serial_overflow(uint8_t* dest, uint8_t length, uint8_t offset)
+static void memcpy_serial_overflow(serial_framer_t* framer, uint8_t* dest, uint8_t length, uint8_t offset)
 {
-  uint8_t local_index = index_start + offset;
+  uint8_t local_index = framer->index_start + offset;
   if(((local_index + length) & 0xFF) > local_index) {
-    memcpy(dest, &buffer[local_index], length);
+    memcpy(dest, &framer->buffer[local_index], length);
   } else {
     uint8_t end_length = MAX_SERIAL_BUFFER_SIZE - local_index;
-    memcpy(dest, &buffer[local_index], end_length);
-    memcpy(dest + end_length, buffer, length - end_length);
+    memcpy(dest, &framer->buffer[local_index], end_length);
+    memcpy(dest + end_length, framer->buffer, length - end_length);
   }
 }
 
-static uint16_t get_serial_size()
+static uint16_t get_serial_size(serial_framer_t* framer)
 {
-  if(index_start > index_end)
-    return (MAX_SERIAL_BUFFER_SIZE - index_start) + index_end;
-  return index_end - index_start;
+  if(framer->index_start > framer->index_end)
+    return (MAX_SERIAL_BUFFER_SIZE - framer->index_start) + framer->index_end;
+  return framer->index_end - framer->index_start;
 }
@@ -2,11 +2,40 @@
 #define SERIAL_INTERFACE_H
 #include "structures.h"
 
-typedef void (*modem_rebooted_callback) (uint8_t);
+#define SERIAL_MESSAGE_TYPE_ALP      1
+#define SERIAL_MESSAGE_TYPE_REBOOTED 5
+
+// one modem per UART, the first one is the modem on the DATA macros
+#define SERIAL_MAX_MODEMS 3
+
+typedef void (*modem_rebooted_callback) (uint8_t modem, uint8_t reason);
+// gets the bytes of a modem as they land in its ring, the data is only valid during the call
+typedef void (*serial_tee_callback) (uint8_t modem, const uint8_t* data, uint16_t length);
+
+typedef struct {
+  uint32_t frames;
+  uint32_t crc_errors;
+  uint32_t dropped_frames;
+  uint32_t dropped_bytes;
+  uint32_t skipped_bytes;
+  uint16_t ring_high_water;
+} serial_statistics_t;
 
 void serial_interface_init(modem_rebooted_callback reboot_callback, uint8_t* output_buffer_pointer);
 void serial_handle();
 uint8_t serial_parse();
-void serial_send(uint8_t* data, uint8_t length, uint8_t type);
+bool serial_send(uint8_t* data, uint8_t length, uint8_t type);
+bool serial_send_modem(uint8_t modem, uint8_t* data, uint8_t length, uint8_t type);
+void serial_write(uint8_t modem, const uint8_t* data, uint16_t length);
+void serial_set_tee(serial_tee_callback callback);
+void serial_set_exclusive(uint8_t modem, bool exclusive);
+// called from the UART event task when bytes of any modem arrived
+void serial_set_receive_callback(void (*callback)());
+bool serial_set_wakeup(bool enabled);
+uint32_t serial_frame_arrival();
+uint8_t serial_frame_modem();
+uint8_t serial_modem_count();
+const serial_statistics_t* serial_get_statistics();
+const serial_statistics_t* serial_get_modem_statistics(uint8_t modem);
 
 #endif
@@ -0,0 +1,26 @@
+#include "socket_send.h"
+#include <lwip/sockets.h>
+#include <errno.h>
+
+int socket_send(WiFiClient& client, const uint8_t* data, size_t length) {
+  int socket = client.fd();
+  if(socket < 0)
+    return -1;
+  if(!length)
+    return 0;
+  int sent = send(socket, data, length, MSG_DONTWAIT);
+  if(sent < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+  return sent;
+}
+
+bool socket_writable(WiFiClient& client) {
+  int socket = client.fd();
+  if(socket < 0)
+    return false;
+  fd_set writable;
+  FD_ZERO(&writable);
+  FD_SET(socket, &writable);
+  struct timeval timeout = { 0, 0 };
+  return select(socket + 1, NULL, &writable, NULL, &timeout) > 0;
+}
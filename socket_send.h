@@ -0,0 +1,15 @@
+#ifndef SOCKET_SEND_H
+#define SOCKET_SEND_H
+#include "structures.h"
+#include <WiFiClient.h>
+
+/**
+ * @brief write to a client without blocking the loop, e.g. for a browser or bridge client that stopped reading
+ * @return the bytes the socket took, 0 when its buffer is full, -1 when the connection failed
+ */
+int socket_send(WiFiClient& client, const uint8_t* data, size_t length);
+
+// whether the socket takes bytes right now
+bool socket_writable(WiFiClient& client);
+
+#endif
@@ -1,9 +1,25 @@
 #ifndef STRUCTURES_H
 #define STRUCTURES_H
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+// host builds get the Arduino and ESP32 APIs the modules use from host/shims
+#include <arduino_shim.h>
+#endif
 
 #define DATARATE 115200
 
+#define MAX_CREDENTIAL_SIZE 100
+
+// what is published per uplink, Home Assistant entities and/or one CBOR document
+#define OUTPUT_MODE_HOME_ASSISTANT 0x01
+#define OUTPUT_MODE_COMPACT        0x02
+#define DEFAULT_COMPACT_TOPIC_PREFIX "d7/cbor"
+// the prefix is stored null terminated in the config slot
+#define MAX_TOPIC_PREFIX_SIZE 64
+
+// builds outside the Arduino toolchain can predefine the debug and data macros to point at their own streams
+#ifndef DPRINT
 #if defined(ARDUINO_ESP32_POE)
   #define DBEGIN(...) Serial.begin(DATARATE, SERIAL_8N1, RX, TX, false)
 #else
@@ -11,10 +27,12 @@
 #endif
 #define DPRINT(...) Serial.print(__VA_ARGS__)
 #define DPRINTLN(...) Serial.println(__VA_ARGS__)
+#endif
 // #define DPRINT(...)
 // #define DPRINTLN(...)
 // #define DBEGIN(...)
 
+#ifndef DATAREAD
 #if defined(ARDUINO_ESP32_POE)
   #define DATAPRINT(...) Serial2.print(__VA_ARGS__)
   #define DATAPRINTLN(...) Serial2.println(__VA_ARGS__)
@@ -22,6 +40,9 @@
   #define DATAREAD(...) Serial2.read(__VA_ARGS__)
   #define DATAREADY(...) Serial2.available()
   #define DATABEGIN(...) Serial2.begin(DATARATE, SERIAL_8N1, RX1, TX1, false)
+  #define DATARECEIVE(...) Serial2.onReceive(__VA_ARGS__)
+  #define DATARXBUFFER(...) Serial2.setRxBufferSize(__VA_ARGS__)
+  #define DATAUART 2
 #else
   #define DATAPRINT(...) Serial.print(__VA_ARGS__)
   #define DATAPRINTLN(...) Serial.println(__VA_ARGS__)
@@ -29,13 +50,41 @@
   #define DATAREAD(...) Serial.read(__VA_ARGS__)
   #define DATAREADY(...) Serial.available()
   #define DATABEGIN(...) Serial.begin(DATARATE)
+  #define DATARECEIVE(...) Serial.onReceive(__VA_ARGS__)
+  #define DATARXBUFFER(...) Serial.setRxBufferSize(__VA_ARGS__)
+  #define DATAUART 0
+#endif
+#endif
+
+// without receive events of the modem UART the main loop wakes on its poll interval only
+#ifndef DATARECEIVE
+  #define DATARECEIVE(...)
+  #define DATAUART -1
 #endif
+#ifndef DATARXBUFFER
+  #define DATARXBUFFER(...)
+#endif
+
 //#define DATAPRINT(...)
 //#define DATAPRINTLN(...)
 // #define DATAWRITE(...)
 //#define DATAREAD(...)
 //#define DATAREADY(...)
 //#define DATABEGIN(...)
+//#define DATARECEIVE(...)
+//#define DATARXBUFFER(...)
+
+// the modem signals on this pin that it is busy
+#define ESP_BUSY_PIN 13
+
+// additional modems on the other UARTs, define the port and pins of a modem to enable it.
+// Serial2 is the first modem on the POE board, use Serial1 there.
+// #define MODEM1_SERIAL Serial1
+// #define MODEM1_RX 32
+// #define MODEM1_TX 33
+// #define MODEM2_SERIAL Serial2
+// #define MODEM2_RX 16
+// #define MODEM2_TX 17
 
 typedef struct {
   int* length;
@@ -49,8 +98,18 @@ typedef struct {
   char_length_t mqtt_user;
   char_length_t mqtt_password;
   uint32_t* mqtt_port;
+  uint8_t* output_mode;
+  char_length_t compact_topic_prefix;
 } persisted_data_t;
 
+// what the last good connection used, so a boot can skip the WiFi scan and the broker lookup
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t channel;        // 0 when nothing is cached
+  uint32_t broker_hash;   // of the broker name the address belongs to
+  uint32_t broker_ip;
+} __attribute__((__packed__)) network_cache_t;
+
 typedef struct {
   int16_t file_id;
   uint8_t length;
@@ -61,6 +120,8 @@ typedef struct {
     uint8_t uid[8];
   };
   uint8_t rssi;
+  uint8_t link_budget;
+  uint8_t modem;
 } custom_file_contents_t;
 
 typedef struct {
@@ -78,26 +139,178 @@ typedef struct {
   char state[20];
   char product[15];
   bool default_shown;
+  const char* state_topic;    // shared state topic instead of a per entity one, state is then not published
+  const char* value_template; // extracts the value from a shared json state
+  bool attributes;            // announce a json attributes topic next to the state topic
+  uint8_t rssi;               // reception of the uplink the state came from
+  uint32_t received;          // millis() when that uplink was handled, 0 for entities of the gateway itself
 } publish_object_t;
 
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
- * INTERNAL FILES                                                                                                        *
+ * CUSTOM FILES                                                                                                          *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-#define GATEWAY_STATUS_FILE_ID     254
+#define BUTTON_FILE_ID             51
+#define HUMIDITY_FILE_ID           53
+#define PUSH7_STATE_FILE_ID        56
+#define LIGHT_FILE_ID              57
+#define PIR_FILE_ID                58
+#define HALL_EFFECT_FILE_ID        59
+
+#define BUTTON_CONFIG_FILE_ID      61
+#define HUMIDITY_CONFIG_FILE_ID    63
+#define PUSH7_CONFIG_STATE_FILE_ID 66
+#define LIGHT_CONFIG_FILE_ID       67
+#define PIR_CONFIG_FILE_ID         68
+#define HALL_EFFECT_CONFIG_FILE_ID 69
+
+typedef struct {
+    union {
+        uint8_t bytes[3];
+        struct {
+            uint8_t button_id;
+            bool mask;
+            uint8_t buttons_state;
+        } __attribute__((__packed__));
+    };
+} button_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[4];
+        struct {
+            bool transmit_mask_0;
+            bool transmit_mask_1;
+            bool button_control_menu;
+            bool enabled;
+        } __attribute__((__packed__));
+    };
+} button_config_file_t;
+
+typedef struct
+{
+    union
+    {
+        uint8_t bytes[1];
+        struct
+        {
+            bool mask;
+        } __attribute__((__packed__));
+    };
+} pir_file_t;
+
+typedef struct
+{
+    union
+    {
+        uint8_t bytes[9];
+        struct
+        {
+            bool transmit_mask_0;
+            bool transmit_mask_1;
+            uint8_t filter_source; // PYD1598_FILTER_SOURCE_t
+            uint8_t window_time; // Window time = [RegisterValue] * 2s + 2s
+            uint8_t pulse_counter; // Amount of pulses = [RegisterValue] + 1
+            uint16_t blind_time; // seconds
+            uint8_t threshold;
+            bool enabled;
+        } __attribute__((__packed__));
+    };
+} pir_config_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[8];
+        struct {
+            int32_t humidity;
+            int32_t temperature;
+        } __attribute__((__packed__));
+    };
+} humidity_file_t;
 
 typedef struct {
     union {
         uint8_t bytes[5];
         struct {
-            uint8_t heartbeat_counter;
-            uint8_t processed_messages;
-            uint8_t dash7_modem_reboot_counter;
-            uint8_t status_interval;
-            bool rebooted;
-        };
+            uint32_t interval;
+            bool enabled;
+        } __attribute__((__packed__));
+    };
+} humidity_config_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[4];
+        struct {
+            uint16_t battery_voltage;
+            uint8_t hw_version;
+            uint8_t sw_version;
+        } __attribute__((__packed__));
+    };
+} push7_state_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[7];
+        struct {
+            uint32_t interval;
+            bool led_flash_state;
+            bool enabled;
+            uint8_t tx_power;
+        } __attribute__((__packed__));
+    };
+} push7_state_config_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[4];
+        struct {
+            uint32_t light_level;
+            uint16_t light_level_raw;
+            bool threshold_high_triggered;
+            bool threshold_low_triggered;
+        } __attribute__((__packed__));
+    };
+} light_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[8];
+        struct {
+            uint32_t interval;
+            uint8_t integration_time;
+            uint8_t persistence_protect_number;
+            uint8_t gain;
+            uint16_t threshold_high;
+            uint16_t threshold_low;
+            bool light_detection_mode;
+            uint8_t low_power_mode;
+            uint8_t interrupt_check_interval;
+            uint8_t threshold_menu_offset;
+            bool enabled;
+        } __attribute__((__packed__));
+    };
+} light_config_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[1];
+        struct {
+            bool mask;
+        } __attribute__((__packed__));
+    };
+} hall_effect_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[3];
+        struct {
+            bool transmit_mask_0;
+            bool transmit_mask_1;
+            bool enabled;
+        } __attribute__((__packed__));
     };
-} gateway_status_file_t;
+} hall_effect_config_file_t;
 
 #endif
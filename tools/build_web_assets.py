@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+Generates web_assets.h from the sources in web/.
+
+Templates (*.html) are minified and stored uncompressed so the webserver can
+substitute %TOKEN% placeholders while streaming them. Static assets (*.css,
+*.js) are minified, gzip-compressed and stored with a content hash as ETag.
+
+Run from the repository root after editing anything in web/:
+    python3 tools/build_web_assets.py
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+WEB_DIR = os.path.join(ROOT, "web")
+OUTPUT = os.path.join(ROOT, "web_assets.h")
+
+CONTENT_TYPES = {
+    ".css": "text/css",
+    ".js": "application/javascript",
+}
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    text = re.sub(r">\s+<", "><", text)
+    text = re.sub(r"\s+", " ", text)
+    return text.strip()
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};:,>])\s*", r"\1", text)
+    text = text.replace(";}", "}")
+    return text.strip()
+
+
+def minify_js(text):
+    lines = [line.strip() for line in text.splitlines()]
+    return "\n".join(line for line in lines if line and not line.startswith("//"))
+
+
+def symbol_name(filename):
+    return re.sub(r"[^a-zA-Z0-9]", "_", filename).lower()
+
+
+def c_string(text):
+    chunks = [text[i:i + 100] for i in range(0, len(text), 100)]
+    return "\n".join("  \"" + c.replace("\\", "\\\\").replace("\"", "\\\"") + "\"" for c in chunks)
+
+
+def c_bytes(data):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]))
+    return ",\n".join(rows)
+
+
+def main():
+    out = [
+        "// generated by tools/build_web_assets.py from web/, do not edit",
+        "#ifndef WEB_ASSETS_H",
+        "#define WEB_ASSETS_H",
+        "#include <Arduino.h>",
+        "",
+        "typedef struct {",
+        "  const char* path;",
+        "  const char* content_type;",
+        "  const char* etag;",
+        "  const uint8_t* data;",
+        "  uint32_t length;",
+        "} web_asset_t;",
+        "",
+    ]
+    assets = []
+
+    for filename in sorted(os.listdir(WEB_DIR)):
+        path = os.path.join(WEB_DIR, filename)
+        extension = os.path.splitext(filename)[1]
+        with open(path, encoding="utf-8") as f:
+            source = f.read()
+        name = symbol_name(filename)
+
+        if extension == ".html":
+            template = minify_html(source)
+            out.append("// %s: %d bytes, served through the token streamer" % (filename, len(template)))
+            out.append("static const char %s[] PROGMEM =\n%s;\n" % (name, c_string(template)))
+        elif extension in CONTENT_TYPES:
+            minified = minify_css(source) if extension == ".css" else minify_js(source)
+            compressed = gzip.compress(minified.encode("utf-8"), compresslevel=9, mtime=0)
+            etag = hashlib.sha1(compressed).hexdigest()[:16]
+            out.append("// %s: %d bytes source, %d bytes minified, %d bytes gzip"
+                       % (filename, len(source), len(minified), len(compressed)))
+            out.append("static const uint8_t %s_gz[] PROGMEM = {\n%s\n};\n" % (name, c_bytes(compressed)))
+            assets.append((filename, CONTENT_TYPES[extension], etag, name + "_gz", len(compressed)))
+        else:
+            print("skipping %s" % filename, file=sys.stderr)
+
+    out.append("static const web_asset_t web_static_assets[] = {")
+    for filename, content_type, etag, symbol, length in assets:
+        out.append("  { \"/%s\", \"%s\", \"\\\"%s\\\"\", %s, %d }," % (filename, content_type, etag, symbol, length))
+    out.append("};")
+    out.append("")
+    out.append("#define WEB_STATIC_ASSET_COUNT (sizeof(web_static_assets) / sizeof(web_static_assets[0]))")
+    out.append("")
+    out.append("#endif")
+
+    with open(OUTPUT, "w", encoding="utf-8") as f:
+        f.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
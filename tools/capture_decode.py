@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+Decodes modem frames captured by the gateway and optionally replays them.
+
+The gateway serves its capture ring on /capture.pcap (pcap, link type 147) and /capture.bin, and the frames
+spilled to flash on /capture-spill.bin. Both .bin files hold records of a little endian u64 timestamp in
+microseconds since boot, a flags byte (bit 0: crc matched, bits 1-2: modem), a u16 length and the modem header plus payload.
+In the pcap the packet data is the flags byte followed by the modem header and payload.
+
+Every frame is printed with its timestamp, crc status and the ALP operations found in it. With --replay the
+frames are written to a serial port, or a pseudo terminal when no port is given, using their original
+spacing scaled by --speed, so a gateway can be fed the exact bytes it received before.
+
+With --batch the input is a message of the raw passthrough topic d7/raw/<gateway id> instead, its records
+are printed with their arrival and modem.
+
+Example:
+    curl -o capture.pcap http://dash7-gateway.local/capture.pcap
+    python3 tools/capture_decode.py capture.pcap --replay /dev/ttyUSB0
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+from modem_emulator import ALP_OP_RETURN_FILE_DATA, ALP_OP_STATUS, crc16, open_output
+
+PCAP_MAGIC = 0xA1B2C3D4
+PCAP_LINKTYPE = 147
+FLAG_CRC_OK = 0x01
+FLAG_MODEM_SHIFT = 1
+FLAG_MODEM_MASK = 0x06
+MODEM_HEADER_SIZE = 7
+
+
+def read_pcap(data):
+    magic, _major, _minor, _zone, _sigfigs, _snaplen, linktype = struct.unpack_from("<IHHiIII", data)
+    if magic != PCAP_MAGIC or linktype != PCAP_LINKTYPE:
+        raise ValueError("not a gateway pcap capture")
+    offset = 24
+    while offset + 16 <= len(data):
+        seconds, microseconds, included, _original = struct.unpack_from("<IIII", data, offset)
+        offset += 16
+        packet = data[offset:offset + included]
+        offset += included
+        yield seconds * 1000000 + microseconds, packet[0], packet[1:]
+
+
+def read_raw(data):
+    offset = 0
+    while offset + 11 <= len(data):
+        timestamp, flags, length = struct.unpack_from("<QBH", data, offset)
+        offset += 11
+        yield timestamp, flags, data[offset:offset + length]
+        offset += length
+
+
+def read_capture(path):
+    with open(path, "rb") as capture:
+        data = capture.read()
+    if len(data) >= 4 and struct.unpack_from("<I", data)[0] == PCAP_MAGIC:
+        return read_pcap(data)
+    return read_raw(data)
+
+
+def read_batch(data):
+    version, count = data[0], data[1]
+    if version != 1:
+        raise ValueError("unknown passthrough batch version %d" % version)
+    offset = 2
+    for _ in range(count):
+        arrival, modem, length = struct.unpack_from("<IBB", data, offset)
+        offset += 6
+        yield arrival, modem, data[offset:offset + length]
+        offset += length
+
+
+def decode_alp(payload):
+    operations = []
+    index = 0
+    while index < len(payload):
+        operation = payload[index] & 0x3F
+        if operation == ALP_OP_STATUS and index + 3 <= len(payload):
+            length = payload[index + 2]
+            status = payload[index + 3:index + 3 + length]
+            if len(status) >= 20:
+                operations.append("status rssi %d lb %d uid %s" % (status[3], status[4], status[12:20].hex().upper()))
+            else:
+                operations.append("status (%d bytes)" % length)
+            index += 3 + length
+        elif operation == ALP_OP_RETURN_FILE_DATA and index + 4 <= len(payload):
+            file_id, offset, length = payload[index + 1:index + 4]
+            operations.append("file %d offset %d: %s" % (file_id, offset, payload[index + 4:index + 4 + length].hex()))
+            index += 4 + length
+        else:
+            operations.append("op 0x%02x: %s" % (payload[index], payload[index:].hex()))
+            break
+    return operations
+
+
+def describe(timestamp, flags, frame):
+    header, payload = frame[:MODEM_HEADER_SIZE], frame[MODEM_HEADER_SIZE:]
+    if len(header) < MODEM_HEADER_SIZE:
+        return "%12.6f truncated frame %s" % (timestamp / 1e6, frame.hex())
+    counter, message_type, length = header[2], header[3], header[4]
+    crc = "crc ok" if flags & FLAG_CRC_OK else "crc BAD (expected %04x, computed %04x)" % ((header[5] << 8) | header[6], crc16(payload))
+    modem = (flags & FLAG_MODEM_MASK) >> FLAG_MODEM_SHIFT
+    lines = ["%12.6f modem %d #%-3d type %d len %d %s" % (timestamp / 1e6, modem, counter, message_type, length, crc)]
+    if message_type == 1:
+        lines += ["    " + operation for operation in decode_alp(payload)]
+    else:
+        lines.append("    " + payload.hex())
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="capture.pcap, capture.bin or capture-spill.bin downloaded from the gateway")
+    parser.add_argument("--batch", action="store_true", help="the input is a raw passthrough message")
+    parser.add_argument("--replay", nargs="?", const="", metavar="PORT", help="write the frames to PORT, or a pseudo terminal")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--speed", type=float, default=1.0, help="replay speed factor, 0 sends back to back")
+    parser.add_argument("--skip-bad", action="store_true", help="do not replay frames with a bad crc")
+    parser.add_argument("--modem", type=int, help="only the frames received on this modem")
+    parser.add_argument("--quiet", action="store_true", help="do not print the decoded frames")
+    args = parser.parse_args()
+
+    if args.batch:
+        with open(args.capture, "rb") as batch:
+            for arrival, modem, payload in read_batch(batch.read()):
+                print("%10.3f modem %d len %d" % (arrival / 1e3, modem, len(payload)))
+                print("\n".join("    " + operation for operation in decode_alp(payload)))
+        return
+
+    write = None
+    if args.replay is not None:
+        write, _slave = open_output(args.replay or None, args.baud)
+
+    previous = None
+    for timestamp, flags, frame in read_capture(args.capture):
+        if args.modem is not None and (flags & FLAG_MODEM_MASK) >> FLAG_MODEM_SHIFT != args.modem:
+            continue
+        if not args.quiet:
+            print(describe(timestamp, flags, frame))
+        if write is None or (args.skip_bad and not flags & FLAG_CRC_OK):
+            continue
+        if previous is not None and args.speed > 0:
+            time.sleep(max(0, timestamp - previous) / 1e6 / args.speed)
+        previous = timestamp
+        write(frame)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,548 @@
+#!/usr/bin/env python3
+"""
+Emulates a DASH7 modem on the gateway UART and generates uplink traffic for a fleet of virtual Push7 nodes.
+
+Frames use the modem serial protocol the gateway parses in serial_interface.cpp: sync byte 0xC0, version,
+counter, type, payload length and a CRC16 (polynomial 0x1021, start 0xFFFF) over the payload. Every uplink
+is an ALP command with an interface status (rssi, link budget, uid) followed by RETURN_FILE_DATA.
+
+Without --port a pseudo terminal is created and its path printed, so a host build of the gateway can open
+it. With --port the frames go to a real serial port (requires pyserial), e.g. a USB-UART wired to the ESP32.
+
+With --modems the uplinks are heard by several modems, one pseudo terminal (or one of the comma separated
+--port entries) each. The first modem hears every uplink, the others with the --coverage probability and at
+their own signal strength per node, so the gateway has to merge the copies into one uplink.
+
+When --broker is given the emulator subscribes to the Home Assistant state topics the gateway publishes
+and reports end-to-end loss and latency. Every uplink of every file type also publishes the received signal
+strength of its node, so that topic is used to match deliveries to the uplinks that caused them. Button
+states are matched as well and reported separately, as the gateway publishes them in its realtime class
+ahead of diagnostics such as the signal strength and config entities.
+
+Example, 300 nodes, 20 uplinks/s with bursts, 1% bit errors and 2% duplicates for 5 minutes:
+    python3 tools/modem_emulator.py --port /dev/ttyUSB0 --devices 300 --rate 20 --burst-probability 0.05 \\
+        --bit-error-rate 0.01 --duplicate-rate 0.02 --duration 300 --broker 192.168.1.10
+
+Three modems on pseudo terminals, each extra modem hearing 60% of the uplinks:
+    python3 tools/modem_emulator.py --modems 3 --coverage 0.6 --duration 120
+
+Button latency under a heavy config sync, every light config uplink results in 12 entities:
+    python3 tools/modem_emulator.py --port /dev/ttyUSB0 --rate 10 --mix button=1,light_config=4 --broker 192.168.1.10
+
+The emulator also answers the forwards the gateway sends, like the modem would. A node only hears them during
+--listen-window seconds after each of its uplinks, otherwise the forward completes with an error after
+--response-timeout. With --gateway it queues --downlink-rate writes per second on the mailbox of the gateway
+and reports how many reached their node, how long they waited, and how fast the gateway reacted to uplinks.
+
+Downlinks to 50 nodes that uplink every 10 s on average and listen for half a second afterwards:
+    python3 tools/modem_emulator.py --port /dev/ttyUSB0 --devices 50 --listen-window 0.5 --gateway 192.168.1.20 \
+        --downlink-rate 1 --duration 300
+"""
+
+import argparse
+import collections
+import os
+import random
+import struct
+import sys
+import threading
+import time
+import tty
+import urllib.parse
+import urllib.request
+
+MODEM_HEADER_SYNC_BYTE = 0xC0
+MODEM_HEADER_VERSION = 0
+SERIAL_MESSAGE_TYPE_ALP = 1
+SERIAL_MESSAGE_TYPE_REBOOTED = 5
+
+ALP_OP_WRITE_FILE_DATA = 0x04
+ALP_OP_RETURN_FILE_DATA = 0x20
+ALP_OP_STATUS = 0x22
+ALP_OP_RESPONSE_TAG = 0x23
+ALP_OP_FORWARD = 0x32
+ALP_OP_REQUEST_TAG = 0x34
+ALP_RESPONSE_TAG_EOP = 0x80
+ALP_RESPONSE_TAG_ERR = 0x40
+D7_INTERFACE_ID = 0xD7
+
+BUTTON_FILE_ID = 51
+HUMIDITY_FILE_ID = 53
+PUSH7_STATE_FILE_ID = 56
+LIGHT_FILE_ID = 57
+PIR_FILE_ID = 58
+HALL_EFFECT_FILE_ID = 59
+LIGHT_CONFIG_FILE_ID = 67
+
+DEFAULT_MIX = "button=4,pir=3,hall=1,humidity=4,light=2,state=1"
+
+# (file id, offset, length) of the settings the queued downlinks change, a later write to one replaces an earlier
+DOWNLINK_FIELDS = [(LIGHT_CONFIG_FILE_ID, 0, 4), (LIGHT_CONFIG_FILE_ID, 7, 2), (LIGHT_CONFIG_FILE_ID, 9, 2),
+                   (LIGHT_CONFIG_FILE_ID, 13, 1)]
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+class Framer:
+    def __init__(self):
+        self.counter = 0
+        self.counter_lock = threading.Lock()
+        self.received = bytearray()
+
+    def frame(self, message_type, payload):
+        crc = crc16(payload)
+        with self.counter_lock:
+            counter = self.counter
+            self.counter = (self.counter + 1) & 0xFF
+        header = bytes([MODEM_HEADER_SYNC_BYTE, MODEM_HEADER_VERSION, counter, message_type,
+                        len(payload), crc >> 8, crc & 0xFF])
+        return header + payload
+
+    def deframe(self, data):
+        """Returns the type and payload of every complete frame the gateway sent, skipping bytes until a valid one."""
+        self.received += data
+        frames = []
+        while True:
+            start = self.received.find(MODEM_HEADER_SYNC_BYTE)
+            if start < 0:
+                self.received.clear()
+                return frames
+            del self.received[:start]
+            if len(self.received) < 7 or len(self.received) < 7 + self.received[4]:
+                return frames
+            payload = bytes(self.received[7:7 + self.received[4]])
+            if crc16(payload) != (self.received[5] << 8 | self.received[6]):
+                del self.received[:1]
+                continue
+            frames.append((self.received[3], payload))
+            del self.received[:7 + len(payload)]
+
+
+def parse_length_operand(data, index):
+    size = (data[index] >> 6) + 1
+    value = data[index] & 0x3F
+    for byte in data[index + 1:index + size]:
+        value = (value << 8) | byte
+    return value, index + size
+
+
+def parse_downlink(payload):
+    """Returns the addressee, request tag and writes of a forward, None for anything else."""
+    uid, tag, writes = None, None, []
+    index = 0
+    while index < len(payload):
+        operation = payload[index] & 0x3F
+        if operation == ALP_OP_FORWARD:
+            uid = bytes(payload[index + 6:index + 14])
+            index += 14
+        elif operation == ALP_OP_REQUEST_TAG:
+            tag = payload[index + 1]
+            index += 2
+        elif operation == ALP_OP_WRITE_FILE_DATA:
+            file_id = payload[index + 1]
+            offset, index = parse_length_operand(payload, index + 2)
+            length, index = parse_length_operand(payload, index)
+            writes.append((file_id, offset, bytes(payload[index:index + length])))
+            index += length
+        else:
+            return None
+    return (uid, tag, writes) if uid else None
+
+
+class VirtualDevice:
+    def __init__(self, uid, rssi_means, rssi_deviation):
+        self.uid = uid
+        # every modem hears the node at its own mean level, as if they were on different antennas
+        self.rssi_means = rssi_means
+        self.rssi_deviation = rssi_deviation
+        self.button_state = False
+        self.pir_state = False
+        self.hall_state = False
+        self.last_uplink = 0.0
+        self.listening_until = 0.0
+        self.files = collections.defaultdict(lambda: bytearray(256))
+
+    @property
+    def uid_string(self):
+        return self.uid.hex().upper()
+
+    def rssi(self, modem=0):
+        return max(0, min(255, int(random.gauss(self.rssi_means[modem], self.rssi_deviation))))
+
+    def file(self, kind):
+        if kind == "button":
+            self.button_state = not self.button_state
+            button_id = random.randrange(4)
+            event = ("button%d" % (button_id + 1), "ON" if self.button_state else "OFF")
+            return BUTTON_FILE_ID, struct.pack("<B?B", button_id, self.button_state, 0), event
+        if kind == "pir":
+            self.pir_state = not self.pir_state
+            return PIR_FILE_ID, struct.pack("<?", self.pir_state), None
+        if kind == "hall":
+            self.hall_state = not self.hall_state
+            return HALL_EFFECT_FILE_ID, struct.pack("<?", self.hall_state), None
+        if kind == "humidity":
+            return HUMIDITY_FILE_ID, struct.pack("<ii", random.randint(300, 700), random.randint(150, 280)), None
+        if kind == "light":
+            return LIGHT_FILE_ID, struct.pack("<IH??", random.randint(0, 50000), random.randint(0, 65535), False, False), None
+        if kind == "state":
+            return PUSH7_STATE_FILE_ID, struct.pack("<HBB", random.randint(2600, 3100), 1, 7), None
+        if kind == "light_config":
+            return LIGHT_CONFIG_FILE_ID, struct.pack("<IBBBHHBBBBB", random.choice((60, 300, 900)), 1, 1, 1, 1000, 10, 0, 0, 5, 0, 1), None
+        raise ValueError("unknown file kind %s" % kind)
+
+    def status(self, rssi):
+        link_budget = max(0, min(255, 140 - rssi))
+        # the gateway reads rssi and link budget, skips 7 bytes and takes the uid from the addressee
+        interface_status = bytes([0, 0, 0, rssi, link_budget]) + bytes(7) + self.uid
+        return bytes([ALP_OP_STATUS, D7_INTERFACE_ID, len(interface_status)]) + interface_status
+
+    def write(self, writes):
+        for file_id, offset, data in writes:
+            self.files[file_id][offset:offset + len(data)] = data
+
+    def uplink(self, kind, modems=(0,)):
+        """Returns the payload and rssi of the uplink as received by each of the modems, and its event."""
+        file_id, data, event = self.file(kind)
+        file_data = bytes([ALP_OP_RETURN_FILE_DATA, file_id, 0, len(data)]) + data
+        receptions = []
+        for modem in modems:
+            rssi = self.rssi(modem)
+            receptions.append((modem, self.status(rssi) + file_data, rssi))
+        return receptions, event
+
+
+class Delivery:
+    """Matches received signal strength states published by the gateway with the uplinks sent."""
+
+    def __init__(self, broker, port, timeout):
+        self.timeout = timeout
+        self.pending = collections.defaultdict(collections.deque)
+        self.latencies = collections.defaultdict(list)
+        self.lost = collections.Counter()
+        self.unexpected = 0
+        self.lock = threading.Lock()
+
+        import paho.mqtt.client as mqtt
+        self.client = mqtt.Client()
+        self.client.on_message = self.on_message
+        self.client.connect(broker, port)
+        self.client.subscribe("homeassistant/+/+/state")
+        self.client.loop_start()
+
+    def expect(self, uid_string, entity, *values):
+        """Any of the values is a delivery, an uplink heard by several modems is published with one of their rssi."""
+        with self.lock:
+            self.pending[(uid_string, entity)].append((time.monotonic(), values))
+
+    def on_message(self, client, userdata, message):
+        object_id = message.topic.split("/")[2]
+        uid_string, _, entity = object_id.partition("_")
+        if message.retain or (uid_string, entity) not in self.pending:
+            return
+        value = message.payload.decode()
+        now = time.monotonic()
+        with self.lock:
+            queue = self.pending[(uid_string, entity)]
+            # deliveries of one entity arrive in order, so pending uplinks older than the match were lost
+            for index, (sent, expected) in enumerate(queue):
+                if value in expected:
+                    for _ in range(index):
+                        queue.popleft()
+                        self.lost[entity] += 1
+                    queue.popleft()
+                    self.latencies[self.kind(entity)].append(now - sent)
+                    return
+            self.unexpected += 1
+
+    @staticmethod
+    def kind(entity):
+        return "button" if entity.startswith("button") else entity
+
+    def report(self, sent):
+        time.sleep(self.timeout)
+        self.client.loop_stop()
+        with self.lock:
+            for (_uid, entity), queue in self.pending.items():
+                self.lost[entity] += len(queue)
+            lost = sum(count for entity, count in self.lost.items() if self.kind(entity) != "button")
+            latencies = {kind: sorted(values) for kind, values in self.latencies.items()}
+        delivered = len(latencies.get("received_signal_strength", ()))
+        print("delivered %d, lost %d (%.2f%%), unmatched %d" % (delivered, lost, 100.0 * lost / max(1, sent), self.unexpected))
+        for kind, values in sorted(latencies.items()):
+            print("  %s latency:" % kind.replace("_", " "))
+            for percent in (50, 90, 99, 100):
+                index = min(len(values) - 1, int(len(values) * percent / 100))
+                print("    p%d: %.1f ms" % (percent, values[index] * 1000))
+
+
+class Mailbox:
+    """Queues writes on the mailbox of the gateway and checks them against what the nodes received."""
+
+    def __init__(self, gateway, ttl):
+        self.url = "http://%s/api/mailbox" % gateway
+        self.ttl = ttl
+        self.pending = {}
+        self.latencies = []
+        self.queued = self.superseded = self.rejected = 0
+        self.lock = threading.Lock()
+
+    def queue(self, device):
+        file_id, offset, length = random.choice(DOWNLINK_FIELDS)
+        data = bytes(random.randrange(256) for _ in range(length))
+        body = urllib.parse.urlencode({"uid": device.uid_string, "file": file_id, "offset": offset,
+                                       "data": data.hex().upper(), "ttl": self.ttl}).encode()
+        try:
+            urllib.request.urlopen(self.url, body, timeout=5).read()
+        except OSError:
+            self.rejected += 1
+            return
+        with self.lock:
+            key = (device.uid, file_id, offset)
+            if key in self.pending:
+                self.superseded += 1
+            self.pending[key] = (time.monotonic(), data)
+            self.queued += 1
+
+    def delivered(self, device, now):
+        with self.lock:
+            for key, (queued, data) in list(self.pending.items()):
+                uid, file_id, offset = key
+                if uid == device.uid and device.files[file_id][offset:offset + len(data)] == data:
+                    self.latencies.append(now - queued)
+                    del self.pending[key]
+
+    def report(self):
+        latencies = sorted(self.latencies)
+        print("mailbox: queued %d, delivered %d, replaced by a later write %d, undelivered %d, rejected %d" % (
+            self.queued, len(latencies), self.superseded, len(self.pending), self.rejected))
+        for percent in (50, 90, 99, 100):
+            if latencies:
+                print("    queued to delivered p%d: %.1f s" % (percent, latencies[min(len(latencies) - 1, int(len(latencies) * percent / 100))]))
+
+
+class Downlinks:
+    """Answers the forwards of the gateway like the modem does, the addressee only hears them while it listens."""
+
+    def __init__(self, devices, respond, response_timeout, mailbox):
+        self.devices = {device.uid: device for device in devices}
+        self.respond = respond
+        self.response_timeout = response_timeout
+        self.mailbox = mailbox
+        self.reactions = []
+        self.writes_per_command = []
+        self.statistics = collections.Counter()
+
+    def handle(self, modem, payload):
+        parsed = parse_downlink(payload)
+        if not parsed:
+            self.statistics["not a forward"] += 1
+            return
+        uid, tag, writes = parsed
+        device = self.devices.get(uid)
+        now = time.monotonic()
+        self.statistics["commands"] += 1
+        self.writes_per_command.append(len(writes))
+        if device and now <= device.listening_until:
+            self.statistics["delivered"] += 1
+            self.reactions.append(now - device.last_uplink)
+            device.write(writes)
+            if self.mailbox:
+                self.mailbox.delivered(device, now)
+            if tag is not None:
+                self.respond(modem, bytes([ALP_OP_RESPONSE_TAG, tag]) + device.status(device.rssi(modem)))
+                self.respond(modem, bytes([ALP_OP_RESPONSE_TAG | ALP_RESPONSE_TAG_EOP, tag]))
+            return
+        # sent while the node sleeps, the modem waits for an answer that never comes
+        self.statistics["missed, node asleep" if device else "missed, unknown node"] += 1
+        if tag is not None:
+            threading.Timer(self.response_timeout, self.respond,
+                            (modem, bytes([ALP_OP_RESPONSE_TAG | ALP_RESPONSE_TAG_EOP | ALP_RESPONSE_TAG_ERR, tag]))).start()
+
+    def report(self):
+        if not self.statistics["commands"]:
+            return
+        print("downlinks: %s, %.2f writes per command" % (", ".join("%s %d" % item for item in sorted(self.statistics.items())),
+                                                        sum(self.writes_per_command) / len(self.writes_per_command)))
+        reactions = sorted(self.reactions)
+        for percent in (50, 90, 99, 100):
+            if reactions:
+                print("    uplink to downlink p%d: %.1f ms" % (percent, reactions[min(len(reactions) - 1, int(len(reactions) * percent / 100))] * 1000))
+
+
+def open_outputs(ports, count, baud):
+    """One output and input per modem, the comma separated ports or that many pseudo terminals."""
+    if ports:
+        return [open_output(port, baud) for port in ports.split(",")]
+    return [open_output(None, baud) for _ in range(count)]
+
+
+def open_output(port, baud):
+    if port:
+        import serial
+        connection = serial.Serial(port, baud)
+        return connection.write, lambda: connection.read(max(1, connection.in_waiting))
+    master, slave = os.openpty()
+    # no echo and no line editing, the frames are binary
+    tty.setraw(slave)
+    print("modem emulator listening on %s" % os.ttyname(slave))
+    return (lambda data: os.write(master, data)), (lambda: os.read(master, 4096))
+
+
+def parse_mix(mix):
+    kinds, weights = [], []
+    for item in mix.split(","):
+        kind, weight = item.split("=")
+        kinds.append(kind)
+        weights.append(float(weight))
+    return kinds, weights
+
+
+def corrupt(frame):
+    data = bytearray(frame)
+    position = random.randrange(7, len(data))
+    data[position] ^= 1 << random.randrange(8)
+    return bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", help="serial port to write to, a pseudo terminal is created when omitted. "
+                        "A comma separated list emulates one modem per port")
+    parser.add_argument("--modems", type=int, default=1, help="number of modems when no ports are given")
+    parser.add_argument("--coverage", type=float, default=0.7,
+                        help="chance that each modem but the first one hears an uplink")
+    parser.add_argument("--modem-offset", type=float, default=8.0,
+                        help="deviation of the mean rssi of a node between modems")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--devices", type=int, default=100, help="number of virtual nodes")
+    parser.add_argument("--rate", type=float, default=5.0, help="mean uplinks per second over the whole fleet")
+    parser.add_argument("--mix", default=DEFAULT_MIX, help="relative weights of the file types")
+    parser.add_argument("--burst-probability", type=float, default=0.0, help="chance an arrival is a burst")
+    parser.add_argument("--burst-size", type=int, default=10, help="uplinks in a burst, back to back")
+    parser.add_argument("--rssi-mean", type=float, default=70.0)
+    parser.add_argument("--rssi-deviation", type=float, default=10.0)
+    parser.add_argument("--bit-error-rate", type=float, default=0.0, help="fraction of frames with a flipped bit")
+    parser.add_argument("--duplicate-rate", type=float, default=0.0, help="fraction of frames sent twice")
+    parser.add_argument("--duration", type=float, default=60.0, help="seconds of traffic")
+    parser.add_argument("--seed", type=int)
+    parser.add_argument("--broker", help="mqtt broker to measure end-to-end loss and latency on")
+    parser.add_argument("--broker-port", type=int, default=1883)
+    parser.add_argument("--settle", type=float, default=10.0, help="seconds to wait for late deliveries")
+    parser.add_argument("--listen-window", type=float, default=1.0, help="seconds a node listens after each uplink")
+    parser.add_argument("--response-timeout", type=float, default=0.3,
+                        help="seconds until the modem reports that a node did not answer")
+    parser.add_argument("--gateway", help="address of the gateway web server to queue downlinks on")
+    parser.add_argument("--downlink-rate", type=float, default=0.5, help="downlinks per second queued on the gateway")
+    parser.add_argument("--downlink-ttl", type=int, default=600, help="seconds a queued downlink may wait")
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    connections = open_outputs(args.port, args.modems, args.baud)
+    locks = [threading.Lock() for _ in connections]
+    framers = [Framer() for _ in connections]
+
+    # the uplinks and the answers to downlinks share the UART of a modem
+    def write_frame(modem, message_type, payload):
+        frame = framers[modem].frame(message_type, payload)
+        with locks[modem]:
+            connections[modem][0](frame)
+
+    kinds, weights = parse_mix(args.mix)
+
+    def rssi_means():
+        mean = random.gauss(args.rssi_mean, args.rssi_deviation / 2)
+        return [mean] + [mean + random.gauss(0, args.modem_offset) for _ in connections[1:]]
+
+    devices = [VirtualDevice(bytes([0xD7, 0xE0]) + struct.pack(">IH", index, random.randrange(0x10000)),
+                             rssi_means(), args.rssi_deviation)
+               for index in range(args.devices)]
+    delivery = Delivery(args.broker, args.broker_port, args.settle) if args.broker else None
+    mailbox = Mailbox(args.gateway, args.downlink_ttl) if args.gateway else None
+    downlinks = Downlinks(devices, lambda modem, payload: write_frame(modem, SERIAL_MESSAGE_TYPE_ALP, payload),
+                          args.response_timeout, mailbox)
+    byte_time = 10.0 / args.baud
+
+    def receive(modem):
+        while True:
+            for message_type, payload in framers[modem].deframe(connections[modem][1]()):
+                if message_type == SERIAL_MESSAGE_TYPE_ALP:
+                    downlinks.handle(modem, payload)
+
+    for modem in range(len(connections)):
+        threading.Thread(target=receive, args=(modem,), daemon=True).start()
+
+    def send(frames):
+        # the modems are on separate UARTs, so their frames go out at the same time
+        for modem, frame in frames:
+            with locks[modem]:
+                connections[modem][0](frame)
+        time.sleep(max(len(frame) for _modem, frame in frames) * byte_time)
+
+    for modem in range(len(connections)):
+        write_frame(modem, SERIAL_MESSAGE_TYPE_REBOOTED, bytes([0]))
+
+    sent = corrupted = duplicated = copies = 0
+    end = time.monotonic() + args.duration
+
+    def queue_downlinks():
+        while time.monotonic() < end:
+            time.sleep(random.expovariate(args.downlink_rate))
+            mailbox.queue(random.choice(devices))
+
+    if mailbox:
+        threading.Thread(target=queue_downlinks, daemon=True).start()
+    next_arrival = time.monotonic()
+    while time.monotonic() < end:
+        now = time.monotonic()
+        if now < next_arrival:
+            time.sleep(next_arrival - now)
+        next_arrival += random.expovariate(args.rate)
+
+        count = args.burst_size if random.random() < args.burst_probability else 1
+        for _ in range(count):
+            device = random.choice(devices)
+            modems = [0] + [modem for modem in range(1, len(connections)) if random.random() < args.coverage]
+            receptions, event = device.uplink(random.choices(kinds, weights)[0], modems)
+            sent += 1
+            copies += len(receptions) - 1
+            frames, received = [], []
+            for modem, payload, rssi in receptions:
+                frame = framers[modem].frame(SERIAL_MESSAGE_TYPE_ALP, payload)
+                if random.random() < args.bit_error_rate:
+                    frames.append((modem, corrupt(frame)))
+                    continue
+                frames.append((modem, frame))
+                received.append(str(rssi))
+            device.last_uplink = time.monotonic()
+            device.listening_until = device.last_uplink + args.listen_window
+            send(frames)
+            if not received:
+                corrupted += 1
+                continue
+            if delivery:
+                delivery.expect(device.uid_string, "received_signal_strength", *received)
+                if event:
+                    delivery.expect(device.uid_string, *event)
+            if random.random() < args.duplicate_rate:
+                send(frames[:1])
+                duplicated += 1
+
+    print("sent %d uplinks, %d corrupted, %d duplicated, %d copies on other modems" % (sent, corrupted, duplicated, copies))
+    if delivery:
+        delivery.report(sent - corrupted)
+    downlinks.report()
+    if mailbox:
+        mailbox.report()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,143 @@
+#include "uplink_dedup.h"
+
+// set associative cache of recently seen uplinks, a lookup only looks at the ways of one bucket
+#define DEDUP_BUCKETS 32
+#define DEDUP_WAYS 4
+#define BUCKET_MASK (DEDUP_BUCKETS - 1)
+
+#define DEDUP_MAX_FILE_WINDOWS 16
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct {
+  uint64_t fingerprint;
+  uint32_t expires;
+  uint8_t modem;
+  uint8_t rssi;
+} dedup_entry_t;
+
+typedef struct {
+  uint8_t file_id;
+  uint16_t window_ms;
+} file_window_t;
+
+static dedup_entry_t entries[DEDUP_BUCKETS][DEDUP_WAYS];
+
+// events get a short window so identical button presses a few seconds apart still come through,
+// a window of 0 disables suppression for that file
+static const file_window_t default_file_windows[] = {
+  { BUTTON_FILE_ID,      1000 },
+  { PIR_FILE_ID,         1000 },
+  { HALL_EFFECT_FILE_ID, 1000 },
+};
+static file_window_t file_windows[DEDUP_MAX_FILE_WINDOWS];
+static uint8_t number_of_file_windows = 0;
+
+static uplink_dedup_statistics_t statistics;
+
+void uplink_dedup_init() {
+  memset(entries, 0, sizeof(entries));
+  memset(&statistics, 0, sizeof(statistics));
+  number_of_file_windows = sizeof(default_file_windows) / sizeof(default_file_windows[0]);
+  memcpy(file_windows, default_file_windows, sizeof(default_file_windows));
+}
+
+/**
+ * @brief change the window of a file type until the next boot, /api/dedup sets it at runtime
+ * @return false when the windows of DEDUP_MAX_FILE_WINDOWS file types are already set
+ */
+bool uplink_dedup_set_window(uint8_t file_id, uint16_t window_ms) {
+  for(uint8_t i = 0; i < number_of_file_windows; i++) {
+    if(file_windows[i].file_id == file_id) {
+      file_windows[i].window_ms = window_ms;
+      return true;
+    }
+  }
+  if(number_of_file_windows == DEDUP_MAX_FILE_WINDOWS)
+    return false;
+  file_windows[number_of_file_windows++] = (file_window_t){ file_id, window_ms };
+  return true;
+}
+
+const uplink_dedup_statistics_t* uplink_dedup_get_statistics() {
+  return &statistics;
+}
+
+// the file types with a window of their own, all others use UPLINK_DEDUP_DEFAULT_WINDOW
+void uplink_dedup_list_windows(void (*callback)(void* context, uint8_t file_id, uint16_t window_ms), void* context) {
+  for(uint8_t i = 0; i < number_of_file_windows; i++)
+    callback(context, file_windows[i].file_id, file_windows[i].window_ms);
+}
+
+static uint16_t window_of(int16_t file_id) {
+  for(uint8_t i = 0; i < number_of_file_windows; i++) {
+    if(file_windows[i].file_id == file_id)
+      return file_windows[i].window_ms;
+  }
+  return UPLINK_DEDUP_DEFAULT_WINDOW;
+}
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t* data, uint16_t length) {
+  for(uint16_t i = 0; i < length; i++) {
+    hash ^= data[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint64_t fingerprint(custom_file_contents_t* custom_file_content) {
+  uint64_t hash = fnv1a(FNV_OFFSET_BASIS, custom_file_content->uid, 8);
+  hash = fnv1a(hash, (const uint8_t*) &custom_file_content->file_id, sizeof(custom_file_content->file_id));
+  hash = fnv1a(hash, &custom_file_content->offset, 1);
+  hash = fnv1a(hash, &custom_file_content->length, 1);
+  hash = fnv1a(hash, custom_file_content->buffer, custom_file_content->length);
+  // 0 marks an empty way
+  return hash ? hash : 1;
+}
+
+/**
+ * @brief check an uplink against the ones seen within the window of its file type, and remember it if it is new
+ * @return UPLINK_DUPLICATE if the same uid, file and payload was already seen within the window,
+ * UPLINK_STRONGER_COPY if that duplicate came in on another modem with a stronger signal
+ */
+uplink_dedup_result_t uplink_dedup_check(custom_file_contents_t* custom_file_content) {
+  uint16_t window = window_of(custom_file_content->file_id);
+  if(!window)
+    return UPLINK_NEW;
+
+  statistics.checked++;
+  uint64_t key = fingerprint(custom_file_content);
+  dedup_entry_t* bucket = entries[(key ^ (key >> 32)) & BUCKET_MASK];
+  uint32_t now = millis();
+
+  // expiry is not refreshed by a duplicate, so a value that keeps repeating is still delivered once per window
+  dedup_entry_t* victim = &bucket[0];
+  for(uint8_t way = 0; way < DEDUP_WAYS; way++) {
+    bool alive = bucket[way].fingerprint && (int32_t)(bucket[way].expires - now) > 0;
+    if(alive && bucket[way].fingerprint == key) {
+      statistics.duplicates++;
+      if(bucket[way].modem == custom_file_content->modem)
+        return UPLINK_DUPLICATE;
+      statistics.cross_modem++;
+      // rssi is the absolute value of the level in dBm, lower is stronger
+      if(custom_file_content->rssi >= bucket[way].rssi)
+        return UPLINK_DUPLICATE;
+      bucket[way].modem = custom_file_content->modem;
+      bucket[way].rssi = custom_file_content->rssi;
+      return UPLINK_STRONGER_COPY;
+    }
+    if(!alive)
+      victim = &bucket[way];
+    else if(victim->fingerprint && (int32_t)(victim->expires - now) > 0 && (int32_t)(bucket[way].expires - victim->expires) < 0)
+      victim = &bucket[way];
+  }
+
+  if(victim->fingerprint && (int32_t)(victim->expires - now) > 0)
+    statistics.evictions++;
+  victim->fingerprint = key;
+  victim->expires = now + window;
+  victim->modem = custom_file_content->modem;
+  victim->rssi = custom_file_content->rssi;
+  return UPLINK_NEW;
+}
@@ -0,0 +1,31 @@
+#ifndef UPLINK_DEDUP_H
+#define UPLINK_DEDUP_H
+#include "structures.h"
+
+// ms an uplink suppresses its copies, for files without a window of their own
+#define UPLINK_DEDUP_DEFAULT_WINDOW 2000
+
+typedef enum {
+  UPLINK_NEW,
+  UPLINK_DUPLICATE,
+  UPLINK_STRONGER_COPY, // a duplicate received on another modem with a stronger signal than the copies before
+} uplink_dedup_result_t;
+
+typedef struct {
+  uint32_t checked;
+  uint32_t duplicates;
+  uint32_t cross_modem; // duplicates received on another modem than the first copy
+  uint32_t evictions; // entries replaced before their window ran out, the cache is too small when this grows
+} uplink_dedup_statistics_t;
+
+void uplink_dedup_init();
+
+uplink_dedup_result_t uplink_dedup_check(custom_file_contents_t* custom_file_content);
+
+bool uplink_dedup_set_window(uint8_t file_id, uint16_t window_ms);
+
+void uplink_dedup_list_windows(void (*callback)(void* context, uint8_t file_id, uint16_t window_ms), void* context);
+
+const uplink_dedup_statistics_t* uplink_dedup_get_statistics();
+
+#endif
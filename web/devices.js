@@ -0,0 +1,29 @@
+// renders /api/devices into the devices table and refreshes it every 5 seconds
+function cell(row, text) {
+  var td = document.createElement("td");
+  td.textContent = text;
+  row.appendChild(td);
+}
+
+function render(response) {
+  var body = document.querySelector("#devices tbody");
+  body.innerHTML = "";
+  response.devices.forEach(function (device) {
+    var row = document.createElement("tr");
+    cell(row, device.uid);
+    cell(row, device.last_seen + " s ago");
+    cell(row, device.uplinks);
+    cell(row, device.rssi.avg + " (" + device.rssi.min + "/" + device.rssi.max + ")");
+    cell(row, device.link_budget.avg + " (" + device.link_budget.min + "/" + device.link_budget.max + ")");
+    cell(row, device.battery ? (device.battery / 1000).toFixed(3) + " V" : "-");
+    cell(row, device.hw ? "hw " + device.hw + " sw " + device.sw : "-");
+    body.appendChild(row);
+  });
+}
+
+function refresh() {
+  fetch("/api/devices").then(function (r) { return r.json(); }).then(render);
+}
+
+refresh();
+setInterval(refresh, 5000);
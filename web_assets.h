@@ -0,0 +1,95 @@
+// generated by tools/build_web_assets.py from web/, do not edit
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+#include <Arduino.h>
+
+typedef struct {
+  const char* path;
+  const char* content_type;
+  const char* etag;
+  const uint8_t* data;
+  uint32_t length;
+} web_asset_t;
+
+// devices.html: 470 bytes, served through the token streamer
+static const char devices_html[] PROGMEM =
+  "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><meta name=\"viewport\" content=\"width=device-width, "
+  "initial-scale=1\"><title>IoWay devices</title><link rel=\"stylesheet\" href=\"/style.css\"></head><body><"
+  "h1>Devices</h1><table id=\"devices\"><thead><tr><th>uid</th><th>last seen</th><th>uplinks</th><th>rssi"
+  " avg (min/max)</th><th>link budget avg (min/max)</th><th>battery</th><th>version</th></tr></thead><t"
+  "body></tbody></table><script src=\"/devices.js\"></script></body></html>";
+
+// devices.js: 1024 bytes source, 888 bytes minified, 409 bytes gzip
+static const uint8_t devices_js_gz[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x7d, 0x53, 0xc1, 0x6e, 0xdb, 0x30,
+  0x0c, 0xbd, 0xfb, 0x2b, 0x08, 0xed, 0x22, 0x63, 0xa9, 0x9c, 0xa1, 0xd8, 0xa5, 0xc6, 0xd0, 0x43,
+  0x91, 0x62, 0x03, 0xb6, 0xd3, 0x86, 0x5e, 0x0b, 0xc5, 0xa2, 0x63, 0xad, 0x8e, 0xe4, 0x49, 0x74,
+  0x9a, 0x60, 0xc8, 0xbf, 0x8f, 0x72, 0xe2, 0xd4, 0xed, 0x8c, 0x5e, 0x2c, 0xf0, 0x91, 0x7c, 0x8f,
+  0xa2, 0x9e, 0xeb, 0xde, 0x55, 0x64, 0xbd, 0x83, 0x0a, 0xdb, 0x56, 0x06, 0xff, 0xbc, 0x00, 0xc2,
+  0x3d, 0xe5, 0xf0, 0x37, 0xdb, 0xe9, 0x00, 0x64, 0xe0, 0x0b, 0x18, 0x5f, 0xf5, 0x5b, 0x74, 0xa4,
+  0xaa, 0x80, 0x9a, 0x70, 0xd5, 0x62, 0x8a, 0xa4, 0x20, 0x23, 0xf2, 0x32, 0x23, 0xa3, 0x52, 0xc7,
+  0x9d, 0x77, 0xc4, 0x28, 0x97, 0xa7, 0xa8, 0xcc, 0x98, 0x4a, 0xe9, 0xae, 0x43, 0x67, 0xee, 0x1a,
+  0xdb, 0x1a, 0x49, 0x86, 0x6b, 0x8f, 0x59, 0x3d, 0xea, 0x05, 0xce, 0x60, 0x90, 0x01, 0x63, 0xe7,
+  0x5d, 0xc4, 0x51, 0x70, 0xed, 0xcd, 0x61, 0x2a, 0xf9, 0xa7, 0xc7, 0x70, 0xf8, 0x89, 0x2d, 0x56,
+  0xe4, 0x83, 0x14, 0x1f, 0x0c, 0xee, 0x6c, 0x85, 0x11, 0x28, 0x15, 0x26, 0xf9, 0x74, 0x2a, 0xeb,
+  0x1c, 0x86, 0xaf, 0xbf, 0x7e, 0x7c, 0xe7, 0x56, 0x21, 0x58, 0xfc, 0xcc, 0xaa, 0xce, 0xe5, 0xaa,
+  0xf6, 0x61, 0xa5, 0xab, 0x46, 0x5e, 0xe4, 0xe5, 0x29, 0x33, 0xca, 0xf2, 0xb4, 0xef, 0x5d, 0x34,
+  0x24, 0xa5, 0x97, 0x0d, 0x9d, 0x7a, 0x55, 0x6f, 0xcd, 0x1c, 0xdc, 0xea, 0x48, 0x8f, 0x11, 0xd1,
+  0xc1, 0x47, 0x10, 0x10, 0x41, 0x6f, 0xfc, 0x7c, 0x7b, 0xd7, 0x5a, 0xf7, 0x14, 0xe7, 0x52, 0x21,
+  0x46, 0xab, 0xf4, 0x6e, 0x33, 0x30, 0x48, 0xc1, 0xc7, 0x34, 0xb1, 0xb5, 0x03, 0x75, 0xf1, 0x1f,
+  0xae, 0xf7, 0x09, 0xcf, 0x67, 0xd5, 0x92, 0xd6, 0xe3, 0xba, 0x37, 0x1b, 0xa4, 0x59, 0xe6, 0x69,
+  0x7e, 0x46, 0xe0, 0x55, 0xfa, 0x3d, 0x9d, 0xb5, 0x26, 0xe2, 0x27, 0x83, 0xdb, 0x71, 0xc5, 0x17,
+  0xa4, 0x80, 0x4f, 0xcb, 0xe5, 0x32, 0x57, 0xe4, 0xef, 0xed, 0x1e, 0x8d, 0xbc, 0xce, 0x87, 0x21,
+  0x1e, 0x04, 0xdc, 0x80, 0xb8, 0x9a, 0x25, 0x6b, 0x9e, 0x99, 0x47, 0xf0, 0x77, 0x32, 0x09, 0x47,
+  0xc3, 0x5e, 0x5f, 0x81, 0x1c, 0x8d, 0x24, 0x83, 0x21, 0xa6, 0xce, 0x63, 0xc2, 0x64, 0xbd, 0xb7,
+  0xf6, 0xab, 0xd9, 0x24, 0x8d, 0x4c, 0x06, 0xa8, 0x91, 0xd8, 0x1a, 0xa2, 0xd0, 0x9d, 0x2d, 0xce,
+  0x86, 0x11, 0x3c, 0x66, 0x83, 0x6e, 0xe2, 0x97, 0xc0, 0x95, 0xdc, 0x45, 0x7d, 0xe0, 0x66, 0xf5,
+  0x3b, 0x7a, 0x27, 0xf3, 0x12, 0x8e, 0xe7, 0xba, 0x93, 0x9b, 0x07, 0x89, 0x0b, 0x73, 0x99, 0x45,
+  0xa4, 0x6f, 0xfc, 0x57, 0x84, 0x9d, 0xe6, 0x6b, 0x9d, 0xe0, 0x05, 0x7c, 0x4e, 0x4b, 0x28, 0xff,
+  0x01, 0xe3, 0xeb, 0x45, 0x5b, 0x78, 0x03, 0x00, 0x00
+};
+
+// index.html: 1285 bytes, served through the token streamer
+static const char index_html[] PROGMEM =
+  "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><meta name=\"viewport\" content=\"width=device-width, "
+  "initial-scale=1\"><title>IoWay</title><link rel=\"stylesheet\" href=\"/style.css\"></head><body><div id=\""
+  "container\"><h1>IoWay</h1><form action=\"change\" method=\"POST\"> %POSTED% <div><label for=\"SSID\">Wi-Fi "
+  "SSID</label><input type=\"text\" name=\"SSID\" /></div><div><label for=\"password\">Password</label><input"
+  " type=\"password\" name=\"password\" /></div><div><label for=\"broker\">MQTT Broker</label><input type=\"te"
+  "xt\" name=\"broker\" value=\"%BROKER%\" /></div><div><label for=\"user\">MQTT User</label><input type=\"text"
+  "\" name=\"user\" value=\"\" /></div><div><label for=\"mqttPassword\">MQTT Password</label><input type=\"pass"
+  "word\" name=\"mqttPassword\" value=\"\" /></div><div><label for=\"mqttPort\">MQTT Port</label><input type=\""
+  "number\" name=\"mqttPort\" value=\"%PORT%\" /></div><div><label for=\"output\">Output</label><select name=\""
+  "output\"><option value=\"1\"%OUTPUT1%>Home Assistant</option><option value=\"2\"%OUTPUT2%>CBOR</option><o"
+  "ption value=\"3\"%OUTPUT3%>Home Assistant and CBOR</option></select></div><div><label for=\"compactPref"
+  "ix\">CBOR topic prefix</label><input type=\"text\" name=\"compactPrefix\" value=\"%PREFIX%\" maxlength=\"63\""
+  " /></div><div><input type=\"submit\" value=\"submit\" /></div></form></div></body></html>";
+
+// style.css: 445 bytes source, 336 bytes minified, 241 bytes gzip
+static const uint8_t style_css_gz[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x4d, 0x50, 0xed, 0x6a, 0xc3, 0x30,
+  0x0c, 0x7c, 0x95, 0x40, 0x09, 0x6c, 0x90, 0x14, 0xa7, 0xb4, 0x63, 0xc8, 0x4f, 0xe3, 0x0f, 0x35,
+  0x31, 0x73, 0x2c, 0xe3, 0x28, 0x2c, 0xc3, 0xf8, 0xdd, 0xe7, 0xac, 0x09, 0xec, 0xdf, 0x49, 0x77,
+  0x92, 0xee, 0x74, 0x31, 0x14, 0x58, 0xb9, 0x80, 0x29, 0xcf, 0x2a, 0x8d, 0x2e, 0x80, 0x90, 0x91,
+  0x16, 0xc7, 0x8e, 0x02, 0x28, 0xbd, 0x90, 0x5f, 0x19, 0x25, 0x53, 0x84, 0xdb, 0xa3, 0x95, 0x1e,
+  0x9f, 0x0c, 0x0f, 0xd1, 0x4a, 0x4e, 0x2a, 0x2c, 0x4f, 0x4a, 0x33, 0xfc, 0x21, 0xaf, 0x18, 0xdf,
+  0xfa, 0x4a, 0x74, 0x7d, 0x95, 0xbd, 0xcb, 0x6f, 0x67, 0x79, 0x82, 0xbb, 0x10, 0x71, 0x93, 0x13,
+  0xba, 0x71, 0x62, 0xf8, 0xd8, 0x8b, 0x32, 0x0d, 0x99, 0x71, 0xe3, 0x5e, 0x79, 0x37, 0x06, 0x30,
+  0x18, 0x18, 0x93, 0x8c, 0xca, 0x5a, 0x17, 0x46, 0x18, 0x76, 0x85, 0x57, 0x1a, 0x7d, 0xe7, 0x42,
+  0x5c, 0x39, 0x5b, 0xb7, 0x44, 0xaf, 0x7e, 0x40, 0x7b, 0x32, 0x5f, 0xc7, 0xd2, 0x41, 0x88, 0xb6,
+  0xbc, 0xe8, 0x97, 0xe1, 0x5e, 0x13, 0x33, 0xcd, 0x70, 0xc3, 0xb9, 0x5c, 0xab, 0x75, 0x46, 0x9b,
+  0x0d, 0x79, 0x4a, 0x90, 0xd0, 0x16, 0x56, 0xda, 0x63, 0xd6, 0x94, 0x2c, 0xa6, 0xbe, 0xb6, 0xbd,
+  0x8a, 0x0b, 0xc2, 0x09, 0xe4, 0x99, 0xb9, 0x51, 0x2b, 0x53, 0xe1, 0xa9, 0x63, 0x9b, 0x4f, 0x3b,
+  0xf7, 0xb8, 0x35, 0x9f, 0x35, 0xc0, 0x31, 0x7c, 0x9c, 0x19, 0x6a, 0xb7, 0x7e, 0xc5, 0xd9, 0xe6,
+  0x62, 0x8c, 0x91, 0xff, 0xd2, 0xec, 0xcf, 0x29, 0xbf, 0xc9, 0xc7, 0xd1, 0x6c, 0x50, 0x01, 0x00,
+  0x00
+};
+
+static const web_asset_t web_static_assets[] = {
+  { "/devices.js", "application/javascript", "\"b4f57c8174ca9c68\"", devices_js_gz, 409 },
+  { "/style.css", "text/css", "\"9ef76339f05f098c\"", style_css_gz, 241 },
+};
+
+#define WEB_STATIC_ASSET_COUNT (sizeof(web_static_assets) / sizeof(web_static_assets[0]))
+
+#endif